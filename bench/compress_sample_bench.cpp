@@ -0,0 +1,113 @@
+// ============================================================================
+// FileTypeAnalyzer Pro - Compressibility sampling benchmark
+//
+// Cost vs accuracy of --compressibility sample budgets: for every file in a
+// corpus, compares the sampled LZ ratio at several budgets against
+// compressing every block, and reports time, bytes read and error.
+//
+// Build: g++ -std=c++17 -O2 -pthread bench/compress_sample_bench.cpp
+//          -o compress_sample_bench
+// Run:   ./compress_sample_bench <corpus_dir> [min_file_kb]
+// ============================================================================
+#define FTA_NO_MAIN
+#include "../src/analyzer.cpp"
+
+struct BudgetResult {
+  size_t budget = 0; // 0 = full compression
+  double seconds = 0.0;
+  uintmax_t bytesSampled = 0;
+  double compressedBytes = 0.0; // Size / ratio, summed over files
+  vector<double> ratios;
+};
+
+// Ratio for one file at one budget, through the same path analyzeFile uses
+double sampleRatio(const fs::path &path, uintmax_t size, size_t budget,
+                   uintmax_t &sampled) {
+  unique_ptr<IoFile> file = ioBackend->open(path.string());
+  if (!file)
+    return 0.0;
+  vector<unsigned char> head(min<uintmax_t>(LZ_BLOCK, size));
+  head.resize(file->read(0, head.data(), head.size()));
+  if (head.size() < 2)
+    return 0.0;
+  FileInfo info;
+  info.size = size;
+  measureCompressibility(info, head.data(), head.size(), *file, budget);
+  sampled += info.compressionSampled;
+  return info.compressionRatio;
+}
+
+int main(int argc, char *argv[]) {
+  if (argc < 2) {
+    cerr << "Usage: " << argv[0] << " <corpus_dir> [min_file_kb]\n";
+    return 1;
+  }
+  uintmax_t minSize = (argc > 2 ? strtoull(argv[2], nullptr, 10) : 0) * 1024;
+
+  vector<pair<fs::path, uintmax_t>> files;
+  uintmax_t totalBytes = 0;
+  for (const auto &entry : fs::recursive_directory_iterator(
+           argv[1], fs::directory_options::skip_permission_denied)) {
+    error_code ec;
+    if (!entry.is_regular_file(ec))
+      continue;
+    uintmax_t size = entry.file_size(ec);
+    if (ec || size < max<uintmax_t>(2, minSize))
+      continue;
+    files.push_back({entry.path(), size});
+    totalBytes += size;
+  }
+  cout << "Corpus: " << argv[1] << " (" << files.size() << " files, "
+       << formatSize(totalBytes) << ")\n\n";
+
+  const size_t FULL = numeric_limits<size_t>::max();
+  vector<size_t> budgets = {64 * 1024, 256 * 1024, 1024 * 1024,
+                            4 * 1024 * 1024, FULL};
+  vector<BudgetResult> results;
+  for (size_t budget : budgets) {
+    BudgetResult r;
+    r.budget = budget == FULL ? 0 : budget;
+    auto start = high_resolution_clock::now();
+    for (const auto &[path, size] : files) {
+      double ratio = sampleRatio(path, size, budget, r.bytesSampled);
+      r.ratios.push_back(ratio);
+      if (ratio > 0)
+        r.compressedBytes += static_cast<double>(size) / ratio;
+    }
+    r.seconds =
+        duration<double>(high_resolution_clock::now() - start).count();
+    results.push_back(std::move(r));
+  }
+
+  const BudgetResult &full = results.back();
+  double fullRatio = static_cast<double>(totalBytes) / full.compressedBytes;
+  cout << left << setw(10) << "Budget" << right << setw(10) << "Seconds"
+       << setw(12) << "Read" << setw(10) << "MB/s" << setw(10) << "Ratio"
+       << setw(12) << "Total err" << setw(14) << "File err p50"
+       << setw(14) << "File err p95" << "\n";
+  for (const auto &r : results) {
+    vector<double> errors;
+    for (size_t i = 0; i < files.size(); i++) {
+      if (full.ratios[i] > 0)
+        errors.push_back(fabs(r.ratios[i] - full.ratios[i]) / full.ratios[i]);
+    }
+    sort(errors.begin(), errors.end());
+    auto quantile = [&](double q) {
+      return errors.empty()
+                 ? 0.0
+                 : errors[min(errors.size() - 1,
+                              static_cast<size_t>(q * errors.size()))];
+    };
+    double ratio = static_cast<double>(totalBytes) / r.compressedBytes;
+    cout << left << setw(10)
+         << (r.budget ? formatSize(r.budget) : string("full")) << right
+         << fixed << setprecision(3) << setw(10) << r.seconds << setw(12)
+         << formatSize(r.bytesSampled) << setw(10) << setprecision(0)
+         << r.bytesSampled / 1048576.0 / max(r.seconds, 1e-9) << setw(10)
+         << setprecision(3) << ratio << setw(11) << setprecision(2)
+         << 100.0 * fabs(ratio - fullRatio) / fullRatio << "%" << setw(13)
+         << 100.0 * quantile(0.5) << "%" << setw(13) << 100.0 * quantile(0.95)
+         << "%\n";
+  }
+  return 0;
+}
@@ -0,0 +1,61 @@
+#!/usr/bin/env bash
+# ============================================================================
+# FileTypeAnalyzer Pro - file(1) compatibility benchmark
+#
+# Compares three ways of getting MIME types for every file in a corpus:
+#   1. file --mime-type -b, forked once per file (what our scripts do today)
+#   2. file --mime-type -b, one process for the whole list
+#   3. analyzer --file-compat --mime-type -b, one process on the worker pool
+# and reports how often the analyzer agrees with file(1).
+#
+# Build: g++ -std=c++17 -O2 -pthread src/analyzer.cpp -o analyzer
+# Run:   bench/file_compat_bench.sh <corpus_dir> [path/to/analyzer]
+# ============================================================================
+set -euo pipefail
+
+corpus=${1:?usage: $0 <corpus_dir> [analyzer]}
+analyzer=${2:-./analyzer}
+work=$(mktemp -d)
+trap 'rm -rf "$work"' EXIT
+
+find "$corpus" -type f > "$work/list"
+count=$(wc -l < "$work/list")
+echo "Corpus: $corpus ($count files)"
+
+elapsed() {
+  local start=$EPOCHREALTIME
+  "$@"
+  awk -v s="$start" -v e="$EPOCHREALTIME" 'BEGIN { printf "%.3f", e - s }'
+}
+
+per_file() {
+  while IFS= read -r f; do file --mime-type -b "$f"; done < "$work/list" \
+    > "$work/file_per_file.txt"
+}
+batch_file() { file --mime-type -b -f "$work/list" > "$work/file_batch.txt"; }
+batch_analyzer() {
+  "$analyzer" --file-compat --mime-type -b -f "$work/list" \
+    > "$work/analyzer.txt"
+}
+
+t1=$(elapsed per_file)
+t2=$(elapsed batch_file)
+t3=$(elapsed batch_analyzer)
+
+printf '%-36s %10s %12s\n' "Method" "Seconds" "Files/sec"
+for row in "file, fork per file:$t1" "file, single process:$t2" \
+           "analyzer --file-compat:$t3"; do
+  name=${row%:*}
+  secs=${row##*:}
+  awk -v n="$name" -v s="$secs" -v c="$count" \
+    'BEGIN { printf "%-36s %10.3f %12.0f\n", n, s, (s > 0 ? c / s : 0) }'
+done
+
+agree=$(paste -d'\t' "$work/file_batch.txt" "$work/analyzer.txt" |
+  awk -F'\t' '$1 == $2' | wc -l)
+echo
+echo "MIME agreement with file(1): $agree / $count"
+echo "Most common disagreements (file -> analyzer):"
+paste -d'\t' "$work/file_batch.txt" "$work/analyzer.txt" |
+  awk -F'\t' '$1 != $2 { print "  " $1 " -> " $2 }' | sort | uniq -c |
+  sort -rn | head -10
@@ -0,0 +1,81 @@
+#!/usr/bin/env python3
+# ============================================================================
+# FileTypeAnalyzer Pro - Python bindings benchmark
+#
+# Compares three ways of classifying a corpus from Python:
+#   1. subprocess: run the CLI with --json and json.loads() its output
+#   2. bindings, paths: filetypeanalyzer.classify(list_of_paths)
+#   3. bindings, buffers: classify() on bytes already in memory (no I/O)
+# and checks that the bindings agree with the CLI on every file's type.
+#
+# Build: g++ -std=c++17 -O2 -pthread src/analyzer.cpp -o analyzer
+#        (cd python && python3 setup.py build_ext --inplace)
+# Run:   PYTHONPATH=python bench/python_bindings_bench.py <corpus_dir> [analyzer]
+# ============================================================================
+import json
+import os
+import subprocess
+import sys
+import time
+
+import filetypeanalyzer as fta
+
+
+def timed(fn, repeat=3):
+    best = float("inf")
+    result = None
+    for _ in range(repeat):
+        start = time.perf_counter()
+        result = fn()
+        best = min(best, time.perf_counter() - start)
+    return best, result
+
+
+def main():
+    if len(sys.argv) < 2:
+        sys.exit(f"usage: {sys.argv[0]} <corpus_dir> [analyzer]")
+    corpus = os.path.abspath(sys.argv[1])
+    analyzer = sys.argv[2] if len(sys.argv) > 2 else "./analyzer"
+
+    paths = [os.path.join(root, name)
+             for root, _, names in os.walk(corpus) for name in names
+             if os.path.isfile(os.path.join(root, name))]
+    print(f"Corpus: {corpus} ({len(paths)} files)")
+
+    def via_cli():
+        out = subprocess.run([analyzer, "--json", "-r", corpus],
+                             check=True, capture_output=True).stdout
+        return {f["path"]: f["type"] for f in json.loads(out)["files"]}
+
+    def via_paths():
+        return fta.classify(paths)
+
+    blobs = []
+    for p in paths:
+        with open(p, "rb") as f:
+            blobs.append(f.read(65536))
+    names = [os.path.basename(p) for p in paths]
+
+    def via_buffers():
+        return fta.classify(blobs, names=names)
+
+    cli_time, cli_types = timed(via_cli)
+    path_time, cols = timed(via_paths)
+    buf_time, _ = timed(via_buffers)
+
+    n = len(paths)
+    print(f"{'method':<28}{'seconds':>10}{'files/s':>12}")
+    for label, t in [("subprocess + JSON", cli_time),
+                     ("bindings (paths)", path_time),
+                     ("bindings (buffers, no I/O)", buf_time)]:
+        print(f"{label:<28}{t:>10.3f}{n / t if t else 0:>12.0f}")
+    print(f"Speedup over subprocess: {cli_time / path_time:.1f}x (paths)")
+
+    types = cols["type_names"]
+    agree = sum(1 for p, code in zip(paths, cols["type"])
+                if cli_types.get(p) == types[code])
+    print(f"Type agreement with CLI: {agree}/{n}")
+
+
+if __name__ == "__main__":
+    main()
@@ -0,0 +1,111 @@
+// ============================================================================
+// FileTypeAnalyzer Pro - Profile-guided signature layout benchmark
+//
+// Matches the first 64 KB of every file in a corpus against the built-in
+// signatures (plus magic(5) rules, if given) with the default layout and
+// with a layout reordered by a profile of the same corpus. Checks that both
+// pick the same rule for every file and reports probes and time per file.
+//
+// Build: g++ -std=c++17 -O2 -pthread bench/signature_profile_bench.cpp
+//          -o signature_profile_bench
+// Run:   ./signature_profile_bench <corpus_dir> [magic_file_or_dir]
+// ============================================================================
+#define FTA_NO_MAIN
+#include "../src/analyzer.cpp"
+
+struct LayoutResult {
+  double nanosPerFile = 0.0;
+  double probesPerFile = 0.0;
+  vector<string> matches; // Winning rule's key, empty for no match
+};
+
+LayoutResult measure(const vector<vector<unsigned char>> &heads) {
+  LayoutResult r;
+  // Probe counts from one counted pass, timing from uncounted passes, all
+  // on the snapshot current when the pass starts
+  SignatureReadGuard signatures;
+  const SignatureMatcher &matcher = signatures->matcher;
+  signatureProfiling = true;
+  mergeSignatureCounters(localSignatureCounters);
+  {
+    lock_guard<mutex> lock(signatureTotalsMutex);
+    signatureTotals.clear();
+  }
+  SignatureCounters &counters = signatureCounters(*signatures);
+  for (const auto &h : heads) {
+    const SignatureRule *rule = matcher.match(h.data(), h.size(), &counters);
+    r.matches.push_back(rule ? rule->type + "\t" + rule->description : "");
+  }
+  uint64_t probes = 0;
+  for (const auto &s : collectSignatureProfile())
+    probes += s.probes;
+  signatureProfiling = false;
+  r.probesPerFile = static_cast<double>(probes) / heads.size();
+
+  const int rounds = 20;
+  size_t sink = 0;
+  auto start = high_resolution_clock::now();
+  for (int round = 0; round < rounds; round++) {
+    for (const auto &h : heads)
+      sink += matcher.match(h.data(), h.size()) != nullptr;
+  }
+  r.nanosPerFile =
+      duration<double, nano>(high_resolution_clock::now() - start).count() /
+      (static_cast<double>(rounds) * heads.size());
+  if (sink == SIZE_MAX)
+    cout << "";
+  return r;
+}
+
+int main(int argc, char *argv[]) {
+  if (argc < 2) {
+    cerr << "Usage: " << argv[0] << " <corpus_dir> [magic_file_or_dir]\n";
+    return 1;
+  }
+  if (argc > 2) {
+    MagicImportReport report;
+    importMagicFile(argv[2], report);
+    cout << "Imported " << report.rules << " magic rules\n";
+  }
+  rebuildSignatureMatcher();
+
+  vector<vector<unsigned char>> heads;
+  for (const auto &entry : fs::recursive_directory_iterator(
+           argv[1], fs::directory_options::skip_permission_denied)) {
+    error_code ec;
+    if (!entry.is_regular_file(ec))
+      continue;
+    vector<unsigned char> head(65536);
+    ifstream file(entry.path(), ios::binary);
+    file.read(reinterpret_cast<char *>(head.data()),
+              static_cast<streamsize>(head.size()));
+    head.resize(static_cast<size_t>(max<streamsize>(0, file.gcount())));
+    if (head.size() >= 2)
+      heads.push_back(std::move(head));
+  }
+  cout << "Corpus: " << heads.size() << " files, "
+       << signatureSnapshots.current()->matcher.ruleCount() << " rules\n\n";
+  if (heads.empty())
+    return 1;
+
+  LayoutResult base = measure(heads);
+  // measure() leaves the totals from the default layout's counted pass
+  for (const auto &s : collectSignatureProfile())
+    signatureProfile[s.key] += s.hits;
+  rebuildSignatureMatcher();
+  LayoutResult tuned = measure(heads);
+
+  size_t differences = 0;
+  for (size_t i = 0; i < heads.size(); i++)
+    differences += base.matches[i] != tuned.matches[i];
+  cout << left << setw(12) << "Layout" << right << setw(14) << "Probes/file"
+       << setw(12) << "ns/file" << "\n";
+  cout << fixed << setprecision(2) << left << setw(12) << "default" << right
+       << setw(14) << base.probesPerFile << setw(12) << setprecision(0)
+       << base.nanosPerFile << "\n";
+  cout << setprecision(2) << left << setw(12) << "profiled" << right
+       << setw(14) << tuned.probesPerFile << setw(12) << setprecision(0)
+       << tuned.nanosPerFile << "\n";
+  cout << "\nDifferent results: " << differences << "\n";
+  return differences == 0 ? 0 : 1;
+}
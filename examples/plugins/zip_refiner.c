@@ -0,0 +1,90 @@
+/*
+ * Example analyzer plugin: tells Office Open XML, OpenDocument, JAR and APK
+ * files apart from plain ZIP archives and reports the entry count.
+ *
+ * Build:
+ *   cc -std=c99 -O2 -shared -fPIC -I../../src zip_refiner.c -o zip_refiner.so
+ * Use:
+ *   analyzer --plugin ./zip_refiner.so -r ./documents
+ *
+ * The first 64 KB arrive as a zero-copy view of the engine's buffer; the
+ * end-of-central-directory record is a 22-byte range read from the tail.
+ */
+#include <stdio.h>
+#include <string.h>
+
+#include "fta_plugin.h"
+
+static const char *const TYPES[] = {"ZIP/DOCX/XLSX", "ZIP", NULL};
+
+static const fta_range RANGES[] = {
+    {0, 65536}, /* Local file headers near the start */
+    {-22, 22},  /* End of central directory (no archive comment) */
+};
+
+static int contains(const fta_view *view, const char *needle) {
+  size_t n = strlen(needle);
+  size_t i;
+  if (view->length < n)
+    return 0;
+  for (i = 0; i + n <= view->length; i++) {
+    if (view->data[i] == (unsigned char)needle[0] &&
+        memcmp(view->data + i, needle, n) == 0)
+      return 1;
+  }
+  return 0;
+}
+
+static void set(fta_result *result, const char *type, const char *category,
+                const char *description) {
+  snprintf(result->type, sizeof(result->type), "%s", type);
+  snprintf(result->category, sizeof(result->category), "%s", category);
+  snprintf(result->description, sizeof(result->description), "%s",
+           description);
+}
+
+static int analyze(const fta_file *file, fta_result *result) {
+  const fta_view *head = &file->views[0];
+  const fta_view *tail = &file->views[1];
+  unsigned entries = 0;
+
+  if (contains(head, "word/"))
+    set(result, "DOCX", "Document", "Microsoft Word document (OOXML)");
+  else if (contains(head, "xl/"))
+    set(result, "XLSX", "Document", "Microsoft Excel workbook (OOXML)");
+  else if (contains(head, "ppt/"))
+    set(result, "PPTX", "Document", "Microsoft PowerPoint presentation (OOXML)");
+  else if (contains(head, "application/vnd.oasis.opendocument"))
+    set(result, "ODF", "Document", "OpenDocument file");
+  else if (contains(head, "AndroidManifest.xml"))
+    set(result, "APK", "Executable", "Android application package");
+  else if (contains(head, "META-INF/MANIFEST.MF"))
+    set(result, "JAR", "Executable", "Java archive");
+  else
+    set(result, "ZIP", "Archive", "ZIP archive");
+
+  /* EOCD: signature PK\5\6, total entries at offset 10 */
+  if (tail->length == 22 && memcmp(tail->data, "PK\x05\x06", 4) == 0) {
+    size_t used = strlen(result->description);
+    entries = (unsigned)tail->data[10] | ((unsigned)tail->data[11] << 8);
+    snprintf(result->description + used, sizeof(result->description) - used,
+             ", %u entries", entries);
+  }
+  return FTA_RESULT_REFINED;
+}
+
+static const fta_plugin PLUGIN = {
+    FTA_PLUGIN_ABI_VERSION,
+    "zip-refiner",
+    "1.0",
+    TYPES,
+    RANGES,
+    sizeof(RANGES) / sizeof(RANGES[0]),
+    4096, /* Only the 22-byte tail is ever read outside the buffer */
+    2000, /* 2 ms per file */
+    NULL,
+    analyze,
+    NULL,
+};
+
+FTA_PLUGIN_EXPORT const fta_plugin *fta_plugin_entry(void) { return &PLUGIN; }
@@ -0,0 +1,410 @@
+// ============================================================================
+// FileTypeAnalyzer Pro - Python Bindings
+// ============================================================================
+// Batch classification for Python without going through the CLI:
+//
+//   import filetypeanalyzer as fta
+//   cols = fta.classify(["a.pdf", pathlib.Path("b.bin"), some_bytes])
+//   cols["type_names"][cols["type"][0]]  # -> "PDF"
+//
+// Items are paths (str / os.PathLike) or any object exporting a contiguous
+// buffer (bytes, bytearray, memoryview, mmap, numpy arrays, ...). Buffers are
+// classified in place, never copied. All native work runs on a worker pool
+// with the GIL released, and results come back as columns: array.array for
+// numbers and dictionary-encoded codes for the string-valued fields.
+// ============================================================================
+
+#define PY_SSIZE_T_CLEAN
+#include <Python.h>
+
+#define FTA_NO_MAIN
+#include "../src/analyzer.cpp"
+
+namespace {
+
+// Leading bytes of a buffer classified like the first read of a file
+FileInfo classifyBuffer(const unsigned char *data, size_t length,
+                        const string &name) {
+  FileInfo info;
+  info.name = name;
+  info.isCorrupt = false;
+  info.extensionMismatch = false;
+  info.type = "Unknown";
+  info.category = "Unknown";
+  info.description = "Unrecognized file type";
+  info.entropy = 0.0;
+  info.size = length;
+  info.actualExtension = toLowercase(fs::path(name).extension().string());
+
+  auto startTime = high_resolution_clock::now();
+  if (length < 2) {
+    info.isCorrupt = true;
+    info.type = "Empty/Corrupt";
+    info.description = "File too small to identify";
+  } else {
+    classifyContent(info, data, min<size_t>(length, 65536), nullptr);
+  }
+  info.analysisTime =
+      static_cast<double>(duration_cast<microseconds>(
+                              high_resolution_clock::now() - startTime)
+                              .count()) /
+      1000.0;
+  return info;
+}
+
+struct BatchItem {
+  bool isPath = false;
+  fs::path path;
+  Py_buffer view{};
+  bool hasView = false;
+  string name;
+};
+
+// Releases buffer views even when building the batch fails halfway
+struct Batch {
+  vector<BatchItem> items;
+  ~Batch() {
+    for (auto &item : items) {
+      if (item.hasView)
+        PyBuffer_Release(&item.view);
+    }
+  }
+};
+
+// Maps strings to dense codes in first-seen order
+struct Dictionary {
+  map<string, uint16_t> codes;
+  vector<string> values;
+
+  uint16_t code(const string &value) {
+    auto it = codes.find(value);
+    if (it != codes.end())
+      return it->second;
+    uint16_t next = static_cast<uint16_t>(values.size());
+    codes.emplace(value, next);
+    values.push_back(value);
+    return next;
+  }
+};
+
+PyObject *arrayModule = nullptr;
+
+template <typename T>
+PyObject *makeArray(const char *typecode, const vector<T> &values) {
+  PyObject *array = PyObject_CallMethod(arrayModule, "array", "s", typecode);
+  if (!array || values.empty())
+    return array;
+  PyObject *result = PyObject_CallMethod(
+      array, "frombytes", "y#", reinterpret_cast<const char *>(values.data()),
+      static_cast<Py_ssize_t>(values.size() * sizeof(T)));
+  if (!result) {
+    Py_DECREF(array);
+    return nullptr;
+  }
+  Py_DECREF(result);
+  return array;
+}
+
+PyObject *makeStringList(const vector<string> &values) {
+  PyObject *list = PyList_New(static_cast<Py_ssize_t>(values.size()));
+  if (!list)
+    return nullptr;
+  for (size_t i = 0; i < values.size(); i++) {
+    PyObject *s = PyUnicode_DecodeUTF8(
+        values[i].data(), static_cast<Py_ssize_t>(values[i].size()),
+        "surrogateescape");
+    if (!s) {
+      Py_DECREF(list);
+      return nullptr;
+    }
+    PyList_SET_ITEM(list, static_cast<Py_ssize_t>(i), s);
+  }
+  return list;
+}
+
+// Steals `value`; returns false (with an exception set) on failure
+bool setColumn(PyObject *dict, const char *key, PyObject *value) {
+  if (!value)
+    return false;
+  int rc = PyDict_SetItemString(dict, key, value);
+  Py_DECREF(value);
+  return rc == 0;
+}
+
+PyObject *buildColumns(const vector<FileInfo> &results) {
+  size_t n = results.size();
+  Dictionary types, categories, mimes;
+  vector<uint16_t> typeCodes(n), categoryCodes(n), mimeCodes(n);
+  vector<uint64_t> sizes(n), fingerprints(n);
+  vector<double> entropies(n), times(n);
+  vector<uint8_t> corrupt(n), mismatch(n);
+  vector<string> names(n), descriptions(n);
+  for (size_t i = 0; i < n; i++) {
+    const FileInfo &f = results[i];
+    typeCodes[i] = types.code(f.type);
+    categoryCodes[i] = categories.code(f.category);
+    mimeCodes[i] = mimes.code(compatClassify(f).mime);
+    sizes[i] = f.size;
+    fingerprints[i] = f.fingerprint;
+    entropies[i] = f.entropy;
+    times[i] = f.analysisTime;
+    corrupt[i] = f.isCorrupt;
+    mismatch[i] = f.extensionMismatch;
+    names[i] = f.name;
+    descriptions[i] = f.description;
+  }
+
+  PyObject *dict = PyDict_New();
+  if (!dict)
+    return nullptr;
+  bool ok = setColumn(dict, "name", makeStringList(names)) &&
+            setColumn(dict, "type", makeArray("H", typeCodes)) &&
+            setColumn(dict, "type_names", makeStringList(types.values)) &&
+            setColumn(dict, "category", makeArray("H", categoryCodes)) &&
+            setColumn(dict, "category_names",
+                      makeStringList(categories.values)) &&
+            setColumn(dict, "mime", makeArray("H", mimeCodes)) &&
+            setColumn(dict, "mime_names", makeStringList(mimes.values)) &&
+            setColumn(dict, "description", makeStringList(descriptions)) &&
+            setColumn(dict, "size", makeArray("Q", sizes)) &&
+            setColumn(dict, "entropy", makeArray("d", entropies)) &&
+            setColumn(dict, "fingerprint", makeArray("Q", fingerprints)) &&
+            setColumn(dict, "is_corrupt", makeArray("B", corrupt)) &&
+            setColumn(dict, "extension_mismatch", makeArray("B", mismatch)) &&
+            setColumn(dict, "analysis_ms", makeArray("d", times));
+  if (!ok) {
+    Py_DECREF(dict);
+    return nullptr;
+  }
+  return dict;
+}
+
+bool collectItems(PyObject *items, PyObject *names, Batch &batch) {
+  PyObject *seq = PySequence_Fast(items, "items must be a sequence");
+  if (!seq)
+    return false;
+  Py_ssize_t n = PySequence_Fast_GET_SIZE(seq);
+  if (names != Py_None &&
+      (!PySequence_Check(names) || PySequence_Size(names) != n)) {
+    Py_DECREF(seq);
+    PyErr_SetString(PyExc_ValueError,
+                    "names must be a sequence as long as items");
+    return false;
+  }
+  batch.items.resize(static_cast<size_t>(n));
+
+  for (Py_ssize_t i = 0; i < n; i++) {
+    PyObject *obj = PySequence_Fast_GET_ITEM(seq, i);
+    BatchItem &item = batch.items[static_cast<size_t>(i)];
+    if (PyUnicode_Check(obj) || PyObject_HasAttrString(obj, "__fspath__")) {
+      PyObject *encoded = nullptr;
+      if (!PyUnicode_FSConverter(obj, &encoded)) {
+        Py_DECREF(seq);
+        return false;
+      }
+      item.isPath = true;
+      item.path = fs::path(PyBytes_AS_STRING(encoded));
+      item.name = item.path.filename().string();
+      Py_DECREF(encoded);
+    } else if (PyObject_CheckBuffer(obj)) {
+      if (PyObject_GetBuffer(obj, &item.view, PyBUF_SIMPLE) != 0) {
+        Py_DECREF(seq);
+        return false;
+      }
+      item.hasView = true;
+    } else {
+      Py_DECREF(seq);
+      PyErr_Format(PyExc_TypeError,
+                   "item %zd is neither a path nor a buffer (got %.80s)", i,
+                   Py_TYPE(obj)->tp_name);
+      return false;
+    }
+
+    if (names != Py_None) {
+      PyObject *name = PySequence_GetItem(names, i);
+      if (!name) {
+        Py_DECREF(seq);
+        return false;
+      }
+      if (name != Py_None) {
+        const char *utf8 = PyUnicode_AsUTF8(name);
+        if (!utf8) {
+          Py_DECREF(name);
+          Py_DECREF(seq);
+          return false;
+        }
+        item.name = utf8;
+      }
+      Py_DECREF(name);
+    }
+  }
+  Py_DECREF(seq);
+  return true;
+}
+
+PyObject *classify(PyObject *, PyObject *args, PyObject *kwargs) {
+  static const char *keywords[] = {"items", "names", "threads", nullptr};
+  PyObject *items = nullptr;
+  PyObject *names = Py_None;
+  int threads = 0;
+  if (!PyArg_ParseTupleAndKeywords(args, kwargs, "O|Oi",
+                                   const_cast<char **>(keywords), &items,
+                                   &names, &threads))
+    return nullptr;
+
+  Batch batch;
+  if (!collectItems(items, names, batch))
+    return nullptr;
+
+  size_t n = batch.items.size();
+  vector<FileInfo> results(n);
+  unsigned int threadCount = threads > 0 ? static_cast<unsigned int>(threads)
+                                         : defaultWorkerCount();
+  threadCount = static_cast<unsigned int>(
+      max<size_t>(1, min<size_t>(threadCount, n)));
+
+  Py_BEGIN_ALLOW_THREADS;
+  atomic<size_t> next{0};
+  auto work = [&]() {
+    for (size_t i = next++; i < n; i = next++) {
+      BatchItem &item = batch.items[i];
+      if (item.isPath) {
+        results[i] = analyzeFile(item.path);
+        if (!item.name.empty())
+          results[i].name = item.name;
+      } else {
+        results[i] = classifyBuffer(
+            static_cast<const unsigned char *>(item.view.buf),
+            static_cast<size_t>(item.view.len), item.name);
+      }
+    }
+  };
+  vector<thread> workers;
+  for (unsigned int t = 1; t < threadCount; t++)
+    workers.emplace_back(work);
+  work();
+  for (auto &w : workers)
+    w.join();
+  Py_END_ALLOW_THREADS;
+
+  return buildColumns(results);
+}
+
+// Loading publishes a new snapshot; classify() calls already running keep
+// the one they started with
+PyObject *loadSignatures(PyObject *, PyObject *args) {
+  const char *path = nullptr;
+  if (!PyArg_ParseTuple(args, "s", &path))
+    return nullptr;
+  {
+    lock_guard<mutex> lock(signatureReloadMutex);
+    if (!loadCustomSignatures(path)) {
+      PyErr_Format(PyExc_OSError, "could not load signatures from %s", path);
+      return nullptr;
+    }
+    signatureSources.customFiles.push_back(path);
+    rebuildSignatureMatcher();
+  }
+  return PyLong_FromSize_t(signatureSnapshots.current()->matcher.ruleCount());
+}
+
+PyObject *loadMagic(PyObject *, PyObject *args) {
+  PyObject *pathObj = nullptr;
+  if (!PyArg_ParseTuple(args, "O&", PyUnicode_FSConverter, &pathObj))
+    return nullptr;
+  MagicImportReport report;
+  {
+    lock_guard<mutex> lock(signatureReloadMutex);
+    string path = PyBytes_AS_STRING(pathObj);
+    Py_DECREF(pathObj);
+    if (!importMagicFile(path, report)) {
+      PyErr_SetString(PyExc_OSError, "could not read magic file");
+      return nullptr;
+    }
+    signatureSources.magicPaths.push_back(path);
+    rebuildSignatureMatcher();
+  }
+  size_t unsupported =
+      report.unsupportedRules + report.unsupportedContinuations;
+  return Py_BuildValue("{s:n,s:n,s:n}", "rules",
+                       static_cast<Py_ssize_t>(report.rules), "continuations",
+                       static_cast<Py_ssize_t>(report.continuations),
+                       "unsupported", static_cast<Py_ssize_t>(unsupported));
+}
+
+PyObject *reloadSignaturesNow(PyObject *, PyObject *) {
+  string error;
+  bool ok;
+  Py_BEGIN_ALLOW_THREADS;
+  ok = reloadSignatures(error);
+  Py_END_ALLOW_THREADS;
+  if (!ok) {
+    PyErr_SetString(PyExc_OSError, error.c_str());
+    return nullptr;
+  }
+  return PyLong_FromUnsignedLongLong(signatureSnapshots.current()->version);
+}
+
+SignatureWatcher watcher;
+
+PyObject *watchSignatures(PyObject *, PyObject *args) {
+  double interval = 1.0;
+  if (!PyArg_ParseTuple(args, "|d", &interval))
+    return nullptr;
+  if (interval <= 0) {
+    PyErr_SetString(PyExc_ValueError, "interval must be positive");
+    return nullptr;
+  }
+  // SIGHUP stays with Python; call reload_signatures() from a handler
+  watcher.start(milliseconds(static_cast<int64_t>(interval * 1000)), false);
+  Py_RETURN_NONE;
+}
+
+PyMethodDef methods[] = {
+    // Through void (*)(void), the generic function pointer type, since
+    // METH_KEYWORDS functions take a third argument
+    {"classify",
+     reinterpret_cast<PyCFunction>(reinterpret_cast<void (*)(void)>(classify)),
+     METH_VARARGS | METH_KEYWORDS,
+     "classify(items, names=None, threads=0) -> dict of columns\n\n"
+     "Classify paths and/or buffer objects in one batch. `names` supplies\n"
+     "file names for buffers (used for extension checks). Returns a dict\n"
+     "of equal-length columns; string fields are dictionary-encoded as\n"
+     "array('H') codes into the matching *_names list."},
+    {"load_signatures", loadSignatures, METH_VARARGS,
+     "load_signatures(path) -> int\n\nAdd custom JSON signatures. Safe while "
+     "classify() runs in another thread: files already in flight finish on "
+     "the previous rules."},
+    {"load_magic", loadMagic, METH_VARARGS,
+     "load_magic(path) -> dict\n\nImport magic(5) rules from a file or "
+     "directory. Safe while classify() runs, like load_signatures()."},
+    {"reload_signatures", reloadSignaturesNow, METH_NOARGS,
+     "reload_signatures() -> int\n\nRe-read every file given to "
+     "load_signatures() and load_magic() and return the new rule-set "
+     "version.\nOn error the current rules stay in place."},
+    {"watch_signatures", watchSignatures, METH_VARARGS,
+     "watch_signatures(interval=1.0)\n\nReload in a background thread "
+     "whenever a loaded signature or magic file changes."},
+    {nullptr, nullptr, 0, nullptr},
+};
+
+PyModuleDef moduleDef = {
+    PyModuleDef_HEAD_INIT,
+    "filetypeanalyzer",
+    "Magic-number file type detection (FileTypeAnalyzer Pro engine).",
+    -1,
+    methods,
+    nullptr,
+    nullptr,
+    nullptr,
+    nullptr,
+};
+
+} // namespace
+
+PyMODINIT_FUNC PyInit_filetypeanalyzer(void) {
+  arrayModule = PyImport_ImportModule("array");
+  if (!arrayModule)
+    return nullptr;
+  return PyModule_Create(&moduleDef);
+}
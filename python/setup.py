@@ -0,0 +1,27 @@
+# Build: python setup.py build_ext --inplace   (or: pip install ./python)
+import sys
+
+from setuptools import Extension, setup
+
+if sys.platform == "win32":
+    compile_args = ["/std:c++17", "/O2", "/EHsc"]
+    link_args = []
+else:
+    compile_args = ["-std=c++17", "-O2", "-pthread"]
+    link_args = ["-pthread"]
+
+setup(
+    name="filetypeanalyzer",
+    version="3.0.0",
+    description="Python bindings for the FileTypeAnalyzer Pro detection engine",
+    ext_modules=[
+        Extension(
+            "filetypeanalyzer",
+            sources=["fta_module.cpp"],
+            depends=["../src/analyzer.cpp", "../src/fta_plugin.h"],
+            extra_compile_args=compile_args,
+            extra_link_args=link_args,
+            language="c++",
+        )
+    ],
+)
@@ -0,0 +1,85 @@
+# Smoke test for the bindings: classify() must agree with the CLI.
+#
+# Build the module first, then run from this directory:
+#   python setup.py build_ext --inplace && python test_fta_module.py
+# The CLI is taken from $FTA_ANALYZER, or compiled from ../src/analyzer.cpp.
+import json
+import os
+import subprocess
+import sys
+import tempfile
+import unittest
+
+import filetypeanalyzer as fta
+
+HERE = os.path.dirname(os.path.abspath(__file__))
+
+SAMPLES = {
+    "image.png": b"\x89PNG\r\n\x1a\n" + b"\x00" * 24,
+    "doc.pdf": b"%PDF-1.4\n%\xe2\xe3\xcf\xd3\n1 0 obj\n",
+    "archive.zip": b"PK\x03\x04" + b"\x00" * 26,
+    "notes.txt": b"plain text notes\nsecond line\n",
+    "renamed.txt": b"\x89PNG\r\n\x1a\n" + b"\x00" * 24,
+}
+
+
+def analyzer_binary(workdir):
+    if os.environ.get("FTA_ANALYZER"):
+        return os.environ["FTA_ANALYZER"]
+    binary = os.path.join(workdir, "analyzer")
+    subprocess.check_call(
+        ["c++", "-std=c++17", "-O1", "-pthread",
+         os.path.join(HERE, "..", "src", "analyzer.cpp"), "-o", binary,
+         "-ldl"])
+    return binary
+
+
+def types_of(columns):
+    return [columns["type_names"][code] for code in columns["type"]]
+
+
+class ClassifyMatchesCli(unittest.TestCase):
+    @classmethod
+    def setUpClass(cls):
+        cls.tmp = tempfile.TemporaryDirectory()
+        cls.dir = os.path.join(cls.tmp.name, "samples")
+        os.mkdir(cls.dir)
+        for name, data in SAMPLES.items():
+            with open(os.path.join(cls.dir, name), "wb") as f:
+                f.write(data)
+        report = subprocess.run(
+            [analyzer_binary(cls.tmp.name), "--json", cls.dir],
+            check=True, capture_output=True).stdout
+        cls.cli = {f["name"]: f for f in json.loads(report)["files"]}
+
+    @classmethod
+    def tearDownClass(cls):
+        cls.tmp.cleanup()
+
+    def test_paths(self):
+        names = sorted(SAMPLES)
+        columns = fta.classify([os.path.join(self.dir, n) for n in names])
+        self.assertEqual(columns["name"], names)
+        self.assertEqual(types_of(columns),
+                         [self.cli[n]["type"] for n in names])
+        mismatch = dict(zip(names, columns["extension_mismatch"]))
+        self.assertEqual(mismatch["renamed.txt"], 1)
+        self.assertEqual(mismatch["image.png"], 0)
+
+    def test_buffers(self):
+        names = sorted(SAMPLES)
+        buffers = [SAMPLES[n] for n in names]
+        buffers[0] = memoryview(bytearray(buffers[0]))
+        columns = fta.classify(buffers, names=names, threads=2)
+        self.assertEqual(types_of(columns),
+                         [self.cli[n]["type"] for n in names])
+        self.assertEqual(list(columns["size"]),
+                         [len(SAMPLES[n]) for n in names])
+
+    def test_rejects_other_objects(self):
+        with self.assertRaises(TypeError):
+            fta.classify([42])
+
+
+if __name__ == "__main__":
+    sys.exit(unittest.main())
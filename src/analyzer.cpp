@@ -1,22 +1,61 @@
 #include <algorithm>
 #include <array>
+#include <atomic>
+#include <cerrno>
 #include <chrono>
 #include <cmath>
+#include <condition_variable>
+#include <csignal>
+#include <cstdio>
+#include <cstdint>
+#include <cstring>
+#include <ctime>
+#include <deque>
 #include <filesystem>
 #include <fstream>
+#include <functional>
 #include <future>
 #include <iomanip>
 #include <iostream>
+#include <limits>
 #include <map>
+#include <memory>
 #include <mutex>
+#include <queue>
+#include <random>
+#include <set>
 #include <sstream>
 #include <string>
 #include <thread>
+#include <unordered_map>
 #include <vector>
 
 #ifdef _WIN32
+#include <io.h>
 #include <windows.h>
+#else
+#include <dlfcn.h>
+#include <fcntl.h>
+#include <grp.h>
+#include <netdb.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <pwd.h>
+#include <sys/file.h>
+#include <sys/ioctl.h>
+#include <sys/mman.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#ifdef __linux__
+#include <sched.h>
+#endif
 #endif
+#ifdef _MSC_VER
+#include <intrin.h>
+#endif
+
+#include "fta_plugin.h"
 
 namespace fs = std::filesystem;
 using namespace std;
@@ -164,7 +203,7 @@ vector<MagicSignature> magicDatabase = {
      {".class"}},
     {"FEEDFACE", "MACH-O", "Executable", "macOS Executable (32-bit)", {}},
     {"FEEDFACF", "MACH-O", "Executable", "macOS Executable (64-bit)", {}},
-    {"DEX0A", "DEX", "Executable", "Android Dalvik Executable", {".dex"}},
+    {"6465780A", "DEX", "Executable", "Android Dalvik Executable", {".dex"}},
 
     // Database
     {"53514C697465",
@@ -193,10 +232,15 @@ vector<MagicSignature> magicDatabase = {
     {"4344303031", "ISO", "Disk", "ISO Disk Image", {".iso"}},
 };
 
+// Custom signatures are appended after these; a reload starts over from here
+const size_t builtinSignatureCount = magicDatabase.size();
+
 // ============================================================================
 // Custom Signature Loading from JSON
 // ============================================================================
-bool loadCustomSignatures(const string &jsonPath) {
+// Appends to `database`; the live matcher changes only on the next rebuild
+bool loadCustomSignatures(const string &jsonPath,
+                          vector<MagicSignature> &database = magicDatabase) {
   ifstream file(jsonPath);
   if (!file)
     return false;
@@ -246,7 +290,7 @@ bool loadCustomSignatures(const string &jsonPath) {
     start = content.find("\"", start) + 1;
     sig.description = content.substr(start, end - start);
 
-    magicDatabase.push_back(sig);
+    database.push_back(sig);
     loaded++;
     pos = end;
   }
@@ -255,219 +299,4958 @@ bool loadCustomSignatures(const string &jsonPath) {
 }
 
 // ============================================================================
-// File Info Structure
+// Signature Engine (compiled byte-level matching tables)
 // ============================================================================
-struct FileInfo {
-  string path;
-  string name;
+// Every signature, whether a built-in hex string, a custom JSON entry or an
+// imported magic(5) rule, is compiled into a ByteTest. Equality tests become
+// a byte pattern with a per-byte mask (numeric values are encoded in file
+// byte order), so they can be indexed by their first exact byte; ordered and
+// bitwise numeric comparisons keep their numeric form.
+struct ByteTest {
+  enum Kind { Pattern, Numeric, Any };
+  Kind kind = Pattern;
+  uint32_t offset = 0;
+  vector<uint8_t> bytes; // Pattern: expected bytes, pre-masked
+  vector<uint8_t> masks; // Pattern: 0xFF exact, 0x00 wildcard
+  uint8_t width = 0;     // Numeric/Any: 1, 2, 4 or 8 (0 = C string)
+  bool bigEndian = false;
+  bool isSigned = true;
+  bool isString = false; // Pattern came from a magic(5) string test
+  char op = '=';         // Numeric: = ! < > & ^
+  uint64_t numMask = ~0ULL;
+  uint64_t value = 0;
+
+  size_t end() const {
+    return offset + (kind == Pattern ? bytes.size() : max<size_t>(width, 1));
+  }
+
+  uint64_t readValue(const unsigned char *data) const {
+    uint64_t v = 0;
+    for (uint8_t i = 0; i < width; i++) {
+      uint8_t b = data[offset + (bigEndian ? i : width - 1 - i)];
+      v = (v << 8) | b;
+    }
+    return v;
+  }
+
+  bool matches(const unsigned char *data, size_t len) const {
+    if (end() > len)
+      return false;
+    if (kind == Pattern) {
+      const unsigned char *p = data + offset;
+      for (size_t i = 0; i < bytes.size(); i++) {
+        if ((p[i] & masks[i]) != bytes[i])
+          return false;
+      }
+      return true;
+    }
+    if (kind == Any)
+      return true;
+
+    uint64_t v = readValue(data) & numMask;
+    switch (op) {
+    case '=':
+      return v == value;
+    case '!':
+      return v != value;
+    case '&':
+      return (v & value) == value;
+    case '^':
+      return (v & value) == 0;
+    case '<':
+    case '>': {
+      if (isSigned) {
+        int shift = 64 - 8 * width;
+        int64_t sv = static_cast<int64_t>(v << shift) >> shift;
+        int64_t sx = static_cast<int64_t>(value << shift) >> shift;
+        return op == '<' ? sv < sx : sv > sx;
+      }
+      return op == '<' ? v < value : v > value;
+    }
+    }
+    return false;
+  }
+};
+
+struct SignatureRule {
+  struct Continuation {
+    int level;
+    ByteTest test;
+    string message;
+    bool noSpace; // Message started with \b: append without a space
+  };
+
+  ByteTest test;
   string type;
   string category;
   string description;
-  uintmax_t size;
-  bool isCorrupt;
-  bool extensionMismatch;
-  string detectedExtension;
-  string actualExtension;
-  double analysisTime;
-  double entropy;
-  string hash;
+  string mime;
+  vector<Continuation> continuations;
 };
 
-// ============================================================================
-// Utility Functions
-// ============================================================================
-string bytesToHex(const vector<unsigned char> &bytes) {
-  stringstream ss;
-  ss << hex << uppercase;
-  for (unsigned char byte : bytes) {
-    ss << setw(2) << setfill('0') << static_cast<int>(byte);
+// Expands the first printf-style conversion in a magic(5) message with the
+// value the test read.
+string formatMagicMessage(const string &message, const ByteTest &test,
+                          const unsigned char *data, size_t len) {
+  size_t pct = message.find('%');
+  while (pct != string::npos && pct + 1 < message.size() &&
+         message[pct + 1] == '%')
+    pct = message.find('%', pct + 2);
+  if (pct == string::npos)
+    return message;
+
+  size_t conv = pct + 1;
+  while (conv < message.size() && strchr("-+ #0123456789.lhjzqL", message[conv]))
+    conv++;
+  if (conv >= message.size())
+    return message;
+  char type = message[conv];
+  string spec = message.substr(pct, conv - pct);
+  spec.erase(remove_if(spec.begin(), spec.end(),
+                       [](char c) { return strchr("lhjzqL", c) != nullptr; }),
+             spec.end());
+
+  string text;
+  if (test.isString || (test.kind == ByteTest::Any && test.width == 0)) {
+    // Printable prefix of the bytes at the offset
+    for (size_t i = test.offset; i < len && i < test.offset + 64; i++) {
+      if (data[i] == 0 || data[i] == '\n' || data[i] == '\r')
+        break;
+      text += static_cast<char>(data[i]);
+    }
+    if (type != 's')
+      text.clear();
+  } else if (test.width > 0 && test.end() <= len) {
+    uint64_t v = test.readValue(data) & test.numMask;
+    char buf[64];
+    if (type == 's') {
+      snprintf(buf, sizeof(buf), "%llu", static_cast<unsigned long long>(v));
+    } else if (type == 'd' || type == 'i') {
+      int shift = 64 - 8 * test.width;
+      long long sv = static_cast<long long>(static_cast<int64_t>(v << shift) >>
+                                            shift);
+      snprintf(buf, sizeof(buf), (spec + "lld").c_str(), sv);
+    } else if (strchr("uxXo", type)) {
+      snprintf(buf, sizeof(buf), (spec + "ll" + type).c_str(),
+               static_cast<unsigned long long>(v));
+    } else if (type == 'c') {
+      snprintf(buf, sizeof(buf), "%c", static_cast<char>(v));
+    } else {
+      buf[0] = '\0';
+    }
+    text = buf;
   }
-  return ss.str();
+  return message.substr(0, pct) + text + message.substr(conv + 1);
 }
 
-string formatSize(uintmax_t bytes) {
-  const char *units[] = {"B", "KB", "MB", "GB", "TB"};
-  int unitIndex = 0;
-  double size = static_cast<double>(bytes);
+// Per-rule probe (test evaluated) and hit (rule won) counts, kept per thread
+// while --signature-profile-out is active and folded into the totals when a
+// thread exits, the profile is collected or the thread moves to a reloaded
+// rule set. Indexes refer to `snapshot`'s rules; totals are keyed by rule.
+struct SignatureSnapshot;
+struct SignatureCounters {
+  shared_ptr<const SignatureSnapshot> snapshot;
+  vector<uint64_t> probes, hits;
+  ~SignatureCounters();
+};
 
-  while (size >= 1024 && unitIndex < 4) {
-    size /= 1024;
-    unitIndex++;
+bool signatureProfiling = false;
+mutex signatureTotalsMutex;
+unordered_map<string, array<uint64_t, 2>> signatureTotals; // {hits, probes}
+
+class SignatureMatcher {
+public:
+  SignatureMatcher() = default;
+
+  explicit SignatureMatcher(vector<SignatureRule> compiled)
+      : rules(std::move(compiled)) {
+    for (uint32_t i = 0; i < rules.size(); i++) {
+      const ByteTest &test = rules[i].test;
+      maxBytesNeeded = max(maxBytesNeeded, test.end());
+      for (const auto &cont : rules[i].continuations)
+        maxBytesNeeded = max(maxBytesNeeded, cont.test.end());
+
+      // Index by the first byte that must match exactly
+      size_t anchor = 0;
+      if (test.kind == ByteTest::Pattern) {
+        while (anchor < test.masks.size() && test.masks[anchor] != 0xFF)
+          anchor++;
+      }
+      if (test.kind != ByteTest::Pattern || anchor == test.masks.size()) {
+        unindexed.push_back(i);
+        continue;
+      }
+      uint32_t offset = test.offset + static_cast<uint32_t>(anchor);
+      auto table = find_if(tables.begin(), tables.end(),
+                           [&](const OffsetTable &t) { return t.offset == offset; });
+      if (table == tables.end()) {
+        tables.push_back(OffsetTable{offset, {}, 0});
+        table = tables.end() - 1;
+      }
+      table->buckets[test.bytes[anchor]].push_back(i);
+    }
+    sort(tables.begin(), tables.end(),
+         [](const OffsetTable &a, const OffsetTable &b) {
+           return a.offset < b.offset;
+         });
   }
 
-  stringstream ss;
-  ss << fixed << setprecision(2) << size << " " << units[unitIndex];
-  return ss.str();
-}
+  // Highest-priority (lowest index) rule whose test matches. Buckets stay
+  // sorted by index, so a bucket is abandoned at the first rule that could
+  // not beat the current best; a profiled layout only changes the order of
+  // the tables, so the usual winner is found first and prunes the rest.
+  const SignatureRule *match(const unsigned char *data, size_t len,
+                             SignatureCounters *counters = nullptr) const {
+    uint32_t best = UINT32_MAX;
+    for (const auto &table : tables) {
+      if (table.offset >= len) {
+        if (profiled)
+          continue;
+        break;
+      }
+      for (uint32_t idx : table.buckets[data[table.offset]]) {
+        if (idx >= best)
+          break;
+        if (counters)
+          counters->probes[idx]++;
+        if (rules[idx].test.matches(data, len)) {
+          best = idx;
+          break;
+        }
+      }
+    }
+    for (uint32_t idx : unindexed) {
+      if (idx >= best)
+        break;
+      if (counters)
+        counters->probes[idx]++;
+      if (rules[idx].test.matches(data, len)) {
+        best = idx;
+        break;
+      }
+    }
+    if (best == UINT32_MAX)
+      return nullptr;
+    if (counters)
+      counters->hits[best]++;
+    return &rules[best];
+  }
 
-string toLowercase(const string &str) {
-  string result = str;
-  transform(result.begin(), result.end(), result.begin(), ::tolower);
-  return result;
-}
+  // Stable identity of a rule across runs: type, offset and test
+  string ruleKey(size_t index) const {
+    const SignatureRule &rule = rules[index];
+    const ByteTest &test = rule.test;
+    string key = rule.type + "@" + to_string(test.offset) + ":";
+    if (test.kind == ByteTest::Pattern) {
+      const char *digits = "0123456789ABCDEF";
+      for (size_t i = 0; i < test.bytes.size(); i++) {
+        if (test.masks[i] == 0xFF) {
+          key += digits[test.bytes[i] >> 4];
+          key += digits[test.bytes[i] & 15];
+        } else {
+          key += "??";
+        }
+      }
+    } else if (test.kind == ByteTest::Numeric) {
+      key += string(1, test.op) + to_string(test.width) + "/" +
+             to_string(test.value);
+    } else {
+      key += "x" + to_string(test.width);
+    }
+    return key;
+  }
 
-bool validatePath(const fs::path &path) {
-  string pathStr = path.string();
-  if (pathStr.find("..") != string::npos) {
-    return false; // Prevent directory traversal
+  // Puts the offset tables holding the rules that won most often in
+  // `hitsByKey` first; which rule wins is unchanged
+  void applyProfile(const unordered_map<string, uint64_t> &hitsByKey) {
+    for (auto &table : tables) {
+      table.hits = 0;
+      for (const auto &bucket : table.buckets) {
+        for (uint32_t idx : bucket) {
+          auto it = hitsByKey.find(ruleKey(idx));
+          if (it != hitsByKey.end())
+            table.hits += it->second;
+        }
+      }
+    }
+    stable_sort(tables.begin(), tables.end(),
+                [](const OffsetTable &a, const OffsetTable &b) {
+                  return a.hits > b.hits;
+                });
+    profiled = true;
+  }
+
+  // Top-level message plus every continuation whose parent chain matched
+  string describe(const SignatureRule &rule, const unsigned char *data,
+                  size_t len) const {
+    if (rule.continuations.empty())
+      return rule.description;
+    string text = formatMagicMessage(rule.description, rule.test, data, len);
+    const int maxLevel = 32;
+    bool matchedAt[maxLevel + 1] = {true};
+    for (const auto &cont : rule.continuations) {
+      if (cont.level > maxLevel)
+        continue;
+      bool ok = matchedAt[cont.level - 1] && cont.test.matches(data, len);
+      matchedAt[cont.level] = ok;
+      if (ok && !cont.message.empty()) {
+        if (!cont.noSpace && !text.empty())
+          text += " ";
+        text += formatMagicMessage(cont.message, cont.test, data, len);
+      }
+    }
+    return text;
+  }
+
+  size_t ruleCount() const { return rules.size(); }
+  size_t bytesNeeded() const { return maxBytesNeeded; }
+
+private:
+  struct OffsetTable {
+    uint32_t offset;
+    array<vector<uint32_t>, 256> buckets;
+    uint64_t hits = 0; // Profiled wins of the table's rules
+  };
+
+  vector<SignatureRule> rules;
+  vector<OffsetTable> tables;
+  vector<uint32_t> unindexed;
+  size_t maxBytesNeeded = 0;
+  bool profiled = false;
+};
+
+// Hex signature ("89504E47", with ".." or "??" for any byte) to a rule.
+// Returns false for malformed patterns, which could never match.
+bool compileHexSignature(const MagicSignature &sig, SignatureRule &rule) {
+  const string &hex = sig.hex;
+  if (hex.empty() || hex.size() % 2 != 0)
+    return false;
+  ByteTest test;
+  for (size_t i = 0; i < hex.size(); i += 2) {
+    string pair = hex.substr(i, 2);
+    if (pair == ".." || pair == "??") {
+      test.bytes.push_back(0);
+      test.masks.push_back(0);
+      continue;
+    }
+    if (!isxdigit(static_cast<unsigned char>(pair[0])) ||
+        !isxdigit(static_cast<unsigned char>(pair[1])))
+      return false;
+    test.bytes.push_back(static_cast<uint8_t>(stoi(pair, nullptr, 16)));
+    test.masks.push_back(0xFF);
   }
+  rule.test = test;
+  rule.type = sig.type;
+  rule.category = sig.category;
+  rule.description = sig.description;
   return true;
 }
 
 // ============================================================================
-// Entropy Calculation
+// magic(5) Rule Import
 // ============================================================================
-double calculateEntropy(const vector<unsigned char> &bytes) {
-  if (bytes.empty())
-    return 0.0;
+// Translates the common subset of magic(5) into SignatureRules: absolute
+// offsets; byte/short/long/quad tests in native, big- and little-endian
+// forms with optional &mask; string tests; the = ! < > & ^ operators, and x
+// on continuations; continuation levels; and !:mime annotations. Everything
+// else (indirect or relative offsets, regex, search, dates, name/use, a
+// top-level x that would match every file, ...) is skipped and reported so
+// coverage gaps are visible.
+struct MagicImportReport {
+  size_t rules = 0;
+  size_t continuations = 0;
+  size_t unsupportedRules = 0;
+  size_t unsupportedContinuations = 0;
+  map<string, size_t> reasons;                  // reason -> count
+  vector<pair<string, string>> unsupportedLines; // "file:line" -> reason
+};
+
+vector<SignatureRule> importedMagicRules;
 
-  array<int, 256> freq{};
-  for (unsigned char b : bytes) {
-    freq[b]++;
+namespace magic {
+
+// Next whitespace-delimited token; backslash escapes the following character
+string nextToken(const string &line, size_t &pos) {
+  while (pos < line.size() && isspace(static_cast<unsigned char>(line[pos])))
+    pos++;
+  size_t start = pos;
+  while (pos < line.size() && !isspace(static_cast<unsigned char>(line[pos]))) {
+    if (line[pos] == '\\' && pos + 1 < line.size())
+      pos++;
+    pos++;
   }
+  return line.substr(start, pos - start);
+}
 
-  double entropy = 0.0;
-  double len = static_cast<double>(bytes.size());
+bool parseNumber(const string &text, uint64_t &value) {
+  if (text.empty())
+    return false;
+  char *end = nullptr;
+  errno = 0;
+  if (text[0] == '-')
+    value = static_cast<uint64_t>(strtoll(text.c_str(), &end, 0));
+  else
+    value = strtoull(text.c_str(), &end, 0);
+  // magic(5) allows a trailing L/l on numbers
+  while (end && (*end == 'L' || *end == 'l'))
+    end++;
+  return errno == 0 && end && *end == '\0';
+}
 
-  for (int i = 0; i < 256; i++) {
-    if (freq[i] > 0) {
-      double p = freq[i] / len;
-      entropy -= p * log2(p);
+string unescapeString(const string &text) {
+  string out;
+  for (size_t i = 0; i < text.size(); i++) {
+    char c = text[i];
+    if (c != '\\' || i + 1 >= text.size()) {
+      out += c;
+      continue;
+    }
+    char e = text[++i];
+    switch (e) {
+    case 'n':
+      out += '\n';
+      break;
+    case 't':
+      out += '\t';
+      break;
+    case 'r':
+      out += '\r';
+      break;
+    case 'b':
+      out += '\b';
+      break;
+    case 'f':
+      out += '\f';
+      break;
+    case 'v':
+      out += '\v';
+      break;
+    case 'a':
+      out += '\a';
+      break;
+    case 'x': {
+      int v = 0, digits = 0;
+      while (digits < 2 && i + 1 < text.size() &&
+             isxdigit(static_cast<unsigned char>(text[i + 1]))) {
+        v = v * 16 + stoi(string(1, text[++i]), nullptr, 16);
+        digits++;
+      }
+      out += static_cast<char>(v);
+      break;
+    }
+    default:
+      if (e >= '0' && e <= '7') {
+        int v = e - '0', digits = 1;
+        while (digits < 3 && i + 1 < text.size() && text[i + 1] >= '0' &&
+               text[i + 1] <= '7') {
+          v = v * 8 + (text[++i] - '0');
+          digits++;
+        }
+        out += static_cast<char>(v);
+      } else {
+        out += e; // \\, \ , \" and friends
+      }
     }
   }
-
-  return entropy;
+  return out;
 }
 
-// ============================================================================
-// Core Detection Function (Thread-safe)
-// ============================================================================
-FileInfo analyzeFile(const fs::path &filePath) {
-  FileInfo info;
-  info.path = filePath.string();
-  info.name = filePath.filename().string();
-  info.isCorrupt = false;
-  info.extensionMismatch = false;
-  info.type = "Unknown";
-  info.category = "Unknown";
-  info.description = "Unrecognized file type";
-  info.entropy = 0.0;
-  info.hash = "";
+// Parses "offset type test" into a ByteTest; returns an empty string on
+// success or the reason the line is unsupported.
+string parseTest(const string &offsetText, const string &typeText,
+                 const string &testText, ByteTest &test) {
+  if (offsetText.empty())
+    return "missing offset";
+  if (offsetText[0] == '(' || offsetText[0] == '&')
+    return "indirect or relative offset";
+  if (offsetText[0] == '-')
+    return "offset from end of file";
+  uint64_t offset;
+  if (!parseNumber(offsetText, offset) || offset > UINT32_MAX)
+    return "malformed offset";
+  test.offset = static_cast<uint32_t>(offset);
 
-  if (!validatePath(filePath)) {
-    info.type = "Error";
-    info.description = "Invalid file path (security check failed)";
-    return info;
+  string type = typeText;
+  string modifier;
+  size_t modPos = type.find_first_of("&/+-*%|");
+  if (modPos != string::npos) {
+    modifier = type.substr(modPos);
+    type = type.substr(0, modPos);
   }
 
-  auto startTime = high_resolution_clock::now();
+  if (type == "string") {
+    if (!modifier.empty()) {
+      // /b and /t are text/binary hints that do not change matching
+      if (modifier[0] != '/' ||
+          modifier.find_first_not_of("/bt") != string::npos)
+        return "string flags " + modifier;
+    }
+    if (testText == "x") {
+      test.kind = ByteTest::Any;
+      test.width = 0;
+      test.isString = true;
+      return "";
+    }
+    string value = testText;
+    if (!value.empty() && value[0] == '=')
+      value = value.substr(1);
+    else if (!value.empty() && strchr("<>!", value[0]))
+      return "string comparison operator";
+    string bytes = unescapeString(value);
+    if (bytes.empty())
+      return "empty string test";
+    test.kind = ByteTest::Pattern;
+    test.isString = true;
+    test.bytes.assign(bytes.begin(), bytes.end());
+    test.masks.assign(bytes.size(), 0xFF);
+    return "";
+  }
 
-  try {
-    info.size = fs::file_size(filePath);
-  } catch (...) {
-    info.size = 0;
+  bool isUnsigned = false;
+  if (!type.empty() && type[0] == 'u') {
+    isUnsigned = true;
+    type = type.substr(1);
+  }
+  static const map<string, pair<uint8_t, int>> numericTypes = {
+      // width, endianness: 0 native (little), 1 big, 2 little
+      {"byte", {1, 0}},   {"short", {2, 0}},   {"long", {4, 0}},
+      {"quad", {8, 0}},   {"beshort", {2, 1}}, {"belong", {4, 1}},
+      {"bequad", {8, 1}}, {"leshort", {2, 2}}, {"lelong", {4, 2}},
+      {"lequad", {8, 2}},
+  };
+  auto numeric = numericTypes.find(type);
+  if (numeric == numericTypes.end())
+    return "type " + typeText;
+  test.width = numeric->second.first;
+  test.bigEndian = numeric->second.second == 1;
+  test.isSigned = !isUnsigned;
+  uint64_t widthMask =
+      test.width == 8 ? ~0ULL : ((uint64_t(1) << (8 * test.width)) - 1);
+  test.numMask = widthMask;
+  if (!modifier.empty()) {
+    uint64_t mask;
+    if (modifier[0] != '&' || !parseNumber(modifier.substr(1), mask))
+      return "type operator " + modifier;
+    test.numMask = mask & widthMask;
   }
 
-  info.actualExtension = toLowercase(filePath.extension().string());
+  if (testText == "x") {
+    test.kind = ByteTest::Any;
+    return "";
+  }
+  char op = '=';
+  string valueText = testText;
+  if (!valueText.empty() && strchr("=!<>&^~", valueText[0])) {
+    op = valueText[0];
+    valueText = valueText.substr(1);
+  }
+  if (op == '~')
+    return "numeric operator ~";
+  uint64_t value;
+  if (!parseNumber(valueText, value))
+    return "malformed value " + testText;
+  value &= widthMask;
 
-  ifstream file(filePath, ios::binary);
-  if (!file) {
-    info.type = "Unreadable";
-    info.description = "Could not open file";
-    return info;
+  if (op != '=') {
+    test.kind = ByteTest::Numeric;
+    test.op = op;
+    test.value = value;
+    return "";
   }
 
-  // Read bytes for analysis
-  size_t readSize = min(static_cast<uintmax_t>(65536), info.size);
-  vector<unsigned char> buffer(readSize);
-  file.read(reinterpret_cast<char *>(buffer.data()), buffer.size());
-  streamsize bytesRead = file.gcount();
+  // Equality becomes a byte pattern in file byte order
+  test.kind = ByteTest::Pattern;
+  for (uint8_t i = 0; i < test.width; i++) {
+    int shift = 8 * (test.bigEndian ? test.width - 1 - i : i);
+    uint8_t maskByte = static_cast<uint8_t>(test.numMask >> shift);
+    test.masks.push_back(maskByte);
+    test.bytes.push_back(static_cast<uint8_t>(value >> shift) & maskByte);
+  }
+  return "";
+}
 
-  if (bytesRead < 2) {
-    info.isCorrupt = true;
-    info.type = "Empty/Corrupt";
-    info.description = "File too small to identify";
-    return info;
+// Category from the MIME type, like the built-in database's categories
+string categoryForMime(const string &mime) {
+  auto startsWith = [&](const char *prefix) {
+    return mime.compare(0, strlen(prefix), prefix) == 0;
+  };
+  if (startsWith("image/"))
+    return "Image";
+  if (startsWith("audio/"))
+    return "Audio";
+  if (startsWith("video/"))
+    return "Video";
+  if (startsWith("font/") || mime.find("font") != string::npos)
+    return "Font";
+  if (startsWith("text/"))
+    return "Text";
+  if (mime.find("zip") != string::npos || mime.find("tar") != string::npos ||
+      mime.find("compress") != string::npos ||
+      mime.find("rar") != string::npos || mime.find("7z") != string::npos ||
+      mime.find("xz") != string::npos || mime.find("archive") != string::npos)
+    return "Archive";
+  if (mime.find("executable") != string::npos ||
+      mime.find("sharedlib") != string::npos ||
+      mime.find("dosexec") != string::npos ||
+      mime.find("mach-binary") != string::npos)
+    return "Executable";
+  if (mime.find("pdf") != string::npos || mime.find("document") != string::npos ||
+      mime.find("msword") != string::npos ||
+      mime.find("postscript") != string::npos)
+    return "Document";
+  if (mime.find("sqlite") != string::npos || mime.find("database") != string::npos)
+    return "Database";
+  return "Data";
+}
+
+void finishRule(SignatureRule &rule) {
+  string message = rule.description;
+  if (message.empty() && !rule.continuations.empty())
+    message = rule.continuations.front().message;
+  // Type: the first word of the message, e.g. "PNG image data" -> "PNG"
+  size_t start = message.find_first_not_of(" \t");
+  size_t end = message.find_first_of(" \t,%", start);
+  rule.type = start == string::npos ? "Magic" : message.substr(start, end - start);
+  transform(rule.type.begin(), rule.type.end(), rule.type.begin(), ::toupper);
+  if (rule.type.empty())
+    rule.type = "Magic";
+  rule.category = rule.mime.empty() ? "Data" : categoryForMime(rule.mime);
+  // libmagic reports rules without !:mime as application/octet-stream
+  if (rule.mime.empty())
+    rule.mime = "application/octet-stream";
+}
+
+} // namespace magic
+
+// Imports one magic(5) file, or every file in a magic directory, appending
+// the supported rules to `rules`.
+bool importMagicFile(const fs::path &path, MagicImportReport &report,
+                     vector<SignatureRule> &rules = importedMagicRules) {
+  error_code ec;
+  if (fs::is_directory(path, ec)) {
+    vector<fs::path> files;
+    for (fs::directory_iterator it(path, ec), end; !ec && it != end;
+         it.increment(ec)) {
+      error_code typeEc;
+      if (it->is_regular_file(typeEc))
+        files.push_back(it->path());
+    }
+    sort(files.begin(), files.end());
+    bool any = false;
+    for (const auto &file : files)
+      any = importMagicFile(file, report, rules) || any;
+    return any;
   }
 
-  buffer.resize(bytesRead);
+  ifstream file(path);
+  if (!file)
+    return false;
 
-  // Calculate entropy
-  info.entropy = calculateEntropy(buffer);
+  SignatureRule current;
+  bool haveRule = false;
+  int skipDeeperThan = INT32_MAX; // Drop children of unsupported lines
+  int lastLevel = 0;
+  string line;
+  size_t lineNumber = 0;
+
+  auto flush = [&]() {
+    if (haveRule) {
+      magic::finishRule(current);
+      rules.push_back(std::move(current));
+      report.rules++;
+    }
+    current = SignatureRule();
+    haveRule = false;
+  };
+  auto unsupported = [&](int level, const string &reason) {
+    report.reasons[reason]++;
+    report.unsupportedLines.push_back(
+        {path.filename().string() + ":" + to_string(lineNumber), reason});
+    if (level == 0)
+      report.unsupportedRules++;
+    else
+      report.unsupportedContinuations++;
+    skipDeeperThan = level;
+  };
 
-  // Get hex for magic matching (first 64 bytes)
-  string hex = bytesToHex(vector<unsigned char>(
-      buffer.begin(), buffer.begin() + min<size_t>(64, bytesRead)));
+  while (getline(file, line)) {
+    lineNumber++;
+    if (!line.empty() && line.back() == '\r')
+      line.pop_back();
+    size_t first = line.find_first_not_of(" \t");
+    if (first == string::npos || line[first] == '#')
+      continue;
 
-  // Try to match against magic database
-  for (const auto &sig : magicDatabase) {
-    string pattern = sig.hex;
-
-    // Handle patterns with wildcards (....)
-    if (pattern.find("....") != string::npos) {
-      size_t wildcardPos = pattern.find("....");
-      if (hex.size() >= pattern.size()) {
-        string checkPattern = pattern.substr(0, wildcardPos) +
-                              hex.substr(wildcardPos, 4) +
-                              pattern.substr(wildcardPos + 4);
-        if (hex.substr(0, checkPattern.size()) == checkPattern) {
-          info.type = sig.type;
-          info.category = sig.category;
-          info.description = sig.description;
-          break;
-        }
+    if (line.compare(first, 2, "!:") == 0) {
+      if (haveRule && current.mime.empty() &&
+          line.compare(first, 6, "!:mime") == 0) {
+        size_t pos = first + 6;
+        current.mime = magic::nextToken(line, pos);
       }
+      continue;
+    }
+
+    int level = 0;
+    while (static_cast<size_t>(level) < line.size() && line[level] == '>')
+      level++;
+
+    if (level == 0) {
+      flush();
+      skipDeeperThan = INT32_MAX;
+    } else if (level > skipDeeperThan) {
+      continue;
     } else {
-      if (hex.size() >= pattern.size() &&
-          hex.substr(0, pattern.size()) == pattern) {
-        info.type = sig.type;
-        info.category = sig.category;
-        info.description = sig.description;
-        break;
+      skipDeeperThan = INT32_MAX;
+      if (!haveRule)
+        continue; // Child of an unsupported top-level rule
+      if (level > lastLevel + 1) {
+        unsupported(level, "continuation level jump");
+        continue;
       }
     }
+
+    size_t pos = static_cast<size_t>(level);
+    string offsetText = magic::nextToken(line, pos);
+    string typeText = magic::nextToken(line, pos);
+    string testText = magic::nextToken(line, pos);
+    while (pos < line.size() && isspace(static_cast<unsigned char>(line[pos])))
+      pos++;
+    string message = line.substr(pos);
+
+    ByteTest test;
+    string reason = magic::parseTest(offsetText, typeText, testText, test);
+    if (reason.empty() && level == 0 && test.kind == ByteTest::Any)
+      reason = "top-level x test"; // Would match every file
+    if (!reason.empty()) {
+      unsupported(level, reason);
+      continue;
+    }
+
+    bool noSpace = message.compare(0, 2, "\\b") == 0;
+    if (noSpace)
+      message = message.substr(2);
+
+    if (level == 0) {
+      current.test = test;
+      current.description = message;
+      haveRule = true;
+    } else {
+      current.continuations.push_back({level, test, message, noSpace});
+      report.continuations++;
+    }
+    lastLevel = level;
   }
+  flush();
+  return true;
+}
 
-  // Fallback for text files
-  if (info.type == "Unknown") {
-    if (info.actualExtension == ".txt" || info.actualExtension == ".log" ||
-        info.actualExtension == ".md" || info.actualExtension == ".csv" ||
-        info.actualExtension == ".cfg" || info.actualExtension == ".ini") {
-      info.type = "Text";
-      info.category = "Text";
-      info.description = "Plain text file";
-    } else if (info.actualExtension == ".cpp" || info.actualExtension == ".c" ||
-               info.actualExtension == ".h" || info.actualExtension == ".hpp") {
-      info.type = "Source Code";
-      info.category = "Code";
-      info.description = "C/C++ source file";
-    } else if (info.actualExtension == ".py") {
-      info.type = "Python";
-      info.category = "Code";
-      info.description = "Python script";
-    } else if (info.actualExtension == ".js") {
-      info.type = "JavaScript";
-      info.category = "Code";
-      info.description = "JavaScript file";
-    } else if (info.actualExtension == ".java") {
-      info.type = "Java";
-      info.category = "Code";
-      info.description = "Java source file";
-    } else if (info.actualExtension == ".html" ||
-               info.actualExtension == ".htm") {
-      info.type = "HTML";
-      info.category = "Web";
-      info.description = "HTML document";
-    } else if (info.actualExtension == ".css") {
-      info.type = "CSS";
-      info.category = "Web";
-      info.description = "Cascading Style Sheet";
+// Built-in and custom signatures first (in database order), then imported
+// magic(5) rules, so existing detections keep their priority.
+vector<SignatureRule> compileSignatureRules() {
+  vector<SignatureRule> rules;
+  rules.reserve(magicDatabase.size() + importedMagicRules.size());
+  for (const auto &sig : magicDatabase) {
+    SignatureRule rule;
+    if (compileHexSignature(sig, rule))
+      rules.push_back(std::move(rule));
+  }
+  rules.insert(rules.end(), importedMagicRules.begin(),
+               importedMagicRules.end());
+  return rules;
+}
+
+// Hits per rule key from --signature-profile, applied on every rebuild
+unordered_map<string, uint64_t> signatureProfile;
+
+// ============================================================================
+// Signature Snapshots (hot reload)
+// ============================================================================
+// A compiled matcher never changes once published. Reloading compiles a new
+// snapshot on the side and swaps one pointer. Each file pins the snapshot it
+// started with, so in-flight files finish on the old rules, new files get
+// the new ones, and the match path takes no lock.
+//
+// Reclamation is epoch based. A reader stores the global epoch in its own
+// slot before loading the pointer and clears the slot when done. Replacing a
+// snapshot bumps the epoch. The old snapshot is freed once no slot still
+// holds an epoch from before the bump.
+template <typename T> class EpochSnapshots {
+public:
+  explicit EpochSnapshots(shared_ptr<T> initial) {
+    publish(std::move(initial));
+  }
+
+  // Pins the current snapshot for this thread until the matching unpin();
+  // nested pins get the outer one. Threads keep their reader slot per T, so
+  // only one instance per T should be live at a time.
+  const T *pin() {
+    ThreadState &state = threadState();
+    if (state.depth++ == 0) {
+      if (!state.slot)
+        state.slot = acquireSlot();
+      state.slot->epoch.store(epoch.load());
+      state.pinned = active.load();
     }
+    return state.pinned;
   }
 
-  // Check for extension mismatch
-  if (info.type != "Unknown" && info.type != "Text" &&
-      !info.actualExtension.empty()) {
+  void unpin() {
+    ThreadState &state = threadState();
+    if (--state.depth == 0) {
+      state.slot->epoch.store(0, memory_order_release);
+      state.pinned = nullptr;
+    }
+  }
+
+  // Makes `next` current and frees retired snapshots that no reader can
+  // still see. Never waits for readers.
+  void publish(shared_ptr<T> next) {
+    lock_guard<mutex> lock(mtx);
+    if (active.exchange(next.get()))
+      retired.push_back({epoch.fetch_add(1) + 1, std::move(owner)});
+    owner = std::move(next);
+    reclaimLocked();
+  }
+
+  // Frees what it can; returns how many retired snapshots are still pinned
+  size_t reclaim() {
+    lock_guard<mutex> lock(mtx);
+    return reclaimLocked();
+  }
+
+  // Writer-side handle on the current snapshot
+  shared_ptr<T> current() {
+    lock_guard<mutex> lock(mtx);
+    return owner;
+  }
+
+private:
+  // Shared by the instance and the thread using it, so either may go first
+  struct alignas(64) ReaderSlot {
+    atomic<uint64_t> epoch{0}; // 0 while the reader holds nothing
+    atomic<bool> inUse{false};
+  };
+
+  struct ThreadState {
+    uint64_t domain = 0; // Instance id, not address: addresses get reused
+    shared_ptr<ReaderSlot> slot;
+    int depth = 0;
+    const T *pinned = nullptr;
+
+    void release() {
+      if (slot) {
+        slot->epoch.store(0);
+        slot->inUse.store(false, memory_order_release);
+      }
+      slot.reset();
+    }
+    ~ThreadState() { release(); }
+  };
+
+  ThreadState &threadState() {
+    static thread_local ThreadState state;
+    if (state.domain != id) {
+      state.release(); // The previous instance of T is gone
+      state.domain = id;
+      state.depth = 0;
+    }
+    return state;
+  }
+
+  shared_ptr<ReaderSlot> acquireSlot() {
+    lock_guard<mutex> lock(mtx);
+    for (auto &slot : slots) {
+      bool expected = false;
+      if (slot->inUse.compare_exchange_strong(expected, true))
+        return slot;
+    }
+    slots.push_back(make_shared<ReaderSlot>());
+    slots.back()->inUse = true;
+    return slots.back();
+  }
+
+  // A reader that entered at or after a retirement epoch loaded a newer
+  // pointer, so only readers from earlier epochs can hold a retired one
+  size_t reclaimLocked() {
+    uint64_t oldest = UINT64_MAX;
+    for (const auto &slot : slots) {
+      uint64_t entered = slot->epoch.load();
+      if (entered != 0)
+        oldest = min(oldest, entered);
+    }
+    retired.erase(remove_if(retired.begin(), retired.end(),
+                            [&](const pair<uint64_t, shared_ptr<T>> &r) {
+                              return r.first <= oldest;
+                            }),
+                  retired.end());
+    return retired.size();
+  }
+
+  static inline atomic<uint64_t> instances{0};
+  const uint64_t id = ++instances;
+  atomic<T *> active{nullptr};
+  atomic<uint64_t> epoch{1};
+  mutex mtx; // Writers and slot registration only
+  shared_ptr<T> owner;
+  vector<shared_ptr<ReaderSlot>> slots;
+  vector<pair<uint64_t, shared_ptr<T>>> retired; // {retirement epoch, snapshot}
+};
+
+struct SignatureSnapshot : enable_shared_from_this<SignatureSnapshot> {
+  uint64_t version = 0;
+  SignatureMatcher matcher;
+};
+
+atomic<uint64_t> signatureVersions{0};
+
+shared_ptr<SignatureSnapshot> compileSignatureSnapshot() {
+  auto snapshot = make_shared<SignatureSnapshot>();
+  snapshot->version = ++signatureVersions;
+  snapshot->matcher = SignatureMatcher(compileSignatureRules());
+  if (!signatureProfile.empty())
+    snapshot->matcher.applyProfile(signatureProfile);
+  return snapshot;
+}
+
+EpochSnapshots<SignatureSnapshot> signatureSnapshots{
+    compileSignatureSnapshot()};
+
+// Pins the current signatures for the guard's lifetime
+class SignatureReadGuard {
+public:
+  SignatureReadGuard() : snapshot(signatureSnapshots.pin()) {}
+  ~SignatureReadGuard() { signatureSnapshots.unpin(); }
+  SignatureReadGuard(const SignatureReadGuard &) = delete;
+  SignatureReadGuard &operator=(const SignatureReadGuard &) = delete;
+
+  const SignatureSnapshot &operator*() const { return *snapshot; }
+  const SignatureSnapshot *operator->() const { return snapshot; }
+
+private:
+  const SignatureSnapshot *snapshot;
+};
+
+void rebuildSignatureMatcher() {
+  signatureSnapshots.publish(compileSignatureSnapshot());
+}
+
+void mergeSignatureCounters(SignatureCounters &counters) {
+  if (!counters.snapshot)
+    return;
+  const SignatureMatcher &matcher = counters.snapshot->matcher;
+  lock_guard<mutex> lock(signatureTotalsMutex);
+  for (size_t i = 0; i < counters.probes.size(); i++) {
+    if (counters.probes[i] == 0)
+      continue;
+    auto &totals = signatureTotals[matcher.ruleKey(i)];
+    totals[0] += counters.hits[i];
+    totals[1] += counters.probes[i];
+  }
+  fill(counters.probes.begin(), counters.probes.end(), 0);
+  fill(counters.hits.begin(), counters.hits.end(), 0);
+}
+
+SignatureCounters::~SignatureCounters() { mergeSignatureCounters(*this); }
+
+thread_local SignatureCounters localSignatureCounters;
+
+// This thread's counters for `snapshot`, flushing any for an older one
+SignatureCounters &signatureCounters(const SignatureSnapshot &snapshot) {
+  SignatureCounters &counters = localSignatureCounters;
+  if (counters.snapshot.get() != &snapshot) {
+    mergeSignatureCounters(counters);
+    counters.snapshot = snapshot.shared_from_this();
+    counters.probes.assign(snapshot.matcher.ruleCount(), 0);
+    counters.hits.assign(snapshot.matcher.ruleCount(), 0);
+  }
+  return counters;
+}
+
+// Where the custom rules came from, so a reload can rebuild them from scratch
+struct SignatureSources {
+  vector<string> customFiles; // JSON signature files (-S)
+  vector<string> magicPaths;  // magic(5) files or directories (--magic)
+};
+
+SignatureSources signatureSources;
+mutex signatureReloadMutex; // One writer at a time; readers never take it
+
+// Recompiles the built-ins plus every source and publishes the result. A
+// source that cannot be read leaves the current snapshot in place.
+bool reloadSignatures(string &error) {
+  lock_guard<mutex> lock(signatureReloadMutex);
+  vector<MagicSignature> database(magicDatabase.begin(),
+                                  magicDatabase.begin() +
+                                      builtinSignatureCount);
+  for (const auto &path : signatureSources.customFiles) {
+    if (!loadCustomSignatures(path, database)) {
+      error = "could not load signatures from " + path;
+      return false;
+    }
+  }
+  vector<SignatureRule> imported;
+  for (const auto &path : signatureSources.magicPaths) {
+    MagicImportReport report;
+    error_code ec;
+    if (!fs::exists(path, ec) || !importMagicFile(path, report, imported)) {
+      error = "could not read magic file " + path;
+      return false;
+    }
+  }
+  magicDatabase.swap(database);
+  importedMagicRules.swap(imported);
+  rebuildSignatureMatcher();
+  return true;
+}
+
+#ifndef _WIN32
+volatile sig_atomic_t signatureReloadRequested = 0;
+
+void requestSignatureReload(int) { signatureReloadRequested = 1; }
+#endif
+
+// Background thread that reloads on SIGHUP (when asked to handle it) and
+// whenever a source's modification time changes, and frees snapshots that
+// in-flight files have let go of
+class SignatureWatcher {
+public:
+  struct Stats {
+    uint64_t reloads = 0;
+    uint64_t failures = 0;
+    string lastError;
+  };
+
+  ~SignatureWatcher() { stop(); }
+
+  void start(milliseconds interval, bool handleHangup) {
+    if (worker.joinable())
+      return;
+#ifndef _WIN32
+    if (handleHangup)
+      signal(SIGHUP, requestSignatureReload);
+#else
+    (void)handleHangup;
+#endif
+    stamps = sourceStamps();
+    running = true;
+    worker = thread([this, interval]() { run(interval); });
+  }
+
+  void stop() {
+    {
+      lock_guard<mutex> lock(mtx);
+      running = false;
+    }
+    wake.notify_all();
+    if (worker.joinable())
+      worker.join();
+  }
+
+  Stats stats() {
+    lock_guard<mutex> lock(mtx);
+    return counters;
+  }
+
+private:
+  // Latest write time of each source (a directory counts its files)
+  static map<string, fs::file_time_type> sourceStamps() {
+    vector<string> paths;
+    {
+      lock_guard<mutex> lock(signatureReloadMutex);
+      paths = signatureSources.customFiles;
+      paths.insert(paths.end(), signatureSources.magicPaths.begin(),
+                   signatureSources.magicPaths.end());
+    }
+    map<string, fs::file_time_type> result;
+    for (const auto &path : paths) {
+      error_code ec;
+      fs::file_time_type latest = fs::last_write_time(path, ec);
+      if (fs::is_directory(path, ec)) {
+        for (const auto &entry : fs::directory_iterator(path, ec))
+          latest = max(latest, entry.last_write_time(ec));
+      }
+      result[path] = latest;
+    }
+    return result;
+  }
+
+  void run(milliseconds interval) {
+    unique_lock<mutex> lock(mtx);
+    while (running) {
+      wake.wait_for(lock, interval, [this]() { return !running; });
+      if (!running)
+        break;
+      lock.unlock();
+      bool requested = false;
+#ifndef _WIN32
+      requested = signatureReloadRequested != 0;
+      signatureReloadRequested = 0;
+#endif
+      auto latest = sourceStamps();
+      if (requested || latest != stamps) {
+        stamps = latest;
+        string error;
+        bool ok = reloadSignatures(error);
+        lock.lock();
+        (ok ? counters.reloads : counters.failures)++;
+        if (!ok)
+          counters.lastError = error;
+        lock.unlock();
+      }
+      signatureSnapshots.reclaim();
+      lock.lock();
+    }
+  }
+
+  thread worker;
+  mutex mtx;
+  condition_variable wake;
+  bool running = false;
+  map<string, fs::file_time_type> stamps; // Watcher thread only
+  Stats counters;
+};
+
+SignatureWatcher *signatureWatcher = nullptr; // Set by --watch-signatures
+
+// ============================================================================
+// Signature Profiles (--signature-profile-out / --signature-profile)
+// ============================================================================
+// A profile is a text file of "hits<TAB>probes<TAB>rule key" lines, busiest
+// rule first. Loading one reorders the matcher for that distribution.
+struct SignatureStat {
+  string key;
+  uint64_t hits = 0;
+  uint64_t probes = 0;
+};
+
+// Totals from every finished thread plus the calling one, busiest first
+vector<SignatureStat> collectSignatureProfile() {
+  mergeSignatureCounters(localSignatureCounters);
+  lock_guard<mutex> lock(signatureTotalsMutex);
+  vector<SignatureStat> stats;
+  for (const auto &[key, totals] : signatureTotals)
+    stats.push_back({key, totals[0], totals[1]});
+  sort(stats.begin(), stats.end(),
+       [](const SignatureStat &a, const SignatureStat &b) {
+         if (a.hits != b.hits)
+           return a.hits > b.hits;
+         if (a.probes != b.probes)
+           return a.probes > b.probes;
+         return a.key < b.key;
+       });
+  return stats;
+}
+
+bool writeSignatureProfile(const string &path,
+                           const vector<SignatureStat> &stats) {
+  ofstream out(path);
+  out << "# fta signature profile v1\n# hits\tprobes\trule\n";
+  for (const auto &s : stats)
+    out << s.hits << "\t" << s.probes << "\t" << s.key << "\n";
+  return static_cast<bool>(out);
+}
+
+bool loadSignatureProfile(const string &path) {
+  ifstream in(path);
+  if (!in)
+    return false;
+  string line;
+  while (getline(in, line)) {
+    if (line.empty() || line[0] == '#')
+      continue;
+    size_t tab1 = line.find('\t');
+    size_t tab2 = tab1 == string::npos ? tab1 : line.find('\t', tab1 + 1);
+    if (tab2 == string::npos)
+      continue;
+    signatureProfile[line.substr(tab2 + 1)] +=
+        strtoull(line.c_str(), nullptr, 10);
+  }
+  return true;
+}
+
+// ============================================================================
+// File Info Structure
+// ============================================================================
+struct FileInfo {
+  string path;
+  string name;
+  string type;
+  string category;
+  string description;
+  uintmax_t size = 0;
+  bool isCorrupt;
+  bool extensionMismatch;
+  string detectedExtension;
+  string actualExtension;
+  double analysisTime;
+  double entropy;
+  string hash;
+  uint64_t fingerprint = 0; // Size + first-block hash, 0 if nothing was read
+  uint32_t uid = 0;
+  uint32_t gid = 0;
+  int64_t modifiedTime = 0; // Seconds since the Unix epoch
+  int64_t accessedTime = 0;
+  bool metadataKnown = true; // False if size/owner/times could not be read
+  string charset; // "us-ascii", "utf-8" or "binary" for text-like results
+  string mimeType; // Set when the matching rule carried a !:mime annotation
+  string refinedBy; // Name of the plugin that last refined the result
+  double compressionRatio = 0.0; // Sampled LZ ratio, 0 if not measured
+  uintmax_t compressionSampled = 0; // Bytes the ratio was measured on
+  string predictedCategory; // Fallback model's guess for Unknown files
+  float predictionConfidence = 0.0f;
+};
+
+// ============================================================================
+// File Metadata (one statx per file)
+// ============================================================================
+// Kind, size, ownership and timestamps come from a single metadata call with
+// only the fields we use requested, replacing separate fs::status and
+// fs::file_size lookups. Symlinks are followed, as with fs::status.
+enum class IoKind { Missing, File, Directory, Other };
+
+#ifndef _WIN32
+IoKind metadataKind(mode_t mode) {
+  return S_ISREG(mode)   ? IoKind::File
+         : S_ISDIR(mode) ? IoKind::Directory
+                         : IoKind::Other;
+}
+#endif
+
+// Size, owner and times are filled (and metadataKnown set) for files only
+IoKind readFileMetadata(const fs::path &filePath, FileInfo &info) {
+  info.metadataKnown = false;
+#if defined(__linux__) && defined(STATX_SIZE)
+  struct statx stx;
+  const unsigned int mask = STATX_TYPE | STATX_SIZE | STATX_UID | STATX_GID |
+                            STATX_MTIME | STATX_ATIME;
+  if (statx(AT_FDCWD, filePath.c_str(), AT_STATX_SYNC_AS_STAT, mask, &stx) ==
+      0) {
+    IoKind kind = metadataKind(stx.stx_mode);
+    if (kind != IoKind::File)
+      return kind;
+    info.size = (stx.stx_mask & STATX_SIZE) ? stx.stx_size : 0;
+    info.uid = stx.stx_uid;
+    info.gid = stx.stx_gid;
+    info.modifiedTime = stx.stx_mtime.tv_sec;
+    info.accessedTime = stx.stx_atime.tv_sec;
+    info.metadataKnown = true;
+    return kind;
+  }
+  if (errno != ENOSYS)
+    return IoKind::Missing;
+  // Kernel without statx: fall through to stat()
+#endif
+#ifndef _WIN32
+  struct stat st;
+  if (stat(filePath.c_str(), &st) != 0)
+    return IoKind::Missing;
+  IoKind kind = metadataKind(st.st_mode);
+  if (kind != IoKind::File)
+    return kind;
+  info.size = static_cast<uintmax_t>(st.st_size);
+  info.uid = st.st_uid;
+  info.gid = st.st_gid;
+  info.modifiedTime = st.st_mtime;
+  info.accessedTime = st.st_atime;
+  info.metadataKnown = true;
+  return kind;
+#else
+  error_code ec;
+  fs::file_status status = fs::status(filePath, ec);
+  if (ec || !fs::exists(status))
+    return IoKind::Missing;
+  if (fs::is_directory(status))
+    return IoKind::Directory;
+  if (!fs::is_regular_file(status))
+    return IoKind::Other;
+  info.size = fs::file_size(filePath, ec);
+  if (ec) {
+    info.size = 0;
+    return IoKind::File;
+  }
+  auto writeTime = fs::last_write_time(filePath, ec);
+  if (!ec) {
+    info.modifiedTime = duration_cast<seconds>(
+                            writeTime.time_since_epoch() -
+                            fs::file_time_type::clock::now().time_since_epoch() +
+                            system_clock::now().time_since_epoch())
+                            .count();
+    info.accessedTime = info.modifiedTime;
+    info.metadataKnown = true;
+  }
+  return IoKind::File;
+#endif
+}
+
+// ============================================================================
+// Utility Functions
+// ============================================================================
+string bytesToHex(const vector<unsigned char> &bytes) {
+  stringstream ss;
+  ss << hex << uppercase;
+  for (unsigned char byte : bytes) {
+    ss << setw(2) << setfill('0') << static_cast<int>(byte);
+  }
+  return ss.str();
+}
+
+string formatSize(uintmax_t bytes) {
+  const char *units[] = {"B", "KB", "MB", "GB", "TB"};
+  int unitIndex = 0;
+  double size = static_cast<double>(bytes);
+
+  while (size >= 1024 && unitIndex < 4) {
+    size /= 1024;
+    unitIndex++;
+  }
+
+  stringstream ss;
+  ss << fixed << setprecision(2) << size << " " << units[unitIndex];
+  return ss.str();
+}
+
+string toLowercase(const string &str) {
+  string result = str;
+  transform(result.begin(), result.end(), result.begin(), ::tolower);
+  return result;
+}
+
+// Cleared by the file(1) compatibility mode, which names files explicitly
+// and must accept paths such as ../x
+bool rejectParentPaths = true;
+
+bool validatePath(const fs::path &path) {
+  if (!rejectParentPaths)
+    return true;
+  string pathStr = path.string();
+  if (pathStr.find("..") != string::npos) {
+    return false; // Prevent directory traversal
+  }
+  return true;
+}
+
+// ============================================================================
+// Entropy Calculation
+// ============================================================================
+using ByteHistogram = array<uint32_t, 256>;
+
+// Four interleaved sub-histograms keep runs of one byte value from
+// serializing on the same counter, then get summed
+void byteHistogram(const unsigned char *data, size_t length,
+                   ByteHistogram &freq) {
+  array<array<uint32_t, 256>, 4> partial{};
+  size_t i = 0;
+  for (; i + 4 <= length; i += 4) {
+    partial[0][data[i]]++;
+    partial[1][data[i + 1]]++;
+    partial[2][data[i + 2]]++;
+    partial[3][data[i + 3]]++;
+  }
+  for (; i < length; i++)
+    partial[0][data[i]]++;
+  for (size_t b = 0; b < 256; b++)
+    freq[b] = partial[0][b] + partial[1][b] + partial[2][b] + partial[3][b];
+}
+
+// Shannon entropy in bits per byte of a histogram over `length` bytes
+double calculateEntropy(const ByteHistogram &freq, size_t length) {
+  if (length == 0)
+    return 0.0;
+
+  double entropy = 0.0;
+  double len = static_cast<double>(length);
+
+  for (int i = 0; i < 256; i++) {
+    if (freq[i] > 0) {
+      double p = freq[i] / len;
+      entropy -= p * log2(p);
+    }
+  }
+
+  return entropy;
+}
+
+// ============================================================================
+// Text Detection
+// ============================================================================
+// Mirrors libmagic's notion of text: printable ASCII plus common control
+// characters, or well-formed UTF-8. A multi-byte sequence cut off by the end
+// of the read buffer is still accepted.
+string detectCharset(const unsigned char *bytes, size_t length) {
+  bool ascii = true;
+  size_t i = 0;
+  while (i < length) {
+    unsigned char c = bytes[i];
+    if (c < 0x80) {
+      bool textControl = (c >= 7 && c <= 13) || c == 27;
+      if (c < 32 && !textControl)
+        return "binary";
+      if (c == 127)
+        return "binary";
+      i++;
+      continue;
+    }
+    ascii = false;
+    size_t seqLength = (c & 0xE0) == 0xC0   ? 2
+                       : (c & 0xF0) == 0xE0 ? 3
+                       : (c & 0xF8) == 0xF0 ? 4
+                                            : 0;
+    if (seqLength == 0 || (seqLength == 2 && c < 0xC2))
+      return "binary";
+    for (size_t k = 1; k < seqLength; k++) {
+      if (i + k >= length)
+        return "utf-8"; // Truncated by the read size
+      if ((bytes[i + k] & 0xC0) != 0x80)
+        return "binary";
+    }
+    i += seqLength;
+  }
+  return ascii ? "us-ascii" : "utf-8";
+}
+
+// ============================================================================
+// Statistical Fallback Classifier (--model)
+// ============================================================================
+// Softmax regression over cheap content features, used only when neither a
+// signature nor the extension identified a file. Features, all from the
+// bytes already read:
+//   [0, 256)      sqrt of byte frequencies (the entropy histogram)
+//   [256, 1280)   sqrt of hashed byte-bigram frequencies
+//   [1280, 1285)  entropy / 8, printable, NUL, high-bit and newline rates
+// The model file is produced by tools/train_classifier.cpp.
+const size_t MODEL_BIGRAM_BUCKETS = 1024;
+const size_t MODEL_SCALAR_FEATURES = 5;
+const size_t MODEL_FEATURES = 256 + MODEL_BIGRAM_BUCKETS + MODEL_SCALAR_FEATURES;
+
+using ModelFeatures = array<float, MODEL_FEATURES>;
+
+void extractFeatures(const unsigned char *data, size_t length,
+                     const ByteHistogram &histogram, double entropy,
+                     ModelFeatures &features) {
+  features.fill(0.0f);
+  if (length == 0)
+    return;
+  float scale = 1.0f / static_cast<float>(length);
+  for (size_t b = 0; b < 256; b++)
+    features[b] = sqrt(static_cast<float>(histogram[b]) * scale);
+
+  array<uint32_t, MODEL_BIGRAM_BUCKETS> bigrams{};
+  for (size_t i = 0; i + 1 < length; i++) {
+    uint32_t pair = (static_cast<uint32_t>(data[i]) << 8) | data[i + 1];
+    bigrams[(pair * 2654435761u) >> 22]++;
+  }
+  float pairScale = length > 1 ? 1.0f / static_cast<float>(length - 1) : 0;
+  for (size_t k = 0; k < MODEL_BIGRAM_BUCKETS; k++)
+    features[256 + k] = sqrt(static_cast<float>(bigrams[k]) * pairScale);
+
+  uint32_t printable = 0, high = 0;
+  for (size_t b = 32; b < 127; b++)
+    printable += histogram[b];
+  printable += histogram['\t'] + histogram['\n'] + histogram['\r'];
+  for (size_t b = 128; b < 256; b++)
+    high += histogram[b];
+  float *scalars = features.data() + 256 + MODEL_BIGRAM_BUCKETS;
+  scalars[0] = static_cast<float>(entropy / 8.0);
+  scalars[1] = static_cast<float>(printable) * scale;
+  scalars[2] = static_cast<float>(histogram[0]) * scale;
+  scalars[3] = static_cast<float>(high) * scale;
+  scalars[4] = min(1.0f, static_cast<float>(histogram['\n']) * scale * 16);
+}
+
+class FallbackModel {
+public:
+  vector<string> classes;
+  // One row of MODEL_FEATURES weights plus a trailing bias per class
+  vector<float> weights;
+
+  bool loaded() const { return !classes.empty(); }
+
+  size_t rowSize() const { return MODEL_FEATURES + 1; }
+
+  // Class probabilities into `probs`; returns the most likely class
+  size_t predict(const ModelFeatures &features, vector<float> &probs) const {
+    probs.assign(classes.size(), 0.0f);
+    float best = -numeric_limits<float>::infinity();
+    for (size_t c = 0; c < classes.size(); c++) {
+      const float *w = weights.data() + c * rowSize();
+      float z = w[MODEL_FEATURES];
+      for (size_t f = 0; f < MODEL_FEATURES; f++)
+        z += w[f] * features[f];
+      probs[c] = z;
+      best = max(best, z);
+    }
+    float sum = 0.0f;
+    for (float &p : probs) {
+      p = exp(p - best);
+      sum += p;
+    }
+    size_t argmax = 0;
+    for (size_t c = 0; c < probs.size(); c++) {
+      probs[c] /= sum;
+      if (probs[c] > probs[argmax])
+        argmax = c;
+    }
+    return argmax;
+  }
+
+  bool save(const string &path) const {
+    ofstream out(path);
+    out << "fta-model 1 " << MODEL_FEATURES << " " << classes.size() << "\n";
+    out << setprecision(7);
+    for (size_t c = 0; c < classes.size(); c++) {
+      out << classes[c];
+      for (size_t f = 0; f < rowSize(); f++)
+        out << " " << weights[c * rowSize() + f];
+      out << "\n";
+    }
+    return static_cast<bool>(out);
+  }
+
+  bool load(const string &path, string &error) {
+    ifstream in(path);
+    string magic;
+    int version = 0;
+    size_t featureCount = 0, classCount = 0;
+    if (!(in >> magic >> version >> featureCount >> classCount) ||
+        magic != "fta-model" || version != 1) {
+      error = "not an fta-model v1 file";
+      return false;
+    }
+    if (featureCount != MODEL_FEATURES) {
+      error = "model has " + to_string(featureCount) + " features, expected " +
+              to_string(MODEL_FEATURES);
+      return false;
+    }
+    vector<string> names(classCount);
+    vector<float> w(classCount * rowSize());
+    for (size_t c = 0; c < classCount; c++) {
+      if (!(in >> names[c])) {
+        error = "truncated model";
+        return false;
+      }
+      for (size_t f = 0; f < rowSize(); f++) {
+        if (!(in >> w[c * rowSize() + f])) {
+          error = "truncated model";
+          return false;
+        }
+      }
+    }
+    classes = std::move(names);
+    weights = std::move(w);
+    return true;
+  }
+};
+
+FallbackModel fallbackModel;
+float fallbackMinConfidence = 0.5f; // Below this, no prediction is reported
+
+// ============================================================================
+// Content Fingerprints and Distinct-Count Sketches
+// ============================================================================
+// MurmurHash64A: fast, well-distributed, and good enough for sketching (not
+// a cryptographic hash).
+uint64_t hash64(const unsigned char *data, size_t len, uint64_t seed) {
+  const uint64_t m = 0xc6a4a7935bd1e995ULL;
+  const int r = 47;
+  uint64_t h = seed ^ (len * m);
+
+  size_t blocks = len / 8;
+  for (size_t i = 0; i < blocks; i++) {
+    uint64_t k;
+    memcpy(&k, data + i * 8, sizeof(k));
+    k *= m;
+    k ^= k >> r;
+    k *= m;
+    h ^= k;
+    h *= m;
+  }
+
+  const unsigned char *tail = data + blocks * 8;
+  switch (len & 7) {
+  case 7:
+    h ^= static_cast<uint64_t>(tail[6]) << 48;
+    [[fallthrough]];
+  case 6:
+    h ^= static_cast<uint64_t>(tail[5]) << 40;
+    [[fallthrough]];
+  case 5:
+    h ^= static_cast<uint64_t>(tail[4]) << 32;
+    [[fallthrough]];
+  case 4:
+    h ^= static_cast<uint64_t>(tail[3]) << 24;
+    [[fallthrough]];
+  case 3:
+    h ^= static_cast<uint64_t>(tail[2]) << 16;
+    [[fallthrough]];
+  case 2:
+    h ^= static_cast<uint64_t>(tail[1]) << 8;
+    [[fallthrough]];
+  case 1:
+    h ^= static_cast<uint64_t>(tail[0]);
+    h *= m;
+  }
+
+  h ^= h >> r;
+  h *= m;
+  h ^= h >> r;
+  return h;
+}
+
+inline int countLeadingZeros64(uint64_t x) {
+#ifdef _MSC_VER
+  unsigned long index;
+  return _BitScanReverse64(&index, x) ? 63 - static_cast<int>(index) : 64;
+#else
+  return x ? __builtin_clzll(x) : 64;
+#endif
+}
+
+// HyperLogLog with 2^12 one-byte registers (4 KB, ~1.6% standard error).
+// Sketches are mergeable, so each worker keeps its own and they are combined
+// once at the end of the scan.
+class HyperLogLog {
+public:
+  static constexpr int PRECISION = 12;
+  static constexpr size_t REGISTERS = size_t(1) << PRECISION;
+
+  HyperLogLog() : registers(REGISTERS, 0) {}
+
+  void add(uint64_t hash) {
+    size_t index = hash >> (64 - PRECISION);
+    uint64_t rest = (hash << PRECISION) | (uint64_t(1) << (PRECISION - 1));
+    uint8_t rank = static_cast<uint8_t>(countLeadingZeros64(rest) + 1);
+    if (rank > registers[index])
+      registers[index] = rank;
+  }
+
+  void merge(const HyperLogLog &other) {
+    for (size_t i = 0; i < REGISTERS; i++) {
+      registers[i] = max(registers[i], other.registers[i]);
+    }
+  }
+
+  double estimate() const {
+    const double m = static_cast<double>(REGISTERS);
+    const double alpha = 0.7213 / (1.0 + 1.079 / m);
+    double sum = 0.0;
+    size_t zeros = 0;
+    for (uint8_t reg : registers) {
+      sum += ldexp(1.0, -reg);
+      if (reg == 0)
+        zeros++;
+    }
+    double raw = alpha * m * m / sum;
+    // Small-range correction: linear counting is far more accurate here
+    if (raw <= 2.5 * m && zeros > 0)
+      return m * log(m / static_cast<double>(zeros));
+    return raw;
+  }
+
+  size_t memoryBytes() const { return registers.size(); }
+
+private:
+  vector<uint8_t> registers;
+};
+
+// SHA-256 (FIPS 180-4), for where a cryptographic digest is required, such
+// as signing object storage requests and content hashes (--hash)
+class Sha256 {
+public:
+  void update(const void *data, size_t length) {
+    const auto *p = static_cast<const unsigned char *>(data);
+    total += length;
+    while (length > 0) {
+      size_t n = min(length, block.size() - used);
+      memcpy(block.data() + used, p, n);
+      used += n;
+      p += n;
+      length -= n;
+      if (used == block.size()) {
+        compress();
+        used = 0;
+      }
+    }
+  }
+
+  void update(const string &data) { update(data.data(), data.size()); }
+
+  vector<unsigned char> finish() {
+    uint64_t bits = total * 8;
+    unsigned char pad = 0x80;
+    update(&pad, 1);
+    pad = 0;
+    while (used != 56)
+      update(&pad, 1);
+    for (int i = 7; i >= 0; i--) {
+      unsigned char b = static_cast<unsigned char>(bits >> (8 * i));
+      update(&b, 1);
+    }
+    vector<unsigned char> digest(32);
+    for (int i = 0; i < 32; i++)
+      digest[i] = static_cast<unsigned char>(state[i / 4] >> (24 - 8 * (i % 4)));
+    return digest;
+  }
+
+private:
+  static uint32_t rotr(uint32_t x, int n) { return (x >> n) | (x << (32 - n)); }
+
+  void compress() {
+    static const uint32_t k[64] = {
+        0x428a2f98, 0x71374491, 0xb5c0fbcf, 0xe9b5dba5, 0x3956c25b, 0x59f111f1,
+        0x923f82a4, 0xab1c5ed5, 0xd807aa98, 0x12835b01, 0x243185be, 0x550c7dc3,
+        0x72be5d74, 0x80deb1fe, 0x9bdc06a7, 0xc19bf174, 0xe49b69c1, 0xefbe4786,
+        0x0fc19dc6, 0x240ca1cc, 0x2de92c6f, 0x4a7484aa, 0x5cb0a9dc, 0x76f988da,
+        0x983e5152, 0xa831c66d, 0xb00327c8, 0xbf597fc7, 0xc6e00bf3, 0xd5a79147,
+        0x06ca6351, 0x14292967, 0x27b70a85, 0x2e1b2138, 0x4d2c6dfc, 0x53380d13,
+        0x650a7354, 0x766a0abb, 0x81c2c92e, 0x92722c85, 0xa2bfe8a1, 0xa81a664b,
+        0xc24b8b70, 0xc76c51a3, 0xd192e819, 0xd6990624, 0xf40e3585, 0x106aa070,
+        0x19a4c116, 0x1e376c08, 0x2748774c, 0x34b0bcb5, 0x391c0cb3, 0x4ed8aa4a,
+        0x5b9cca4f, 0x682e6ff3, 0x748f82ee, 0x78a5636f, 0x84c87814, 0x8cc70208,
+        0x90befffa, 0xa4506ceb, 0xbef9a3f7, 0xc67178f2};
+    uint32_t w[64];
+    for (int i = 0; i < 16; i++) {
+      w[i] = static_cast<uint32_t>(block[i * 4]) << 24 |
+             static_cast<uint32_t>(block[i * 4 + 1]) << 16 |
+             static_cast<uint32_t>(block[i * 4 + 2]) << 8 | block[i * 4 + 3];
+    }
+    for (int i = 16; i < 64; i++) {
+      uint32_t s0 = rotr(w[i - 15], 7) ^ rotr(w[i - 15], 18) ^ (w[i - 15] >> 3);
+      uint32_t s1 = rotr(w[i - 2], 17) ^ rotr(w[i - 2], 19) ^ (w[i - 2] >> 10);
+      w[i] = w[i - 16] + s0 + w[i - 7] + s1;
+    }
+    uint32_t a = state[0], b = state[1], c = state[2], d = state[3];
+    uint32_t e = state[4], f = state[5], g = state[6], h = state[7];
+    for (int i = 0; i < 64; i++) {
+      uint32_t s1 = rotr(e, 6) ^ rotr(e, 11) ^ rotr(e, 25);
+      uint32_t t1 = h + s1 + ((e & f) ^ (~e & g)) + k[i] + w[i];
+      uint32_t s0 = rotr(a, 2) ^ rotr(a, 13) ^ rotr(a, 22);
+      uint32_t t2 = s0 + ((a & b) ^ (a & c) ^ (b & c));
+      h = g;
+      g = f;
+      f = e;
+      e = d + t1;
+      d = c;
+      c = b;
+      b = a;
+      a = t1 + t2;
+    }
+    state[0] += a;
+    state[1] += b;
+    state[2] += c;
+    state[3] += d;
+    state[4] += e;
+    state[5] += f;
+    state[6] += g;
+    state[7] += h;
+  }
+
+  uint32_t state[8] = {0x6a09e667, 0xbb67ae85, 0x3c6ef372, 0xa54ff53a,
+                       0x510e527f, 0x9b05688c, 0x1f83d9ab, 0x5be0cd19};
+  array<unsigned char, 64> block{};
+  size_t used = 0;
+  uint64_t total = 0;
+};
+
+vector<unsigned char> sha256(const string &data) {
+  Sha256 h;
+  h.update(data);
+  return h.finish();
+}
+
+// HMAC-SHA256 (RFC 2104)
+vector<unsigned char> hmacSha256(const string &key, const string &message) {
+  string k = key;
+  if (k.size() > 64) {
+    vector<unsigned char> digest = sha256(key);
+    k.assign(digest.begin(), digest.end());
+  }
+  k.resize(64, '\0');
+  string inner(64, '\0'), outer(64, '\0');
+  for (size_t i = 0; i < 64; i++) {
+    inner[i] = static_cast<char>(k[i] ^ 0x36);
+    outer[i] = static_cast<char>(k[i] ^ 0x5c);
+  }
+  vector<unsigned char> innerHash = sha256(inner + message);
+  return sha256(outer + string(innerHash.begin(), innerHash.end()));
+}
+
+// ============================================================================
+// I/O Backends
+// ============================================================================
+// Traversal and analyzeFile reach the filesystem only through an IoBackend:
+// stat, readdir and open, with reads on the returned IoFile (closed when it
+// is destroyed). LocalIoBackend is the real filesystem; SimulatedIoBackend is
+// an in-memory tree with injected latency, used to benchmark scheduling
+// policies reproducibly without a slow network share.
+struct IoDirEntry {
+  string path;
+  IoKind kind = IoKind::Other;
+};
+
+class IoFile {
+public:
+  virtual ~IoFile() = default;
+  // Up to `length` bytes at `offset`; short at end of file, 0 on error
+  virtual size_t read(uint64_t offset, void *buffer, size_t length) = 0;
+};
+
+class IoBackend {
+public:
+  virtual ~IoBackend() = default;
+  // Kind of `path`; for files also size, ownership and timestamps
+  virtual IoKind stat(const string &path, FileInfo &info) = 0;
+  // Entries of a directory in listing order; false if it cannot be listed
+  virtual bool readdir(const string &path, vector<IoDirEntry> &entries) = 0;
+  // nullptr if the file cannot be opened
+  virtual unique_ptr<IoFile> open(const string &path) = 0;
+  // Leading bytes analyzeFile classifies; remote backends may ask for fewer
+  virtual size_t headBytes() const { return 65536; }
+};
+
+class LocalIoFile : public IoFile {
+public:
+#ifndef _WIN32
+  explicit LocalIoFile(int fd) : fd(fd) {}
+  ~LocalIoFile() override { ::close(fd); }
+
+  size_t read(uint64_t offset, void *buffer, size_t length) override {
+    size_t done = 0;
+    while (done < length) {
+      ssize_t got = pread(fd, static_cast<char *>(buffer) + done,
+                          length - done, static_cast<off_t>(offset + done));
+      if (got < 0 && errno == EINTR)
+        continue;
+      if (got <= 0)
+        break;
+      done += static_cast<size_t>(got);
+    }
+    return done;
+  }
+
+private:
+  int fd;
+#else
+  explicit LocalIoFile(ifstream stream) : in(std::move(stream)) {}
+
+  size_t read(uint64_t offset, void *buffer, size_t length) override {
+    in.clear();
+    in.seekg(static_cast<streamoff>(offset));
+    in.read(static_cast<char *>(buffer), static_cast<streamsize>(length));
+    return static_cast<size_t>(max<streamsize>(0, in.gcount()));
+  }
+
+private:
+  ifstream in;
+#endif
+};
+
+class LocalIoBackend : public IoBackend {
+public:
+  IoKind stat(const string &path, FileInfo &info) override {
+    return readFileMetadata(path, info);
+  }
+
+  // Symlinks to directories are not descended, as with
+  // recursive_directory_iterator; symlinks to files count as files
+  bool readdir(const string &path, vector<IoDirEntry> &entries) override {
+    error_code ec;
+    fs::directory_iterator it(path, ec), end;
+    if (ec)
+      return false;
+    for (; it != end; it.increment(ec)) {
+      if (ec)
+        return false;
+      IoDirEntry entry{it->path().string(), IoKind::Other};
+      if (it->is_directory(ec) && !it->is_symlink(ec))
+        entry.kind = IoKind::Directory;
+      else if (it->is_regular_file(ec))
+        entry.kind = IoKind::File;
+      entries.push_back(std::move(entry));
+    }
+    return !ec;
+  }
+
+  unique_ptr<IoFile> open(const string &path) override {
+#ifndef _WIN32
+    int fd = ::open(path.c_str(), O_RDONLY | O_CLOEXEC);
+    if (fd < 0)
+      return nullptr;
+    return make_unique<LocalIoFile>(fd);
+#else
+    ifstream in(path, ios::binary);
+    if (!in)
+      return nullptr;
+    return make_unique<LocalIoFile>(std::move(in));
+#endif
+  }
+};
+
+LocalIoBackend localIoBackend;
+IoBackend *ioBackend = &localIoBackend;
+
+// Calls `onFile` for every regular file under `root` (or `root` itself if it
+// is a file), depth first in listing order. Throws fs::filesystem_error when
+// `root` is missing or a directory cannot be listed, like
+// recursive_directory_iterator.
+void walkFiles(IoBackend &io, const string &root, bool recursive,
+               const function<void(const string &)> &onFile) {
+  FileInfo ignored;
+  IoKind kind = io.stat(root, ignored);
+  if (kind == IoKind::File) {
+    onFile(root);
+    return;
+  }
+  if (kind == IoKind::Other) // Devices, sockets and the like hold no files
+    return;
+  vector<IoDirEntry> entries;
+  if (kind != IoKind::Directory || !io.readdir(root, entries))
+    throw fs::filesystem_error("cannot list directory", root,
+                               make_error_code(errc::io_error));
+  for (const auto &entry : entries) {
+    if (entry.kind == IoKind::File)
+      onFile(entry.path);
+    else if (entry.kind == IoKind::Directory && recursive)
+      walkFiles(io, entry.path, recursive, onFile);
+  }
+}
+
+// Per-operation delay in microseconds
+struct LatencyModel {
+  enum Kind { Fixed, Uniform, LogNormal, Exponential };
+  Kind kind = Fixed;
+  double a = 0.0; // Fixed: delay; Uniform: low; LogNormal: median; Exp: mean
+  double b = 0.0; // Uniform: high; LogNormal: sigma
+
+  double sample(mt19937_64 &rng) const {
+    switch (kind) {
+    case Uniform:
+      return uniform_real_distribution<double>(a, max(a, b))(rng);
+    case LogNormal:
+      return lognormal_distribution<double>(log(max(a, 1e-3)), b)(rng);
+    case Exponential:
+      return a > 0 ? exponential_distribution<double>(1.0 / a)(rng) : 0.0;
+    default:
+      return a;
+    }
+  }
+};
+
+struct SimulatedIoConfig {
+  LatencyModel stat, readdir, open, read; // read: per call, before transfer
+  double bandwidth = 0.0; // Bytes/second shared by all reads, 0 = unlimited
+  uint64_t seed = 1;
+};
+
+// "op=kind:a[:b],...,bandwidth=N[K|M|G],seed=N" with op one of stat,
+// readdir, open, read and kind one of fixed, uniform, lognormal, exp.
+// Latencies are in microseconds, bandwidth in bytes per second.
+bool parseSimulatedIoSpec(const string &spec, SimulatedIoConfig &config,
+                          string &error) {
+  istringstream items(spec);
+  for (string item; getline(items, item, ',');) {
+    size_t eq = item.find('=');
+    if (eq == string::npos) {
+      error = "expected key=value in '" + item + "'";
+      return false;
+    }
+    string key = item.substr(0, eq), value = item.substr(eq + 1);
+    if (key == "bandwidth") {
+      char *end = nullptr;
+      double v = strtod(value.c_str(), &end);
+      string unit = toLowercase(end);
+      if (unit == "k")
+        v *= 1024;
+      else if (unit == "m")
+        v *= 1024 * 1024;
+      else if (unit == "g")
+        v *= 1024.0 * 1024 * 1024;
+      config.bandwidth = v;
+      continue;
+    }
+    if (key == "seed") {
+      config.seed = strtoull(value.c_str(), nullptr, 10);
+      continue;
+    }
+    LatencyModel *model = key == "stat"      ? &config.stat
+                          : key == "readdir" ? &config.readdir
+                          : key == "open"    ? &config.open
+                          : key == "read"    ? &config.read
+                                             : nullptr;
+    if (!model) {
+      error = "unknown key '" + key + "'";
+      return false;
+    }
+    vector<string> parts;
+    istringstream fields(value);
+    for (string part; getline(fields, part, ':');)
+      parts.push_back(part);
+    if (parts.size() < 2) {
+      error = "expected kind:value for '" + key + "'";
+      return false;
+    }
+    const string &kind = parts[0];
+    model->kind = kind == "uniform"     ? LatencyModel::Uniform
+                  : kind == "lognormal" ? LatencyModel::LogNormal
+                  : kind == "exp"       ? LatencyModel::Exponential
+                                        : LatencyModel::Fixed;
+    if (kind != "fixed" && model->kind == LatencyModel::Fixed) {
+      error = "unknown latency kind '" + kind + "'";
+      return false;
+    }
+    model->a = atof(parts[1].c_str());
+    model->b = parts.size() > 2 ? atof(parts[2].c_str()) : 0.0;
+  }
+  return true;
+}
+
+// In-memory tree. File contents are a stored head followed by a body that is
+// either one repeated byte or seeded pseudo-random bytes, so large trees cost
+// little memory. Every delay is drawn from a generator seeded by the
+// operation, path and offset, so a given request always waits the same time
+// regardless of thread interleaving; bandwidth is a single shared link.
+class SimulatedIoBackend : public IoBackend {
+public:
+  struct Stats {
+    atomic<uint64_t> stats{0}, readdirs{0}, opens{0}, reads{0};
+    atomic<uint64_t> bytesRead{0};
+    atomic<uint64_t> delayMicros{0}; // Injected latency plus transfer time
+  };
+
+  explicit SimulatedIoBackend(SimulatedIoConfig config = {})
+      : config(config) {
+    directories["/"];
+  }
+
+  // Adds a file (and any missing parent directories); paths are absolute
+  void addFile(const string &path, uintmax_t size, int64_t modifiedTime,
+               vector<unsigned char> head, uint64_t bodySeed = 0,
+               unsigned char bodyFill = 0) {
+    SimFile &file = files[path];
+    file.size = size;
+    file.modifiedTime = modifiedTime;
+    file.head = std::move(head);
+    file.bodySeed = bodySeed;
+    file.bodyFill = bodyFill;
+    string child = path;
+    while (child != "/" && linked.insert(child).second) {
+      size_t slash = child.find_last_of('/');
+      string parent = slash == 0 ? "/" : child.substr(0, slash);
+      directories[parent].push_back(child);
+      child = parent;
+    }
+  }
+
+  const Stats &stats() const { return counters; }
+
+  IoKind stat(const string &path, FileInfo &info) override {
+    counters.stats++;
+    delay(config.stat, 1, path, 0);
+    auto it = files.find(path);
+    if (it != files.end()) {
+      info.size = it->second.size;
+      info.modifiedTime = it->second.modifiedTime;
+      info.accessedTime = it->second.modifiedTime;
+      return IoKind::File;
+    }
+    return directories.count(path) ? IoKind::Directory : IoKind::Missing;
+  }
+
+  bool readdir(const string &path, vector<IoDirEntry> &entries) override {
+    counters.readdirs++;
+    delay(config.readdir, 2, path, 0);
+    auto it = directories.find(path);
+    if (it == directories.end())
+      return false;
+    for (const auto &child : it->second) {
+      entries.push_back(
+          {child, files.count(child) ? IoKind::File : IoKind::Directory});
+    }
+    return true;
+  }
+
+  unique_ptr<IoFile> open(const string &path) override {
+    counters.opens++;
+    delay(config.open, 3, path, 0);
+    auto it = files.find(path);
+    if (it == files.end())
+      return nullptr;
+    return make_unique<SimulatedIoFile>(*this, path, it->second);
+  }
+
+private:
+  struct SimFile {
+    uintmax_t size = 0;
+    int64_t modifiedTime = 0;
+    vector<unsigned char> head;
+    uint64_t bodySeed = 0;
+    unsigned char bodyFill = 0;
+  };
+
+  class SimulatedIoFile : public IoFile {
+  public:
+    SimulatedIoFile(SimulatedIoBackend &owner, const string &path,
+                    const SimFile &file)
+        : owner(owner), path(path), file(file) {}
+
+    size_t read(uint64_t offset, void *buffer, size_t length) override {
+      owner.counters.reads++;
+      owner.delay(owner.config.read, 4, path, offset);
+      if (offset >= file.size)
+        return 0;
+      size_t n = static_cast<size_t>(min<uint64_t>(length, file.size - offset));
+      auto *out = static_cast<unsigned char *>(buffer);
+      for (size_t i = 0; i < n; i++) {
+        uint64_t pos = offset + i;
+        if (pos < file.head.size())
+          out[i] = file.head[pos];
+        else if (file.bodySeed == 0)
+          out[i] = file.bodyFill;
+        else
+          out[i] = static_cast<unsigned char>(
+              splitmix64(file.bodySeed + pos / 8) >> (8 * (pos % 8)));
+      }
+      owner.transfer(n);
+      owner.counters.bytesRead += n;
+      return n;
+    }
+
+  private:
+    SimulatedIoBackend &owner;
+    string path;
+    const SimFile &file;
+  };
+
+  static uint64_t splitmix64(uint64_t x) {
+    x += 0x9E3779B97F4A7C15ULL;
+    x = (x ^ (x >> 30)) * 0xBF58476D1CE4E5B9ULL;
+    x = (x ^ (x >> 27)) * 0x94D049BB133111EBULL;
+    return x ^ (x >> 31);
+  }
+
+  void delay(const LatencyModel &model, uint64_t op, const string &path,
+             uint64_t offset) {
+    if (model.kind == LatencyModel::Fixed && model.a <= 0)
+      return;
+    const auto *name = reinterpret_cast<const unsigned char *>(path.data());
+    mt19937_64 rng(splitmix64(config.seed ^ (op << 56) ^
+                              hash64(name, path.size(), offset)));
+    double micros = max(0.0, model.sample(rng));
+    counters.delayMicros += static_cast<uint64_t>(micros);
+    this_thread::sleep_for(duration<double, micro>(micros));
+  }
+
+  // Reserves the shared link for `bytes` and waits for the transfer to end
+  void transfer(size_t bytes) {
+    if (config.bandwidth <= 0 || bytes == 0)
+      return;
+    auto length = duration_cast<steady_clock::duration>(
+        duration<double>(static_cast<double>(bytes) / config.bandwidth));
+    steady_clock::time_point done;
+    {
+      lock_guard<mutex> lock(linkMutex);
+      linkFree = max(linkFree, steady_clock::now()) + length;
+      done = linkFree;
+    }
+    counters.delayMicros += static_cast<uint64_t>(
+        duration_cast<microseconds>(length).count());
+    this_thread::sleep_until(done);
+  }
+
+  SimulatedIoConfig config;
+  map<string, SimFile> files;
+  map<string, vector<string>> directories;
+  set<string> linked; // Paths already listed in their parent
+  Stats counters;
+  mutex linkMutex;
+  steady_clock::time_point linkFree{};
+};
+
+// ============================================================================
+// Object Storage (s3://bucket/prefix)
+// ============================================================================
+// An IoBackend over the S3 REST API (path-style, plain HTTP/1.1; put a TLS
+// proxy in front of https endpoints). Listings carry size and mtime, so
+// objects are never stat'ed one by one, and only headBytes() from the start
+// of each object is fetched with a ranged GET: everything the signature
+// tables can reach, plus a small sample for entropy and text detection.
+// A worker that misses fetches the heads of the next listed objects in the
+// same pipelined batch on a pooled keep-alive connection, so most opens are
+// served from memory without a round trip.
+struct S3Config {
+  string host = "127.0.0.1"; // As sent in Host (and signed)
+  string port = "80";
+  string region = "us-east-1";
+  string accessKey, secretKey, sessionToken; // Anonymous when empty
+  size_t headBytes = 4096;       // Floor; raised to the matcher's reach
+  size_t pipelineDepth = 16;     // Requests in flight per connection
+  size_t maxIdleConnections = 16;
+  size_t prefetchBudget = 64u << 20; // Bytes of unclaimed heads held
+};
+
+// "http://host[:port]"; https needs a TLS-terminating proxy
+bool parseS3Endpoint(const string &url, S3Config &config, string &error) {
+  string rest = url;
+  if (rest.rfind("https://", 0) == 0) {
+    error = "https endpoints are not supported; use a local TLS proxy";
+    return false;
+  }
+  if (rest.rfind("http://", 0) == 0)
+    rest = rest.substr(7);
+  rest = rest.substr(0, rest.find('/'));
+  if (rest.empty()) {
+    error = "missing host in '" + url + "'";
+    return false;
+  }
+  config.host = rest;
+  size_t colon = rest.rfind(':');
+  config.port = colon == string::npos ? "80" : rest.substr(colon + 1);
+  return true;
+}
+
+// Endpoint, region and credentials from the usual AWS environment variables
+S3Config s3ConfigFromEnvironment() {
+  S3Config config;
+  auto env = [](const char *name) {
+    const char *v = getenv(name);
+    return string(v ? v : "");
+  };
+  string error;
+  string endpoint = env("FTA_S3_ENDPOINT");
+  if (endpoint.empty())
+    endpoint = env("AWS_ENDPOINT_URL");
+  if (!endpoint.empty())
+    parseS3Endpoint(endpoint, config, error);
+  if (!env("AWS_REGION").empty())
+    config.region = env("AWS_REGION");
+  else if (!env("AWS_DEFAULT_REGION").empty())
+    config.region = env("AWS_DEFAULT_REGION");
+  config.accessKey = env("AWS_ACCESS_KEY_ID");
+  config.secretKey = env("AWS_SECRET_ACCESS_KEY");
+  config.sessionToken = env("AWS_SESSION_TOKEN");
+  return config;
+}
+
+// RFC 3986 percent-encoding as SigV4 canonicalizes it
+string uriEncode(const string &text, bool keepSlash) {
+  static const char *digits = "0123456789ABCDEF";
+  string out;
+  for (unsigned char c : text) {
+    if (isalnum(c) || c == '-' || c == '_' || c == '.' || c == '~' ||
+        (keepSlash && c == '/')) {
+      out += static_cast<char>(c);
+    } else {
+      out += '%';
+      out += digits[c >> 4];
+      out += digits[c & 15];
+    }
+  }
+  return out;
+}
+
+struct HttpRequest {
+  string method = "GET";
+  string path;  // Already percent-encoded
+  string query; // Canonical: sorted and encoded, without the '?'
+  vector<pair<string, string>> headers; // Lowercase names
+};
+
+struct HttpResponse {
+  int status = 0;
+  map<string, string> headers; // Lowercase names
+  string body;
+};
+
+// Adds the x-amz-* headers and, with credentials, an AWS Signature V4
+// Authorization header. Every header present is signed, plus Host.
+void signRequestV4(HttpRequest &request, const S3Config &config,
+                   const string &amzDate) {
+  const string payloadHash = toLowercase(bytesToHex(sha256("")));
+  request.headers.push_back({"x-amz-content-sha256", payloadHash});
+  request.headers.push_back({"x-amz-date", amzDate});
+  if (!config.sessionToken.empty())
+    request.headers.push_back({"x-amz-security-token", config.sessionToken});
+  if (config.accessKey.empty())
+    return;
+
+  vector<pair<string, string>> headers = request.headers;
+  headers.push_back({"host", config.host});
+  sort(headers.begin(), headers.end());
+  string canonicalHeaders, signedHeaders;
+  for (const auto &[name, value] : headers) {
+    canonicalHeaders += name + ":" + value + "\n";
+    signedHeaders += (signedHeaders.empty() ? "" : ";") + name;
+  }
+  string canonical = request.method + "\n" + request.path + "\n" +
+                     request.query + "\n" + canonicalHeaders + "\n" +
+                     signedHeaders + "\n" + payloadHash;
+  string date = amzDate.substr(0, 8);
+  string scope = date + "/" + config.region + "/s3/aws4_request";
+  string toSign = "AWS4-HMAC-SHA256\n" + amzDate + "\n" + scope + "\n" +
+                  toLowercase(bytesToHex(sha256(canonical)));
+
+  auto asString = [](const vector<unsigned char> &v) {
+    return string(v.begin(), v.end());
+  };
+  string key = asString(hmacSha256("AWS4" + config.secretKey, date));
+  key = asString(hmacSha256(key, config.region));
+  key = asString(hmacSha256(key, "s3"));
+  key = asString(hmacSha256(key, "aws4_request"));
+  request.headers.push_back(
+      {"authorization", "AWS4-HMAC-SHA256 Credential=" + config.accessKey +
+                            "/" + scope + ", SignedHeaders=" + signedHeaders +
+                            ", Signature=" +
+                            toLowercase(bytesToHex(hmacSha256(key, toSign)))});
+}
+
+string amzTimestamp() {
+  time_t now = system_clock::to_time_t(system_clock::now());
+  tm utc{};
+#ifdef _WIN32
+  gmtime_s(&utc, &now);
+#else
+  gmtime_r(&now, &utc);
+#endif
+  char buf[32];
+  strftime(buf, sizeof(buf), "%Y%m%dT%H%M%SZ", &utc);
+  return buf;
+}
+
+// Seconds since the epoch for a UTC civil time (days_from_civil)
+int64_t utcSeconds(int year, int month, int day, int hour, int minute,
+                   int second) {
+  year -= month <= 2;
+  int64_t era = (year >= 0 ? year : year - 399) / 400;
+  int64_t yoe = year - era * 400;
+  int64_t doy = (153 * (month + (month > 2 ? -3 : 9)) + 2) / 5 + day - 1;
+  int64_t doe = yoe * 365 + yoe / 4 - yoe / 100 + doy;
+  int64_t days = era * 146097 + doe - 719468;
+  return days * 86400 + hour * 3600 + minute * 60 + second;
+}
+
+// ISO 8601 from listings ("2024-01-31T12:00:00.000Z") or an HTTP date from
+// HEAD ("Wed, 31 Jan 2024 12:00:00 GMT"); 0 if neither
+int64_t parseObjectTime(const string &text) {
+  int y, mo, d, h, mi, s;
+  if (sscanf(text.c_str(), "%d-%d-%dT%d:%d:%d", &y, &mo, &d, &h, &mi, &s) ==
+      6)
+    return utcSeconds(y, mo, d, h, mi, s);
+  char month[4] = {};
+  if (sscanf(text.c_str(), "%*3s, %d %3s %d %d:%d:%d", &d, month, &y, &h, &mi,
+             &s) == 6) {
+    static const string months = "JanFebMarAprMayJunJulAugSepOctNovDec";
+    size_t at = months.find(month);
+    if (at != string::npos && at % 3 == 0)
+      return utcSeconds(y, static_cast<int>(at / 3) + 1, d, h, mi, s);
+  }
+  return 0;
+}
+
+// Text of the first <tag>...</tag> at or after `from`, entities decoded
+string xmlText(const string &xml, const string &tag, size_t from = 0) {
+  size_t start = xml.find("<" + tag + ">", from);
+  if (start == string::npos)
+    return "";
+  start += tag.size() + 2;
+  size_t end = xml.find("</" + tag + ">", start);
+  string raw = xml.substr(start, end == string::npos ? 0 : end - start);
+  static const pair<const char *, char> entities[] = {
+      {"&amp;", '&'}, {"&lt;", '<'}, {"&gt;", '>'}, {"&quot;", '"'},
+      {"&apos;", '\''}};
+  string text;
+  for (size_t i = 0; i < raw.size(); i++) {
+    bool decoded = false;
+    for (const auto &[entity, c] : entities) {
+      size_t n = strlen(entity);
+      if (raw.compare(i, n, entity) == 0) {
+        text += c;
+        i += n - 1;
+        decoded = true;
+        break;
+      }
+    }
+    if (!decoded)
+      text += raw[i];
+  }
+  return text;
+}
+
+// One keep-alive HTTP/1.1 connection. exchange() writes a whole batch of
+// requests before reading any response, so a batch costs one round trip.
+class HttpConnection {
+public:
+  ~HttpConnection() {
+#ifndef _WIN32
+    if (fd >= 0)
+      ::close(fd);
+#endif
+  }
+
+  bool connect(const S3Config &config, string &error) {
+#ifdef _WIN32
+    (void)config;
+    error = "object storage is not supported on this platform";
+    return false;
+#else
+    string host = config.host.substr(0, config.host.rfind(':'));
+    addrinfo hints{}, *found = nullptr;
+    hints.ai_family = AF_UNSPEC;
+    hints.ai_socktype = SOCK_STREAM;
+    int rc = getaddrinfo(host.c_str(), config.port.c_str(), &hints, &found);
+    if (rc != 0) {
+      error = string("cannot resolve ") + host + ": " + gai_strerror(rc);
+      return false;
+    }
+    for (addrinfo *a = found; a && fd < 0; a = a->ai_next) {
+      fd = socket(a->ai_family, a->ai_socktype | SOCK_CLOEXEC, a->ai_protocol);
+      if (fd >= 0 && ::connect(fd, a->ai_addr, a->ai_addrlen) != 0) {
+        ::close(fd);
+        fd = -1;
+      }
+    }
+    freeaddrinfo(found);
+    if (fd < 0) {
+      error = "cannot connect to " + config.host + ": " + strerror(errno);
+      return false;
+    }
+    int one = 1;
+    setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+    timeval timeout{30, 0};
+    setsockopt(fd, SOL_SOCKET, SO_RCVTIMEO, &timeout, sizeof(timeout));
+    setsockopt(fd, SOL_SOCKET, SO_SNDTIMEO, &timeout, sizeof(timeout));
+    hostHeader = config.host;
+    alive = true;
+    return true;
+#endif
+  }
+
+  bool reusable() const { return alive; }
+
+  // Responses in request order; returns how many arrived complete. The
+  // connection stays reusable only if all did and the server kept it open.
+  size_t exchange(const vector<HttpRequest> &requests,
+                  vector<HttpResponse> &responses) {
+    string wire;
+    for (const auto &r : requests) {
+      wire += r.method + " " + r.path + (r.query.empty() ? "" : "?") +
+              r.query + " HTTP/1.1\r\nHost: " + hostHeader + "\r\n";
+      for (const auto &[name, value] : r.headers)
+        wire += name + ": " + value + "\r\n";
+      wire += "\r\n";
+    }
+    if (!sendAll(wire)) {
+      alive = false;
+      return 0;
+    }
+    size_t done = 0;
+    for (const auto &r : requests) {
+      HttpResponse response;
+      if (!readResponse(response, r.method == "HEAD")) {
+        alive = false;
+        break;
+      }
+      responses.push_back(std::move(response));
+      done++;
+      if (!alive) // Server said Connection: close
+        break;
+    }
+    return done;
+  }
+
+private:
+  bool sendAll(const string &data) {
+#ifndef _WIN32
+    size_t sent = 0;
+    while (sent < data.size()) {
+      ssize_t n = ::send(fd, data.data() + sent, data.size() - sent,
+                         MSG_NOSIGNAL);
+      if (n < 0 && errno == EINTR)
+        continue;
+      if (n <= 0)
+        return false;
+      sent += static_cast<size_t>(n);
+    }
+    return true;
+#else
+    (void)data;
+    return false;
+#endif
+  }
+
+  bool fill() {
+#ifndef _WIN32
+    if (pos > 0) {
+      buffer.erase(0, pos);
+      pos = 0;
+    }
+    char chunk[65536];
+    for (;;) {
+      ssize_t n = ::recv(fd, chunk, sizeof(chunk), 0);
+      if (n < 0 && errno == EINTR)
+        continue;
+      if (n <= 0)
+        return false;
+      buffer.append(chunk, static_cast<size_t>(n));
+      return true;
+    }
+#else
+    return false;
+#endif
+  }
+
+  bool readLine(string &line) {
+    size_t eol;
+    while ((eol = buffer.find("\r\n", pos)) == string::npos) {
+      if (!fill())
+        return false;
+    }
+    line = buffer.substr(pos, eol - pos);
+    pos = eol + 2;
+    return true;
+  }
+
+  bool readBytes(size_t n, string &out) {
+    while (buffer.size() - pos < n) {
+      if (!fill())
+        return false;
+    }
+    out.append(buffer, pos, n);
+    pos += n;
+    return true;
+  }
+
+  bool readResponse(HttpResponse &response, bool headOnly) {
+    string line;
+    if (!readLine(line) || line.rfind("HTTP/1.", 0) != 0)
+      return false;
+    response.status = atoi(line.c_str() + 9);
+    while (readLine(line) && !line.empty()) {
+      size_t colon = line.find(':');
+      if (colon == string::npos)
+        continue;
+      string value = line.substr(colon + 1);
+      value.erase(0, value.find_first_not_of(' '));
+      response.headers[toLowercase(line.substr(0, colon))] = value;
+    }
+    if (line.size() > 0)
+      return false;
+    if (toLowercase(response.headers["connection"]) == "close")
+      alive = false;
+    if (headOnly || response.status == 204 || response.status == 304)
+      return true;
+    if (toLowercase(response.headers["transfer-encoding"]) == "chunked") {
+      for (;;) {
+        if (!readLine(line))
+          return false;
+        size_t size = strtoull(line.c_str(), nullptr, 16);
+        if (size == 0)
+          break;
+        if (!readBytes(size, response.body) || !readLine(line))
+          return false;
+      }
+      while (readLine(line) && !line.empty()) {
+      }
+      return line.empty();
+    }
+    auto length = response.headers.find("content-length");
+    if (length == response.headers.end()) {
+      alive = false; // Body runs to end of connection
+      while (fill()) {
+      }
+      response.body = buffer.substr(pos);
+      pos = buffer.size();
+      return true;
+    }
+    return readBytes(strtoull(length->second.c_str(), nullptr, 10),
+                     response.body);
+  }
+
+  int fd = -1;
+  bool alive = false;
+  string hostHeader;
+  string buffer;
+  size_t pos = 0;
+};
+
+class S3IoBackend : public IoBackend {
+public:
+  struct Stats {
+    atomic<uint64_t> requests{0}, batches{0}, connections{0};
+    atomic<uint64_t> listings{0}, heads{0}, ranged{0};
+    atomic<uint64_t> bytesFetched{0}; // Object bytes, not listings
+    atomic<uint64_t> servedFromBatch{0}; // Opens answered by a prefetch
+  };
+
+  explicit S3IoBackend(S3Config config) : config(std::move(config)) {}
+
+  const Stats &stats() const { return counters; }
+  const S3Config &settings() const { return config; }
+
+  string lastError() {
+    lock_guard<mutex> lock(mtx);
+    return error;
+  }
+
+  size_t headBytes() const override {
+    SignatureReadGuard signatures;
+    return max(config.headBytes, signatures->matcher.bytesNeeded());
+  }
+
+  IoKind stat(const string &path, FileInfo &info) override {
+    {
+      lock_guard<mutex> lock(mtx);
+      auto it = objects.find(path);
+      if (it != objects.end()) {
+        info.size = it->second.size;
+        info.modifiedTime = info.accessedTime = it->second.modifiedTime;
+        return IoKind::File;
+      }
+      if (prefixes.count(path))
+        return IoKind::Directory;
+    }
+    string bucket, key;
+    if (!splitPath(path, bucket, key))
+      return IoKind::Missing;
+    if (key.empty() || key.back() == '/')
+      return IoKind::Directory;
+
+    HttpRequest head;
+    head.method = "HEAD";
+    head.path = objectPath(bucket, key);
+    vector<HttpResponse> responses;
+    if (!send({head}, responses))
+      return IoKind::Missing;
+    if (responses[0].status == 200) {
+      lock_guard<mutex> lock(mtx);
+      Object &o = objects[path];
+      o.size = strtoull(responses[0].headers["content-length"].c_str(),
+                        nullptr, 10);
+      o.modifiedTime = parseObjectTime(responses[0].headers["last-modified"]);
+      info.size = o.size;
+      info.modifiedTime = info.accessedTime = o.modifiedTime;
+      return IoKind::File;
+    }
+    // Not an object: a prefix counts as a directory if anything is under it
+    responses.clear();
+    if (!send({listRequest(bucket, key + "/", "", 1)}, responses))
+      return IoKind::Missing;
+    if (responses[0].status != 200) {
+      setError(path + ": HTTP " + to_string(responses[0].status) + " " +
+               xmlText(responses[0].body, "Code"));
+      return IoKind::Missing;
+    }
+    const string &xml = responses[0].body;
+    if (xml.find("<Contents>") == string::npos &&
+        xml.find("<CommonPrefixes>") == string::npos)
+      return IoKind::Missing;
+    lock_guard<mutex> lock(mtx);
+    prefixes.insert(path);
+    return IoKind::Directory;
+  }
+
+  // One level of the prefix: objects, and common prefixes as directories
+  bool readdir(const string &path, vector<IoDirEntry> &entries) override {
+    string bucket, key;
+    if (!splitPath(path, bucket, key))
+      return false;
+    string prefix = key.empty() || key.back() == '/' ? key : key + "/";
+    string base = "s3://" + bucket + "/";
+    string token;
+    do {
+      vector<HttpResponse> responses;
+      counters.listings++;
+      if (!send({listRequest(bucket, prefix, token, 1000)}, responses))
+        return false;
+      const string &xml = responses[0].body;
+      if (responses[0].status != 200) {
+        setError("listing " + path + ": HTTP " +
+                 to_string(responses[0].status) + " " + xmlText(xml, "Code"));
+        return false;
+      }
+      lock_guard<mutex> lock(mtx);
+      for (size_t at = xml.find("<Contents>"); at != string::npos;
+           at = xml.find("<Contents>", at + 1)) {
+        string name = xmlText(xml, "Key", at);
+        if (name.empty() || name.back() == '/') // Folder placeholders
+          continue;
+        string objectPath = base + name;
+        Object &o = objects[objectPath];
+        o.size = strtoull(xmlText(xml, "Size", at).c_str(), nullptr, 10);
+        o.modifiedTime = parseObjectTime(xmlText(xml, "LastModified", at));
+        if (o.listed == SIZE_MAX) {
+          o.listed = listed.size();
+          listed.push_back(objectPath);
+        }
+        entries.push_back({objectPath, IoKind::File});
+      }
+      for (size_t at = xml.find("<CommonPrefixes>"); at != string::npos;
+           at = xml.find("<CommonPrefixes>", at + 1)) {
+        string sub = xmlText(xml, "Prefix", at);
+        if (!sub.empty() && sub.back() == '/')
+          sub.pop_back();
+        if (!sub.empty()) {
+          prefixes.insert(base + sub);
+          entries.push_back({base + sub, IoKind::Directory});
+        }
+      }
+      token = xmlText(xml, "IsTruncated") == "true"
+                  ? xmlText(xml, "NextContinuationToken")
+                  : "";
+    } while (!token.empty());
+    return true;
+  }
+
+  unique_ptr<IoFile> open(const string &path) override {
+    FileInfo info;
+    if (stat(path, info) != IoKind::File)
+      return nullptr;
+    return make_unique<S3IoFile>(*this, path, info.size);
+  }
+
+private:
+  enum class HeadState { Unfetched, Pending, Ready, Claimed };
+
+  struct Object {
+    uintmax_t size = 0;
+    int64_t modifiedTime = 0;
+    HeadState head = HeadState::Unfetched;
+    bool reserved = false;   // Fetched ahead; counts against the budget
+    size_t listed = SIZE_MAX; // Position in listing order
+    string data;             // Prefetched head while Ready
+  };
+
+  class S3IoFile : public IoFile {
+  public:
+    S3IoFile(S3IoBackend &owner, string path, uintmax_t size)
+        : owner(owner), path(std::move(path)), size(size) {}
+
+    size_t read(uint64_t offset, void *buffer, size_t length) override {
+      if (offset >= size || length == 0)
+        return 0;
+      length = static_cast<size_t>(min<uint64_t>(length, size - offset));
+      string data;
+      if (!(offset == 0 && owner.claimHead(path, length, data)) &&
+          !owner.fetchRange(path, offset, length, data))
+        return 0;
+      size_t n = min(length, data.size());
+      memcpy(buffer, data.data(), n);
+      return n;
+    }
+
+  private:
+    S3IoBackend &owner;
+    string path;
+    uintmax_t size;
+  };
+
+  static bool splitPath(const string &path, string &bucket, string &key) {
+    if (path.rfind("s3://", 0) != 0)
+      return false;
+    string rest = path.substr(5);
+    size_t slash = rest.find('/');
+    bucket = rest.substr(0, slash);
+    key = slash == string::npos ? "" : rest.substr(slash + 1);
+    return !bucket.empty();
+  }
+
+  static string objectPath(const string &bucket, const string &key) {
+    return "/" + uriEncode(bucket, false) + "/" + uriEncode(key, true);
+  }
+
+  static HttpRequest listRequest(const string &bucket, const string &prefix,
+                                 const string &token, int maxKeys) {
+    HttpRequest r;
+    r.path = "/" + uriEncode(bucket, false);
+    // Parameters in canonical (sorted) order
+    if (!token.empty())
+      r.query += "continuation-token=" + uriEncode(token, false) + "&";
+    r.query += "delimiter=%2F&list-type=2&max-keys=" + to_string(maxKeys) +
+               "&prefix=" + uriEncode(prefix, false);
+    return r;
+  }
+
+  HttpRequest rangeRequest(const string &path, uint64_t offset,
+                           size_t length) const {
+    string bucket, key;
+    splitPath(path, bucket, key);
+    HttpRequest r;
+    r.path = objectPath(bucket, key);
+    r.headers.push_back({"range", "bytes=" + to_string(offset) + "-" +
+                                      to_string(offset + length - 1)});
+    return r;
+  }
+
+  void setError(const string &message) {
+    lock_guard<mutex> lock(mtx);
+    error = message;
+  }
+
+  unique_ptr<HttpConnection> acquire() {
+    {
+      lock_guard<mutex> lock(poolMutex);
+      if (!idle.empty()) {
+        auto c = std::move(idle.back());
+        idle.pop_back();
+        return c;
+      }
+    }
+    auto c = make_unique<HttpConnection>();
+    string message;
+    if (!c->connect(config, message)) {
+      setError(message);
+      return nullptr;
+    }
+    counters.connections++;
+    return c;
+  }
+
+  void release(unique_ptr<HttpConnection> c) {
+    lock_guard<mutex> lock(poolMutex);
+    if (c->reusable() && idle.size() < config.maxIdleConnections)
+      idle.push_back(std::move(c));
+  }
+
+  // Signs and pipelines `requests` on one pooled connection; whatever is
+  // left when a connection drops is resent on a fresh one
+  bool send(vector<HttpRequest> requests, vector<HttpResponse> &responses) {
+    string amzDate = amzTimestamp();
+    for (auto &r : requests)
+      signRequestV4(r, config, amzDate);
+    size_t done = 0;
+    for (int attempt = 0; attempt < 3 && done < requests.size(); attempt++) {
+      unique_ptr<HttpConnection> c = acquire();
+      if (!c)
+        return false;
+      vector<HttpRequest> rest(requests.begin() + done, requests.end());
+      counters.batches++;
+      counters.requests += rest.size();
+      size_t got = c->exchange(rest, responses);
+      done += got;
+      if (got > 0)
+        attempt = -1; // Progress: keep going on a fresh connection
+      release(std::move(c));
+    }
+    if (done < requests.size())
+      setError("connection to " + config.host + " failed");
+    return done == requests.size();
+  }
+
+  bool fetchRange(const string &path, uint64_t offset, size_t length,
+                  string &data) {
+    vector<HttpResponse> responses;
+    if (!send({rangeRequest(path, offset, length)}, responses))
+      return false;
+    HttpResponse &r = responses[0];
+    counters.ranged++;
+    if (r.status == 200 && r.body.size() > offset) // Range ignored
+      data = r.body.substr(static_cast<size_t>(offset), length);
+    else if (r.status == 206)
+      data = std::move(r.body);
+    else
+      return false;
+    counters.bytesFetched += data.size();
+    return true;
+  }
+
+  // Hands over the prefetched head of `path` if it covers `length` bytes.
+  // On a miss, this worker fetches it together with the heads of the
+  // objects listed after it in one pipelined batch, since the scan (or the
+  // next worker) usually wants those next.
+  bool claimHead(const string &path, size_t length, string &data) {
+    size_t want = headBytes();
+    if (length > want)
+      return false;
+    unique_lock<mutex> lock(mtx);
+    auto it = objects.find(path);
+    if (it == objects.end())
+      return false;
+    Object &own = it->second; // Element references survive rehashing
+    if (own.head == HeadState::Unfetched) {
+      vector<string> batch{path};
+      own.head = HeadState::Pending;
+      size_t scanLimit = own.listed + 4 * config.pipelineDepth;
+      for (size_t i = own.listed + 1;
+           i < listed.size() && i < scanLimit &&
+           batch.size() < config.pipelineDepth &&
+           prefetched + want <= config.prefetchBudget;
+           i++) {
+        Object &o = objects[listed[i]];
+        if (o.head != HeadState::Unfetched || o.size == 0)
+          continue;
+        o.head = HeadState::Pending;
+        o.reserved = true;
+        prefetched += want;
+        batch.push_back(listed[i]);
+      }
+      lock.unlock();
+      fetchHeads(batch, want);
+      lock.lock();
+    }
+    headReady.wait(lock, [&] { return own.head != HeadState::Pending; });
+    if (own.head != HeadState::Ready ||
+        own.data.size() < min<uintmax_t>(length, own.size))
+      return false;
+    data = std::move(own.data);
+    own.data = string();
+    own.head = HeadState::Claimed;
+    if (own.reserved) {
+      own.reserved = false;
+      prefetched -= want;
+      counters.servedFromBatch++;
+    }
+    return true;
+  }
+
+  void fetchHeads(const vector<string> &batch, size_t want) {
+    vector<HttpRequest> requests;
+    {
+      lock_guard<mutex> lock(mtx);
+      for (const auto &p : batch) {
+        requests.push_back(rangeRequest(
+            p, 0, static_cast<size_t>(min<uintmax_t>(want, objects[p].size))));
+      }
+    }
+    vector<HttpResponse> responses;
+    send(requests, responses);
+    counters.heads += responses.size();
+    lock_guard<mutex> lock(mtx);
+    for (size_t i = 0; i < batch.size(); i++) {
+      Object &o = objects[batch[i]];
+      if (i < responses.size() &&
+          (responses[i].status == 206 || responses[i].status == 200)) {
+        o.data = std::move(responses[i].body);
+        if (o.data.size() > want)
+          o.data.resize(want);
+        counters.bytesFetched += o.data.size();
+        o.head = HeadState::Ready;
+        continue;
+      }
+      // Nobody gets a failed head; readers fall back to plain ranges
+      o.head = HeadState::Claimed;
+      if (o.reserved) {
+        o.reserved = false;
+        prefetched -= want;
+      }
+    }
+    headReady.notify_all();
+  }
+
+  S3Config config;
+  Stats counters;
+  mutex mtx;
+  condition_variable headReady;
+  unordered_map<string, Object> objects;
+  set<string> prefixes; // Paths known to be directories, from listings
+  vector<string> listed; // Object paths in listing order
+  size_t prefetched = 0;  // Bytes of heads fetched ahead and not yet claimed
+  string error;
+  mutex poolMutex;
+  vector<unique_ptr<HttpConnection>> idle;
+};
+
+// Set while scanning an s3:// path, for the summary
+S3IoBackend *objectStore = nullptr;
+
+// ============================================================================
+// Content-Defined Chunking (--chunk-dedup)
+// ============================================================================
+// FastCDC with normalized chunking (2 KB min, 8 KB normal, 64 KB max). Cut
+// points depend only on content, so an insertion shifts at most a couple of
+// chunks and shared blocks between VM images or backups line up. The gear
+// hash is rolled two bytes per step (FastCDC 2020): the first byte's gear
+// value is pre-shifted, which halves the shifts without moving any cut point.
+const size_t CDC_MIN_CHUNK = 2 * 1024;
+const size_t CDC_NORMAL_CHUNK = 8 * 1024;
+const size_t CDC_MAX_CHUNK = 64 * 1024;
+const uint64_t CDC_MASK_S = 0x0003590703530000ULL; // 15 bits, before normal
+const uint64_t CDC_MASK_L = 0x0000d90003530000ULL; // 11 bits, after normal
+const uint64_t CDC_MASK_S_LS = CDC_MASK_S << 1;
+const uint64_t CDC_MASK_L_LS = CDC_MASK_L << 1;
+
+struct GearTables {
+  array<uint64_t, 256> gear{};
+  array<uint64_t, 256> gearShifted{};
+};
+
+// Fixed pseudo-random gear values (splitmix64), identical across runs
+constexpr GearTables makeGearTables() {
+  GearTables tables{};
+  uint64_t state = 0x6a09e667f3bcc909ULL;
+  for (size_t i = 0; i < 256; i++) {
+    state += 0x9e3779b97f4a7c15ULL;
+    uint64_t z = state;
+    z = (z ^ (z >> 30)) * 0xbf58476d1ce4e5b9ULL;
+    z = (z ^ (z >> 27)) * 0x94d049bb133111ebULL;
+    tables.gear[i] = z ^ (z >> 31);
+    tables.gearShifted[i] = tables.gear[i] << 1;
+  }
+  return tables;
+}
+
+constexpr GearTables GEAR_TABLES = makeGearTables();
+
+// Length of the chunk starting at `data`, given `length` available bytes
+size_t cdcCutPoint(const unsigned char *data, size_t length) {
+  if (length <= CDC_MIN_CHUNK)
+    return length;
+  size_t normal = min(length, CDC_NORMAL_CHUNK);
+  size_t end = min(length, CDC_MAX_CHUNK);
+  const auto &gear = GEAR_TABLES.gear;
+  const auto &gearShifted = GEAR_TABLES.gearShifted;
+  uint64_t fp = 0;
+  size_t i = CDC_MIN_CHUNK;
+  for (; i + 1 < normal; i += 2) {
+    fp = (fp << 2) + gearShifted[data[i]];
+    if (!(fp & CDC_MASK_S_LS))
+      return i + 1;
+    fp += gear[data[i + 1]];
+    if (!(fp & CDC_MASK_S))
+      return i + 2;
+  }
+  for (; i + 1 < end; i += 2) {
+    fp = (fp << 2) + gearShifted[data[i]];
+    if (!(fp & CDC_MASK_L_LS))
+      return i + 1;
+    fp += gear[data[i + 1]];
+    if (!(fp & CDC_MASK_L))
+      return i + 2;
+  }
+  return end;
+}
+
+// Bounded-memory sample of distinct chunks. A chunk is kept only if the low
+// `level` bits of its hash are zero; when the index outgrows its capacity
+// the level goes up and half the entries are dropped. Unique bytes are then
+// the sampled unique bytes scaled by 2^level.
+class ChunkSample {
+public:
+  explicit ChunkSample(size_t capacity = 1 << 16) : capacity(capacity) {}
+
+  void add(uint64_t hash, uint32_t length) {
+    totalBytes += length;
+    totalChunks++;
+    if (!sampled(hash))
+      return;
+    chunks.emplace(hash, length);
+    while (chunks.size() > capacity)
+      raiseLevel();
+  }
+
+  void merge(const ChunkSample &other) {
+    totalBytes += other.totalBytes;
+    totalChunks += other.totalChunks;
+    while (level < other.level)
+      raiseLevel();
+    for (const auto &[hash, length] : other.chunks) {
+      if (sampled(hash))
+        chunks.emplace(hash, length);
+    }
+    while (chunks.size() > capacity)
+      raiseLevel();
+  }
+
+  double estimatedUniqueBytes() const {
+    double sampledBytes = 0.0;
+    for (const auto &entry : chunks)
+      sampledBytes += entry.second;
+    return min(ldexp(sampledBytes, static_cast<int>(level)),
+               static_cast<double>(totalBytes));
+  }
+
+  double estimatedUniqueChunks() const {
+    return min(ldexp(static_cast<double>(chunks.size()),
+                     static_cast<int>(level)),
+               static_cast<double>(totalChunks));
+  }
+
+  // Fraction of bytes a block-level dedup store would not need to keep
+  double estimatedSavings() const {
+    if (totalBytes == 0)
+      return 0.0;
+    return max(0.0, 1.0 - estimatedUniqueBytes() /
+                              static_cast<double>(totalBytes));
+  }
+
+  uint64_t bytes() const { return totalBytes; }
+  uint64_t chunkCount() const { return totalChunks; }
+  unsigned int sampleLevel() const { return level; }
+  size_t indexEntries() const { return chunks.size(); }
+
+private:
+  size_t capacity;
+  unsigned int level = 0;
+  uint64_t totalBytes = 0;
+  uint64_t totalChunks = 0;
+  unordered_map<uint64_t, uint32_t> chunks;
+
+  bool sampled(uint64_t hash) const {
+    return level == 0 || (hash & ((1ULL << level) - 1)) == 0;
+  }
+
+  void raiseLevel() {
+    level++;
+    for (auto it = chunks.begin(); it != chunks.end();) {
+      if (sampled(it->first))
+        ++it;
+      else
+        it = chunks.erase(it);
+    }
+  }
+};
+
+// Index entries kept overall; per-type samples get 1/16 of it. Lowered to
+// fit a container memory limit (fitChunkIndexToBudget).
+size_t chunkIndexCapacity = 1 << 18;
+
+// Chunk samples overall and per detected type
+struct ChunkDedupIndex {
+  ChunkSample overall{chunkIndexCapacity};
+  map<string, ChunkSample> byType;
+
+  ChunkSample &forType(const string &type) {
+    return byType.try_emplace(type, max<size_t>(256, chunkIndexCapacity / 16))
+        .first->second;
+  }
+
+  void merge(const ChunkDedupIndex &other) {
+    overall.merge(other.overall);
+    for (const auto &[type, sample] : other.byType)
+      forType(type).merge(sample);
+  }
+};
+
+// Chunks a whole file whose first `headLength` bytes are already in `head`,
+// reading the rest from `file` in large blocks
+void chunkFile(const unsigned char *head, size_t headLength, IoFile &file,
+               ChunkSample &overall, ChunkSample &typeSample) {
+  const size_t BLOCK = 1 << 20;
+  thread_local vector<unsigned char> buffer;
+  buffer.resize(BLOCK + CDC_MAX_CHUNK);
+  memcpy(buffer.data(), head, headLength);
+  size_t have = headLength;
+  uint64_t offset = headLength;
+  bool eof = false;
+
+  while (have > 0 || !eof) {
+    if (!eof && have < buffer.size()) {
+      size_t want = buffer.size() - have;
+      size_t got = file.read(offset, buffer.data() + have, want);
+      have += got;
+      offset += got;
+      eof = got < want;
+    }
+    // Only cut where a full max-size window is available, except at EOF
+    size_t pos = 0;
+    while (have - pos >= CDC_MAX_CHUNK || (eof && pos < have)) {
+      size_t length = cdcCutPoint(buffer.data() + pos, have - pos);
+      uint64_t hash = hash64(buffer.data() + pos, length, 0);
+      overall.add(hash, static_cast<uint32_t>(length));
+      typeSample.add(hash, static_cast<uint32_t>(length));
+      pos += length;
+    }
+    memmove(buffer.data(), buffer.data() + pos, have - pos);
+    have -= pos;
+  }
+}
+
+// ============================================================================
+// Compressibility Estimation (--compressibility)
+// ============================================================================
+// An LZ4-style greedy matcher that only counts the bytes it would emit,
+// run over sampled 64 KB blocks of each file. The block size equals the
+// match window, so each block compresses exactly as it would on its own.
+// Hash-table state lives per thread and is never cleared: positions are
+// tagged with a running base, so entries from earlier blocks simply fail
+// the range check.
+const size_t LZ_BLOCK = 64 * 1024;
+
+class LzSizeEstimator {
+public:
+  size_t compressedSize(const unsigned char *src, size_t n) {
+    const size_t MIN_MATCH = 4;
+    const size_t LAST_LITERALS = 5;
+    const size_t MF_LIMIT = 12;
+    if (base > 0xC0000000u) {
+      table.fill(0);
+      base = 1;
+    }
+    size_t out = 0;
+    size_t anchor = 0;
+    size_t i = 0;
+    if (n >= MF_LIMIT + 1) {
+      while (i + MF_LIMIT <= n) {
+        uint32_t seq = read32(src + i);
+        uint32_t &slot = table[hashOf(seq)];
+        uint32_t ref = slot;
+        slot = base + static_cast<uint32_t>(i);
+        if (ref >= base && read32(src + (ref - base)) == seq) {
+          size_t match = ref - base;
+          size_t length = MIN_MATCH;
+          while (i + length < n - LAST_LITERALS &&
+                 src[match + length] == src[i + length])
+            length++;
+          // Catch up on match bytes the skipping stepped over
+          while (i > anchor && match > 0 && src[i - 1] == src[match - 1]) {
+            i--;
+            match--;
+            length++;
+          }
+          out += sequenceSize(i - anchor, length - MIN_MATCH);
+          i += length;
+          anchor = i;
+          if (i >= 2 && i + 2 <= n)
+            table[hashOf(read32(src + i - 2))] =
+                base + static_cast<uint32_t>(i - 2);
+        } else {
+          // Skip faster through incompressible stretches, as LZ4 does
+          i += 1 + ((i - anchor) >> 6);
+        }
+      }
+    }
+    out += sequenceSize(n - anchor, 0) - 2; // Last literals, no offset
+    base += static_cast<uint32_t>(n) + 1;
+    return out;
+  }
+
+private:
+  static const int HASH_BITS = 14;
+  array<uint32_t, 1 << HASH_BITS> table{};
+  uint32_t base = 1;
+
+  static uint32_t read32(const unsigned char *p) {
+    uint32_t v;
+    memcpy(&v, p, sizeof(v));
+    return v;
+  }
+
+  static uint32_t hashOf(uint32_t seq) {
+    return (seq * 2654435761u) >> (32 - HASH_BITS);
+  }
+
+  // Token + literal-length bytes + literals + offset + match-length bytes
+  static size_t sequenceSize(size_t literals, size_t matchExtra) {
+    size_t size = 1 + literals + 2;
+    if (literals >= 15)
+      size += (literals - 15) / 255 + 1;
+    if (matchExtra >= 15)
+      size += (matchExtra - 15) / 255 + 1;
+    return size;
+  }
+};
+
+// Per-file sample budget in bytes; 0 disables the measurement
+size_t compressionSampleBudget = 0;
+
+// Sets info.compressionRatio from up to `budget` bytes of evenly spaced
+// blocks. The first block is the classification buffer, reused as-is.
+void measureCompressibility(FileInfo &info, const unsigned char *head,
+                            size_t headLength, IoFile &file,
+                            size_t budget) {
+  thread_local LzSizeEstimator estimator;
+  thread_local vector<unsigned char> block(LZ_BLOCK);
+
+  uintmax_t blocks = (info.size + LZ_BLOCK - 1) / LZ_BLOCK;
+  uintmax_t samples =
+      min<uintmax_t>(blocks, max<size_t>(1, budget / LZ_BLOCK));
+  size_t firstLength = min(headLength, LZ_BLOCK);
+  uintmax_t original = firstLength;
+  uintmax_t compressed = estimator.compressedSize(head, firstLength);
+
+  for (uintmax_t s = 1; s < samples; s++) {
+    // Sample s of n covers block s * (blocks - 1) / (n - 1)
+    uintmax_t index = s * (blocks - 1) / (samples - 1);
+    size_t got = file.read(index * LZ_BLOCK, block.data(), LZ_BLOCK);
+    if (got == 0)
+      break;
+    original += got;
+    compressed += estimator.compressedSize(block.data(), got);
+  }
+  info.compressionRatio =
+      static_cast<double>(original) /
+      static_cast<double>(max<uintmax_t>(1, compressed));
+  info.compressionSampled = original;
+}
+
+// ============================================================================
+// Scan Aggregates (per-worker, merged at the end)
+// ============================================================================
+// Path order of Merkle tree files: byte order with '/' below every other
+// byte, which lists each directory's subtree as one contiguous block
+int compareTreePaths(const string &a, const string &b) {
+  size_t n = min(a.size(), b.size());
+  for (size_t i = 0; i < n; i++) {
+    unsigned char x = a[i] == '/' ? 1 : static_cast<unsigned char>(a[i]);
+    unsigned char y = b[i] == '/' ? 1 : static_cast<unsigned char>(b[i]);
+    if (x != y)
+      return x < y ? -1 : 1;
+  }
+  return a.size() < b.size() ? -1 : a.size() > b.size() ? 1 : 0;
+}
+
+bool insideTreePath(const string &path, const string &dir) {
+  return dir.empty() ||
+         (path.size() > dir.size() && path[dir.size()] == '/' &&
+          path.compare(0, dir.size(), dir) == 0);
+}
+
+string merkleChildPath(const string &dir, const string &name) {
+  return dir.empty() ? name : dir + "/" + name;
+}
+
+// One file as it enters its directory's Merkle fingerprint (--merkle)
+struct MerkleLeaf {
+  string path; // Relative to the scan root, '/'-separated
+  string type;
+  uintmax_t size = 0;
+  string sha256; // Empty if the content could not be read
+
+  size_t footprint() const {
+    return sizeof(MerkleLeaf) + path.size() + type.size() + sha256.size();
+  }
+  void write(ostream &out) const {
+    out << path << '\0' << type << '\0' << size << '\0' << sha256 << '\0';
+  }
+  bool read(istream &in) {
+    string number;
+    if (!getline(in, path, '\0') || !getline(in, type, '\0') ||
+        !getline(in, number, '\0') || !getline(in, sha256, '\0'))
+      return false;
+    size = strtoull(number.c_str(), nullptr, 10);
+    return true;
+  }
+};
+
+// A directory's fingerprint and subtree totals, once all its files are in
+struct MerkleDirectory {
+  string path; // "" for the root
+  string digest; // Lowercase hex
+  uint64_t files = 0;
+  uintmax_t bytes = 0;
+
+  size_t footprint() const {
+    return sizeof(MerkleDirectory) + path.size() + digest.size();
+  }
+  void write(ostream &out) const {
+    out << path << '\0' << digest << '\0' << files << '\0' << bytes << '\0';
+  }
+  bool read(istream &in) {
+    string count, total;
+    if (!getline(in, path, '\0') || !getline(in, digest, '\0') ||
+        !getline(in, count, '\0') || !getline(in, total, '\0'))
+      return false;
+    files = strtoull(count.c_str(), nullptr, 10);
+    bytes = strtoull(total.c_str(), nullptr, 10);
+    return true;
+  }
+};
+
+// Bytes of records a MerkleRuns buffers before sorting them into a run file
+size_t merkleRunBytes = 16 << 20;
+
+// Records in tree path order without holding them all: whenever the buffer
+// fills, it is sorted and spilled to a temporary run file, and a Reader
+// merges the runs with whatever is still buffered. Records are written as
+// NUL-terminated fields, so paths may hold any other byte. If a run cannot
+// be written, records stay in memory.
+template <typename T> class MerkleRuns {
+public:
+  MerkleRuns() = default;
+  MerkleRuns(const MerkleRuns &) = delete;
+  MerkleRuns &operator=(const MerkleRuns &) = delete;
+  MerkleRuns(MerkleRuns &&other) noexcept { *this = std::move(other); }
+  MerkleRuns &operator=(MerkleRuns &&other) noexcept {
+    if (this != &other) {
+      clear();
+      swap(buffer, other.buffer);
+      swap(runs, other.runs);
+      swap(buffered, other.buffered);
+      swap(spillable, other.spillable);
+    }
+    return *this;
+  }
+  ~MerkleRuns() { clear(); }
+
+  void add(T record) {
+    buffered += record.footprint();
+    buffer.push_back(std::move(record));
+    if (buffered >= merkleRunBytes && spillable)
+      spill();
+  }
+
+  // Takes over `other`'s runs and buffered records
+  void merge(MerkleRuns &other) {
+    runs.insert(runs.end(), other.runs.begin(), other.runs.end());
+    other.runs.clear();
+    for (auto &record : other.buffer)
+      add(std::move(record));
+    other.buffer.clear();
+    other.buffered = 0;
+  }
+
+  size_t runCount() const { return runs.size(); }
+
+  // Deletes the run files and drops the buffer
+  void clear() {
+    error_code ec;
+    for (const auto &run : runs)
+      fs::remove(run, ec);
+    runs.clear();
+    buffer.clear();
+    buffered = 0;
+  }
+
+  // One ordered pass over every record; the buffer is sorted in place
+  class Reader {
+  public:
+    explicit Reader(MerkleRuns &source)
+        : buffer(source.buffer), heap([this](size_t a, size_t b) {
+            return compareTreePaths(heads[a].path, heads[b].path) > 0;
+          }) {
+      sort(source.buffer.begin(), source.buffer.end(), MerkleRuns::less);
+      for (const auto &run : source.runs)
+        files.push_back(make_unique<ifstream>(run, ios::binary));
+      heads.resize(files.size() + 1);
+      for (size_t i = 0; i <= files.size(); i++)
+        advance(i);
+    }
+
+    bool next(T &record) {
+      if (heap.empty())
+        return false;
+      size_t i = heap.top();
+      heap.pop();
+      record = std::move(heads[i]);
+      advance(i);
+      return true;
+    }
+
+  private:
+    // Loads source i's next record; the last source is the buffer
+    void advance(size_t i) {
+      bool more = false;
+      if (i < files.size())
+        more = heads[i].read(*files[i]);
+      else if (position < buffer.size()) {
+        heads[i] = buffer[position++];
+        more = true;
+      }
+      if (more)
+        heap.push(i);
+    }
+
+    const vector<T> &buffer;
+    size_t position = 0;
+    vector<unique_ptr<ifstream>> files;
+    vector<T> heads;
+    priority_queue<size_t, vector<size_t>, function<bool(size_t, size_t)>>
+        heap;
+  };
+
+private:
+  static bool less(const T &a, const T &b) {
+    return compareTreePaths(a.path, b.path) < 0;
+  }
+
+  void spill() {
+    static atomic<uint64_t> counter{0};
+    static const string tag = to_string(random_device{}());
+    error_code ec;
+    fs::path run = fs::temp_directory_path(ec) /
+                   ("fta-merkle-" + tag + "-" + to_string(counter++) + ".run");
+    sort(buffer.begin(), buffer.end(), less);
+    ofstream out(run, ios::binary | ios::trunc);
+    for (const auto &record : buffer)
+      record.write(out);
+    out.close();
+    if (ec || !out) {
+      fs::remove(run, ec);
+      spillable = false;
+      return;
+    }
+    runs.push_back(run);
+    buffer.clear();
+    buffered = 0;
+  }
+
+  vector<T> buffer;
+  vector<fs::path> runs;
+  size_t buffered = 0; // footprint() of the buffer
+  bool spillable = true;
+};
+
+// Filled once the fingerprints are written, for the report
+struct MerkleSummary {
+  string rootHash;
+  string file;
+  size_t directories = 0;
+};
+
+struct TypeContentStats {
+  size_t count = 0;
+  uintmax_t bytes = 0;
+  HyperLogLog distinct;
+};
+
+// Original vs estimated compressed bytes for files with a sampled ratio
+struct CompressionTotals {
+  size_t files = 0;
+  uintmax_t bytes = 0;
+  double compressedBytes = 0.0;
+
+  double ratio() const {
+    return compressedBytes > 0 ? static_cast<double>(bytes) / compressedBytes
+                               : 0.0;
+  }
+};
+
+struct TypeTotals {
+  size_t count = 0;
+  uintmax_t bytes = 0;
+
+  void add(uintmax_t size) {
+    count++;
+    bytes += size;
+  }
+
+  void merge(const TypeTotals &other) {
+    count += other.count;
+    bytes += other.bytes;
+  }
+};
+
+using TypeBreakdown = map<string, TypeTotals>;
+
+// Streaming mean and variance (Welford); merge() is Chan et al.'s pairwise
+// update, so per-worker results combine exactly
+struct RunningStats {
+  uint64_t n = 0;
+  double mean = 0.0;
+  double m2 = 0.0;
+
+  void add(double x) {
+    n++;
+    double delta = x - mean;
+    mean += delta / n;
+    m2 += delta * (x - mean);
+  }
+
+  void merge(const RunningStats &other) {
+    if (other.n == 0)
+      return;
+    uint64_t total = n + other.n;
+    double delta = other.mean - mean;
+    mean += delta * other.n / total;
+    m2 += other.m2 + delta * delta * n * other.n / total;
+    n = total;
+  }
+
+  // Inverse of add(), for judging a value against all the others
+  void remove(double x) {
+    if (n <= 1) {
+      *this = RunningStats();
+      return;
+    }
+    double oldMean = mean;
+    n--;
+    mean = (oldMean * (n + 1) - x) / n;
+    m2 = max(0.0, m2 - (x - mean) * (x - oldMean));
+  }
+
+  double stddev() const { return n > 1 ? sqrt(m2 / (n - 1)) : 0.0; }
+};
+
+// Fixed-width histogram over [lo, hi): quantiles to within one bin, merged
+// by addition. Entropy (0-8 bits) and log2 size (0-64) are both bounded, so
+// this is exact enough without a rank-error sketch.
+struct QuantileSketch {
+  static const size_t BINS = 128;
+  double lo = 0.0, hi = 1.0;
+  array<uint64_t, BINS> counts{};
+  uint64_t total = 0;
+
+  QuantileSketch() = default;
+  QuantileSketch(double low, double high) : lo(low), hi(high) {}
+
+  size_t bin(double x) const {
+    double f = (x - lo) / (hi - lo) * BINS;
+    return static_cast<size_t>(min(max(f, 0.0), BINS - 1.0));
+  }
+
+  void add(double x) {
+    counts[bin(x)]++;
+    total++;
+  }
+
+  void remove(double x) {
+    size_t b = bin(x);
+    if (counts[b] > 0) {
+      counts[b]--;
+      total--;
+    }
+  }
+
+  void merge(const QuantileSketch &other) {
+    for (size_t i = 0; i < BINS; i++)
+      counts[i] += other.counts[i];
+    total += other.total;
+  }
+
+  // Midpoint of the bin holding the q-th fraction of the values
+  double quantile(double q) const {
+    if (total == 0)
+      return 0.0;
+    uint64_t rank = static_cast<uint64_t>(q * (total - 1));
+    uint64_t seen = 0;
+    for (size_t i = 0; i < BINS; i++) {
+      seen += counts[i];
+      if (seen > rank)
+        return lo + (i + 0.5) * (hi - lo) / BINS;
+    }
+    return hi;
+  }
+};
+
+// Per-type entropy and size distribution (--anomalies)
+struct TypeEntropyStats {
+  RunningStats entropy;
+  RunningStats logSize; // log2(size + 1)
+  QuantileSketch entropyQuantiles{0.0, 8.0};
+  QuantileSketch sizeQuantiles{0.0, 64.0};
+
+  void add(double bits, uintmax_t size) {
+    double logBytes = log2(static_cast<double>(size) + 1.0);
+    entropy.add(bits);
+    logSize.add(logBytes);
+    entropyQuantiles.add(bits);
+    sizeQuantiles.add(logBytes);
+  }
+
+  void remove(double bits, uintmax_t size) {
+    double logBytes = log2(static_cast<double>(size) + 1.0);
+    entropy.remove(bits);
+    logSize.remove(logBytes);
+    entropyQuantiles.remove(bits);
+    sizeQuantiles.remove(logBytes);
+  }
+
+  void merge(const TypeEntropyStats &other) {
+    entropy.merge(other.entropy);
+    logSize.merge(other.logSize);
+    entropyQuantiles.merge(other.entropyQuantiles);
+    sizeQuantiles.merge(other.sizeQuantiles);
+  }
+};
+
+struct AggregateOptions {
+  bool directoryTree = false;
+  int directoryTreeDepth = 2;
+  string rootDirectory;
+  bool ownerBreakdown = false;
+  bool ageBreakdown = false;
+  int64_t referenceTime = 0; // "Now" for age buckets, seconds since epoch
+  bool chunkDedup = false;    // Chunk whole files for block-level dedup
+  bool entropyAnomalies = false; // Per-type entropy/size statistics
+  bool merkleTree = false; // Collect leaves for Merkle fingerprints
+};
+
+// Age histogram buckets for --ages (upper bounds in days)
+const array<pair<const char *, int64_t>, 7> AGE_BUCKETS = {{
+    {"<1d", 1},
+    {"1-7d", 7},
+    {"7-30d", 30},
+    {"30-90d", 90},
+    {"90d-1y", 365},
+    {"1-3y", 3 * 365},
+    {">3y", INT64_MAX},
+}};
+
+size_t ageBucket(int64_t referenceTime, int64_t timestamp) {
+  int64_t days = max<int64_t>(0, referenceTime - timestamp) / 86400;
+  for (size_t i = 0; i < AGE_BUCKETS.size(); i++) {
+    if (days < AGE_BUCKETS[i].second)
+      return i;
+  }
+  return AGE_BUCKETS.size() - 1;
+}
+
+struct ScanAggregates {
+  AggregateOptions options;
+  HyperLogLog distinctContents;
+  map<string, TypeContentStats> contentByType;
+  // Per-directory type totals for files directly inside each directory;
+  // rolled up into subtree totals only when the report is built.
+  map<string, TypeBreakdown> byDirectory;
+  // Ownership and age histograms (--owners, --ages)
+  map<uint32_t, TypeBreakdown> byOwner;
+  map<uint32_t, TypeBreakdown> byGroup;
+  array<TypeBreakdown, AGE_BUCKETS.size()> byModifiedAge;
+  array<TypeBreakdown, AGE_BUCKETS.size()> byAccessedAge;
+  // Files left out of the owner and age histograms because their metadata
+  // could not be read (uid 0 and time 0 would read as root and ">3y")
+  TypeTotals metadataUnknown;
+  // Block-level dedup samples, filled by analyzeFile (--chunk-dedup)
+  ChunkDedupIndex chunks;
+  // Sampled compressibility per type (--compressibility)
+  map<string, CompressionTotals> compressionByType;
+  // Entropy and size distribution per type, possibly seeded from a saved
+  // baseline (--anomalies)
+  map<string, TypeEntropyStats> entropyByType;
+  // Files relative to the scan root, spilled in sorted runs (--merkle);
+  // folded into fingerprints by writeMerkleTree
+  MerkleRuns<MerkleLeaf> merkleLeaves;
+  MerkleSummary merkle;
+
+  ScanAggregates() = default;
+  ScanAggregates(const ScanAggregates &) = delete;
+  ScanAggregates &operator=(const ScanAggregates &) = delete;
+  ScanAggregates(ScanAggregates &&) = default;
+  ScanAggregates &operator=(ScanAggregates &&) = default;
+
+  // Empty aggregates with the same options, for a worker to fill locally
+  ScanAggregates emptyCopy() const {
+    ScanAggregates copy;
+    copy.options = options;
+    return copy;
+  }
+
+  void add(const FileInfo &info) {
+    if (options.directoryTree) {
+      // Files arrive grouped by directory, so remember the last bucket.
+      // Files directly under "/" keep the slash as their directory.
+      size_t slash = info.path.find_last_of("/\\");
+      string dir = slash == string::npos ? "."
+                   : slash == 0          ? info.path.substr(0, 1)
+                                         : info.path.substr(0, slash);
+      if (dir != lastDirectory || lastDirectoryTotals == nullptr) {
+        lastDirectory = dir;
+        lastDirectoryTotals = &byDirectory[dir];
+      }
+      (*lastDirectoryTotals)[info.type].add(info.size);
+    }
+    if ((options.ownerBreakdown || options.ageBreakdown) &&
+        !info.metadataKnown) {
+      metadataUnknown.add(info.size);
+    } else {
+      if (options.ownerBreakdown) {
+        byOwner[info.uid][info.type].add(info.size);
+        byGroup[info.gid][info.type].add(info.size);
+      }
+      if (options.ageBreakdown) {
+        byModifiedAge[ageBucket(options.referenceTime, info.modifiedTime)]
+                     [info.type]
+                         .add(info.size);
+        byAccessedAge[ageBucket(options.referenceTime, info.accessedTime)]
+                     [info.type]
+                         .add(info.size);
+      }
+    }
+
+    if (options.entropyAnomalies && !info.isCorrupt && info.size >= 2)
+      entropyByType[info.type].add(info.entropy, info.size);
+
+    if (options.merkleTree) {
+      const string &root = options.rootDirectory;
+      size_t slash = info.path.find_last_of("/\\");
+      string dir = slash == string::npos ? "" : info.path.substr(0, slash);
+      bool rootSlash =
+          !root.empty() && (root.back() == '/' || root.back() == '\\');
+      if (dir == root) {
+        dir.clear();
+      } else if (dir.size() > root.size() &&
+                 dir.compare(0, root.size(), root) == 0 &&
+                 (rootSlash || dir[root.size()] == '/' ||
+                  dir[root.size()] == '\\')) {
+        dir = dir.substr(root.size() + (rootSlash ? 0 : 1));
+      }
+      string relative = merkleChildPath(
+          dir, slash == string::npos ? info.path : info.path.substr(slash + 1));
+      replace(relative.begin(), relative.end(), '\\', '/');
+      merkleLeaves.add(MerkleLeaf{relative, info.type, info.size, info.hash});
+    }
+
+    if (info.compressionRatio > 0) {
+      auto &totals = compressionByType[info.type];
+      totals.files++;
+      totals.bytes += info.size;
+      totals.compressedBytes +=
+          static_cast<double>(info.size) / info.compressionRatio;
+    }
+
+    if (info.fingerprint == 0)
+      return;
+    distinctContents.add(info.fingerprint);
+    auto &stats = contentByType[info.type];
+    stats.count++;
+    stats.bytes += info.size;
+    stats.distinct.add(info.fingerprint);
+  }
+
+  // Folds in a worker's aggregates, taking over its spilled Merkle runs
+  void merge(ScanAggregates &other) {
+    distinctContents.merge(other.distinctContents);
+    for (const auto &[type, stats] : other.contentByType) {
+      auto &mine = contentByType[type];
+      mine.count += stats.count;
+      mine.bytes += stats.bytes;
+      mine.distinct.merge(stats.distinct);
+    }
+    for (const auto &[dir, types] : other.byDirectory)
+      mergeBreakdown(byDirectory[dir], types);
+    for (const auto &[uid, types] : other.byOwner)
+      mergeBreakdown(byOwner[uid], types);
+    for (const auto &[gid, types] : other.byGroup)
+      mergeBreakdown(byGroup[gid], types);
+    for (size_t i = 0; i < AGE_BUCKETS.size(); i++) {
+      mergeBreakdown(byModifiedAge[i], other.byModifiedAge[i]);
+      mergeBreakdown(byAccessedAge[i], other.byAccessedAge[i]);
+    }
+    metadataUnknown.merge(other.metadataUnknown);
+    chunks.merge(other.chunks);
+    for (const auto &[type, totals] : other.compressionByType) {
+      auto &mine = compressionByType[type];
+      mine.files += totals.files;
+      mine.bytes += totals.bytes;
+      mine.compressedBytes += totals.compressedBytes;
+    }
+    for (const auto &[type, stats] : other.entropyByType)
+      entropyByType[type].merge(stats);
+    merkleLeaves.merge(other.merkleLeaves);
+  }
+
+  static void mergeBreakdown(TypeBreakdown &into, const TypeBreakdown &from) {
+    for (const auto &[type, totals] : from)
+      into[type].merge(totals);
+  }
+
+  // Distinct-content estimates are capped at the observed count, since HLL
+  // noise can otherwise report more unique files than exist.
+  double estimatedUnique(const TypeContentStats &stats) const {
+    return min(stats.distinct.estimate(), static_cast<double>(stats.count));
+  }
+
+  // Unique bytes are approximated per type as bytes * (unique / count), then
+  // summed, which keeps size skew between types out of the estimate.
+  double estimatedUniqueBytes() const {
+    double total = 0.0;
+    for (const auto &[type, stats] : contentByType) {
+      if (stats.count > 0)
+        total += static_cast<double>(stats.bytes) * estimatedUnique(stats) /
+                 static_cast<double>(stats.count);
+    }
+    return total;
+  }
+
+  size_t fingerprintedFiles() const {
+    size_t total = 0;
+    for (const auto &[type, stats] : contentByType)
+      total += stats.count;
+    return total;
+  }
+
+  double estimatedUniqueFiles() const {
+    return min(distinctContents.estimate(),
+               static_cast<double>(fingerprintedFiles()));
+  }
+
+  size_t sketchMemoryBytes() const {
+    return distinctContents.memoryBytes() +
+           contentByType.size() * HyperLogLog::REGISTERS;
+  }
+
+private:
+  string lastDirectory;
+  TypeBreakdown *lastDirectoryTotals = nullptr;
+};
+
+// ============================================================================
+// Analyzer Plugins (see fta_plugin.h)
+// ============================================================================
+// Plugins refine the engine's classification for the type IDs they register.
+// Ranges inside the already-read 64 KB buffer are passed as zero-copy views;
+// anything else is read on demand against the plugin's read budget. Each
+// analyze() call is timed on the thread CPU clock and results from calls
+// over the CPU budget are dropped. That check runs only once a call returns,
+// so a watchdog thread disables plugins whose calls run past the hang limit.
+const uint64_t DEFAULT_PLUGIN_READ_BUDGET = 1024 * 1024;
+const uint64_t DEFAULT_PLUGIN_CPU_MICROS = 50000;
+const uint64_t DEFAULT_PLUGIN_HANG_MICROS = 5000000;
+const uint64_t PLUGIN_STRIKE_LIMIT = 3; // Over-budget calls before disabling
+
+// Wall-clock time one analyze() call may run before the watchdog disables
+// its plugin (--plugin-hang-ms); never below the plugin's CPU budget
+uint64_t pluginHangMicros = DEFAULT_PLUGIN_HANG_MICROS;
+
+struct LoadedPlugin {
+  string path;
+  string name;
+  string version;
+  const fta_plugin *api = nullptr;
+  void *handle = nullptr;
+  bool matchesAll = false;
+  set<string> types;
+  uint64_t readBudget = DEFAULT_PLUGIN_READ_BUDGET;
+  uint64_t cpuBudgetMicros = DEFAULT_PLUGIN_CPU_MICROS;
+
+  atomic<uint64_t> calls{0};
+  atomic<uint64_t> refined{0};
+  atomic<uint64_t> cpuMicros{0};
+  atomic<uint64_t> zeroCopyBytes{0};
+  atomic<uint64_t> bytesRead{0};
+  atomic<uint64_t> readLimited{0}; // Calls whose views were cut by the budget
+  atomic<uint64_t> overBudget{0};
+  atomic<uint64_t> hung{0}; // Calls the watchdog caught past the hang limit
+  atomic<bool> disabled{false};
+
+  bool wants(const string &type) const {
+    return matchesAll || types.count(type) > 0;
+  }
+};
+
+vector<unique_ptr<LoadedPlugin>> loadedPlugins;
+
+int64_t monotonicMicros() {
+  return duration_cast<microseconds>(steady_clock::now().time_since_epoch())
+      .count();
+}
+
+// The analyze() call a worker is in, if any. The watchdog only reads it.
+struct PluginCall {
+  atomic<LoadedPlugin *> plugin{nullptr};
+  atomic<int64_t> startedMicros{0};
+  atomic<bool> flagged{false}; // Already reported by the watchdog
+};
+
+mutex pluginCallsMutex;
+vector<PluginCall *> pluginCalls; // One per live thread that ran a plugin
+
+// The calling thread's slot, registered on first use and removed when the
+// thread exits
+PluginCall &currentPluginCall() {
+  struct Registration {
+    PluginCall call;
+    Registration() {
+      lock_guard<mutex> lock(pluginCallsMutex);
+      pluginCalls.push_back(&call);
+    }
+    ~Registration() {
+      lock_guard<mutex> lock(pluginCallsMutex);
+      pluginCalls.erase(find(pluginCalls.begin(), pluginCalls.end(), &call));
+    }
+  };
+  thread_local Registration registration;
+  return registration.call;
+}
+
+// Disables plugins whose in-flight call has run past the hang limit, so the
+// other workers stop calling them. The stuck call itself cannot be cancelled
+// safely in-process: its worker, and the end of the scan, still wait for it.
+class PluginWatchdog {
+public:
+  ~PluginWatchdog() { stop(); }
+
+  void start() {
+    lock_guard<mutex> lock(stateMutex);
+    if (running)
+      return;
+    running = true;
+    worker = thread([this] { run(); });
+  }
+
+  void stop() {
+    {
+      lock_guard<mutex> lock(stateMutex);
+      if (!running)
+        return;
+      running = false;
+    }
+    wake.notify_all();
+    worker.join();
+  }
+
+  // One pass over the in-flight calls; also called directly by tests
+  static void check() {
+    int64_t now = monotonicMicros();
+    lock_guard<mutex> lock(pluginCallsMutex);
+    for (PluginCall *call : pluginCalls) {
+      LoadedPlugin *plugin = call->plugin.load(memory_order_acquire);
+      if (!plugin || call->flagged.load(memory_order_relaxed))
+        continue;
+      int64_t elapsed = now - call->startedMicros.load(memory_order_relaxed);
+      uint64_t limit = max(pluginHangMicros, plugin->cpuBudgetMicros);
+      if (elapsed < static_cast<int64_t>(limit))
+        continue;
+      call->flagged.store(true, memory_order_relaxed);
+      plugin->hung++;
+      if (!plugin->disabled.exchange(true)) {
+        cerr << "Warning: plugin " << plugin->name << " has not returned after "
+             << elapsed / 1000 << " ms; disabled for the rest of the scan\n";
+      }
+    }
+  }
+
+private:
+  void run() {
+    unique_lock<mutex> lock(stateMutex);
+    while (running) {
+      wake.wait_for(lock, milliseconds(100));
+      check();
+    }
+  }
+
+  mutex stateMutex;
+  condition_variable wake;
+  bool running = false;
+  thread worker;
+};
+
+PluginWatchdog pluginWatchdog;
+
+uint64_t threadCpuMicros() {
+#ifdef _WIN32
+  FILETIME created, exited, kernel, user;
+  if (!GetThreadTimes(GetCurrentThread(), &created, &exited, &kernel, &user))
+    return 0;
+  uint64_t k = (static_cast<uint64_t>(kernel.dwHighDateTime) << 32) |
+               kernel.dwLowDateTime;
+  uint64_t u =
+      (static_cast<uint64_t>(user.dwHighDateTime) << 32) | user.dwLowDateTime;
+  return (k + u) / 10; // 100 ns units
+#else
+  timespec ts{};
+  clock_gettime(CLOCK_THREAD_CPUTIME_ID, &ts);
+  return static_cast<uint64_t>(ts.tv_sec) * 1000000 +
+         static_cast<uint64_t>(ts.tv_nsec) / 1000;
+#endif
+}
+
+// `readCap` and `cpuCapMicros` are engine-side limits; a plugin may ask for
+// less but never more
+bool loadPlugin(const string &path, uint64_t readCap, uint64_t cpuCapMicros,
+                string &error) {
+#ifdef _WIN32
+  void *handle = reinterpret_cast<void *>(LoadLibraryA(path.c_str()));
+  if (!handle) {
+    error = "could not load library";
+    return false;
+  }
+  auto entry = reinterpret_cast<fta_plugin_entry_fn>(GetProcAddress(
+      reinterpret_cast<HMODULE>(handle), "fta_plugin_entry"));
+#else
+  void *handle = dlopen(path.c_str(), RTLD_NOW | RTLD_LOCAL);
+  if (!handle) {
+    error = dlerror();
+    return false;
+  }
+  auto entry = reinterpret_cast<fta_plugin_entry_fn>(
+      dlsym(handle, "fta_plugin_entry"));
+#endif
+  auto fail = [&](const string &message) {
+    error = message;
+#ifdef _WIN32
+    FreeLibrary(reinterpret_cast<HMODULE>(handle));
+#else
+    dlclose(handle);
+#endif
+    return false;
+  };
+
+  if (!entry)
+    return fail("missing fta_plugin_entry");
+  const fta_plugin *api = entry();
+  if (!api)
+    return fail("fta_plugin_entry returned NULL");
+  if (api->abi_version != FTA_PLUGIN_ABI_VERSION)
+    return fail("ABI version " + to_string(api->abi_version) +
+                ", expected " + to_string(FTA_PLUGIN_ABI_VERSION));
+  if (!api->analyze || !api->name || !api->types)
+    return fail("descriptor is missing name, types or analyze()");
+  if (api->range_count > 0 && !api->ranges)
+    return fail("range_count set without ranges");
+  if (api->init && api->init() != 0)
+    return fail("init() failed");
+
+  auto plugin = make_unique<LoadedPlugin>();
+  plugin->path = path;
+  plugin->name = api->name;
+  plugin->version = api->version ? api->version : "";
+  plugin->api = api;
+  plugin->handle = handle;
+  for (const char *const *t = api->types; *t; t++) {
+    if (string(*t) == "*")
+      plugin->matchesAll = true;
+    else
+      plugin->types.insert(*t);
+  }
+  plugin->readBudget =
+      api->max_read_bytes ? min(api->max_read_bytes, readCap) : readCap;
+  plugin->cpuBudgetMicros =
+      api->max_cpu_micros ? min(api->max_cpu_micros, cpuCapMicros)
+                          : cpuCapMicros;
+  loadedPlugins.push_back(std::move(plugin));
+  pluginWatchdog.start();
+  return true;
+}
+
+void unloadPlugins() {
+  pluginWatchdog.stop();
+  for (auto &plugin : loadedPlugins) {
+    if (plugin->api->shutdown)
+      plugin->api->shutdown();
+#ifdef _WIN32
+    FreeLibrary(reinterpret_cast<HMODULE>(plugin->handle));
+#else
+    dlclose(plugin->handle);
+#endif
+  }
+  loadedPlugins.clear();
+}
+
+// Copies a fixed-size, possibly unterminated plugin string
+string pluginString(const char *s, size_t capacity) {
+  return string(s, strnlen(s, capacity));
+}
+
+// Runs every interested plugin over a classified file. `data` holds the
+// first bytes of `file`, which (if given) is still open for ranges beyond it.
+void runPlugins(FileInfo &info, const unsigned char *data, size_t length,
+                IoFile *file) {
+  thread_local vector<vector<unsigned char>> scratch;
+  vector<fta_view> views;
+
+  for (auto &pluginPtr : loadedPlugins) {
+    LoadedPlugin &plugin = *pluginPtr;
+    if (plugin.disabled || !plugin.wants(info.type))
+      continue;
+    const fta_plugin &api = *plugin.api;
+
+    // Resolve ranges: zero-copy when inside the buffer, otherwise read
+    views.assign(api.range_count, fta_view{nullptr, 0, 0});
+    if (scratch.size() < api.range_count)
+      scratch.resize(api.range_count);
+    uint64_t readLeft = plugin.readBudget;
+    bool limited = false;
+    for (size_t r = 0; r < api.range_count; r++) {
+      const fta_range &range = api.ranges[r];
+      uint64_t start;
+      if (range.offset >= 0) {
+        start = min<uint64_t>(static_cast<uint64_t>(range.offset), info.size);
+      } else {
+        uint64_t back = static_cast<uint64_t>(-(range.offset + 1)) + 1;
+        start = info.size - min<uint64_t>(back, info.size);
+      }
+      uint64_t end = min<uint64_t>(start + range.length, info.size);
+      views[r].offset = start;
+      if (end <= length) {
+        views[r].data = data + start;
+        views[r].length = static_cast<size_t>(end - start);
+        plugin.zeroCopyBytes += end - start;
+        continue;
+      }
+      uint64_t want = file ? min(end - start, readLeft) : 0;
+      limited |= want < end - start;
+      if (want == 0)
+        continue;
+      vector<unsigned char> &bytes = scratch[r];
+      bytes.resize(static_cast<size_t>(want));
+      size_t got = file->read(start, bytes.data(), bytes.size());
+      views[r].data = bytes.data();
+      views[r].length = got;
+      readLeft -= got;
+      plugin.bytesRead += got;
+    }
+    if (limited)
+      plugin.readLimited++;
+
+    fta_file request{info.path.c_str(), info.size,   info.type.c_str(),
+                     info.category.c_str(), views.data(), views.size()};
+    fta_result result{};
+    PluginCall &call = currentPluginCall();
+    call.startedMicros.store(monotonicMicros(), memory_order_relaxed);
+    call.flagged.store(false, memory_order_relaxed);
+    call.plugin.store(&plugin, memory_order_release);
+    uint64_t cpuStart = threadCpuMicros();
+    int status = api.analyze(&request, &result);
+    uint64_t cpuUsed = threadCpuMicros() - cpuStart;
+    call.plugin.store(nullptr, memory_order_release);
+    plugin.calls++;
+    plugin.cpuMicros += cpuUsed;
+    if (call.flagged.load(memory_order_relaxed))
+      continue; // The watchdog already gave up on this call
+
+    if (cpuUsed > plugin.cpuBudgetMicros) {
+      if (++plugin.overBudget >= PLUGIN_STRIKE_LIMIT)
+        plugin.disabled = true;
+      continue;
+    }
+    if (status != FTA_RESULT_REFINED)
+      continue;
+
+    string type = pluginString(result.type, sizeof(result.type));
+    string category = pluginString(result.category, sizeof(result.category));
+    string description =
+        pluginString(result.description, sizeof(result.description));
+    if (!type.empty())
+      info.type = type;
+    if (!category.empty())
+      info.category = category;
+    if (!description.empty())
+      info.description = description;
+    info.refinedBy = plugin.name;
+    plugin.refined++;
+  }
+}
+
+// ============================================================================
+// Live Dashboard (--dashboard)
+// ============================================================================
+// Every worker publishes its state into its own cache-line-aligned
+// WorkerStatus using relaxed atomic stores, and the current path goes
+// through a seqlock, so the renderer never sees a torn name and workers
+// never wait for it. A render thread samples all slots four times a second
+// and redraws a full-screen view on stderr (alternate screen), leaving
+// stdout to the normal results.
+enum class ScanPhase : uint8_t {
+  Idle,
+  Stat,
+  Open,
+  Read,
+  Classify,
+  Compress,
+  Chunk,
+  Hash
+};
+
+const char *phaseName(ScanPhase phase) {
+  static const char *names[] = {"idle",     "stat",     "open", "read",
+                                "classify", "compress", "chunk",
+                                "hash"};
+  return names[static_cast<size_t>(phase)];
+}
+
+struct alignas(64) WorkerStatus {
+  static constexpr size_t PATH_WORDS = 32; // Last 256 bytes of the path
+
+  atomic<uint32_t> sequence{0}; // Odd while the path is being written
+  array<atomic<uint64_t>, PATH_WORDS> path{};
+  atomic<uint8_t> phase{0};
+  atomic<int64_t> startedMicros{0}; // 0 when not in a file
+  atomic<uint64_t> files{0}, bytes{0}, errors{0};
+  atomic<uint64_t> queued{0}; // Files still assigned to this worker
+
+  // Writer side; only the owning worker calls these
+  void beginFile(const string &name) {
+    string tail = name.size() > PATH_WORDS * 8
+                      ? name.substr(name.size() - PATH_WORDS * 8)
+                      : name;
+    tail.resize(PATH_WORDS * 8, '\0');
+    uint32_t s = sequence.load(memory_order_relaxed);
+    sequence.store(s + 1, memory_order_relaxed);
+    atomic_thread_fence(memory_order_release);
+    for (size_t i = 0; i < PATH_WORDS; i++) {
+      uint64_t word;
+      memcpy(&word, tail.data() + i * 8, 8);
+      path[i].store(word, memory_order_relaxed);
+    }
+    sequence.store(s + 2, memory_order_release);
+    phase.store(static_cast<uint8_t>(ScanPhase::Stat), memory_order_relaxed);
+    startedMicros.store(monotonicMicros(), memory_order_relaxed);
+  }
+
+  void finishFile(const FileInfo &info) {
+    files.fetch_add(1, memory_order_relaxed);
+    bytes.fetch_add(info.size, memory_order_relaxed);
+    if (info.type == "Unreadable" || info.type == "Error")
+      errors.fetch_add(1, memory_order_relaxed);
+    phase.store(static_cast<uint8_t>(ScanPhase::Idle), memory_order_relaxed);
+    startedMicros.store(0, memory_order_relaxed);
+  }
+
+  // Reader side; empty if the writer kept changing it
+  string currentPath() const {
+    for (int attempt = 0; attempt < 16; attempt++) {
+      uint32_t before = sequence.load(memory_order_acquire);
+      if (before & 1)
+        continue;
+      string text(PATH_WORDS * 8, '\0');
+      for (size_t i = 0; i < PATH_WORDS; i++) {
+        uint64_t word = path[i].load(memory_order_relaxed);
+        memcpy(&text[i * 8], &word, 8);
+      }
+      atomic_thread_fence(memory_order_acquire);
+      if (sequence.load(memory_order_relaxed) == before)
+        return text.substr(0, text.find('\0'));
+    }
+    return "";
+  }
+};
+
+thread_local WorkerStatus *currentWorker = nullptr;
+
+inline void setScanPhase(ScanPhase phase) {
+  if (currentWorker)
+    currentWorker->phase.store(static_cast<uint8_t>(phase),
+                               memory_order_relaxed);
+}
+
+#ifndef _WIN32
+void restoreTerminalOnSignal(int sig) {
+  const char restore[] = "\033[?25h\033[?1049l";
+  ssize_t ignored = write(STDERR_FILENO, restore, sizeof(restore) - 1);
+  (void)ignored;
+  signal(sig, SIG_DFL);
+  raise(sig);
+}
+#endif
+
+class ScanDashboard {
+public:
+  static constexpr size_t MAX_WORKERS = 256;
+
+  atomic<uint64_t> totalFiles{0};  // Known total, or enumerated so far
+  atomic<uint64_t> sharedQueue{0}; // Enumerated but not yet taken
+  atomic<bool> enumerating{false};
+
+  ScanDashboard() : slots(new WorkerStatus[MAX_WORKERS]) {}
+  ~ScanDashboard() { stop(); }
+
+  static bool isTerminal(int fd) {
+#ifdef _WIN32
+    return _isatty(fd) != 0;
+#else
+    return isatty(fd) != 0;
+#endif
+  }
+
+  WorkerStatus *slot(size_t index) {
+    if (index >= MAX_WORKERS)
+      return nullptr;
+    size_t seen = active.load();
+    while (seen < index + 1 && !active.compare_exchange_weak(seen, index + 1)) {
+    }
+    return &slots[index];
+  }
+
+  void start(const string &scanTitle) {
+    title = scanTitle;
+    startMicros = monotonicMicros();
+#ifdef _WIN32
+    HANDLE err = GetStdHandle(STD_ERROR_HANDLE);
+    DWORD mode = 0;
+    if (err != INVALID_HANDLE_VALUE && GetConsoleMode(err, &mode))
+      SetConsoleMode(err, mode | ENABLE_VIRTUAL_TERMINAL_PROCESSING);
+#else
+    signal(SIGINT, restoreTerminalOnSignal);
+    signal(SIGTERM, restoreTerminalOnSignal);
+#endif
+    cerr << "\033[?1049h\033[?25l\033[2J" << flush;
+    running = true;
+    renderer = thread([this] {
+      unique_lock<mutex> lock(wakeMutex);
+      while (running) {
+        lock.unlock();
+        render();
+        lock.lock();
+        wake.wait_for(lock, milliseconds(250), [this] { return !running; });
+      }
+    });
+  }
+
+  void stop() {
+    {
+      lock_guard<mutex> lock(wakeMutex);
+      if (!running)
+        return;
+      running = false;
+    }
+    wake.notify_all();
+    renderer.join();
+    cerr << "\033[?25h\033[?1049l" << flush;
+#ifndef _WIN32
+    signal(SIGINT, SIG_DFL);
+    signal(SIGTERM, SIG_DFL);
+#endif
+  }
+
+private:
+  static constexpr size_t HISTORY = 48;
+
+  struct Snapshot {
+    uint64_t files = 0, bytes = 0, errors = 0, queued = 0;
+    ScanPhase phase = ScanPhase::Idle;
+    int64_t started = 0;
+    string path;
+  };
+
+  static void terminalSize(int &columns, int &rows) {
+    columns = 100;
+    rows = 30;
+#ifdef _WIN32
+    CONSOLE_SCREEN_BUFFER_INFO info;
+    if (GetConsoleScreenBufferInfo(GetStdHandle(STD_ERROR_HANDLE), &info)) {
+      columns = info.srWindow.Right - info.srWindow.Left + 1;
+      rows = info.srWindow.Bottom - info.srWindow.Top + 1;
+    }
+#else
+    winsize size{};
+    if (ioctl(STDERR_FILENO, TIOCGWINSZ, &size) == 0 && size.ws_col > 0) {
+      columns = size.ws_col;
+      rows = size.ws_row;
+    }
+#endif
+    columns = max(columns, 60);
+    rows = max(rows, 12);
+  }
+
+  static string sparkline(const deque<double> &values, size_t width) {
+    static const char *bars[] = {"▁", "▂", "▃", "▄", "▅", "▆", "▇", "█"};
+    double peak = 0.0;
+    for (double v : values)
+      peak = max(peak, v);
+    string line;
+    size_t skip = values.size() > width ? values.size() - width : 0;
+    for (size_t i = skip; i < values.size(); i++) {
+      int level = peak > 0 ? static_cast<int>(values[i] / peak * 7.0 + 0.5) : 0;
+      line += bars[min(max(level, 0), 7)];
+    }
+    return line + string(width - (values.size() - skip), ' ');
+  }
+
+  // Keeps the end of `text`, which is the informative part of a path
+  static string fit(const string &text, size_t width) {
+    if (text.size() <= width)
+      return text;
+    return width > 3 ? "..." + text.substr(text.size() - (width - 3)) : "";
+  }
+
+  static void push(deque<double> &history, double value) {
+    history.push_back(value);
+    if (history.size() > HISTORY)
+      history.pop_front();
+  }
+
+  void render() {
+    int64_t now = monotonicMicros();
+    double interval =
+        lastFrame ? max(1e-3, (now - lastFrame) / 1e6) : 0.25;
+    lastFrame = now;
+
+    size_t count = active.load();
+    vector<Snapshot> workers(count);
+    Snapshot sum;
+    for (size_t i = 0; i < count; i++) {
+      const WorkerStatus &w = slots[i];
+      Snapshot &s = workers[i];
+      s.files = w.files.load(memory_order_relaxed);
+      s.bytes = w.bytes.load(memory_order_relaxed);
+      s.errors = w.errors.load(memory_order_relaxed);
+      s.queued = w.queued.load(memory_order_relaxed);
+      s.phase = static_cast<ScanPhase>(w.phase.load(memory_order_relaxed));
+      s.started = w.startedMicros.load(memory_order_relaxed);
+      if (s.started)
+        s.path = w.currentPath();
+      sum.files += s.files;
+      sum.bytes += s.bytes;
+      sum.errors += s.errors;
+      sum.queued += s.queued;
+    }
+    if (workerRates.size() < count) {
+      workerRates.resize(count);
+      lastWorkerFiles.resize(count);
+    }
+    push(fileRates, (sum.files - lastFiles) / interval);
+    push(byteRates, (sum.bytes - lastBytes) / interval);
+    lastFiles = sum.files;
+    lastBytes = sum.bytes;
+    for (size_t i = 0; i < count; i++) {
+      push(workerRates[i], (workers[i].files - lastWorkerFiles[i]) / interval);
+      lastWorkerFiles[i] = workers[i].files;
+    }
+
+    int columns, rows;
+    terminalSize(columns, rows);
+    size_t width = static_cast<size_t>(columns);
+    ostringstream out;
+    auto line = [&](const string &text) { out << text << "\033[K\n"; };
+
+    int64_t elapsed = (now - startMicros) / 1000000;
+    ostringstream head;
+    head << BOLD << " FileTypeAnalyzer Pro" << RESET << "  live scan of "
+         << fit(title, width / 2) << "   elapsed " << setfill('0') << setw(2)
+         << elapsed / 60 << ":" << setw(2) << elapsed % 60 << setfill(' ');
+    line(head.str());
+
+    uint64_t total = totalFiles.load(memory_order_relaxed);
+    uint64_t queue = sharedQueue.load(memory_order_relaxed) + sum.queued;
+    bool walking = enumerating.load(memory_order_relaxed);
+    ostringstream progressLine;
+    progressLine << " Files " << BOLD << sum.files << RESET << " / " << total
+                 << (walking ? "+" : "");
+    if (total > 0 && !walking) {
+      const int barWidth = 30;
+      double done = min(1.0, static_cast<double>(sum.files) / total);
+      int filled = static_cast<int>(done * barWidth);
+      progressLine << " (" << fixed << setprecision(1) << done * 100 << "%) "
+                   << GREEN;
+      for (int i = 0; i < barWidth; i++)
+        progressLine << (i < filled ? "█" : "░");
+      progressLine << RESET;
+    }
+    progressLine << "   Errors " << (sum.errors ? RED : "") << sum.errors
+                 << RESET << "   Queue " << queue
+                 << (walking ? " (enumerating)" : "");
+    line(progressLine.str());
+
+    size_t sparkWidth = min<size_t>(HISTORY, max<size_t>(8, width / 4));
+    ostringstream rates;
+    rates << " Throughput " << CYAN << sparkline(fileRates, sparkWidth)
+          << RESET << " " << fixed << setprecision(0) << setw(6)
+          << fileRates.back() << " files/s   " << CYAN
+          << sparkline(byteRates, sparkWidth) << RESET << " "
+          << formatSize(static_cast<uintmax_t>(byteRates.back())) << "/s";
+    line(rates.str());
+    line("");
+
+    // Workers, then the slowest files still in flight
+    const size_t slowRows = 5;
+    size_t room = rows > 12 ? static_cast<size_t>(rows) - 6 - slowRows - 2 : 4;
+    size_t shown = min(count, room);
+    size_t pathWidth = width > 62 ? width - 62 : 10;
+    ostringstream header;
+    header << BOLD << " " << left << setw(4) << "#" << setw(10) << "Phase"
+           << right << setw(8) << "Files" << setw(7) << "Errors" << setw(7)
+           << "Queue" << "  " << left << setw(14) << "Rate" << "  "
+           << "Current file" << RESET;
+    line(header.str());
+    for (size_t i = 0; i < shown; i++) {
+      const Snapshot &s = workers[i];
+      ostringstream row;
+      row << " " << left << setw(4) << i << setw(10) << phaseName(s.phase)
+          << right << setw(8) << s.files << setw(7) << s.errors << setw(7)
+          << s.queued << "  " << sparkline(workerRates[i], 14) << "  "
+          << fit(s.path, pathWidth);
+      line(row.str());
+    }
+    if (shown < count)
+      line(" ... " + to_string(count - shown) + " more workers");
+    line("");
+
+    vector<const Snapshot *> inFlight;
+    for (const auto &s : workers) {
+      if (s.started)
+        inFlight.push_back(&s);
+    }
+    sort(inFlight.begin(), inFlight.end(),
+         [](const Snapshot *a, const Snapshot *b) {
+           return a->started < b->started;
+         });
+    line(string(BOLD) + " Slowest in flight" + RESET);
+    for (size_t i = 0; i < slowRows; i++) {
+      if (i >= inFlight.size()) {
+        line("");
+        continue;
+      }
+      ostringstream row;
+      row << "  " << fixed << setprecision(2) << setw(8)
+          << (now - inFlight[i]->started) / 1e6 << "s  " << left << setw(9)
+          << phaseName(inFlight[i]->phase) << right
+          << fit(inFlight[i]->path, width > 24 ? width - 24 : 10);
+      line(row.str());
+    }
+    cerr << "\033[H" << out.str() << "\033[J" << flush;
+  }
+
+  unique_ptr<WorkerStatus[]> slots;
+  atomic<size_t> active{0};
+  string title;
+  int64_t startMicros = 0;
+
+  // Render thread only
+  int64_t lastFrame = 0;
+  uint64_t lastFiles = 0, lastBytes = 0;
+  deque<double> fileRates, byteRates;
+  vector<deque<double>> workerRates;
+  vector<uint64_t> lastWorkerFiles;
+
+  thread renderer;
+  mutex wakeMutex;
+  condition_variable wake;
+  bool running = false;
+};
+
+// Set while --dashboard is showing
+ScanDashboard *dashboard = nullptr;
+
+inline void dashboardBeginFile(const string &path) {
+  if (currentWorker)
+    currentWorker->beginFile(path);
+}
+
+inline void dashboardFinishFile(const FileInfo &info) {
+  if (currentWorker)
+    currentWorker->finishFile(info);
+}
+
+// Binds the calling thread to a dashboard slot for its lifetime
+class DashboardSlot {
+public:
+  explicit DashboardSlot(size_t index) {
+    currentWorker = dashboard ? dashboard->slot(index) : nullptr;
+  }
+  ~DashboardSlot() { currentWorker = nullptr; }
+  DashboardSlot(const DashboardSlot &) = delete;
+  DashboardSlot &operator=(const DashboardSlot &) = delete;
+};
+
+// ============================================================================
+// Partitioned Manifests (--emit-manifests)
+// ============================================================================
+// One NUL-delimited path list per type (or category), appended while the
+// scan runs so a downstream stage can start on its partition early. Records
+// are buffered per partition and written whole, so everything up to a
+// list's last NUL is complete. index.tsv is renamed into place last and
+// marks the set as finished.
+enum class ManifestKey { Type, Category };
+
+class ManifestWriter {
+public:
+  static constexpr size_t FLUSH_BYTES = 64 * 1024;
+  static constexpr milliseconds FLUSH_INTERVAL{500};
+
+  ManifestWriter(fs::path directory, ManifestKey key)
+      : dir(std::move(directory)), key(key) {}
+  ~ManifestWriter() {
+    string ignored;
+    close(ignored);
+  }
+
+  // Creates the directory and removes the lists a previous run indexed
+  bool open(string &error) {
+    error_code ec;
+    fs::create_directories(dir, ec);
+    if (!fs::is_directory(dir, ec)) {
+      error = "cannot create manifest directory " + dir.string();
+      return false;
+    }
+    ifstream previous(dir / "index.tsv");
+    string line;
+    while (getline(previous, line)) {
+      size_t tab2 = line.find('\t', line.find('\t') + 1);
+      size_t tab3 = tab2 == string::npos ? tab2 : line.find('\t', tab2 + 1);
+      if (line.empty() || line[0] == '#' || tab3 == string::npos)
+        continue;
+      string name = line.substr(tab2 + 1, tab3 - tab2 - 1);
+      // The index is only trusted to name lists inside this directory
+      fs::path list = dir / name;
+      if (isListFileName(name) &&
+          list.lexically_normal().parent_path() == dir.lexically_normal())
+        fs::remove(list, ec);
+    }
+    previous.close();
+    fs::remove(dir / "index.tsv", ec);
+    running = true;
+    flusher = thread([this]() { flushPeriodically(); });
+    return true;
+  }
+
+  // A bare "*.list" name, as listFileName produces: no separators, no
+  // parent references
+  static bool isListFileName(const string &name) {
+    const string suffix = ".list";
+    return name.size() > suffix.size() &&
+           name.compare(name.size() - suffix.size(), suffix.size(), suffix) ==
+               0 &&
+           name.find_first_of("/\\") == string::npos && name != ".." &&
+           name.find(':') == string::npos;
+  }
+
+  void add(const FileInfo &info) {
+    Partition &p = partition(key == ManifestKey::Type ? info.type
+                                                      : info.category);
+    lock_guard<mutex> lock(p.mtx);
+    p.buffer += info.path;
+    p.buffer += '\0';
+    p.files++;
+    p.bytes += info.size;
+    if (p.buffer.size() >= FLUSH_BYTES)
+      flush(p);
+  }
+
+  // Flushes every list and writes the index; returns false if any write
+  // failed
+  bool close(string &error) {
+    {
+      lock_guard<mutex> lock(flushMutex);
+      if (!running)
+        return true;
+      running = false;
+    }
+    flushWake.notify_all();
+    flusher.join();
+
+    lock_guard<mutex> lock(partitionsMutex);
+    ofstream index(dir / "index.tsv.tmp");
+    index << "# fta manifests v1\n# files\tbytes\tfile\t"
+          << (key == ManifestKey::Type ? "type" : "category") << "\n";
+    bool ok = true;
+    for (auto &[name, p] : partitions) {
+      lock_guard<mutex> partitionLock(p->mtx);
+      flush(*p);
+      p->out.close();
+      if (!p->error.empty() && ok) {
+        error = p->error;
+        ok = false;
+      }
+      index << p->files << "\t" << p->bytes << "\t" << p->fileName << "\t"
+            << name << "\n";
+    }
+    index.close();
+    error_code ec;
+    if (!index)
+      ec = make_error_code(errc::io_error);
+    else
+      fs::rename(dir / "index.tsv.tmp", dir / "index.tsv", ec);
+    if (ec && ok) {
+      error = "cannot write " + (dir / "index.tsv").string();
+      ok = false;
+    }
+    return ok;
+  }
+
+  size_t partitionCount() {
+    lock_guard<mutex> lock(partitionsMutex);
+    return partitions.size();
+  }
+
+  const fs::path &directory() const { return dir; }
+
+private:
+  struct Partition {
+    mutex mtx;
+    string fileName;
+    ofstream out;
+    string buffer;
+    uint64_t files = 0;
+    uint64_t bytes = 0; // Sum of the listed files' sizes
+    string error;
+  };
+
+  // "Empty/Corrupt" -> "Empty_Corrupt.list", kept unique
+  string listFileName(const string &name) {
+    string base;
+    for (char c : name) {
+      bool safe = isalnum(static_cast<unsigned char>(c)) || c == '-' ||
+                  c == '_' || c == '.';
+      base += safe ? c : '_';
+    }
+    if (base.empty() || base[0] == '.')
+      base = "_" + base;
+    string candidate = base + ".list";
+    for (int n = 2; !usedFileNames.insert(candidate).second; n++)
+      candidate = base + "-" + to_string(n) + ".list";
+    return candidate;
+  }
+
+  Partition &partition(const string &name) {
+    lock_guard<mutex> lock(partitionsMutex);
+    auto &slot = partitions[name];
+    if (!slot) {
+      slot = make_unique<Partition>();
+      slot->fileName = listFileName(name);
+      slot->out.open(dir / slot->fileName, ios::binary | ios::trunc);
+      if (!slot->out)
+        slot->error = "cannot create " + (dir / slot->fileName).string();
+    }
+    return *slot;
+  }
+
+  // Caller holds p.mtx
+  void flush(Partition &p) {
+    if (p.buffer.empty())
+      return;
+    if (p.out) {
+      p.out.write(p.buffer.data(), static_cast<streamsize>(p.buffer.size()));
+      p.out.flush();
+    }
+    if (!p.out && p.error.empty())
+      p.error = "cannot write " + (dir / p.fileName).string();
+    p.buffer.clear();
+  }
+
+  void flushPeriodically() {
+    unique_lock<mutex> lock(flushMutex);
+    while (running) {
+      flushWake.wait_for(lock, FLUSH_INTERVAL, [this]() { return !running; });
+      vector<Partition *> all;
+      {
+        lock_guard<mutex> partitionsLock(partitionsMutex);
+        for (auto &entry : partitions)
+          all.push_back(entry.second.get());
+      }
+      for (Partition *p : all) {
+        lock_guard<mutex> partitionLock(p->mtx);
+        flush(*p);
+      }
+    }
+  }
+
+  fs::path dir;
+  ManifestKey key;
+  mutex partitionsMutex;
+  map<string, unique_ptr<Partition>> partitions;
+  set<string> usedFileNames;
+
+  thread flusher;
+  mutex flushMutex;
+  condition_variable flushWake;
+  bool running = false;
+};
+
+// Set by --emit-manifests
+ManifestWriter *manifests = nullptr;
+
+inline void recordManifest(const FileInfo &info) {
+  if (manifests)
+    manifests->add(info);
+}
+
+// ============================================================================
+// Content Hashes (--hash)
+// ============================================================================
+// Full-content SHA-256, reported as "sha256" so reports can be ingested into
+// a content index. Reads on from the already-fetched head in 1 MB blocks.
+bool contentHashing = false;
+
+string hashFileContent(const unsigned char *head, size_t headLength,
+                       IoFile &file) {
+  const size_t BLOCK = 1 << 20;
+  thread_local vector<unsigned char> buffer;
+  buffer.resize(BLOCK);
+  Sha256 digest;
+  digest.update(head, headLength);
+  uint64_t offset = headLength;
+  while (true) {
+    size_t got = file.read(offset, buffer.data(), buffer.size());
+    digest.update(buffer.data(), got);
+    offset += got;
+    if (got < buffer.size())
+      break;
+  }
+  return toLowercase(bytesToHex(digest.finish()));
+}
+
+// 64 hex digits to a digest; false for anything else
+bool parseSha256Hex(const string &hex, unsigned char digest[32]) {
+  if (hex.size() != 64)
+    return false;
+  for (size_t i = 0; i < 32; i++) {
+    int value = 0;
+    for (size_t j = 0; j < 2; j++) {
+      char c = hex[2 * i + j];
+      int nibble = isdigit(static_cast<unsigned char>(c)) ? c - '0'
+                   : c >= 'a' && c <= 'f'                 ? c - 'a' + 10
+                   : c >= 'A' && c <= 'F'                 ? c - 'A' + 10
+                                                          : -1;
+      if (nibble < 0)
+        return false;
+      value = value * 16 + nibble;
+    }
+    digest[i] = static_cast<unsigned char>(value);
+  }
+  return true;
+}
+
+// ============================================================================
+// Core Detection Function (Thread-safe)
+// ============================================================================
+// Classifies the leading bytes of a file. `info` must already carry the size
+// and actual extension; `file`, when open, serves plugin ranges beyond
+// `data`. Works directly on caller-owned memory, so bindings can classify
+// buffers without copying them.
+void classifyContent(FileInfo &info, const unsigned char *data, size_t length,
+                     IoFile *file) {
+  // Calculate entropy (the histogram is shared with the fallback model)
+  ByteHistogram histogram;
+  byteHistogram(data, length, histogram);
+  info.entropy = calculateEntropy(histogram, length);
+
+  // Partial-content fingerprint (size + first block) for duplicate sketches
+  info.fingerprint = hash64(data, length, info.size) | 1;
+
+  // Match against the compiled signature tables (the caller's snapshot, if
+  // it already pinned one)
+  SignatureReadGuard signatures;
+  const SignatureMatcher &matcher = signatures->matcher;
+  SignatureCounters *counters =
+      signatureProfiling ? &signatureCounters(*signatures) : nullptr;
+  if (const SignatureRule *rule = matcher.match(data, length, counters)) {
+    info.type = rule->type;
+    info.category = rule->category;
+    info.description = matcher.describe(*rule, data, length);
+    info.mimeType = rule->mime;
+  }
+
+  // Fallback for text files
+  if (info.type == "Unknown") {
+    if (info.actualExtension == ".txt" || info.actualExtension == ".log" ||
+        info.actualExtension == ".md" || info.actualExtension == ".csv" ||
+        info.actualExtension == ".cfg" || info.actualExtension == ".ini") {
+      info.type = "Text";
+      info.category = "Text";
+      info.description = "Plain text file";
+    } else if (info.actualExtension == ".cpp" || info.actualExtension == ".c" ||
+               info.actualExtension == ".h" || info.actualExtension == ".hpp") {
+      info.type = "Source Code";
+      info.category = "Code";
+      info.description = "C/C++ source file";
+    } else if (info.actualExtension == ".py") {
+      info.type = "Python";
+      info.category = "Code";
+      info.description = "Python script";
+    } else if (info.actualExtension == ".js") {
+      info.type = "JavaScript";
+      info.category = "Code";
+      info.description = "JavaScript file";
+    } else if (info.actualExtension == ".java") {
+      info.type = "Java";
+      info.category = "Code";
+      info.description = "Java source file";
+    } else if (info.actualExtension == ".html" ||
+               info.actualExtension == ".htm") {
+      info.type = "HTML";
+      info.category = "Web";
+      info.description = "HTML document";
+    } else if (info.actualExtension == ".css") {
+      info.type = "CSS";
+      info.category = "Web";
+      info.description = "Cascading Style Sheet";
+    }
+  }
+
+  // Third-party refinements
+  if (!loadedPlugins.empty())
+    runPlugins(info, data, length, file);
+
+  // Statistical guess for what nothing else could identify
+  if (info.type == "Unknown" && fallbackModel.loaded()) {
+    ModelFeatures features;
+    extractFeatures(data, length, histogram, info.entropy, features);
+    vector<float> probs;
+    size_t best = fallbackModel.predict(features, probs);
+    if (probs[best] >= fallbackMinConfidence) {
+      info.predictedCategory = fallbackModel.classes[best];
+      info.predictionConfidence = probs[best];
+    }
+  }
+
+  // Character set for unidentified and text-like results
+  if (info.type == "Unknown" || info.category == "Text" ||
+      info.category == "Code" || info.category == "Web" ||
+      info.category == "Data") {
+    info.charset = detectCharset(data, length);
+  }
+
+  // Check for extension mismatch
+  if (info.type != "Unknown" && info.type != "Text" &&
+      !info.actualExtension.empty()) {
     string expectedExts = toLowercase(info.type);
     map<string, vector<string>> validExtensions = {
         {"png", {".png"}},
@@ -487,356 +5270,4682 @@ FileInfo analyzeFile(const fs::path &filePath) {
         {"doc/xls/ppt", {".doc", ".xls", ".ppt"}},
     };
 
-    string lowerType = toLowercase(info.type);
-    if (validExtensions.count(lowerType)) {
-      auto &valid = validExtensions[lowerType];
-      if (find(valid.begin(), valid.end(), info.actualExtension) ==
-          valid.end()) {
-        info.extensionMismatch = true;
-        info.detectedExtension = valid[0];
+    string lowerType = toLowercase(info.type);
+    if (validExtensions.count(lowerType)) {
+      auto &valid = validExtensions[lowerType];
+      if (find(valid.begin(), valid.end(), info.actualExtension) ==
+          valid.end()) {
+        info.extensionMismatch = true;
+        info.detectedExtension = valid[0];
+      }
+    }
+  }
+}
+
+// `metadata`, when given, carries size/owner/times already gathered during
+// enumeration so the file is not stat'ed twice. With `chunks`, the rest of
+// the file is read after classification and chunked into the dedup index.
+FileInfo analyzeFile(const fs::path &filePath,
+                     const FileInfo *metadata = nullptr,
+                     ChunkDedupIndex *chunks = nullptr) {
+  FileInfo info;
+  info.path = filePath.string();
+  info.name = filePath.filename().string();
+  info.isCorrupt = false;
+  info.extensionMismatch = false;
+  info.type = "Unknown";
+  info.category = "Unknown";
+  info.description = "Unrecognized file type";
+  info.entropy = 0.0;
+  info.hash = "";
+
+  if (!validatePath(filePath)) {
+    info.type = "Error";
+    info.description = "Invalid file path (security check failed)";
+    return info;
+  }
+
+  // One rule set for the whole file, even if signatures reload mid-read
+  SignatureReadGuard signatures;
+  auto startTime = high_resolution_clock::now();
+
+  if (metadata) {
+    info.size = metadata->size;
+    info.uid = metadata->uid;
+    info.gid = metadata->gid;
+    info.modifiedTime = metadata->modifiedTime;
+    info.accessedTime = metadata->accessedTime;
+    info.metadataKnown = metadata->metadataKnown;
+  } else if (ioBackend->stat(filePath.string(), info) != IoKind::File) {
+    info.size = 0;
+    info.metadataKnown = false;
+  }
+
+  info.actualExtension = toLowercase(filePath.extension().string());
+
+  setScanPhase(ScanPhase::Open);
+  unique_ptr<IoFile> file = ioBackend->open(filePath.string());
+  if (!file) {
+    info.type = "Unreadable";
+    info.description = "Could not open file";
+    return info;
+  }
+
+  // Read bytes for analysis
+  size_t readSize =
+      min(static_cast<uintmax_t>(ioBackend->headBytes()), info.size);
+  vector<unsigned char> buffer(readSize);
+  setScanPhase(ScanPhase::Read);
+  size_t bytesRead = file->read(0, buffer.data(), buffer.size());
+
+  if (bytesRead < 2) {
+    info.isCorrupt = true;
+    info.type = "Empty/Corrupt";
+    info.description = "File too small to identify";
+    if (contentHashing)
+      info.hash = hashFileContent(buffer.data(), bytesRead, *file);
+    return info;
+  }
+
+  buffer.resize(bytesRead);
+  setScanPhase(ScanPhase::Classify);
+  classifyContent(info, buffer.data(), buffer.size(), file.get());
+
+  if (compressionSampleBudget > 0) {
+    setScanPhase(ScanPhase::Compress);
+    measureCompressibility(info, buffer.data(), buffer.size(), *file,
+                           compressionSampleBudget);
+  }
+
+  if (chunks) {
+    setScanPhase(ScanPhase::Chunk);
+    chunkFile(buffer.data(), buffer.size(), *file, chunks->overall,
+              chunks->forType(info.type));
+  }
+
+  if (contentHashing) {
+    setScanPhase(ScanPhase::Hash);
+    info.hash = hashFileContent(buffer.data(), buffer.size(), *file);
+  }
+
+  auto endTime = high_resolution_clock::now();
+  info.analysisTime =
+      static_cast<double>(
+          duration_cast<microseconds>(endTime - startTime).count()) /
+      1000.0;
+
+  return info;
+}
+
+// ============================================================================
+// Resource Limits (cgroup-aware sizing)
+// ============================================================================
+// hardware_concurrency() reports host cores, which inside a container with a
+// CPU quota oversubscribes the workers and gets them throttled. The worker
+// count, and with it the number of files read concurrently, follows the
+// tightest of: host CPUs, the affinity mask (which reflects the cpuset), the
+// cgroup CPU quota, and how many worker buffers fit in half the cgroup memory
+// limit. Both cgroup v2 and v1 hierarchies are read; FTA_CGROUP_ROOT points
+// detection at another tree for testing.
+const unsigned int MAX_WORKERS = 8;
+const uint64_t UNLIMITED_MEMORY_FLOOR = 1ULL << 60; // v1 "no limit" values
+
+struct ResourceLimits {
+  unsigned int hostCpus = 0;
+  unsigned int affinityCpus = 0; // 0 if unknown
+  double cpuQuota = 0.0;         // CPUs allowed by the quota, 0 = none
+  uint64_t memoryLimit = 0;      // Bytes, 0 = none
+  string cgroup = "none";        // "v2", "v1" or "none"
+
+  unsigned int effectiveCpus() const {
+    unsigned int cpus = hostCpus ? hostCpus : 4;
+    if (affinityCpus)
+      cpus = min(cpus, affinityCpus);
+    if (cpuQuota > 0)
+      cpus = min(cpus, max(1u, static_cast<unsigned int>(ceil(cpuQuota))));
+    return cpus;
+  }
+
+  // Memory the scan may spend on per-worker buffers and indexes
+  uint64_t bufferBudget() const { return memoryLimit / 2; }
+};
+
+string readFirstLine(const fs::path &path) {
+  ifstream in(path);
+  string line;
+  getline(in, line);
+  return line;
+}
+
+// Walks from the process's cgroup directory up to the hierarchy root, since
+// a limit on any ancestor applies; returns the existing directories
+vector<fs::path> cgroupChain(const fs::path &mount, const string &relative) {
+  vector<fs::path> chain;
+  fs::path dir = mount / fs::path(relative).relative_path();
+  error_code ec;
+  while (true) {
+    if (fs::is_directory(dir, ec))
+      chain.push_back(dir);
+    if (dir == mount || !dir.has_relative_path() ||
+        dir.parent_path() == dir)
+      break;
+    dir = dir.parent_path();
+    if (dir.string().size() < mount.string().size())
+      break;
+  }
+  if (chain.empty() || chain.back() != mount)
+    chain.push_back(mount);
+  return chain;
+}
+
+void readCgroupV2(const fs::path &root, const string &relative,
+                  ResourceLimits &limits) {
+  for (const auto &dir : cgroupChain(root, relative)) {
+    // cpu.max: "<quota> <period>" or "max <period>"
+    istringstream cpu(readFirstLine(dir / "cpu.max"));
+    string quota;
+    double period = 0;
+    if (cpu >> quota >> period && quota != "max" && period > 0) {
+      double cpus = atof(quota.c_str()) / period;
+      if (cpus > 0 && (limits.cpuQuota == 0 || cpus < limits.cpuQuota))
+        limits.cpuQuota = cpus;
+    }
+    string memory = readFirstLine(dir / "memory.max");
+    if (!memory.empty() && memory != "max") {
+      uint64_t bytes = strtoull(memory.c_str(), nullptr, 10);
+      if (bytes > 0 && (limits.memoryLimit == 0 || bytes < limits.memoryLimit))
+        limits.memoryLimit = bytes;
+    }
+  }
+}
+
+void readCgroupV1(const fs::path &root, const map<string, string> &paths,
+                  ResourceLimits &limits) {
+  auto controller = [&](const string &name) -> pair<fs::path, string> {
+    for (const auto &[controllers, relative] : paths) {
+      istringstream list(controllers);
+      for (string c; getline(list, c, ',');) {
+        if (c == name) {
+          fs::path mount = root / controllers;
+          error_code ec;
+          if (!fs::is_directory(mount, ec))
+            mount = root / name;
+          return {mount, relative};
+        }
+      }
+    }
+    return {root / name, "/"};
+  };
+
+  auto [cpuMount, cpuPath] = controller("cpu");
+  for (const auto &dir : cgroupChain(cpuMount, cpuPath)) {
+    double quota = atof(readFirstLine(dir / "cpu.cfs_quota_us").c_str());
+    double period = atof(readFirstLine(dir / "cpu.cfs_period_us").c_str());
+    if (quota > 0 && period > 0) {
+      double cpus = quota / period;
+      if (limits.cpuQuota == 0 || cpus < limits.cpuQuota)
+        limits.cpuQuota = cpus;
+    }
+  }
+  auto [memoryMount, memoryPath] = controller("memory");
+  for (const auto &dir : cgroupChain(memoryMount, memoryPath)) {
+    string memory = readFirstLine(dir / "memory.limit_in_bytes");
+    uint64_t bytes = strtoull(memory.c_str(), nullptr, 10);
+    if (bytes > 0 && bytes < UNLIMITED_MEMORY_FLOOR &&
+        (limits.memoryLimit == 0 || bytes < limits.memoryLimit))
+      limits.memoryLimit = bytes;
+  }
+}
+
+ResourceLimits detectResourceLimits(const fs::path &root,
+                                    const fs::path &procCgroup) {
+  ResourceLimits limits;
+  limits.hostCpus = thread::hardware_concurrency();
+#ifdef __linux__
+  cpu_set_t set;
+  if (sched_getaffinity(0, sizeof(set), &set) == 0)
+    limits.affinityCpus = static_cast<unsigned int>(CPU_COUNT(&set));
+#endif
+
+  // /proc/self/cgroup: "<id>:<controllers>:<path>", v2 is "0::<path>"
+  map<string, string> v1Paths;
+  string v2Path;
+  bool haveV2 = false;
+  ifstream in(procCgroup);
+  for (string line; getline(in, line);) {
+    size_t first = line.find(':');
+    size_t second = first == string::npos ? first : line.find(':', first + 1);
+    if (second == string::npos)
+      continue;
+    string controllers = line.substr(first + 1, second - first - 1);
+    string path = line.substr(second + 1);
+    if (controllers.empty()) {
+      v2Path = path;
+      haveV2 = true;
+    } else if (controllers.rfind("name=", 0) != 0) {
+      v1Paths[controllers] = path;
+    }
+  }
+
+  error_code ec;
+  if (haveV2 && fs::exists(root / "cgroup.controllers", ec)) {
+    limits.cgroup = "v2";
+    readCgroupV2(root, v2Path, limits);
+  } else if (!v1Paths.empty()) {
+    limits.cgroup = "v1";
+    readCgroupV1(root, v1Paths, limits);
+  }
+  return limits;
+}
+
+const ResourceLimits &resourceLimits() {
+  static const ResourceLimits limits = [] {
+    const char *root = getenv("FTA_CGROUP_ROOT");
+    return detectResourceLimits(root && *root ? root : "/sys/fs/cgroup",
+                                "/proc/self/cgroup");
+  }();
+  return limits;
+}
+
+// Memory one worker holds at once: its 64 KB read buffer and compressor
+// state, plus the chunk read block and index when chunking whole files
+uint64_t workerMemoryBytes(bool chunkDedup) {
+  uint64_t bytes = 256 * 1024;
+  if (chunkDedup)
+    bytes += (1 << 20) + CDC_MAX_CHUNK + chunkIndexCapacity * 2 * 64;
+  return bytes;
+}
+
+// Default worker count: effective CPUs, capped at MAX_WORKERS and at the
+// number of workers whose buffers fit in the memory budget
+unsigned int
+defaultWorkerCount(bool chunkDedup = false,
+                   const ResourceLimits &limits = resourceLimits()) {
+  unsigned int workers = min(limits.effectiveCpus(), MAX_WORKERS);
+  if (limits.memoryLimit > 0) {
+    uint64_t fit = limits.bufferBudget() / workerMemoryBytes(chunkDedup);
+    workers = static_cast<unsigned int>(
+        max<uint64_t>(1, min<uint64_t>(workers, fit)));
+  }
+  return workers;
+}
+
+// Shrinks the chunk index so `workers` copies stay inside the budget
+void fitChunkIndexToBudget(unsigned int workers) {
+  uint64_t budget = resourceLimits().bufferBudget();
+  if (budget == 0)
+    return;
+  uint64_t perWorker = budget / max(1u, workers);
+  uint64_t fixedBytes = 256 * 1024 + (1 << 20) + CDC_MAX_CHUNK;
+  uint64_t entries = perWorker > fixedBytes ? (perWorker - fixedBytes) / 128 : 0;
+  chunkIndexCapacity = static_cast<size_t>(
+      min<uint64_t>(chunkIndexCapacity, max<uint64_t>(1 << 12, entries)));
+}
+
+string describeLimits(const ResourceLimits &limits) {
+  stringstream ss;
+  ss << limits.effectiveCpus() << " of " << limits.hostCpus << " CPUs";
+  if (limits.cgroup != "none") {
+    ss << " (cgroup " << limits.cgroup;
+    if (limits.cpuQuota > 0)
+      ss << ", quota " << fixed << setprecision(2) << limits.cpuQuota;
+    if (limits.affinityCpus && limits.affinityCpus < limits.hostCpus)
+      ss << ", cpuset " << limits.affinityCpus;
+    ss << ", memory "
+       << (limits.memoryLimit ? formatSize(limits.memoryLimit) : "unlimited")
+       << ")";
+  }
+  return ss.str();
+}
+
+// ============================================================================
+// Multi-threaded File Analysis
+// ============================================================================
+vector<FileInfo> analyzeFilesParallel(const vector<fs::path> &filePaths,
+                                      ProgressTracker &progress,
+                                      bool showProgress,
+                                      ScanAggregates &aggregates) {
+  vector<FileInfo> results(filePaths.size());
+  mutex aggregatesMutex;
+  progress.setTotal(filePaths.size());
+  if (dashboard)
+    dashboard->totalFiles = filePaths.size();
+
+  unsigned int threadCount = defaultWorkerCount(aggregates.options.chunkDedup);
+
+  // Chunk files for parallel processing
+  vector<future<void>> futures;
+  size_t chunkSize = max<size_t>(1, filePaths.size() / threadCount);
+
+  for (size_t i = 0; i < filePaths.size(); i += chunkSize) {
+    size_t end = min(i + chunkSize, filePaths.size());
+
+    futures.push_back(async(launch::async, [&, i, end]() {
+      DashboardSlot slot(i / chunkSize);
+      if (currentWorker)
+        currentWorker->queued = end - i;
+      ScanAggregates local = aggregates.emptyCopy();
+      for (size_t j = i; j < end; j++) {
+        dashboardBeginFile(filePaths[j].string());
+        results[j] = analyzeFile(
+            filePaths[j], nullptr,
+            local.options.chunkDedup ? &local.chunks : nullptr);
+        local.add(results[j]);
+        progress.update(results[j].name);
+        dashboardFinishFile(results[j]);
+        recordManifest(results[j]);
+        if (currentWorker)
+          currentWorker->queued--;
+      }
+      lock_guard<mutex> lock(aggregatesMutex);
+      aggregates.merge(local);
+    }));
+  }
+
+  // Wait for all threads with progress display
+  if (showProgress) {
+    while (true) {
+      auto [current, total, fileName] = progress.getProgress();
+      if (current >= total)
+        break;
+
+      const int barWidth = 40;
+      float progressPct =
+          static_cast<float>(current) / static_cast<float>(total);
+      int pos = static_cast<int>(barWidth * progressPct);
+
+      cout << "\r" << CYAN << "Progress: " << RESET << setw(3)
+           << static_cast<int>(progressPct * 100) << "% [";
+      for (int k = 0; k < barWidth; ++k) {
+        if (k < pos)
+          cout << GREEN << "█" << RESET;
+        else
+          cout << "░";
+      }
+      cout << "] " << current << "/" << total << " ";
+
+      string shortName = fileName.substr(0, 30);
+      if (fileName.length() > 30)
+        shortName += "...";
+      cout << shortName << "        ";
+      cout.flush();
+
+      this_thread::sleep_for(milliseconds(50));
+    }
+  }
+
+  // Wait for all threads to complete
+  for (auto &f : futures) {
+    f.wait();
+  }
+
+  return results;
+}
+
+// ============================================================================
+// Progress Bar
+// ============================================================================
+void showProgressBar(size_t current, size_t total, const string &fileName) {
+  const int barWidth = 40;
+  float progress = static_cast<float>(current) / static_cast<float>(total);
+  int pos = static_cast<int>(barWidth * progress);
+
+  cout << "\r" << CYAN << "Progress: " << RESET << setw(3)
+       << static_cast<int>(progress * 100) << "% [";
+  for (int i = 0; i < barWidth; ++i) {
+    if (i < pos)
+      cout << GREEN << "█" << RESET;
+    else
+      cout << "░";
+  }
+  cout << "] " << current << "/" << total << " " << fileName.substr(0, 30);
+  if (fileName.length() > 30)
+    cout << "...";
+  cout << "        ";
+  cout.flush();
+}
+
+// ============================================================================
+// JSON Output
+// ============================================================================
+string escapeJson(const string &s) {
+  string result;
+  for (char c : s) {
+    switch (c) {
+    case '"':
+      result += "\\\"";
+      break;
+    case '\\':
+      result += "\\\\";
+      break;
+    case '\n':
+      result += "\\n";
+      break;
+    case '\r':
+      result += "\\r";
+      break;
+    case '\t':
+      result += "\\t";
+      break;
+    default:
+      result += c;
+    }
+  }
+  return result;
+}
+
+// ============================================================================
+// Prioritized Scheduling (--order)
+// ============================================================================
+// Enumeration runs on its own thread and pushes each file, with the metadata
+// it stat'ed, into a priority queue the workers drain. Workers always take
+// the most relevant file enumerated so far, so results for the newest or
+// largest files arrive first without waiting for a full walk and sort.
+enum class ScanOrder { Directory, MtimeDesc, SizeDesc, SizeAsc };
+
+bool parseScanOrder(const string &name, ScanOrder &order) {
+  if (name == "directory")
+    order = ScanOrder::Directory;
+  else if (name == "mtime-desc")
+    order = ScanOrder::MtimeDesc;
+  else if (name == "size-desc")
+    order = ScanOrder::SizeDesc;
+  else if (name == "size-asc")
+    order = ScanOrder::SizeAsc;
+  else
+    return false;
+  return true;
+}
+
+struct ScanItem {
+  fs::path path;
+  FileInfo metadata;
+  int64_t priority = 0; // Higher is scanned first
+  uint64_t sequence = 0; // Enumeration order breaks ties
+};
+
+int64_t scanPriority(ScanOrder order, const FileInfo &metadata) {
+  switch (order) {
+  case ScanOrder::MtimeDesc:
+    return metadata.modifiedTime;
+  case ScanOrder::SizeDesc:
+    return static_cast<int64_t>(min<uintmax_t>(metadata.size, INT64_MAX));
+  case ScanOrder::SizeAsc:
+    return -static_cast<int64_t>(min<uintmax_t>(metadata.size, INT64_MAX));
+  default:
+    return 0;
+  }
+}
+
+// Unbounded MPMC priority queue; pop() blocks until an item is available or
+// the queue has been closed and drained
+class ScanQueue {
+private:
+  struct Compare {
+    bool operator()(const ScanItem &a, const ScanItem &b) const {
+      if (a.priority != b.priority)
+        return a.priority < b.priority;
+      return a.sequence > b.sequence;
+    }
+  };
+
+  mutex mtx;
+  condition_variable ready;
+  priority_queue<ScanItem, vector<ScanItem>, Compare> heap;
+  bool closed = false;
+
+public:
+  void push(ScanItem item) {
+    {
+      lock_guard<mutex> lock(mtx);
+      heap.push(std::move(item));
+    }
+    ready.notify_one();
+  }
+
+  bool pop(ScanItem &item) {
+    unique_lock<mutex> lock(mtx);
+    ready.wait(lock, [this] { return closed || !heap.empty(); });
+    if (heap.empty())
+      return false;
+    item = heap.top();
+    heap.pop();
+    return true;
+  }
+
+  void close() {
+    {
+      lock_guard<mutex> lock(mtx);
+      closed = true;
+    }
+    ready.notify_all();
+  }
+};
+
+// Walks `root` (or takes a single file) and analyzes files in `order` on
+// `threadCount` workers. Results are returned in completion order;
+// `onResult`, if set, sees each one as soon as it is ready.
+vector<FileInfo>
+analyzeFilesOrdered(const fs::path &root, bool recursive, ScanOrder order,
+                    unsigned int threadCount, bool showProgress,
+                    ScanAggregates &aggregates,
+                    const function<void(const FileInfo &)> &onResult) {
+  ScanQueue queue;
+  ProgressTracker progress;
+  atomic<size_t> enumerated{0};
+  atomic<bool> enumerationDone{false};
+  string enumerationError;
+
+  if (dashboard)
+    dashboard->enumerating = true;
+  thread producer([&]() {
+    uint64_t sequence = 0;
+    auto enqueue = [&](const string &path) {
+      ScanItem item;
+      item.path = path;
+      ioBackend->stat(path, item.metadata);
+      item.priority = scanPriority(order, item.metadata);
+      item.sequence = sequence++;
+      if (dashboard) {
+        dashboard->sharedQueue++;
+        dashboard->totalFiles++;
+      }
+      queue.push(std::move(item));
+      enumerated++;
+    };
+    try {
+      walkFiles(*ioBackend, root.string(), recursive, enqueue);
+    } catch (const fs::filesystem_error &e) {
+      enumerationError = e.what();
+    }
+    enumerationDone = true;
+    if (dashboard)
+      dashboard->enumerating = false;
+    queue.close();
+  });
+
+  vector<FileInfo> results;
+  mutex resultsMutex;
+  vector<thread> workers;
+  for (unsigned int t = 0; t < max(1u, threadCount); t++) {
+    workers.emplace_back([&, t]() {
+      DashboardSlot slot(t);
+      ScanAggregates local = aggregates.emptyCopy();
+      ScanItem item;
+      while (queue.pop(item)) {
+        if (dashboard)
+          dashboard->sharedQueue--;
+        dashboardBeginFile(item.path.string());
+        FileInfo info =
+            analyzeFile(item.path, &item.metadata,
+                        local.options.chunkDedup ? &local.chunks : nullptr);
+        local.add(info);
+        progress.update(info.name);
+        dashboardFinishFile(info);
+        recordManifest(info);
+        lock_guard<mutex> lock(resultsMutex);
+        if (onResult)
+          onResult(info);
+        results.push_back(std::move(info));
+      }
+      lock_guard<mutex> lock(resultsMutex);
+      aggregates.merge(local);
+    });
+  }
+
+  // The total keeps growing while enumeration is still running
+  if (showProgress) {
+    while (true) {
+      bool done = enumerationDone;
+      progress.setTotal(enumerated);
+      auto [current, total, fileName] = progress.getProgress();
+      if (total > 0)
+        showProgressBar(current, total, fileName);
+      if (done && current >= total)
+        break;
+      this_thread::sleep_for(milliseconds(50));
+    }
+  }
+
+  producer.join();
+  for (auto &w : workers)
+    w.join();
+
+  if (!enumerationError.empty())
+    throw fs::filesystem_error(enumerationError, root,
+                               make_error_code(errc::io_error));
+  return results;
+}
+
+// One result as a single-line JSON object (no trailing newline)
+void writeFileJson(ostream &out, const FileInfo &f) {
+  out << "{\"name\": \"" << escapeJson(f.name) << "\", \"path\": \""
+      << escapeJson(f.path) << "\", \"type\": \"" << escapeJson(f.type)
+      << "\", \"category\": \"" << escapeJson(f.category)
+      << "\", \"description\": \"" << escapeJson(f.description)
+      << "\", \"size\": " << f.size;
+  if (!f.hash.empty())
+    out << ", \"sha256\": \"" << f.hash << "\"";
+  out << ", \"modifiedTime\": "
+      << f.modifiedTime << ", \"entropy\": " << fixed << setprecision(4)
+      << f.entropy << ", \"isCorrupt\": " << (f.isCorrupt ? "true" : "false")
+      << ", \"extensionMismatch\": "
+      << (f.extensionMismatch ? "true" : "false");
+  if (f.compressionRatio > 0)
+    out << ", \"compressionRatio\": " << setprecision(3) << f.compressionRatio;
+  if (!f.predictedCategory.empty())
+    out << ", \"predictedCategory\": \"" << escapeJson(f.predictedCategory)
+        << "\", \"predictionConfidence\": " << setprecision(3)
+        << f.predictionConfidence;
+  out << ", \"analysisTime\": " << setprecision(2) << f.analysisTime << "}";
+}
+
+// One compact JSON object per line, for --stream
+void outputFileJsonLine(const FileInfo &f) {
+  writeFileJson(cout, f);
+  cout << "\n";
+  cout.flush();
+}
+
+string merkleSummaryJson(const MerkleSummary &merkle) {
+  return "{\"root\": \"" + merkle.rootHash + "\", \"directories\": " +
+         to_string(merkle.directories) + ", \"file\": \"" +
+         escapeJson(merkle.file) + "\"}";
+}
+
+// ============================================================================
+// Directory Rollups (du-by-type)
+// ============================================================================
+// Built from ScanAggregates::byDirectory after the scan: each directory's own
+// totals are added into its parent, deepest first, so memory stays
+// proportional to the number of directories rather than files.
+struct DirectoryNode {
+  TypeBreakdown types;
+  TypeTotals total;
+  vector<string> children;
+};
+
+struct DirectoryTree {
+  string root;
+  map<string, DirectoryNode> nodes;
+};
+
+DirectoryTree buildDirectoryTree(const ScanAggregates &aggregates,
+                                 const fs::path &rootDir) {
+  DirectoryTree tree;
+  tree.root = rootDir.string();
+  while (tree.root.size() > 1 &&
+         (tree.root.back() == '/' || tree.root.back() == '\\'))
+    tree.root.pop_back();
+  tree.nodes[tree.root];
+
+  // Seed each directory with its own files and create missing ancestors
+  for (const auto &[dir, types] : aggregates.byDirectory) {
+    auto &node = tree.nodes[dir];
+    for (const auto &[type, totals] : types) {
+      node.types[type].merge(totals);
+      node.total.merge(totals);
+    }
+    fs::path current = dir;
+    while (current.string() != tree.root && current.has_parent_path() &&
+           current.parent_path() != current) {
+      current = current.parent_path();
+      if (!tree.nodes.try_emplace(current.string()).second)
+        break; // Already linked up to the root
+    }
+  }
+  for (auto &[dir, node] : tree.nodes) {
+    if (dir == tree.root)
+      continue;
+    auto parentIt = tree.nodes.find(fs::path(dir).parent_path().string());
+    if (parentIt != tree.nodes.end())
+      parentIt->second.children.push_back(dir);
+  }
+
+  // Roll up bottom-up: deeper paths first
+  vector<pair<size_t, string>> byDepth;
+  for (const auto &[dir, node] : tree.nodes) {
+    fs::path dirPath = dir;
+    size_t depth =
+        static_cast<size_t>(distance(dirPath.begin(), dirPath.end()));
+    byDepth.push_back({depth, dir});
+  }
+  sort(byDepth.begin(), byDepth.end(), greater<>());
+  for (const auto &[depth, dir] : byDepth) {
+    if (dir == tree.root)
+      continue;
+    auto parentIt = tree.nodes.find(fs::path(dir).parent_path().string());
+    if (parentIt == tree.nodes.end())
+      continue;
+    const auto &node = tree.nodes[dir];
+    for (const auto &[type, totals] : node.types)
+      parentIt->second.types[type].merge(totals);
+    parentIt->second.total.merge(node.total);
+  }
+
+  // Largest subtrees first
+  for (auto &[dir, node] : tree.nodes) {
+    sort(node.children.begin(), node.children.end(),
+         [&](const string &a, const string &b) {
+           return tree.nodes[a].total.bytes > tree.nodes[b].total.bytes;
+         });
+  }
+  return tree;
+}
+
+vector<pair<string, TypeTotals>> typesBySize(const TypeBreakdown &types) {
+  vector<pair<string, TypeTotals>> sorted(types.begin(), types.end());
+  sort(sorted.begin(), sorted.end(), [](const auto &a, const auto &b) {
+    return a.second.bytes > b.second.bytes;
+  });
+  return sorted;
+}
+
+void outputTypeBreakdownJson(const TypeBreakdown &types) {
+  cout << "[";
+  bool first = true;
+  for (const auto &[type, totals] : typesBySize(types)) {
+    if (!first)
+      cout << ", ";
+    first = false;
+    cout << "{\"type\": \"" << escapeJson(type) << "\", \"count\": "
+         << totals.count << ", \"bytes\": " << totals.bytes << "}";
+  }
+  cout << "]";
+}
+
+void outputDirectoryTreeJson(const DirectoryTree &tree, const string &dir,
+                             int depth, int maxDepth, const string &indent) {
+  const auto &node = tree.nodes.at(dir);
+  cout << indent << "{\"path\": \"" << escapeJson(dir)
+       << "\", \"files\": " << node.total.count
+       << ", \"bytes\": " << node.total.bytes << ", \"types\": ";
+  outputTypeBreakdownJson(node.types);
+  if (depth < maxDepth && !node.children.empty()) {
+    cout << ", \"children\": [\n";
+    for (size_t i = 0; i < node.children.size(); i++) {
+      outputDirectoryTreeJson(tree, node.children[i], depth + 1, maxDepth,
+                              indent + "  ");
+      cout << (i + 1 < node.children.size() ? ",\n" : "\n");
+    }
+    cout << indent << "]";
+  }
+  cout << "}";
+}
+
+void outputTopTypes(const TypeBreakdown &breakdown, size_t limit = 3) {
+  auto types = typesBySize(breakdown);
+  for (size_t i = 0; i < types.size() && i < limit; i++) {
+    cout << (i == 0 ? "  [" : ", ") << types[i].first << " "
+         << formatSize(types[i].second.bytes);
+  }
+  if (!types.empty())
+    cout << (types.size() > limit ? ", ...]" : "]");
+}
+
+void outputDirectoryTreeTerminal(const DirectoryTree &tree, const string &dir,
+                                 int depth, int maxDepth,
+                                 const string &prefix) {
+  const auto &node = tree.nodes.at(dir);
+  string label = depth == 0 ? dir : fs::path(dir).filename().string() + "/";
+  cout << prefix << BOLD << label << RESET << "  "
+       << formatSize(node.total.bytes) << ", " << node.total.count
+       << " files";
+  outputTopTypes(node.types);
+  cout << "\n";
+  if (depth >= maxDepth)
+    return;
+  for (const auto &child : node.children)
+    outputDirectoryTreeTerminal(tree, child, depth + 1, maxDepth,
+                                prefix + "   ");
+}
+
+// ============================================================================
+// Ownership and Age Breakdowns
+// ============================================================================
+TypeTotals breakdownTotal(const TypeBreakdown &types) {
+  TypeTotals total;
+  for (const auto &[type, totals] : types)
+    total.merge(totals);
+  return total;
+}
+
+string ownerName(uint32_t uid, bool isGroup) {
+#ifndef _WIN32
+  vector<char> buffer(4096);
+  if (isGroup) {
+    struct group grp, *result = nullptr;
+    if (getgrgid_r(uid, &grp, buffer.data(), buffer.size(), &result) == 0 &&
+        result)
+      return result->gr_name;
+  } else {
+    struct passwd pwd, *result = nullptr;
+    if (getpwuid_r(uid, &pwd, buffer.data(), buffer.size(), &result) == 0 &&
+        result)
+      return result->pw_name;
+  }
+#else
+  (void)isGroup;
+#endif
+  return to_string(uid);
+}
+
+// Owners sorted by bytes, largest first
+vector<pair<uint32_t, TypeTotals>>
+ownersBySize(const map<uint32_t, TypeBreakdown> &owners) {
+  vector<pair<uint32_t, TypeTotals>> sorted;
+  for (const auto &[id, types] : owners)
+    sorted.push_back({id, breakdownTotal(types)});
+  sort(sorted.begin(), sorted.end(), [](const auto &a, const auto &b) {
+    return a.second.bytes > b.second.bytes;
+  });
+  return sorted;
+}
+
+void outputOwnersJson(const map<uint32_t, TypeBreakdown> &owners,
+                      bool isGroup) {
+  cout << "[\n";
+  auto sorted = ownersBySize(owners);
+  for (size_t i = 0; i < sorted.size(); i++) {
+    uint32_t id = sorted[i].first;
+    cout << "    {\"" << (isGroup ? "gid" : "uid") << "\": " << id << ", \""
+         << (isGroup ? "group" : "user") << "\": \""
+         << escapeJson(ownerName(id, isGroup))
+         << "\", \"files\": " << sorted[i].second.count
+         << ", \"bytes\": " << sorted[i].second.bytes << ", \"types\": ";
+    outputTypeBreakdownJson(owners.at(id));
+    cout << "}" << (i + 1 < sorted.size() ? ",\n" : "\n");
+  }
+  cout << "  ]";
+}
+
+void outputAgesJson(
+    const array<TypeBreakdown, AGE_BUCKETS.size()> &buckets) {
+  cout << "[\n";
+  for (size_t i = 0; i < buckets.size(); i++) {
+    TypeTotals total = breakdownTotal(buckets[i]);
+    cout << "      {\"bucket\": \"" << AGE_BUCKETS[i].first
+         << "\", \"files\": " << total.count << ", \"bytes\": " << total.bytes
+         << ", \"types\": ";
+    outputTypeBreakdownJson(buckets[i]);
+    cout << "}" << (i + 1 < buckets.size() ? ",\n" : "\n");
+  }
+  cout << "    ]";
+}
+
+void outputOwnersTerminal(const map<uint32_t, TypeBreakdown> &owners,
+                          bool isGroup) {
+  for (const auto &[id, total] : ownersBySize(owners)) {
+    cout << " " << setw(18) << left << ownerName(id, isGroup) << " │ "
+         << setw(11) << formatSize(total.bytes) << " " << total.count
+         << " files";
+    outputTopTypes(owners.at(id));
+    cout << "\n";
+  }
+}
+
+void outputAgesTerminal(
+    const array<TypeBreakdown, AGE_BUCKETS.size()> &buckets) {
+  for (size_t i = 0; i < buckets.size(); i++) {
+    TypeTotals total = breakdownTotal(buckets[i]);
+    if (total.count == 0)
+      continue;
+    cout << "   " << setw(8) << left << AGE_BUCKETS[i].first << " │ "
+         << setw(11) << formatSize(total.bytes) << " " << total.count
+         << " files";
+    outputTopTypes(buckets[i]);
+    cout << "\n";
+  }
+}
+
+// Files whose owner and times could not be read, left out of the histograms
+void outputMetadataUnknownTerminal(const TypeTotals &unknown) {
+  if (unknown.count == 0)
+    return;
+  cout << " " << setw(18) << left << "(unknown)" << " │ " << setw(11)
+       << formatSize(unknown.bytes) << " " << unknown.count
+       << " files, metadata unavailable\n";
+}
+
+// Block-level dedup estimate (--chunk-dedup), overall and per type
+void outputChunkSampleJson(const ChunkSample &sample) {
+  cout << "\"bytes\": " << sample.bytes()
+       << ", \"chunks\": " << sample.chunkCount()
+       << ", \"estimatedUniqueBytes\": " << fixed << setprecision(0)
+       << sample.estimatedUniqueBytes()
+       << ", \"estimatedSavings\": " << setprecision(4)
+       << sample.estimatedSavings();
+}
+
+void outputChunkDedupJson(const ChunkDedupIndex &chunks) {
+  cout << "{";
+  outputChunkSampleJson(chunks.overall);
+  cout << ", \"averageChunk\": "
+       << (chunks.overall.chunkCount()
+               ? chunks.overall.bytes() / chunks.overall.chunkCount()
+               : 0)
+       << ", \"sampleRate\": " << setprecision(8)
+       << ldexp(1.0, -static_cast<int>(chunks.overall.sampleLevel()))
+       << ", \"indexEntries\": " << chunks.overall.indexEntries()
+       << ",\n    \"byType\": [\n";
+  vector<pair<uint64_t, string>> sorted;
+  for (const auto &[type, sample] : chunks.byType)
+    sorted.push_back({sample.bytes(), type});
+  sort(sorted.rbegin(), sorted.rend());
+  for (size_t i = 0; i < sorted.size(); i++) {
+    cout << "      {\"type\": \"" << escapeJson(sorted[i].second) << "\", ";
+    outputChunkSampleJson(chunks.byType.at(sorted[i].second));
+    cout << "}" << (i + 1 < sorted.size() ? ",\n" : "\n");
+  }
+  cout << "    ]}";
+}
+
+void outputChunkDedupTerminal(const ChunkDedupIndex &chunks) {
+  const ChunkSample &all = chunks.overall;
+  cout << " Chunked " << BOLD << formatSize(all.bytes()) << RESET << " in "
+       << all.chunkCount() << " chunks → ~"
+       << formatSize(static_cast<uintmax_t>(all.estimatedUniqueBytes()))
+       << " unique, " << GREEN << fixed << setprecision(1)
+       << all.estimatedSavings() * 100.0 << "% dedup savings" << RESET
+       << "\n";
+  vector<pair<uint64_t, string>> sorted;
+  for (const auto &[type, sample] : chunks.byType)
+    sorted.push_back({sample.bytes(), type});
+  sort(sorted.rbegin(), sorted.rend());
+  for (const auto &[bytes, type] : sorted) {
+    const ChunkSample &sample = chunks.byType.at(type);
+    cout << " " << setw(18) << left << type << " │ " << setw(11)
+         << formatSize(bytes) << " ~" << setw(11)
+         << formatSize(static_cast<uintmax_t>(sample.estimatedUniqueBytes()))
+         << " unique │ " << setprecision(1) << sample.estimatedSavings() * 100.0
+         << "% savings\n";
+  }
+  if (all.sampleLevel() > 0)
+    cout << " Sampled 1 in " << (1ULL << all.sampleLevel())
+         << " chunks to bound memory\n";
+}
+
+// Sampled compressibility (--compressibility), overall and per type
+CompressionTotals compressionTotal(const ScanAggregates &aggregates) {
+  CompressionTotals total;
+  for (const auto &[type, totals] : aggregates.compressionByType) {
+    total.files += totals.files;
+    total.bytes += totals.bytes;
+    total.compressedBytes += totals.compressedBytes;
+  }
+  return total;
+}
+
+vector<pair<string, CompressionTotals>>
+compressionBySize(const ScanAggregates &aggregates) {
+  vector<pair<string, CompressionTotals>> sorted(
+      aggregates.compressionByType.begin(), aggregates.compressionByType.end());
+  sort(sorted.begin(), sorted.end(), [](const auto &a, const auto &b) {
+    return a.second.bytes > b.second.bytes;
+  });
+  return sorted;
+}
+
+void outputCompressibilityJson(const ScanAggregates &aggregates) {
+  CompressionTotals total = compressionTotal(aggregates);
+  cout << "{\"sampleBudget\": " << compressionSampleBudget
+       << ", \"files\": " << total.files << ", \"bytes\": " << total.bytes
+       << ", \"estimatedCompressedBytes\": " << fixed << setprecision(0)
+       << total.compressedBytes << ", \"ratio\": " << setprecision(3)
+       << total.ratio() << ",\n    \"byType\": [\n";
+  auto sorted = compressionBySize(aggregates);
+  for (size_t i = 0; i < sorted.size(); i++) {
+    const auto &[type, totals] = sorted[i];
+    cout << "      {\"type\": \"" << escapeJson(type)
+         << "\", \"files\": " << totals.files << ", \"bytes\": " << totals.bytes
+         << ", \"estimatedCompressedBytes\": " << setprecision(0)
+         << totals.compressedBytes << ", \"ratio\": " << setprecision(3)
+         << totals.ratio() << "}" << (i + 1 < sorted.size() ? ",\n" : "\n");
+  }
+  cout << "    ]}";
+}
+
+void outputCompressibilityTerminal(const ScanAggregates &aggregates) {
+  CompressionTotals total = compressionTotal(aggregates);
+  cout << " " << formatSize(total.bytes) << " → ~"
+       << formatSize(static_cast<uintmax_t>(total.compressedBytes)) << " ("
+       << BOLD << fixed << setprecision(2) << total.ratio() << "x" << RESET
+       << ", sampling up to " << formatSize(compressionSampleBudget)
+       << " per file)\n";
+  for (const auto &[type, totals] : compressionBySize(aggregates)) {
+    cout << " " << setw(18) << left << type << " │ " << setw(11)
+         << formatSize(totals.bytes) << " → ~" << setw(11)
+         << formatSize(static_cast<uintmax_t>(totals.compressedBytes)) << " "
+         << setprecision(2) << totals.ratio() << "x\n";
+  }
+}
+
+// Busiest signatures of the scan (--signature-profile-out)
+void outputSignatureProfileJson(const vector<SignatureStat> &stats) {
+  uint64_t probes = 0, hits = 0;
+  for (const auto &s : stats) {
+    probes += s.probes;
+    hits += s.hits;
+  }
+  cout << "{\"probes\": " << probes << ", \"hits\": " << hits
+       << ", \"rules\": [\n";
+  size_t shown = min<size_t>(stats.size(), 20);
+  for (size_t i = 0; i < shown; i++) {
+    cout << "      {\"rule\": \"" << escapeJson(stats[i].key)
+         << "\", \"hits\": " << stats[i].hits
+         << ", \"probes\": " << stats[i].probes << "}"
+         << (i + 1 < shown ? ",\n" : "\n");
+  }
+  cout << "    ]}";
+}
+
+void outputSignatureProfileTerminal(const vector<SignatureStat> &stats) {
+  uint64_t probes = 0, hits = 0;
+  for (const auto &s : stats) {
+    probes += s.probes;
+    hits += s.hits;
+  }
+  cout << " " << hits << " matches from " << probes << " rule probes across "
+       << stats.size() << " rules\n";
+  for (size_t i = 0; i < stats.size() && i < 10; i++) {
+    cout << " " << setw(40) << left << stats[i].key.substr(0, 40) << " │ "
+         << setw(8) << stats[i].hits << " hits " << stats[i].probes
+         << " probes\n";
+  }
+}
+
+// Fallback model guesses for files left Unknown, by predicted category
+void outputPredictionsTerminal(const vector<FileInfo> &files) {
+  size_t unknown = 0;
+  map<string, pair<size_t, double>> guesses; // Count, summed confidence
+  for (const auto &f : files) {
+    if (f.type != "Unknown")
+      continue;
+    unknown++;
+    if (!f.predictedCategory.empty()) {
+      auto &g = guesses[f.predictedCategory];
+      g.first++;
+      g.second += f.predictionConfidence;
+    }
+  }
+  size_t guessed = 0;
+  for (const auto &[category, g] : guesses)
+    guessed += g.first;
+  cout << " " << unknown << " unidentified, " << guessed << " with a guess at "
+       << fixed << setprecision(0) << fallbackMinConfidence * 100
+       << "% confidence or more\n";
+  for (const auto &[category, g] : guesses) {
+    cout << " " << setw(18) << left << category << " │ " << setw(6) << g.first
+         << " avg " << setprecision(0) << 100.0 * g.second / g.first << "%\n";
+  }
+}
+
+// Per-plugin cost: calls, CPU time spent in analyze() and bytes served
+void outputPluginsJson() {
+  cout << "[\n";
+  for (size_t i = 0; i < loadedPlugins.size(); i++) {
+    const LoadedPlugin &p = *loadedPlugins[i];
+    uint64_t calls = p.calls;
+    cout << "    {\"name\": \"" << escapeJson(p.name) << "\", \"version\": \""
+         << escapeJson(p.version) << "\", \"path\": \"" << escapeJson(p.path)
+         << "\", \"calls\": " << calls << ", \"refined\": " << p.refined
+         << ", \"cpuSeconds\": " << fixed << setprecision(6)
+         << p.cpuMicros / 1e6 << ", \"avgCpuMicros\": " << setprecision(1)
+         << (calls ? static_cast<double>(p.cpuMicros) / calls : 0.0)
+         << ", \"zeroCopyBytes\": " << p.zeroCopyBytes
+         << ", \"bytesRead\": " << p.bytesRead
+         << ", \"readLimited\": " << p.readLimited
+         << ", \"overBudget\": " << p.overBudget << ", \"hung\": " << p.hung
+         << ", \"readBudget\": " << p.readBudget
+         << ", \"cpuBudgetMicros\": " << p.cpuBudgetMicros
+         << ", \"disabled\": " << (p.disabled ? "true" : "false") << "}"
+         << (i + 1 < loadedPlugins.size() ? ",\n" : "\n");
+  }
+  cout << "  ]";
+}
+
+void outputPluginsTerminal() {
+  for (const auto &plugin : loadedPlugins) {
+    const LoadedPlugin &p = *plugin;
+    uint64_t calls = p.calls;
+    cout << " " << setw(18) << left << p.name << " │ " << setw(7) << calls
+         << " calls │ " << setw(7) << p.refined << " refined │ " << fixed
+         << setprecision(3) << p.cpuMicros / 1e6 << "s CPU ("
+         << setprecision(1)
+         << (calls ? static_cast<double>(p.cpuMicros) / calls : 0.0)
+         << "µs/call) │ read " << formatSize(p.bytesRead);
+    if (p.overBudget > 0)
+      cout << " " << YELLOW << p.overBudget << " over budget" << RESET;
+    if (p.hung > 0)
+      cout << " " << RED << p.hung << " hung" << RESET;
+    if (p.disabled)
+      cout << " " << RED << "disabled" << RESET;
+    cout << "\n";
+  }
+}
+
+// ============================================================================
+// Entropy Anomalies (--anomalies)
+// ============================================================================
+// Every result is checked against its type's distribution once the scan's
+// statistics (plus any baseline) are final; nothing is read again. Each file
+// is judged against its type with its own contribution taken out, so one
+// extreme file cannot mask itself by inflating the variance. It is an
+// outlier when it sits far out both in standard deviations and beyond the
+// 1st/99th percentile, so wide, lumpy types such as Text do not flag on
+// spread alone.
+const uint64_t ANOMALY_MIN_SAMPLES = 8;
+const double ANOMALY_Z = 4.0;
+const double ANOMALY_MIN_ENTROPY_STDDEV = 0.15; // bits; floors tight types
+const double ANOMALY_MIN_SIZE_STDDEV = 1.0;     // log2 bytes
+
+struct EntropyOutlier {
+  const FileInfo *file;
+  string reason; // "high entropy", "low entropy", "large", "small"
+  double value;    // Entropy in bits, or log2 size
+  double expected; // Type median on the same scale
+  double z;
+};
+
+vector<EntropyOutlier> findEntropyOutliers(const vector<FileInfo> &files,
+                                           const ScanAggregates &aggregates) {
+  vector<EntropyOutlier> outliers;
+  for (const auto &f : files) {
+    auto it = aggregates.entropyByType.find(f.type);
+    if (f.isCorrupt || f.size < 2 || it == aggregates.entropyByType.end() ||
+        it->second.entropy.n <= ANOMALY_MIN_SAMPLES)
+      continue;
+    TypeEntropyStats stats = it->second;
+    stats.remove(f.entropy, f.size);
+
+    double sd = max(stats.entropy.stddev(), ANOMALY_MIN_ENTROPY_STDDEV);
+    double z = (f.entropy - stats.entropy.mean) / sd;
+    if ((z >= ANOMALY_Z && f.entropy > stats.entropyQuantiles.quantile(0.99)) ||
+        (z <= -ANOMALY_Z && f.entropy < stats.entropyQuantiles.quantile(0.01))) {
+      outliers.push_back({&f, z > 0 ? "high entropy" : "low entropy",
+                          f.entropy, stats.entropyQuantiles.quantile(0.5), z});
+      continue;
+    }
+
+    double logBytes = log2(static_cast<double>(f.size) + 1.0);
+    sd = max(stats.logSize.stddev(), ANOMALY_MIN_SIZE_STDDEV);
+    z = (logBytes - stats.logSize.mean) / sd;
+    if ((z >= ANOMALY_Z && logBytes > stats.sizeQuantiles.quantile(0.99)) ||
+        (z <= -ANOMALY_Z && logBytes < stats.sizeQuantiles.quantile(0.01))) {
+      outliers.push_back({&f, z > 0 ? "large" : "small", logBytes,
+                          stats.sizeQuantiles.quantile(0.5), z});
+    }
+  }
+  sort(outliers.begin(), outliers.end(),
+       [](const EntropyOutlier &a, const EntropyOutlier &b) {
+         return fabs(a.z) > fabs(b.z);
+       });
+  return outliers;
+}
+
+// Baseline file: one line per type with both running statistics and the
+// non-empty sketch bins, so a later scan starts from the same distribution
+bool saveEntropyBaseline(const string &path,
+                         const map<string, TypeEntropyStats> &byType) {
+  ofstream out(path);
+  out << "# fta entropy baseline v1\n";
+  out << setprecision(17);
+  auto writeSketch = [&](const QuantileSketch &q) {
+    out << "\t";
+    bool first = true;
+    for (size_t i = 0; i < QuantileSketch::BINS; i++) {
+      if (q.counts[i] == 0)
+        continue;
+      out << (first ? "" : ",") << i << ":" << q.counts[i];
+      first = false;
+    }
+  };
+  for (const auto &[type, stats] : byType) {
+    string name = type;
+    replace(name.begin(), name.end(), '\t', ' ');
+    out << name;
+    for (const RunningStats *r : {&stats.entropy, &stats.logSize})
+      out << "\t" << r->n << "\t" << r->mean << "\t" << r->m2;
+    writeSketch(stats.entropyQuantiles);
+    writeSketch(stats.sizeQuantiles);
+    out << "\n";
+  }
+  return static_cast<bool>(out);
+}
+
+bool loadEntropyBaseline(const string &path,
+                         map<string, TypeEntropyStats> &byType) {
+  ifstream in(path);
+  if (!in)
+    return false;
+  string line;
+  while (getline(in, line)) {
+    if (line.empty() || line[0] == '#')
+      continue;
+    vector<string> fields;
+    istringstream row(line);
+    for (string field; getline(row, field, '\t');)
+      fields.push_back(field);
+    if (fields.size() != 9)
+      continue;
+    TypeEntropyStats stats;
+    RunningStats *running[] = {&stats.entropy, &stats.logSize};
+    for (size_t r = 0; r < 2; r++) {
+      running[r]->n = strtoull(fields[1 + 3 * r].c_str(), nullptr, 10);
+      running[r]->mean = atof(fields[2 + 3 * r].c_str());
+      running[r]->m2 = atof(fields[3 + 3 * r].c_str());
+    }
+    QuantileSketch *sketches[] = {&stats.entropyQuantiles,
+                                  &stats.sizeQuantiles};
+    for (size_t q = 0; q < 2; q++) {
+      istringstream bins(fields[7 + q]);
+      for (string cell; getline(bins, cell, ',');) {
+        size_t colon = cell.find(':');
+        size_t bin = strtoull(cell.c_str(), nullptr, 10);
+        if (colon == string::npos || bin >= QuantileSketch::BINS)
+          continue;
+        uint64_t count = strtoull(cell.c_str() + colon + 1, nullptr, 10);
+        sketches[q]->counts[bin] += count;
+        sketches[q]->total += count;
+      }
+    }
+    byType[fields[0]].merge(stats);
+  }
+  return true;
+}
+
+void outputAnomaliesJson(const vector<FileInfo> &files,
+                         const ScanAggregates &aggregates) {
+  cout << "{\"types\": [\n";
+  size_t i = 0;
+  for (const auto &[type, stats] : aggregates.entropyByType) {
+    cout << "      {\"type\": \"" << escapeJson(type)
+         << "\", \"samples\": " << stats.entropy.n << ", \"entropyMean\": "
+         << fixed << setprecision(4) << stats.entropy.mean
+         << ", \"entropyStddev\": " << stats.entropy.stddev()
+         << ", \"entropyP01\": " << stats.entropyQuantiles.quantile(0.01)
+         << ", \"entropyP50\": " << stats.entropyQuantiles.quantile(0.5)
+         << ", \"entropyP99\": " << stats.entropyQuantiles.quantile(0.99)
+         << ", \"sizeMedian\": " << setprecision(0)
+         << exp2(stats.sizeQuantiles.quantile(0.5)) << "}"
+         << (++i < aggregates.entropyByType.size() ? ",\n" : "\n");
+  }
+  cout << "    ], \"outliers\": [\n";
+  auto outliers = findEntropyOutliers(files, aggregates);
+  for (size_t o = 0; o < outliers.size(); o++) {
+    const auto &a = outliers[o];
+    bool bySize = a.reason == "large" || a.reason == "small";
+    cout << "      {\"path\": \"" << escapeJson(a.file->path)
+         << "\", \"type\": \"" << escapeJson(a.file->type)
+         << "\", \"reason\": \"" << a.reason << "\", ";
+    if (bySize)
+      cout << "\"size\": " << a.file->size << ", \"typicalSize\": "
+           << setprecision(0) << exp2(a.expected);
+    else
+      cout << "\"entropy\": " << setprecision(4) << a.value
+           << ", \"typicalEntropy\": " << a.expected;
+    cout << ", \"zScore\": " << setprecision(2) << a.z << "}"
+         << (o + 1 < outliers.size() ? ",\n" : "\n");
+  }
+  cout << "    ]}";
+}
+
+void outputAnomaliesTerminal(const vector<FileInfo> &files,
+                             const ScanAggregates &aggregates) {
+  auto outliers = findEntropyOutliers(files, aggregates);
+  cout << " " << outliers.size() << " outlier(s) across "
+       << aggregates.entropyByType.size() << " types\n";
+  for (size_t o = 0; o < outliers.size() && o < 15; o++) {
+    const auto &a = outliers[o];
+    bool bySize = a.reason == "large" || a.reason == "small";
+    cout << " " << YELLOW << setw(12) << left << a.reason << RESET << " "
+         << setw(10) << a.file->type.substr(0, 10) << " ";
+    if (bySize)
+      cout << setw(10) << formatSize(a.file->size) << " typ "
+           << setw(10)
+           << formatSize(static_cast<uintmax_t>(exp2(a.expected)));
+    else
+      cout << fixed << setprecision(2) << setw(10) << a.value << " typ "
+           << setw(10) << a.expected;
+    cout << " " << a.file->name.substr(0, 24) << "\n";
+  }
+  if (outliers.size() > 15)
+    cout << " ... " << outliers.size() - 15 << " more (see --json)\n";
+}
+
+void outputJson(const vector<FileInfo> &files, double totalTime,
+                unsigned int threadCount, const ScanAggregates &aggregates) {
+  cout << "{\n";
+  cout << "  \"totalFiles\": " << files.size() << ",\n";
+  cout << "  \"totalTime\": " << fixed << setprecision(2) << totalTime << ",\n";
+  cout << "  \"threadsUsed\": " << threadCount << ",\n";
+  const ResourceLimits &limits = resourceLimits();
+  cout << "  \"resourceLimits\": {\"cgroup\": \"" << limits.cgroup
+       << "\", \"hostCpus\": " << limits.hostCpus
+       << ", \"affinityCpus\": " << limits.affinityCpus
+       << ", \"cpuQuota\": " << fixed << setprecision(2) << limits.cpuQuota
+       << ", \"effectiveCpus\": " << limits.effectiveCpus()
+       << ", \"memoryLimit\": " << limits.memoryLimit << "},\n";
+  if (objectStore) {
+    const S3IoBackend::Stats &io = objectStore->stats();
+    cout << "  \"objectStorage\": {\"endpoint\": \""
+         << escapeJson(objectStore->settings().host)
+         << "\", \"requests\": " << io.requests
+         << ", \"roundTrips\": " << io.batches
+         << ", \"connections\": " << io.connections
+         << ", \"listings\": " << io.listings
+         << ", \"headBytes\": " << objectStore->headBytes()
+         << ", \"bytesFetched\": " << io.bytesFetched
+         << ", \"servedFromBatch\": " << io.servedFromBatch << "},\n";
+  }
+  if (!aggregates.merkle.rootHash.empty())
+    cout << "  \"merkle\": " << merkleSummaryJson(aggregates.merkle) << ",\n";
+  if (manifests) {
+    cout << "  \"manifests\": {\"directory\": \""
+         << escapeJson(manifests->directory().string())
+         << "\", \"partitions\": " << manifests->partitionCount() << "},\n";
+  }
+  if (signatureWatcher) {
+    SignatureWatcher::Stats reloads = signatureWatcher->stats();
+    cout << "  \"signatures\": {\"version\": "
+         << signatureSnapshots.current()->version
+         << ", \"reloads\": " << reloads.reloads
+         << ", \"failedReloads\": " << reloads.failures
+         << ", \"lastError\": \"" << escapeJson(reloads.lastError) << "\"},\n";
+  }
+
+  // Calculate statistics
+  map<string, int> typeCounts;
+  map<string, uintmax_t> typeSizes;
+  int corruptCount = 0, mismatchCount = 0, encryptedCount = 0;
+  uintmax_t totalSize = 0;
+
+  for (const auto &f : files) {
+    typeCounts[f.type]++;
+    typeSizes[f.type] += f.size;
+    totalSize += f.size;
+    if (f.isCorrupt)
+      corruptCount++;
+    if (f.extensionMismatch)
+      mismatchCount++;
+    if (f.entropy >= 7.5)
+      encryptedCount++;
+  }
+
+  cout << "  \"totalSize\": " << totalSize << ",\n";
+  cout << "  \"totalSizeFormatted\": \"" << formatSize(totalSize) << "\",\n";
+  cout << "  \"corruptFiles\": " << corruptCount << ",\n";
+  cout << "  \"mismatchedFiles\": " << mismatchCount << ",\n";
+  cout << "  \"encryptedFiles\": " << encryptedCount << ",\n";
+
+  // Type statistics
+  cout << "  \"statistics\": [\n";
+  bool first = true;
+  for (const auto &[type, count] : typeCounts) {
+    if (!first)
+      cout << ",\n";
+    first = false;
+    cout << "    {\"type\": \"" << escapeJson(type)
+         << "\", \"count\": " << count << ", \"size\": " << typeSizes[type]
+         << ", \"sizeFormatted\": \"" << formatSize(typeSizes[type]) << "\"";
+    auto content = aggregates.contentByType.find(type);
+    if (content != aggregates.contentByType.end() &&
+        content->second.count > 0) {
+      double unique = aggregates.estimatedUnique(content->second);
+      cout << ", \"estimatedUnique\": " << fixed << setprecision(0) << unique
+           << ", \"duplicationRatio\": " << setprecision(3)
+           << static_cast<double>(content->second.count) / max(1.0, unique);
+    }
+    cout << "}";
+  }
+  cout << "\n  ],\n";
+
+  // Approximate distinct contents (HyperLogLog over partial fingerprints)
+  size_t fingerprinted = aggregates.fingerprintedFiles();
+  double uniqueFiles = aggregates.estimatedUniqueFiles();
+  double uniqueBytes = aggregates.estimatedUniqueBytes();
+  cout << "  \"contentEstimate\": {\"fingerprintedFiles\": " << fingerprinted
+       << ", \"estimatedUniqueFiles\": " << fixed << setprecision(0)
+       << uniqueFiles << ", \"estimatedUniqueBytes\": " << uniqueBytes
+       << ", \"duplicationRatio\": " << setprecision(3)
+       << static_cast<double>(fingerprinted) / max(1.0, uniqueFiles)
+       << ", \"sketchBytes\": " << aggregates.sketchMemoryBytes() << "},\n";
+
+  if (aggregates.options.directoryTree) {
+    DirectoryTree tree =
+        buildDirectoryTree(aggregates, aggregates.options.rootDirectory);
+    cout << "  \"directoryTree\":\n";
+    outputDirectoryTreeJson(tree, tree.root, 0,
+                            aggregates.options.directoryTreeDepth, "    ");
+    cout << ",\n";
+  }
+
+  if (aggregates.options.ownerBreakdown) {
+    cout << "  \"owners\": ";
+    outputOwnersJson(aggregates.byOwner, false);
+    cout << ",\n  \"groups\": ";
+    outputOwnersJson(aggregates.byGroup, true);
+    cout << ",\n";
+  }
+
+  if (aggregates.options.ageBreakdown) {
+    cout << "  \"ages\": {\n    \"modified\": ";
+    outputAgesJson(aggregates.byModifiedAge);
+    cout << ",\n    \"accessed\": ";
+    outputAgesJson(aggregates.byAccessedAge);
+    cout << "\n  },\n";
+  }
+
+  if ((aggregates.options.ownerBreakdown ||
+       aggregates.options.ageBreakdown) &&
+      aggregates.metadataUnknown.count > 0) {
+    cout << "  \"metadataUnavailable\": {\"files\": "
+         << aggregates.metadataUnknown.count
+         << ", \"bytes\": " << aggregates.metadataUnknown.bytes << "},\n";
+  }
+
+  if (compressionSampleBudget > 0) {
+    cout << "  \"compressibility\": ";
+    outputCompressibilityJson(aggregates);
+    cout << ",\n";
+  }
+
+  if (aggregates.options.chunkDedup) {
+    cout << "  \"chunkDedup\": ";
+    outputChunkDedupJson(aggregates.chunks);
+    cout << ",\n";
+  }
+
+  if (!loadedPlugins.empty()) {
+    cout << "  \"plugins\": ";
+    outputPluginsJson();
+    cout << ",\n";
+  }
+
+  if (aggregates.options.entropyAnomalies) {
+    cout << "  \"anomalies\": ";
+    outputAnomaliesJson(files, aggregates);
+    cout << ",\n";
+  }
+
+  if (signatureProfiling) {
+    cout << "  \"signatureProfile\": ";
+    outputSignatureProfileJson(collectSignatureProfile());
+    cout << ",\n";
+  }
+
+  // File details
+  cout << "  \"files\": [\n";
+  first = true;
+  for (const auto &f : files) {
+    if (!first)
+      cout << ",\n";
+    first = false;
+    cout << "    {\n";
+    cout << "      \"name\": \"" << escapeJson(f.name) << "\",\n";
+    cout << "      \"path\": \"" << escapeJson(f.path) << "\",\n";
+    cout << "      \"type\": \"" << escapeJson(f.type) << "\",\n";
+    cout << "      \"category\": \"" << escapeJson(f.category) << "\",\n";
+    cout << "      \"description\": \"" << escapeJson(f.description) << "\",\n";
+    cout << "      \"size\": " << f.size << ",\n";
+    cout << "      \"sizeFormatted\": \"" << formatSize(f.size) << "\",\n";
+    if (!f.hash.empty())
+      cout << "      \"sha256\": \"" << f.hash << "\",\n";
+    cout << "      \"entropy\": " << fixed << setprecision(4) << f.entropy
+         << ",\n";
+    cout << "      \"isCorrupt\": " << (f.isCorrupt ? "true" : "false")
+         << ",\n";
+    cout << "      \"extensionMismatch\": "
+         << (f.extensionMismatch ? "true" : "false") << ",\n";
+    cout << "      \"isEncrypted\": " << (f.entropy >= 7.5 ? "true" : "false")
+         << ",\n";
+    cout << "      \"actualExtension\": \"" << escapeJson(f.actualExtension)
+         << "\",\n";
+    if (!f.refinedBy.empty())
+      cout << "      \"refinedBy\": \"" << escapeJson(f.refinedBy) << "\",\n";
+    if (f.compressionRatio > 0)
+      cout << "      \"compressionRatio\": " << fixed << setprecision(3)
+           << f.compressionRatio << ",\n";
+    if (!f.predictedCategory.empty()) {
+      cout << "      \"predictedCategory\": \""
+           << escapeJson(f.predictedCategory) << "\",\n";
+      cout << "      \"predictionConfidence\": " << fixed << setprecision(3)
+           << f.predictionConfidence << ",\n";
+    }
+    cout << "      \"analysisTime\": " << fixed << setprecision(2)
+         << f.analysisTime << "\n";
+    cout << "    }";
+  }
+  cout << "\n  ]\n";
+  cout << "}\n";
+}
+
+// ============================================================================
+// Terminal Output
+// ============================================================================
+void outputTerminal(const vector<FileInfo> &files, double totalTime,
+                    bool organize, const fs::path &outputDir,
+                    unsigned int threadCount,
+                    const ScanAggregates &aggregates) {
+  cout << "\n\n";
+  cout << CYAN
+       << "╔══════════════════════════════════════════════════════════════╗\n";
+  cout << "║" << BOLD
+       << "         FileTypeAnalyzer Pro - Analysis Complete            "
+       << RESET << CYAN << "║\n";
+  cout << "╚══════════════════════════════════════════════════════════════╝"
+       << RESET << "\n\n";
+
+  // Sort by size
+  vector<FileInfo> sorted = files;
+  sort(sorted.begin(), sorted.end(),
+       [](const FileInfo &a, const FileInfo &b) { return a.size > b.size; });
+
+  // Detailed results
+  cout << YELLOW
+       << "┌─ Detailed Analysis Results ─────────────────────────────────────┐"
+       << RESET << "\n";
+  cout << BOLD
+       << " File Name                           │ Type           │ Size       "
+          "│ Entropy │ Status"
+       << RESET << "\n";
+  cout << "─────────────────────────────────────┼────────────────┼────────────┼"
+          "─────────┼──────────\n";
+
+  for (const auto &f : sorted) {
+    string name = f.name.length() > 35 ? f.name.substr(0, 32) + "..." : f.name;
+    string type = f.type.length() > 14 ? f.type.substr(0, 11) + "..." : f.type;
+
+    cout << " " << setw(36) << left << name << "│ " << setw(15) << left << type
+         << "│ " << setw(11) << left << formatSize(f.size) << "│ " << fixed
+         << setprecision(2) << setw(7) << f.entropy << " │ ";
+
+    if (f.isCorrupt) {
+      cout << RED << "⚠ CORRUPT" << RESET;
+    } else if (f.extensionMismatch) {
+      cout << YELLOW << "⚠ MISMATCH" << RESET;
+    } else if (f.entropy >= 7.5) {
+      cout << BLUE << "🔐 ENCRYPTED" << RESET;
+    } else {
+      cout << GREEN << "✓ OK" << RESET;
+    }
+    cout << "\n";
+  }
+  cout << YELLOW
+       << "└──────────────────────────────────────────────────────────────────┘"
+       << RESET << "\n\n";
+
+  // Statistics
+  map<string, int> typeCounts;
+  map<string, uintmax_t> typeSizes;
+  int corruptCount = 0, mismatchCount = 0, encryptedCount = 0;
+  uintmax_t totalSize = 0;
+
+  for (const auto &f : files) {
+    typeCounts[f.type]++;
+    typeSizes[f.type] += f.size;
+    totalSize += f.size;
+    if (f.isCorrupt)
+      corruptCount++;
+    if (f.extensionMismatch)
+      mismatchCount++;
+    if (f.entropy >= 7.5)
+      encryptedCount++;
+  }
+
+  cout << MAGENTA
+       << "┌─ File Type Distribution ─────────────────────────────────────────┐"
+       << RESET << "\n";
+  for (const auto &[type, count] : typeCounts) {
+    int barLen = min(count * 2, 30);
+    cout << " " << setw(18) << left << type << " │ ";
+    cout << GREEN;
+    for (int i = 0; i < barLen; i++)
+      cout << "█";
+    cout << RESET << " " << count << " files (" << formatSize(typeSizes[type])
+         << ")\n";
+  }
+  cout << MAGENTA
+       << "└──────────────────────────────────────────────────────────────────┘"
+       << RESET << "\n\n";
+
+  if (aggregates.options.directoryTree) {
+    DirectoryTree tree =
+        buildDirectoryTree(aggregates, aggregates.options.rootDirectory);
+    cout << CYAN
+         << "┌─ Directory Breakdown ────────────────────────────────────────────┐"
+         << RESET << "\n";
+    outputDirectoryTreeTerminal(tree, tree.root, 0,
+                                aggregates.options.directoryTreeDepth, " ");
+    cout << CYAN
+         << "└──────────────────────────────────────────────────────────────────┘"
+         << RESET << "\n\n";
+  }
+
+  if (aggregates.options.ownerBreakdown) {
+    cout << CYAN
+         << "┌─ Ownership ──────────────────────────────────────────────────────┐"
+         << RESET << "\n";
+    cout << BOLD << " Users" << RESET << "\n";
+    outputOwnersTerminal(aggregates.byOwner, false);
+    cout << BOLD << " Groups" << RESET << "\n";
+    outputOwnersTerminal(aggregates.byGroup, true);
+    outputMetadataUnknownTerminal(aggregates.metadataUnknown);
+    cout << CYAN
+         << "└──────────────────────────────────────────────────────────────────┘"
+         << RESET << "\n\n";
+  }
+
+  if (aggregates.options.ageBreakdown) {
+    cout << CYAN
+         << "┌─ File Age ───────────────────────────────────────────────────────┐"
+         << RESET << "\n";
+    cout << BOLD << " Last modified" << RESET << "\n";
+    outputAgesTerminal(aggregates.byModifiedAge);
+    cout << BOLD << " Last accessed" << RESET << "\n";
+    outputAgesTerminal(aggregates.byAccessedAge);
+    outputMetadataUnknownTerminal(aggregates.metadataUnknown);
+    cout << CYAN
+         << "└──────────────────────────────────────────────────────────────────┘"
+         << RESET << "\n\n";
+  }
+
+  if (compressionSampleBudget > 0) {
+    cout << CYAN
+         << "┌─ Compressibility (sampled LZ) ───────────────────────────────────┐"
+         << RESET << "\n";
+    outputCompressibilityTerminal(aggregates);
+    cout << CYAN
+         << "└──────────────────────────────────────────────────────────────────┘"
+         << RESET << "\n\n";
+  }
+
+  if (aggregates.options.chunkDedup) {
+    cout << CYAN
+         << "┌─ Block-Level Dedup (estimated) ──────────────────────────────────┐"
+         << RESET << "\n";
+    outputChunkDedupTerminal(aggregates.chunks);
+    cout << CYAN
+         << "└──────────────────────────────────────────────────────────────────┘"
+         << RESET << "\n\n";
+  }
+
+  if (!loadedPlugins.empty()) {
+    cout << CYAN
+         << "┌─ Plugins ────────────────────────────────────────────────────────┐"
+         << RESET << "\n";
+    outputPluginsTerminal();
+    cout << CYAN
+         << "└──────────────────────────────────────────────────────────────────┘"
+         << RESET << "\n\n";
+  }
+
+  if (aggregates.options.entropyAnomalies) {
+    cout << CYAN
+         << "┌─ Entropy Anomalies (per type) ───────────────────────────────────┐"
+         << RESET << "\n";
+    outputAnomaliesTerminal(files, aggregates);
+    cout << CYAN
+         << "└──────────────────────────────────────────────────────────────────┘"
+         << RESET << "\n\n";
+  }
+
+  if (signatureProfiling) {
+    cout << CYAN
+         << "┌─ Signature Profile ──────────────────────────────────────────────┐"
+         << RESET << "\n";
+    outputSignatureProfileTerminal(collectSignatureProfile());
+    cout << CYAN
+         << "└──────────────────────────────────────────────────────────────────┘"
+         << RESET << "\n\n";
+  }
+
+  if (fallbackModel.loaded()) {
+    cout << CYAN
+         << "┌─ Unknown Files (model guesses) ──────────────────────────────────┐"
+         << RESET << "\n";
+    outputPredictionsTerminal(files);
+    cout << CYAN
+         << "└──────────────────────────────────────────────────────────────────┘"
+         << RESET << "\n\n";
+  }
+
+  // Summary
+  cout << BLUE
+       << "┌─ Analysis Summary ───────────────────────────────────────────────┐"
+       << RESET << "\n";
+  cout << " │ Total files analyzed: " << BOLD << files.size() << RESET << "\n";
+  cout << " │ Total size: " << BOLD << formatSize(totalSize) << RESET << "\n";
+  cout << " │ Unique file types: " << BOLD << typeCounts.size() << RESET
+       << "\n";
+  cout << " │ Threads used: " << BOLD << threadCount << RESET << "\n";
+  cout << " │ Analysis time: " << BOLD << fixed << setprecision(2) << totalTime
+       << "s" << RESET << "\n";
+  if (objectStore) {
+    const S3IoBackend::Stats &io = objectStore->stats();
+    cout << " │ Object storage: " << BOLD << io.requests << RESET
+         << " requests in " << io.batches << " round trips over "
+         << io.connections << " connections, "
+         << formatSize(io.bytesFetched) << " of objects fetched\n";
+  }
+  if (manifests) {
+    cout << " │ Manifests: " << BOLD << manifests->partitionCount() << RESET
+         << " lists in " << manifests->directory().string() << "\n";
+  }
+  if (!aggregates.merkle.rootHash.empty()) {
+    cout << " │ Merkle: root " << BOLD
+         << aggregates.merkle.rootHash.substr(0, 16) << RESET << " over "
+         << aggregates.merkle.directories << " directories in "
+         << aggregates.merkle.file << "\n";
+  }
+  if (signatureWatcher) {
+    SignatureWatcher::Stats reloads = signatureWatcher->stats();
+    cout << " │ Signatures: version " << BOLD
+         << signatureSnapshots.current()->version << RESET << ", "
+         << reloads.reloads << " reloads";
+    if (reloads.failures > 0)
+      cout << ", " << YELLOW << reloads.failures
+           << " failed (" << reloads.lastError << ")" << RESET;
+    cout << "\n";
+  }
+  if (corruptCount > 0)
+    cout << " │ " << RED << "Corrupt files: " << corruptCount << RESET << "\n";
+  if (mismatchCount > 0)
+    cout << " │ " << YELLOW << "Extension mismatches: " << mismatchCount
+         << RESET << "\n";
+  if (encryptedCount > 0)
+    cout << " │ " << BLUE << "Encrypted/Compressed files: " << encryptedCount
+         << RESET << "\n";
+  if (aggregates.fingerprintedFiles() > 0) {
+    double uniqueFiles = aggregates.estimatedUniqueFiles();
+    cout << " │ Estimated unique contents: " << BOLD << fixed
+         << setprecision(0) << uniqueFiles << RESET << " files, "
+         << formatSize(static_cast<uintmax_t>(
+                aggregates.estimatedUniqueBytes()))
+         << " (" << setprecision(2)
+         << static_cast<double>(aggregates.fingerprintedFiles()) /
+                max(1.0, uniqueFiles)
+         << "x duplication)\n";
+  }
+  if (organize)
+    cout << " │ Files organized to: " << CYAN << outputDir.string() << RESET
+         << "\n";
+  cout << BLUE
+       << "└──────────────────────────────────────────────────────────────────┘"
+       << RESET << "\n";
+}
+
+// ============================================================================
+// Scan Estimation (--estimate)
+// ============================================================================
+// Predicts the cost of a full scan without walking the whole tree. Directory
+// counts come from Knuth's random-path estimator: each probe descends from the
+// root into a random subdirectory, weighting every level by the product of
+// the branching factors seen so far. Averaging many probes gives an unbiased
+// estimate of total files and bytes while touching only metadata.
+
+// Unordered scans of at most this many files run on the calling thread
+const size_t SEQUENTIAL_SCAN_MAX_FILES = 10;
+
+// Keeps `capacity` distinct items, each chosen with probability
+// proportional to its total weight (an exponential race: the smallest
+// Exp(1)/weight keys win, and an item seen again keeps its smaller key,
+// which is distributed as one draw with the weights summed).
+template <typename T> class WeightedReservoir {
+public:
+  explicit WeightedReservoir(size_t capacity) : capacity(capacity) {}
+
+  template <typename Rng> void add(const T &item, double weight, Rng &rng) {
+    if (weight <= 0 || capacity == 0)
+      return;
+    double key = exponential_distribution<double>(1.0)(rng) / weight;
+    for (auto &entry : entries) {
+      if (entry.second == item) {
+        entry.first = min(entry.first, key);
+        return;
+      }
+    }
+    if (entries.size() < capacity) {
+      entries.push_back({key, item});
+      return;
+    }
+    auto largest = max_element(entries.begin(), entries.end(),
+                               [](const pair<double, T> &a,
+                                  const pair<double, T> &b) {
+                                 return a.first < b.first;
+                               });
+    if (key < largest->first)
+      *largest = {key, item};
+  }
+
+  vector<T> items() const {
+    vector<T> out;
+    for (const auto &entry : entries)
+      out.push_back(entry.second);
+    return out;
+  }
+
+private:
+  size_t capacity;
+  vector<pair<double, T>> entries; // {key, item}
+};
+
+struct ScanEstimate {
+  double files = 0;
+  double bytes = 0;
+  double bytesRead = 0; // Bytes the scan reads with the chosen options
+  double directories = 0;
+  double filesStdError = 0;
+  size_t probes = 0;
+  size_t probeFiles = 0;
+  double meanOpenReadMs = 0;
+  double meanAnalyzeMs = 0;
+  double meanListDirMs = 0;
+  double estimatedSeconds = 0;
+  uintmax_t estimatedPeakMemory = 0;
+  double elapsedSeconds = 0;
+  unsigned int threads = 1; // Workers the real scan would use
+};
+
+// `threadCount` is what main would give the parallel path; small unordered
+// scans run sequentially, as main does. `options` are the aggregates the
+// scan would collect; --hash and -z are read from their globals, as
+// analyzeFile does.
+ScanEstimate estimateScan(const fs::path &root, bool recursive,
+                          unsigned int threadCount, bool jsonOutput,
+                          bool ordered = false, double budgetSeconds = 2.0,
+                          const AggregateOptions &options = {}) {
+  ScanEstimate est;
+  auto startTime = high_resolution_clock::now();
+  auto elapsed = [&]() {
+    return duration_cast<duration<double>>(high_resolution_clock::now() -
+                                           startTime)
+        .count();
+  };
+
+  mt19937_64 rng(random_device{}());
+  const size_t maxStatPerDir = 64;
+  const size_t probeSetSize = 32;
+  const size_t maxProbes = 5000;
+
+  // Files for the latency probe set. Every probe lists the root again, so
+  // each sampled file is weighted by how many files it stands for.
+  WeightedReservoir<fs::path> reservoir(probeSetSize);
+  vector<fs::path> probeSet;
+
+  // Bytes the scan reads from a file of `size`: the classification head,
+  // the -z sample budget, or all of it when hashing or chunking
+  auto bytesReadFor = [&](uintmax_t size) {
+    uintmax_t read = min<uintmax_t>(size, 65536);
+    if (contentHashing || options.merkleTree || options.chunkDedup)
+      read = size;
+    else if (compressionSampleBudget > 0)
+      read = max(read, min<uintmax_t>(size, compressionSampleBudget));
+    return static_cast<double>(read);
+  };
+
+  double sumFiles = 0, sumFilesSq = 0, sumBytes = 0, sumRead = 0, sumDirs = 0;
+  double sumPathLen = 0, pathSamples = 0;
+  double listDirTime = 0;
+  size_t listDirCount = 0;
+
+  if (fs::is_regular_file(root)) {
+    probeSet.push_back(root);
+    error_code ec;
+    uintmax_t size = fs::file_size(root, ec);
+    est.files = 1;
+    est.bytes = ec ? 0 : static_cast<double>(size);
+    est.bytesRead = ec ? 0 : bytesReadFor(size);
+    est.probes = 1;
+    sumPathLen = static_cast<double>(root.string().size());
+    pathSamples = 1;
+  } else {
+    while (est.probes < maxProbes && (est.probes == 0 || elapsed() < budgetSeconds)) {
+      fs::path dir = root;
+      double weight = 1.0;
+      double probeFiles = 0, probeBytes = 0, probeRead = 0, probeDirs = 0;
+
+      while (true) {
+        vector<fs::path> files;
+        vector<fs::path> subdirs;
+        auto listStart = high_resolution_clock::now();
+        error_code ec;
+        for (fs::directory_iterator it(
+                 dir, fs::directory_options::skip_permission_denied, ec),
+             endIt;
+             !ec && it != endIt; it.increment(ec)) {
+          const auto &entry = *it;
+          error_code typeEc;
+          if (entry.is_regular_file(typeEc)) {
+            files.push_back(entry.path());
+          } else if (recursive && entry.is_directory(typeEc) &&
+                     !entry.is_symlink(typeEc)) {
+            subdirs.push_back(entry.path());
+          }
+        }
+        listDirTime += duration_cast<duration<double>>(
+                           high_resolution_clock::now() - listStart)
+                           .count();
+        listDirCount++;
+
+        // Stat a bounded random subset and scale up to the whole directory
+        shuffle(files.begin(), files.end(), rng);
+        size_t statCount = min(files.size(), maxStatPerDir);
+        double dirBytes = 0, dirRead = 0;
+        for (size_t i = 0; i < statCount; i++) {
+          error_code sizeEc;
+          uintmax_t size = fs::file_size(files[i], sizeEc);
+          if (sizeEc)
+            continue;
+          dirBytes += static_cast<double>(size);
+          dirRead += bytesReadFor(size);
+          sumPathLen += static_cast<double>(files[i].string().size());
+          pathSamples++;
+        }
+        double scale = statCount > 0 ? static_cast<double>(files.size()) /
+                                           static_cast<double>(statCount)
+                                     : 0.0;
+        for (size_t i = 0; i < statCount; i++)
+          reservoir.add(files[i], weight * scale, rng);
+
+        probeFiles += weight * static_cast<double>(files.size());
+        probeBytes += weight * dirBytes * scale;
+        probeRead += weight * dirRead * scale;
+        probeDirs += weight;
+
+        if (subdirs.empty())
+          break;
+        uniform_int_distribution<size_t> pick(0, subdirs.size() - 1);
+        dir = subdirs[pick(rng)];
+        weight *= static_cast<double>(subdirs.size());
+      }
+
+      est.probes++;
+      sumFiles += probeFiles;
+      sumFilesSq += probeFiles * probeFiles;
+      sumBytes += probeBytes;
+      sumRead += probeRead;
+      sumDirs += probeDirs;
+
+      // A flat tree has exactly one possible path, so one probe is exact
+      if (!recursive || probeDirs == 1.0)
+        break;
+
+      // Stop early once the estimate has converged
+      if (est.probes >= 30) {
+        double n = static_cast<double>(est.probes);
+        double mean = sumFiles / n;
+        double variance = max(0.0, sumFilesSq / n - mean * mean);
+        if (mean > 0 && sqrt(variance / n) / mean < 0.02)
+          break;
+      }
+    }
+
+    double n = static_cast<double>(est.probes);
+    est.files = sumFiles / n;
+    est.bytes = sumBytes / n;
+    est.bytesRead = sumRead / n;
+    est.directories = sumDirs / n;
+    double variance = max(0.0, sumFilesSq / n - est.files * est.files);
+    est.filesStdError = est.probes > 1 ? sqrt(variance / n) : 0.0;
+    probeSet = reservoir.items();
+  }
+  est.threads = !ordered && est.files <= SEQUENTIAL_SCAN_MAX_FILES
+                    ? 1
+                    : max(1u, threadCount);
+
+  // Latency probe: raw open/read, then the full per-file analysis with the
+  // scan's options
+  ChunkDedupIndex probeChunks;
+  set<string> probeTypes;
+  double openReadTime = 0, analyzeTime = 0, probeRead = 0;
+  for (const auto &path : probeSet) {
+    auto t0 = high_resolution_clock::now();
+    ifstream file(path, ios::binary);
+    if (file) {
+      vector<char> buffer(65536);
+      file.read(buffer.data(), buffer.size());
+    }
+    auto t1 = high_resolution_clock::now();
+    FileInfo info =
+        analyzeFile(path, nullptr, options.chunkDedup ? &probeChunks : nullptr);
+    auto t2 = high_resolution_clock::now();
+    openReadTime += duration_cast<duration<double, milli>>(t1 - t0).count();
+    analyzeTime += duration_cast<duration<double, milli>>(t2 - t1).count();
+    probeRead += bytesReadFor(info.size);
+    probeTypes.insert(info.type);
+  }
+  est.probeFiles = probeSet.size();
+  if (!probeSet.empty()) {
+    est.meanOpenReadMs = openReadTime / static_cast<double>(probeSet.size());
+    est.meanAnalyzeMs = analyzeTime / static_cast<double>(probeSet.size());
+  }
+  if (listDirCount > 0)
+    est.meanListDirMs = listDirTime * 1000.0 / static_cast<double>(listDirCount);
+
+  // Enumeration is single-threaded; analysis is spread over the workers.
+  // The probe set was just read, so use the slower of the two timings to
+  // offset the page-cache warmup. Options that read past the head cost
+  // time in proportion to the bytes read, so their analysis time is scaled
+  // from the probe files' mean bytes read to the tree's: a few dozen probe
+  // files rarely include the large ones that dominate.
+  double perFileMs = max(est.meanOpenReadMs, est.meanAnalyzeMs);
+  bool readsPastHead = contentHashing || options.merkleTree ||
+                       options.chunkDedup || compressionSampleBudget > 0;
+  if (readsPastHead && probeRead > 0 && est.files > 0) {
+    double probeMean = probeRead / static_cast<double>(probeSet.size());
+    perFileMs = max(est.meanOpenReadMs,
+                    est.meanAnalyzeMs * (est.bytesRead / est.files) / probeMean);
+  }
+  est.estimatedSeconds =
+      (est.directories * est.meanListDirMs +
+       est.files * perFileMs / static_cast<double>(est.threads)) /
+      1000.0;
+
+  // Peak memory: the path list plus one FileInfo per file (terminal output
+  // also keeps a sorted copy), with heap storage for strings that exceed the
+  // small-string buffer, plus each worker's buffers, plus the aggregates,
+  // which every worker keeps its own copy of until they are merged.
+  const double MAP_NODE = 48; // Per-entry overhead of a std::map node
+  double avgPathLen = pathSamples > 0 ? sumPathLen / pathSamples : 32.0;
+  double pathHeap = avgPathLen > 15 ? avgPathLen + 1 : 0;
+  double perFile = static_cast<double>(sizeof(fs::path)) + pathHeap;
+  double perResult = static_cast<double>(sizeof(FileInfo)) + pathHeap + 32;
+  perFile += perResult * (jsonOutput ? 1.0 : 2.0);
+  double threads = static_cast<double>(est.threads);
+  double copies = threads + 1.0;
+  double memory =
+      est.files * perFile +
+      threads * static_cast<double>(workerMemoryBytes(options.chunkDedup));
+  if (options.chunkDedup) // The merged index
+    memory += static_cast<double>(chunkIndexCapacity) * 2 * 64;
+
+  // Per-type content sketches, and entropy and compression totals when on;
+  // types not in the probe set are missed
+  double types = max<double>(1.0, static_cast<double>(probeTypes.size()));
+  double perType = MAP_NODE + static_cast<double>(sizeof(TypeContentStats) +
+                                                  HyperLogLog::REGISTERS);
+  if (options.entropyAnomalies)
+    perType += MAP_NODE + static_cast<double>(sizeof(TypeEntropyStats));
+  if (compressionSampleBudget > 0)
+    perType += MAP_NODE + static_cast<double>(sizeof(CompressionTotals));
+  memory += copies * (types * perType + HyperLogLog::REGISTERS);
+
+  // --tree: type totals per directory, in the workers' and merged maps
+  if (options.directoryTree) {
+    double typesPerDirectory =
+        min(types, max(1.0, est.files / max(1.0, est.directories)));
+    double perDirectory =
+        MAP_NODE + pathHeap +
+        typesPerDirectory * (MAP_NODE + static_cast<double>(sizeof(TypeTotals)));
+    memory += 2.0 * est.directories * perDirectory;
+  }
+
+  // --merkle: leaf buffers up to the run size each, then the directory
+  // records while the tree file is written
+  if (options.merkleTree) {
+    double run = static_cast<double>(merkleRunBytes);
+    double perLeaf = static_cast<double>(sizeof(MerkleLeaf)) + avgPathLen + 72;
+    double perRecord =
+        static_cast<double>(sizeof(MerkleDirectory)) + avgPathLen + 64;
+    memory += min(est.files * perLeaf, copies * run) +
+              min(est.directories * perRecord, run);
+  }
+  est.estimatedPeakMemory = static_cast<uintmax_t>(memory);
+
+  est.elapsedSeconds = elapsed();
+  return est;
+}
+
+string formatDuration(double seconds) {
+  stringstream ss;
+  if (seconds < 60) {
+    ss << fixed << setprecision(1) << seconds << "s";
+  } else if (seconds < 3600) {
+    ss << static_cast<int>(seconds / 60) << "m "
+       << static_cast<int>(seconds) % 60 << "s";
+  } else {
+    ss << static_cast<int>(seconds / 3600) << "h "
+       << static_cast<int>(seconds / 60) % 60 << "m";
+  }
+  return ss.str();
+}
+
+void outputEstimate(const ScanEstimate &est, bool jsonOutput) {
+  if (jsonOutput) {
+    cout << "{\n";
+    cout << "  \"estimatedFiles\": " << fixed << setprecision(0) << est.files
+         << ",\n";
+    cout << "  \"filesStdError\": " << est.filesStdError << ",\n";
+    cout << "  \"estimatedDirectories\": " << est.directories << ",\n";
+    cout << "  \"estimatedBytes\": " << est.bytes << ",\n";
+    cout << "  \"estimatedBytesRead\": " << est.bytesRead << ",\n";
+    cout << "  \"estimatedSeconds\": " << setprecision(2)
+         << est.estimatedSeconds << ",\n";
+    cout << "  \"estimatedPeakMemory\": " << est.estimatedPeakMemory << ",\n";
+    cout << "  \"threads\": " << est.threads << ",\n";
+    cout << "  \"probes\": " << est.probes << ",\n";
+    cout << "  \"probeFiles\": " << est.probeFiles << ",\n";
+    cout << "  \"meanOpenReadMs\": " << setprecision(3) << est.meanOpenReadMs
+         << ",\n";
+    cout << "  \"meanAnalyzeMs\": " << est.meanAnalyzeMs << ",\n";
+    cout << "  \"meanListDirMs\": " << est.meanListDirMs << ",\n";
+    cout << "  \"elapsedSeconds\": " << setprecision(2) << est.elapsedSeconds
+         << "\n";
+    cout << "}\n";
+    return;
+  }
+
+  cout << BLUE
+       << "┌─ Scan Estimate ──────────────────────────────────────────────────┐"
+       << RESET << "\n";
+  cout << " │ Files: " << BOLD << fixed << setprecision(0) << est.files
+       << RESET;
+  if (est.filesStdError > 0)
+    cout << " (±" << est.filesStdError << ")";
+  cout << "\n";
+  cout << " │ Directories: " << BOLD << est.directories << RESET << "\n";
+  cout << " │ Total size: " << BOLD
+       << formatSize(static_cast<uintmax_t>(est.bytes)) << RESET << "\n";
+  cout << " │ Bytes to read: " << BOLD
+       << formatSize(static_cast<uintmax_t>(est.bytesRead)) << RESET << "\n";
+  cout << " │ Wall time: " << BOLD << formatDuration(est.estimatedSeconds)
+       << RESET << " with " << est.threads << " thread(s)\n";
+  cout << " │ Peak memory: " << BOLD << formatSize(est.estimatedPeakMemory)
+       << RESET << "\n";
+  cout << " │ Per-file latency: " << setprecision(3) << est.meanOpenReadMs
+       << " ms open/read, " << est.meanAnalyzeMs << " ms analysis ("
+       << est.probeFiles << " probe files)\n";
+  cout << " │ Sampled " << est.probes << " random path(s) in " << setprecision(2)
+       << est.elapsedSeconds << "s\n";
+  cout << BLUE
+       << "└──────────────────────────────────────────────────────────────────┘"
+       << RESET << "\n";
+}
+
+// ============================================================================
+// Scan History (append-only summaries + trend queries)
+// ============================================================================
+// One tab-separated line per scan, appended with a single write, so
+// recording is O(1) regardless of how long the history is:
+//   v1 <time> <root> <files> <bytes> <seconds> <threads> <type=count:bytes;...>
+// Fields are backslash-escaped so paths and type names cannot break the
+// line structure.
+struct HistoryRecord {
+  int64_t timestamp = 0;
+  string root;
+  size_t files = 0;
+  uintmax_t bytes = 0;
+  double seconds = 0;
+  unsigned int threads = 0;
+  map<string, TypeTotals> types;
+
+  double filesPerSecond() const {
+    return seconds > 0 ? static_cast<double>(files) / seconds : 0.0;
+  }
+  double bytesPerSecond() const {
+    return seconds > 0 ? static_cast<double>(bytes) / seconds : 0.0;
+  }
+};
+
+string escapeHistoryField(const string &s) {
+  string out;
+  for (char c : s) {
+    switch (c) {
+    case '\\':
+      out += "\\\\";
+      break;
+    case '\t':
+      out += "\\t";
+      break;
+    case '\n':
+      out += "\\n";
+      break;
+    case ';':
+      out += "\\;";
+      break;
+    case '=':
+      out += "\\=";
+      break;
+    default:
+      out += c;
+    }
+  }
+  return out;
+}
+
+// Splits on an unescaped delimiter, unescaping each piece
+vector<string> splitHistoryField(const string &s, char delimiter) {
+  vector<string> parts(1);
+  for (size_t i = 0; i < s.size(); i++) {
+    char c = s[i];
+    if (c == '\\' && i + 1 < s.size()) {
+      char e = s[++i];
+      parts.back() += e == 't' ? '\t' : e == 'n' ? '\n' : e;
+    } else if (c == delimiter) {
+      parts.emplace_back();
+    } else {
+      parts.back() += c;
+    }
+  }
+  return parts;
+}
+
+// Like splitHistoryField, but leaves escapes in place for a second split
+vector<string> splitEscaped(const string &s, char delimiter) {
+  vector<string> parts(1);
+  for (size_t i = 0; i < s.size(); i++) {
+    if (s[i] == '\\' && i + 1 < s.size()) {
+      parts.back() += s[i];
+      parts.back() += s[++i];
+    } else if (s[i] == delimiter) {
+      parts.emplace_back();
+    } else {
+      parts.back() += s[i];
+    }
+  }
+  return parts;
+}
+
+string encodeHistoryRecord(const HistoryRecord &rec) {
+  stringstream ss;
+  ss << "v1\t" << rec.timestamp << "\t" << escapeHistoryField(rec.root) << "\t"
+     << rec.files << "\t" << rec.bytes << "\t" << fixed << setprecision(3)
+     << rec.seconds << "\t" << rec.threads << "\t";
+  bool first = true;
+  for (const auto &[type, totals] : rec.types) {
+    if (!first)
+      ss << ";";
+    first = false;
+    ss << escapeHistoryField(type) << "=" << totals.count << ":"
+       << totals.bytes;
+  }
+  ss << "\n";
+  return ss.str();
+}
+
+bool decodeHistoryRecord(const string &line, HistoryRecord &rec) {
+  vector<string> fields = splitEscaped(line, '\t');
+  if (fields.size() != 8 || fields[0] != "v1")
+    return false;
+  try {
+    rec.timestamp = stoll(fields[1]);
+    rec.root = splitHistoryField(fields[2], '\0')[0];
+    rec.files = stoull(fields[3]);
+    rec.bytes = stoull(fields[4]);
+    rec.seconds = stod(fields[5]);
+    rec.threads = static_cast<unsigned int>(stoul(fields[6]));
+    rec.types.clear();
+    if (!fields[7].empty()) {
+      for (const string &entry : splitEscaped(fields[7], ';')) {
+        vector<string> kv = splitEscaped(entry, '=');
+        if (kv.size() != 2)
+          return false;
+        size_t colon = kv[1].find(':');
+        if (colon == string::npos)
+          return false;
+        TypeTotals totals;
+        totals.count = stoull(kv[1].substr(0, colon));
+        totals.bytes = stoull(kv[1].substr(colon + 1));
+        rec.types[splitHistoryField(kv[0], '\0')[0]] = totals;
+      }
+    }
+  } catch (...) {
+    return false;
+  }
+  return true;
+}
+
+string defaultHistoryPath() {
+  if (const char *env = getenv("FTA_HISTORY"))
+    return env;
+#ifdef _WIN32
+  const char *home = getenv("USERPROFILE");
+#else
+  const char *home = getenv("HOME");
+#endif
+  return string(home ? home : ".") + "/.filetypeanalyzer_history";
+}
+
+bool appendHistory(const string &historyPath, const HistoryRecord &rec) {
+  string line = encodeHistoryRecord(rec);
+#ifndef _WIN32
+  // O_APPEND makes the single write land atomically at the end of the file,
+  // even with concurrent scans recording to the same history
+  int fd = open(historyPath.c_str(), O_WRONLY | O_CREAT | O_APPEND, 0644);
+  if (fd < 0)
+    return false;
+  bool ok = write(fd, line.data(), line.size()) ==
+            static_cast<ssize_t>(line.size());
+  close(fd);
+  return ok;
+#else
+  ofstream out(historyPath, ios::app | ios::binary);
+  out << line;
+  return static_cast<bool>(out);
+#endif
+}
+
+HistoryRecord summarizeScan(const vector<FileInfo> &files, const string &root,
+                            double totalTime, unsigned int threadCount) {
+  HistoryRecord rec;
+  rec.timestamp =
+      duration_cast<seconds>(system_clock::now().time_since_epoch()).count();
+  error_code ec;
+  fs::path absolute = fs::absolute(root, ec);
+  rec.root = ec ? root : absolute.lexically_normal().string();
+  rec.files = files.size();
+  rec.seconds = totalTime;
+  rec.threads = threadCount;
+  for (const auto &f : files) {
+    rec.bytes += f.size;
+    rec.types[f.type].add(f.size);
+  }
+  return rec;
+}
+
+string formatTimestamp(int64_t timestamp) {
+  time_t t = static_cast<time_t>(timestamp);
+  tm local{};
+#ifdef _WIN32
+  localtime_s(&local, &t);
+#else
+  localtime_r(&t, &local);
+#endif
+  char buf[32];
+  strftime(buf, sizeof(buf), "%Y-%m-%d %H:%M", &local);
+  return buf;
+}
+
+// `analyzer history [options]`: recent scans, per-type growth and
+// throughput regressions for one scan root
+int runHistoryQuery(int argc, char *argv[], int firstArg) {
+  string historyPath = defaultHistoryPath();
+  string root;
+  string typeFilter;
+  size_t last = 20;
+  double regressionThreshold = 0.8;
+  bool jsonOutput = false;
+
+  for (int i = firstArg; i < argc; i++) {
+    string arg = argv[i];
+    if ((arg == "--history-file" || arg == "-H") && i + 1 < argc) {
+      historyPath = argv[++i];
+    } else if (arg == "--root" && i + 1 < argc) {
+      root = argv[++i];
+    } else if (arg == "--type" && i + 1 < argc) {
+      typeFilter = argv[++i];
+    } else if (arg == "--last" && i + 1 < argc) {
+      last = max<size_t>(1, static_cast<size_t>(atoi(argv[++i])));
+    } else if (arg == "--threshold" && i + 1 < argc) {
+      regressionThreshold = atof(argv[++i]);
+    } else if (arg == "--json" || arg == "-j") {
+      jsonOutput = true;
+    } else if (arg == "--help" || arg == "-h") {
+      cout << "Usage: " << argv[0] << " history [options]\n\n";
+      cout << "Options:\n";
+      cout << "  -H, --history-file  History file (default "
+           << defaultHistoryPath() << ")\n";
+      cout << "      --root PATH     Scan root to report on (default: most "
+              "recent scan's)\n";
+      cout << "      --type TYPE     Only show growth for this type\n";
+      cout << "      --last N        Number of scans to include (default "
+              "20)\n";
+      cout << "      --threshold F   Flag scans below F x median throughput "
+              "(default 0.8)\n";
+      cout << "  -j, --json          Output as JSON\n";
+      return 0;
+    }
+  }
+
+  ifstream in(historyPath);
+  if (!in) {
+    cerr << "No scan history at " << historyPath << "\n";
+    return 1;
+  }
+  vector<HistoryRecord> all;
+  string line;
+  while (getline(in, line)) {
+    HistoryRecord rec;
+    if (decodeHistoryRecord(line, rec))
+      all.push_back(std::move(rec));
+  }
+  if (all.empty()) {
+    cerr << "No scans recorded in " << historyPath << "\n";
+    return 1;
+  }
+
+  if (root.empty()) {
+    root = all.back().root;
+  } else {
+    error_code ec;
+    fs::path absolute = fs::absolute(root, ec);
+    if (!ec)
+      root = absolute.lexically_normal().string();
+  }
+  vector<const HistoryRecord *> scans;
+  for (const auto &rec : all) {
+    if (rec.root == root)
+      scans.push_back(&rec);
+  }
+  if (scans.size() > last)
+    scans.erase(scans.begin(), scans.end() - static_cast<ptrdiff_t>(last));
+  if (scans.empty()) {
+    cerr << "No scans recorded for " << root << "\n";
+    return 1;
+  }
+
+  // Throughput regressions: files/s against the median of up to ten
+  // preceding scans
+  vector<double> baselines(scans.size(), 0.0);
+  vector<bool> regressed(scans.size(), false);
+  for (size_t i = 1; i < scans.size(); i++) {
+    vector<double> window;
+    for (size_t k = i >= 10 ? i - 10 : 0; k < i; k++)
+      window.push_back(scans[k]->filesPerSecond());
+    nth_element(window.begin(), window.begin() + window.size() / 2,
+                window.end());
+    baselines[i] = window[window.size() / 2];
+    regressed[i] = baselines[i] > 0 &&
+                   scans[i]->filesPerSecond() <
+                       regressionThreshold * baselines[i];
+  }
+
+  // Per-type growth from the first to the last selected scan
+  const HistoryRecord &oldest = *scans.front();
+  const HistoryRecord &newest = *scans.back();
+  double days = max(1.0, static_cast<double>(newest.timestamp -
+                                             oldest.timestamp) /
+                             86400.0);
+  set<string> typeNames;
+  for (const auto *rec : {&oldest, &newest}) {
+    for (const auto &[type, totals] : rec->types) {
+      if (typeFilter.empty() || type == typeFilter)
+        typeNames.insert(type);
+    }
+  }
+  auto totalsFor = [](const HistoryRecord &rec, const string &type) {
+    auto it = rec.types.find(type);
+    return it == rec.types.end() ? TypeTotals() : it->second;
+  };
+
+  if (jsonOutput) {
+    cout << "{\n  \"root\": \"" << escapeJson(root) << "\",\n";
+    cout << "  \"scans\": [\n";
+    for (size_t i = 0; i < scans.size(); i++) {
+      const auto &rec = *scans[i];
+      cout << "    {\"timestamp\": " << rec.timestamp
+           << ", \"files\": " << rec.files << ", \"bytes\": " << rec.bytes
+           << ", \"seconds\": " << fixed << setprecision(3) << rec.seconds
+           << ", \"threads\": " << rec.threads
+           << ", \"filesPerSecond\": " << setprecision(1)
+           << rec.filesPerSecond() << ", \"bytesPerSecond\": " << setprecision(0)
+           << rec.bytesPerSecond()
+           << ", \"regression\": " << (regressed[i] ? "true" : "false") << "}"
+           << (i + 1 < scans.size() ? ",\n" : "\n");
+    }
+    cout << "  ],\n  \"growth\": [\n";
+    size_t n = 0;
+    for (const auto &type : typeNames) {
+      TypeTotals before = totalsFor(oldest, type);
+      TypeTotals after = totalsFor(newest, type);
+      double byteDelta =
+          static_cast<double>(after.bytes) - static_cast<double>(before.bytes);
+      cout << "    {\"type\": \"" << escapeJson(type)
+           << "\", \"countBefore\": " << before.count
+           << ", \"countAfter\": " << after.count
+           << ", \"bytesBefore\": " << before.bytes
+           << ", \"bytesAfter\": " << after.bytes
+           << ", \"bytesPerDay\": " << setprecision(0) << byteDelta / days
+           << "}" << (++n < typeNames.size() ? ",\n" : "\n");
+    }
+    cout << "  ]\n}\n";
+    return 0;
+  }
+
+  cout << BLUE
+       << "┌─ Scan History ───────────────────────────────────────────────────┐"
+       << RESET << "\n";
+  cout << " Root: " << BOLD << root << RESET << " (" << scans.size()
+       << " scans)\n";
+  cout << BOLD << " Date              │ Files      │ Size       │ Time     │ "
+                  "Files/s   │ MB/s"
+       << RESET << "\n";
+  for (size_t i = 0; i < scans.size(); i++) {
+    const auto &rec = *scans[i];
+    cout << " " << setw(17) << left << formatTimestamp(rec.timestamp) << " │ "
+         << setw(10) << rec.files << " │ " << setw(10)
+         << formatSize(rec.bytes) << " │ " << setw(8)
+         << formatDuration(rec.seconds) << " │ " << setw(9) << fixed
+         << setprecision(0) << rec.filesPerSecond() << " │ " << setprecision(1)
+         << rec.bytesPerSecond() / (1024.0 * 1024.0);
+    if (regressed[i])
+      cout << "  " << RED << "▼ " << setprecision(0)
+           << 100.0 * rec.filesPerSecond() / baselines[i] << "% of median"
+           << RESET;
+    cout << "\n";
+  }
+  cout << BLUE
+       << "└──────────────────────────────────────────────────────────────────┘"
+       << RESET << "\n\n";
+
+  cout << MAGENTA
+       << "┌─ Growth by Type ─────────────────────────────────────────────────┐"
+       << RESET << "\n";
+  cout << " " << formatTimestamp(oldest.timestamp) << " → "
+       << formatTimestamp(newest.timestamp) << "\n";
+  vector<pair<double, string>> growth;
+  for (const auto &type : typeNames) {
+    double delta = static_cast<double>(totalsFor(newest, type).bytes) -
+                   static_cast<double>(totalsFor(oldest, type).bytes);
+    growth.push_back({delta, type});
+  }
+  sort(growth.begin(), growth.end(), [](const auto &a, const auto &b) {
+    return fabs(a.first) > fabs(b.first);
+  });
+  for (const auto &[delta, type] : growth) {
+    TypeTotals before = totalsFor(oldest, type);
+    TypeTotals after = totalsFor(newest, type);
+    long long countDelta = static_cast<long long>(after.count) -
+                           static_cast<long long>(before.count);
+    cout << " " << setw(18) << left << type << " │ " << setw(11)
+         << formatSize(after.bytes) << " " << (delta >= 0 ? GREEN + "+" : RED + "-")
+         << formatSize(static_cast<uintmax_t>(fabs(delta))) << RESET << " ("
+         << (countDelta >= 0 ? "+" : "") << countDelta << " files, "
+         << (delta >= 0 ? "+" : "-")
+         << formatSize(static_cast<uintmax_t>(fabs(delta) / days)) << "/day)\n";
+  }
+  cout << MAGENTA
+       << "└──────────────────────────────────────────────────────────────────┘"
+       << RESET << "\n";
+  return 0;
+}
+
+// ============================================================================
+// Merkle Directory Fingerprints (--merkle)
+// ============================================================================
+// Each directory's fingerprint is the SHA-256 of its children in name order:
+// a file contributes its name, type, size and content hash, a subdirectory
+// its name and fingerprint. Equal fingerprints mean equal subtrees, so two
+// trees can be compared by descending only where they differ. The tree file
+// lists every directory and file, one per line, in preorder with names in
+// byte order:
+//   # fta merkle v1<TAB>root
+//   path<TAB>d<TAB>fingerprint<TAB>files<TAB>bytes
+//   path<TAB>f<TAB>sha256 or -<TAB>size<TAB>type
+// Paths are relative to the root ("" is the root itself), '/'-separated and
+// escaped like history fields. Preorder with byte-ordered names is the order
+// of paths compared with '/' below every other byte, so each subtree is one
+// contiguous, binary-searchable block.
+// Directories come only from the paths of scanned files, so an empty
+// directory has no line and one that has been emptied compares as removed.
+//
+// Leaves reach the aggregates in completion order, so they are spilled in
+// sorted runs during the scan (MerkleRuns) and folded from disk at the end,
+// in two merged passes: the first closes each directory as the sorted
+// leaves move past it and spills its record, holding only the chain of
+// open directories; the second interleaves those records, whose sorted
+// order is preorder, with the leaves.
+
+// Fills aggregates.merkle on success and drops the spilled runs
+bool writeMerkleTree(ScanAggregates &aggregates, const string &path) {
+  struct OpenDirectory {
+    string path;
+    Sha256 digest;
+    uint64_t files = 0;
+    uintmax_t bytes = 0;
+  };
+  MerkleRuns<MerkleDirectory> directories;
+  size_t directoryCount = 0;
+  vector<OpenDirectory> open(1);
+  auto close = [&]() {
+    OpenDirectory dir = std::move(open.back());
+    open.pop_back();
+    vector<unsigned char> digest = dir.digest.finish();
+    string hex = toLowercase(bytesToHex(digest));
+    if (!open.empty()) {
+      OpenDirectory &parent = open.back();
+      string name =
+          dir.path.substr(parent.path.empty() ? 0 : parent.path.size() + 1);
+      parent.digest.update("d" + name + '\0');
+      parent.digest.update(digest.data(), digest.size());
+      parent.files += dir.files;
+      parent.bytes += dir.bytes;
+    }
+    directories.add({dir.path, hex, dir.files, dir.bytes});
+    directoryCount++;
+    return hex;
+  };
+
+  MerkleLeaf leaf;
+  for (MerkleRuns<MerkleLeaf>::Reader leaves(aggregates.merkleLeaves);
+       leaves.next(leaf);) {
+    size_t slash = leaf.path.rfind('/');
+    string dir = slash == string::npos ? "" : leaf.path.substr(0, slash);
+    while (open.back().path != dir && !insideTreePath(dir, open.back().path))
+      close();
+    while (open.back().path != dir) {
+      const string &top = open.back().path;
+      size_t end = dir.find('/', top.empty() ? 0 : top.size() + 1);
+      string child = dir.substr(0, end);
+      open.emplace_back();
+      open.back().path = std::move(child);
+    }
+    OpenDirectory &parent = open.back();
+    unsigned char content[32] = {};
+    parseSha256Hex(leaf.sha256, content);
+    parent.digest.update("f" + leaf.path.substr(slash + 1) + '\0' +
+                         leaf.type + '\0' + to_string(leaf.size) + '\0');
+    parent.digest.update(content, sizeof(content));
+    parent.files++;
+    parent.bytes += leaf.size;
+  }
+  while (open.size() > 1)
+    close();
+  string rootHash = close();
+
+  string tmp = path + ".tmp";
+  ofstream out(tmp, ios::binary | ios::trunc);
+  out << "# fta merkle v1\t"
+      << escapeHistoryField(aggregates.options.rootDirectory) << "\n";
+  MerkleRuns<MerkleDirectory>::Reader dirs(directories);
+  MerkleRuns<MerkleLeaf>::Reader leaves(aggregates.merkleLeaves);
+  MerkleDirectory dir;
+  bool hasDir = dirs.next(dir), hasLeaf = leaves.next(leaf);
+  while (hasDir || hasLeaf) {
+    if (hasDir && (!hasLeaf || compareTreePaths(dir.path, leaf.path) < 0)) {
+      out << escapeHistoryField(dir.path) << "\td\t" << dir.digest << "\t"
+          << dir.files << "\t" << dir.bytes << "\n";
+      hasDir = dirs.next(dir);
+    } else {
+      out << escapeHistoryField(leaf.path) << "\tf\t"
+          << (leaf.sha256.empty() ? "-" : leaf.sha256) << "\t" << leaf.size
+          << "\t" << escapeHistoryField(leaf.type) << "\n";
+      hasLeaf = leaves.next(leaf);
+    }
+  }
+  out.close();
+  aggregates.merkleLeaves.clear();
+  error_code ec;
+  if (!out) {
+    fs::remove(tmp, ec);
+    return false;
+  }
+  fs::rename(tmp, path, ec);
+  if (ec)
+    return false;
+  aggregates.merkle.rootHash = rootHash;
+  aggregates.merkle.file = path;
+  aggregates.merkle.directories = directoryCount;
+  return true;
+}
+
+// ============================================================================
+// file(1) Compatibility Mode
+// ============================================================================
+// Drop-in replacement for scripts that call `file --mime-type -b` per file:
+// accepts file(1)-style options and classifies every argument in one process
+// on the worker pool. Enabled with --file-compat or by invoking the binary
+// through a link named "file".
+struct LibmagicInfo {
+  const char *mime;
+  const char *description;
+};
+
+const map<string, LibmagicInfo> libmagicTypes = {
+    {"PNG", {"image/png", "PNG image data"}},
+    {"JPEG", {"image/jpeg", "JPEG image data"}},
+    {"GIF", {"image/gif", "GIF image data"}},
+    {"BMP", {"image/bmp", "PC bitmap"}},
+    {"PSD", {"image/vnd.adobe.photoshop", "Adobe Photoshop Image"}},
+    {"TIFF", {"image/tiff", "TIFF image data"}},
+    {"ICO", {"image/vnd.microsoft.icon", "MS Windows icon resource"}},
+    {"CUR", {"image/x-win-bitmap", "MS Windows cursor resource"}},
+    {"PDF", {"application/pdf", "PDF document"}},
+    {"DOC/XLS/PPT",
+     {"application/x-ole-storage", "Composite Document File V2 Document"}},
+    {"ZIP/DOCX/XLSX", {"application/zip", "Zip archive data"}},
+    {"ZIP", {"application/zip", "Zip archive data"}},
+    {"RTF", {"text/rtf", "Rich Text Format data"}},
+    {"RAR", {"application/x-rar", "RAR archive data"}},
+    {"7Z", {"application/x-7z-compressed", "7-zip archive data"}},
+    {"GZIP", {"application/gzip", "gzip compressed data"}},
+    {"BZ2", {"application/x-bzip2", "bzip2 compressed data"}},
+    {"XZ", {"application/x-xz", "XZ compressed data"}},
+    {"Z", {"application/x-compress", "compress'd data"}},
+    {"MP3", {"audio/mpeg", "Audio file with ID3"}},
+    {"FLAC", {"audio/flac", "FLAC audio bitstream data"}},
+    {"OGG", {"audio/ogg", "Ogg data"}},
+    {"MKV/WEBM", {"video/x-matroska", "Matroska data"}},
+    {"FLV", {"video/x-flv", "Macromedia Flash Video"}},
+    {"MPEG", {"video/mpeg", "MPEG sequence"}},
+    {"WMV", {"video/x-ms-asf", "Microsoft ASF"}},
+    {"EXE/DLL", {"application/x-dosexec", "MS-DOS executable"}},
+    {"ELF", {"application/x-executable", "ELF"}},
+    {"CLASS/MACH-O", {"application/x-java-applet", "compiled Java class data"}},
+    {"MACH-O", {"application/x-mach-binary", "Mach-O executable"}},
+    {"DEX", {"application/vnd.android.dex", "Dalvik dex file"}},
+    {"SQLITE", {"application/vnd.sqlite3", "SQLite 3.x database"}},
+    {"XML", {"text/xml", "XML document text"}},
+    {"HTML", {"text/html", "HTML document text"}},
+    {"JSON", {"application/json", "JSON data"}},
+    {"UTF8-BOM", {"text/plain", "UTF-8 Unicode (with BOM) text"}},
+    {"UTF16-LE", {"text/plain", "Little-endian UTF-16 Unicode text"}},
+    {"UTF16-BE", {"text/plain", "Big-endian UTF-16 Unicode text"}},
+    {"TTF", {"font/sfnt", "TrueType Font data"}},
+    {"OTF", {"font/sfnt", "OpenType font data"}},
+    {"WOFF", {"font/woff", "Web Open Font Format"}},
+    {"WOFF2", {"font/woff2", "Web Open Font Format (Version 2)"}},
+    {"PS", {"application/postscript", "PostScript document text"}},
+    {"ISO", {"application/x-iso9660-image", "ISO 9660 CD-ROM filesystem data"}},
+    {"Source Code", {"text/x-c", "C source"}},
+    {"Python", {"text/x-script.python", "Python script"}},
+    {"JavaScript", {"application/javascript", "JavaScript source"}},
+    {"Java", {"text/x-java", "Java source"}},
+    {"CSS", {"text/css", "CSS stylesheet"}},
+};
+
+// MIME type, charset and description for a classified file, in the form
+// libmagic would print them
+struct CompatResult {
+  string mime;
+  string charset;
+  string description;
+};
+
+CompatResult compatClassify(const FileInfo &info) {
+  CompatResult result{"application/octet-stream", "binary", "data"};
+
+  if (info.type == "Unreadable") {
+    // file(1) still reports what the inode is
+    string message = "regular file, no read permission";
+    return {message, "", message};
+  }
+  if (info.type == "Error") {
+    string message = "cannot open `" + info.path + "' (Invalid path)";
+    return {message, "", message};
+  }
+  if (info.type == "Empty/Corrupt") {
+    if (info.size == 0)
+      return {"inode/x-empty", "binary", "empty"};
+    return {"application/octet-stream", "binary", "very short file (no magic)"};
+  }
+
+  string textSuffix;
+  if (info.charset == "us-ascii")
+    textSuffix = "ASCII text";
+  else if (info.charset == "utf-8")
+    textSuffix = "Unicode text, UTF-8 text";
+
+  auto known = libmagicTypes.find(info.type);
+  if (!info.mimeType.empty()) {
+    // Imported magic(5) rule: already libmagic's own wording
+    result.mime = info.mimeType;
+    result.description = info.description;
+  } else if (known != libmagicTypes.end()) {
+    result.mime = known->second.mime;
+    result.description = known->second.description;
+    if (info.category == "Code" && !textSuffix.empty())
+      result.description += ", " + textSuffix;
+  } else if (!textSuffix.empty()) {
+    result.mime = "text/plain";
+    result.description = textSuffix;
+  }
+  if (!info.charset.empty())
+    result.charset = info.charset;
+  else if (result.mime.compare(0, 5, "text/") == 0)
+    result.charset = "us-ascii";
+  return result;
+}
+
+// Classifies the head of a stream the way analyzeFile would a regular file
+CompatResult compatClassifyStream(istream &in, const string &name) {
+  FileInfo info;
+  info.path = name;
+  info.name = name;
+  info.isCorrupt = false;
+  info.extensionMismatch = false;
+  info.type = "Unknown";
+  info.category = "Unknown";
+  info.description = "Unrecognized file type";
+  info.analysisTime = 0.0;
+  info.entropy = 0.0;
+  vector<unsigned char> buffer(localIoBackend.headBytes());
+  in.read(reinterpret_cast<char *>(buffer.data()),
+          static_cast<streamsize>(buffer.size()));
+  buffer.resize(static_cast<size_t>(in.gcount()));
+  info.size = buffer.size();
+  if (buffer.size() < 2) {
+    info.isCorrupt = true;
+    info.type = "Empty/Corrupt";
+  } else {
+    classifyContent(info, buffer.data(), buffer.size(), nullptr);
+  }
+  return compatClassify(info);
+}
+
+int runFileCompat(int argc, char *argv[], int firstArg) {
+  bool brief = false;
+  bool mimeType = false;
+  bool mimeEncoding = false;
+  bool dereference = true;
+  bool print0 = false;
+  bool pad = true;
+  string separator = ":";
+  vector<string> names;
+
+  bool optionsDone = false;
+  for (int i = firstArg; i < argc; i++) {
+    string arg = argv[i];
+    if (optionsDone || arg.empty() || arg[0] != '-' || arg == "-") {
+      names.push_back(arg);
+    } else if (arg == "--") {
+      optionsDone = true;
+    } else if (arg == "-b" || arg == "--brief") {
+      brief = true;
+    } else if (arg == "--mime-type") {
+      mimeType = true;
+    } else if (arg == "--mime-encoding") {
+      mimeEncoding = true;
+    } else if (arg == "-i" || arg == "--mime") {
+      mimeType = mimeEncoding = true;
+    } else if (arg == "-L" || arg == "--dereference") {
+      dereference = true;
+    } else if (arg == "-h" || arg == "--no-dereference") {
+      dereference = false;
+    } else if (arg == "-0" || arg == "--print0") {
+      print0 = true;
+    } else if (arg == "-N" || arg == "--no-pad") {
+      pad = false;
+    } else if (arg == "-E" || arg == "-z" || arg == "-s") {
+      // Accepted for compatibility; no effect here
+    } else if ((arg == "-F" || arg == "--separator") && i + 1 < argc) {
+      separator = argv[++i];
+    } else if ((arg == "-m" || arg == "--magic-file") && i + 1 < argc) {
+      // Colon-separated list, as in file(1)
+      string list = argv[++i];
+      MagicImportReport report;
+      size_t start = 0;
+      while (start <= list.size()) {
+        size_t colon = list.find(':', start);
+        string magicPath = list.substr(
+            start, colon == string::npos ? string::npos : colon - start);
+        if (!magicPath.empty() && !importMagicFile(magicPath, report)) {
+          cerr << "file: could not find any valid magic files!\n";
+          return 1;
+        }
+        if (colon == string::npos)
+          break;
+        start = colon + 1;
+      }
+      rebuildSignatureMatcher();
+    } else if ((arg == "-f" || arg == "--files-from") && i + 1 < argc) {
+      string listPath = argv[++i];
+      ifstream list;
+      istream *in = &cin;
+      if (listPath != "-") {
+        list.open(listPath);
+        if (!list) {
+          cerr << "file: Cannot open `" << listPath
+               << "' (No such file or directory)\n";
+          return 1;
+        }
+        in = &list;
+      }
+      string line;
+      while (getline(*in, line)) {
+        if (!line.empty())
+          names.push_back(line);
+      }
+    } else if (arg == "--help") {
+      cout << "Usage: file [-bhiLN0] [-F separator] [-f namefile] "
+              "[-m magicfiles] [--mime-type] [--mime-encoding] file ...\n";
+      return 0;
+    } else {
+      // Combined short flags such as -bi or -bL
+      bool valid = arg.size() > 1 && arg[1] != '-';
+      for (size_t k = 1; valid && k < arg.size(); k++) {
+        switch (arg[k]) {
+        case 'b':
+          brief = true;
+          break;
+        case 'i':
+          mimeType = mimeEncoding = true;
+          break;
+        case 'L':
+          dereference = true;
+          break;
+        case 'h':
+          dereference = false;
+          break;
+        case '0':
+          print0 = true;
+          break;
+        case 'N':
+          pad = false;
+          break;
+        case 'E':
+        case 'z':
+        case 's':
+          break;
+        default:
+          valid = false;
+        }
+      }
+      if (!valid) {
+        cerr << "file: unrecognized option '" << arg << "'\n";
+        return 1;
+      }
+    }
+  }
+
+  if (names.empty()) {
+    cerr << "Usage: file [-bhiLN0] [-F separator] [-f namefile] "
+            "[--mime-type] [--mime-encoding] file ...\n";
+    return 1;
+  }
+
+  // Names are given explicitly, so parent references are fine here
+  rejectParentPaths = false;
+
+  // Regular files go to the worker pool; everything else is answered here
+  vector<CompatResult> answers(names.size());
+  vector<fs::path> toAnalyze;
+  vector<size_t> analyzeIndex;
+  for (size_t i = 0; i < names.size(); i++) {
+    fs::path path = names[i];
+    error_code ec;
+    if (names[i] == "-") {
+      // Standard input, printed under the name file(1) uses
+      names[i] = "/dev/stdin";
+      answers[i] = compatClassifyStream(cin, names[i]);
+      continue;
+    }
+    fs::file_status status =
+        dereference ? fs::status(path, ec) : fs::symlink_status(path, ec);
+    if (ec || !fs::exists(status)) {
+      string message =
+          "cannot open `" + names[i] + "' (No such file or directory)";
+      answers[i] = {message, "", message};
+    } else if (fs::is_symlink(status)) {
+      answers[i] = {"inode/symlink", "binary",
+                    "symbolic link to " + fs::read_symlink(path, ec).string()};
+    } else if (fs::is_directory(status)) {
+      answers[i] = {"inode/directory", "binary", "directory"};
+    } else if (fs::is_fifo(status)) {
+      answers[i] = {"inode/fifo", "binary", "fifo (named pipe)"};
+    } else if (fs::is_character_file(status)) {
+      answers[i] = {"inode/chardevice", "binary", "character special"};
+    } else if (fs::is_block_file(status)) {
+      answers[i] = {"inode/blockdevice", "binary", "block special"};
+    } else if (fs::is_socket(status)) {
+      answers[i] = {"inode/socket", "binary", "socket"};
+    } else {
+      toAnalyze.push_back(path);
+      analyzeIndex.push_back(i);
+    }
+  }
+
+  ProgressTracker progress;
+  ScanAggregates aggregates;
+  vector<FileInfo> results =
+      analyzeFilesParallel(toAnalyze, progress, false, aggregates);
+  for (size_t k = 0; k < results.size(); k++) {
+    answers[analyzeIndex[k]] = compatClassify(results[k]);
+  }
+
+  // Like file(1), align the results column unless -N or -0 is given
+  size_t width = 0;
+  if (pad && !print0) {
+    for (const auto &name : names)
+      width = max(width, name.size() + separator.size());
+  }
+
+  string out;
+  for (size_t i = 0; i < names.size(); i++) {
+    const auto &answer = answers[i];
+    if (!brief) {
+      out += names[i];
+      if (print0) {
+        out += '\0';
+      } else {
+        out += separator;
+        out += string(width > names[i].size() + separator.size()
+                          ? width - names[i].size() - separator.size()
+                          : 0,
+                      ' ');
+        out += " ";
+      }
+    }
+    if (answer.charset.empty()) {
+      out += answer.description; // Error text is printed as-is in every mode
+    } else if (mimeType && mimeEncoding) {
+      out += answer.mime + "; charset=" + answer.charset;
+    } else if (mimeType) {
+      out += answer.mime;
+    } else if (mimeEncoding) {
+      out += answer.charset;
+    } else {
+      out += answer.description;
+    }
+    out += "\n";
+  }
+  cout << out;
+  return 0;
+}
+
+// ============================================================================
+// Coprocess Pipe Mode (--pipe)
+// ============================================================================
+// One long-lived process answers paths read from stdin on the worker pool,
+// in completion order:
+//
+//   request:  PATH  or  ID<TAB>PRIORITY<TAB>PATH   (higher priority first)
+//   response: {"id": ..., "status": "OK", "queueMs": ..., "file": {...}}
+//             {"id": ..., "status": "BUSY", "predictedQueueMs": ..., ...}
+//             {"id": ..., "status": "ERROR", "error": ...}
+//
+// Records end with '\n', or '\0' with --pipe-nul, in both directions. The
+// ID defaults to the path. A malformed request, or a path that is missing
+// or cannot be read, is answered with ERROR; the latter also carries
+// queueMs.
+
+// Holds each priority's p99 queue time at the target by capping how many
+// requests may wait at or above that priority, adjusted from observed
+// queue times. A late start cuts the cap by 10%, or down to the depth that
+// request's own drain rate fits in the target if that is lower. Only
+// requests admitted since the last cut may cut again, since late answers
+// from the old, larger cap keep arriving for a queue time after it. Timely
+// starts with the queue at least half full grow the cap by STEP each, about
+// 10% per queue length, so it probes back up until the tail turns late.
+// Nothing is assumed about service times, so CPU contention, slow storage
+// and later high-priority requests overtaking queued ones are all absorbed.
+class AdmissionController {
+public:
+  static constexpr double STEP = 0.1;
+
+  AdmissionController(double p99TargetMs, unsigned int workers)
+      : targetMs(p99TargetMs), workers(max(1u, workers)) {}
+
+  bool admit(int64_t priority, size_t ahead, unsigned int busy) const {
+    if (targetMs <= 0.0 || (ahead == 0 && busy < workers))
+      return true;
+    return static_cast<double>(ahead) < limit(priority);
+  }
+
+  // Requests allowed to wait at or above `priority`
+  double limit(int64_t priority) const {
+    auto it = limits.find(priority);
+    return it != limits.end() ? it->second.cap : initialLimit();
+  }
+
+  // Expected queue time behind `ahead` requests, for BUSY answers
+  double predictMs(size_t ahead) const {
+    return static_cast<double>(ahead) * serviceMs / workers;
+  }
+
+  // Admitted request number `sequence` of `priority` had `ahead` requests
+  // in front of it, waited `queueMs` and then took `serviceMs` to analyze.
+  // `nextSequence` is the number the next admitted request will get.
+  void record(int64_t priority, uint64_t sequence, size_t ahead,
+              double queueMs, double serviceMs, uint64_t nextSequence) {
+    this->serviceMs = this->serviceMs <= 0.0
+                          ? serviceMs
+                          : this->serviceMs + 0.05 * (serviceMs - this->serviceMs);
+    if (targetMs <= 0.0)
+      return;
+    auto it = limits.find(priority);
+    if (it == limits.end())
+      it = limits.emplace(priority, Limit{initialLimit(), 0}).first;
+    Limit &limit = it->second;
+    if (queueMs > targetMs) {
+      if (sequence >= limit.cutAt) {
+        // The queue this request saw drained at ahead/queueMs, so that
+        // rate bounds what fits in the target
+        double drained = static_cast<double>(ahead) * targetMs / queueMs;
+        limit.cap = max<double>(
+            workers, min(limit.cap * (1.0 - STEP * 0.99), drained));
+        limit.cutAt = nextSequence;
+      }
+    } else if (static_cast<double>(ahead) >= limit.cap / 2) {
+      limit.cap += STEP;
+    }
+  }
+
+  double meanServiceMs() const { return serviceMs; }
+  double target() const { return targetMs; }
+
+private:
+  // Until a priority has feedback: what the target allows if service
+  // times alone set the pace
+  double initialLimit() const {
+    if (serviceMs <= 0.0)
+      return 16.0 * workers;
+    return max<double>(workers, targetMs * workers / serviceMs);
+  }
+
+  struct Limit {
+    double cap;
+    uint64_t cutAt; // First sequence number allowed to cut again
+  };
+
+  double targetMs;
+  unsigned int workers;
+  double serviceMs = 0.0; // EWMA per request on one worker
+  map<int64_t, Limit> limits;
+};
+
+class PipeServer {
+public:
+  PipeServer(unsigned int workers, double p99TargetMs, char delimiter)
+      : workerCount(max(1u, workers)), admission(p99TargetMs, workerCount),
+        delimiter(delimiter) {}
+
+  // Serves until `in` ends, then drains the queue; returns the exit code
+  int run(istream &in) {
+    vector<thread> pool;
+    for (unsigned int i = 0; i < workerCount; i++)
+      pool.emplace_back([this, i]() { work(i); });
+
+    string record;
+    while (getline(in, record, delimiter)) {
+      if (delimiter == '\n' && !record.empty() && record.back() == '\r')
+        record.pop_back();
+      if (!record.empty())
+        accept(record);
+    }
+    {
+      lock_guard<mutex> lock(mtx);
+      closed = true;
+    }
+    ready.notify_all();
+    for (auto &t : pool)
+      t.join();
+
+    cerr << "pipe: " << received << " requests, " << admitted
+         << " admitted, " << refused << " busy, " << malformed
+         << " malformed, " << failed << " failed; queue p50 " << fixed << setprecision(1)
+         << exp2(queueTimes.quantile(0.5)) - 1.0 << " ms, p99 "
+         << exp2(queueTimes.quantile(0.99)) - 1.0 << " ms; service "
+         << setprecision(3) << admission.meanServiceMs() << " ms; cap "
+         << setprecision(0) << admission.limit(0) << " queued\n";
+    return 0;
+  }
+
+private:
+  struct Request {
+    string id;
+    fs::path path;
+    int64_t priority = 0;
+    uint64_t sequence = 0;
+    steady_clock::time_point arrived;
+    size_t ahead = 0; // Queued at or above `priority` when admitted
+  };
+
+  struct Compare {
+    bool operator()(const Request &a, const Request &b) const {
+      if (a.priority != b.priority)
+        return a.priority < b.priority;
+      return a.sequence > b.sequence;
+    }
+  };
+
+  void accept(const string &record) {
+    Request request;
+    request.arrived = steady_clock::now();
+    size_t tab1 = record.find('\t');
+    size_t tab2 = tab1 == string::npos ? tab1 : record.find('\t', tab1 + 1);
+    if (tab1 == string::npos) {
+      request.id = record;
+      request.path = record;
+    } else {
+      request.id = record.substr(0, tab1);
+      string priority = tab2 == string::npos
+                            ? ""
+                            : record.substr(tab1 + 1, tab2 - tab1 - 1);
+      char *end = nullptr;
+      errno = 0;
+      long long value = strtoll(priority.c_str(), &end, 10);
+      if (priority.empty() || *end != '\0' || errno == ERANGE ||
+          tab2 + 1 >= record.size()) {
+        received++;
+        malformed++;
+        respond("{\"id\": \"" + escapeJson(request.id) +
+                "\", \"status\": \"ERROR\", \"error\": \"expected "
+                "ID<TAB>PRIORITY<TAB>PATH\"}");
+        return;
+      }
+      request.priority = value;
+      request.path = record.substr(tab2 + 1);
+    }
+
+    double predictedMs;
+    {
+      lock_guard<mutex> lock(mtx);
+      received++;
+      size_t ahead = 0;
+      for (auto it = queuedByPriority.lower_bound(request.priority);
+           it != queuedByPriority.end(); ++it)
+        ahead += it->second;
+      if (admission.admit(request.priority, ahead, busy)) {
+        admitted++;
+        request.sequence = nextSequence++;
+        request.ahead = ahead;
+        queuedByPriority[request.priority]++;
+        queue.push(std::move(request));
+        ready.notify_one();
+        return;
+      }
+      refused++;
+      predictedMs = admission.predictMs(ahead);
+    }
+    ostringstream busyRecord;
+    busyRecord << "{\"id\": \"" << escapeJson(request.id)
+               << "\", \"status\": \"BUSY\", \"predictedQueueMs\": " << fixed
+               << setprecision(1) << predictedMs
+               << ", \"p99TargetMs\": " << admission.target() << "}";
+    respond(busyRecord.str());
+  }
+
+  void work(unsigned int index) {
+    DashboardSlot slot(index);
+    while (true) {
+      Request request;
+      {
+        unique_lock<mutex> lock(mtx);
+        ready.wait(lock, [this]() { return closed || !queue.empty(); });
+        if (queue.empty())
+          return;
+        request = queue.top();
+        queue.pop();
+        if (--queuedByPriority[request.priority] == 0)
+          queuedByPriority.erase(request.priority);
+        busy++;
+      }
+      auto started = steady_clock::now();
+      double queueMs =
+          duration<double, milli>(started - request.arrived).count();
+      FileInfo info = analyzeFile(request.path);
+      recordManifest(info);
+      double serviceMs =
+          duration<double, milli>(steady_clock::now() - started).count();
+      {
+        lock_guard<mutex> lock(mtx);
+        busy--;
+        admission.record(request.priority, request.sequence, request.ahead,
+                         queueMs, serviceMs, nextSequence);
+        queueTimes.add(log2(queueMs + 1.0));
       }
+      bool failed = info.type == "Unreadable" || info.type == "Error";
+      if (failed) {
+        lock_guard<mutex> lock(mtx);
+        this->failed++;
+      }
+      ostringstream out;
+      out << "{\"id\": \"" << escapeJson(request.id) << "\", \"status\": \""
+          << (failed ? "ERROR" : "OK") << "\", \"queueMs\": " << fixed
+          << setprecision(2) << queueMs;
+      if (failed) {
+        out << ", \"error\": \"" << escapeJson(info.description) << "\"}";
+      } else {
+        out << ", \"file\": ";
+        writeFileJson(out, info);
+        out << "}";
+      }
+      respond(out.str());
+    }
+  }
+
+  void respond(const string &record) {
+    lock_guard<mutex> lock(outMutex);
+    cout << record << delimiter;
+    cout.flush();
+  }
+
+  unsigned int workerCount;
+  AdmissionController admission; // Guarded by mtx
+  char delimiter;
+
+  mutex mtx;
+  condition_variable ready;
+  priority_queue<Request, vector<Request>, Compare> queue;
+  map<int64_t, size_t> queuedByPriority;
+  unsigned int busy = 0;
+  bool closed = false;
+  uint64_t nextSequence = 0;
+  uint64_t received = 0, admitted = 0, refused = 0, malformed = 0;
+  uint64_t failed = 0; // Admitted, but the path could not be analyzed
+  QuantileSketch queueTimes{0.0, 24.0}; // log2(ms + 1) of admitted requests
+
+  mutex outMutex;
+};
+
+// ============================================================================
+// Content Index (`analyzer index`)
+// ============================================================================
+// Answers "where else does this file exist?" across many scans without
+// rereading their reports. `index add` streams the path/sha256 pairs of
+// --hash reports into runs: files of fixed-size keys sorted by hash, each
+// built within a memory budget, with the paths they point at kept beside
+// them. Whenever the newest runs together reach a quarter of the one before,
+// they are merged, so run sizes fall geometrically and a lookup
+// binary-searches a logarithmic number of memory-mapped runs. MANIFEST lists
+// the scans and live runs; it is renamed into place only after new runs are
+// complete, and replaced runs are deleted only after that, so an interrupted
+// add or merge leaves the previous index intact.
+const char INDEX_MAGIC[8] = {'F', 'T', 'A', 'I', 'D', 'X', '1', '\0'};
+const size_t INDEX_MERGE_RATIO = 4;
+const size_t DEFAULT_INDEX_MEMORY = 256ULL << 20;
+
+struct IndexKey {
+  unsigned char hash[32];
+  uint64_t pathOffset; // Into the run's .paths file; paths end in NUL
+  uint32_t scan;
+  uint32_t reserved;
+};
+static_assert(sizeof(IndexKey) == 48, "IndexKey is an on-disk layout");
+
+struct IndexRunHeader {
+  char magic[8];
+  uint32_t keySize; // sizeof(IndexKey); also rejects a foreign byte order
+  uint32_t reserved;
+  uint64_t count;
+  uint64_t pathBytes;
+  uint64_t unused[4];
+};
+static_assert(sizeof(IndexRunHeader) == 64, "IndexRunHeader is on-disk");
+
+bool indexKeyLess(const IndexKey &a, const IndexKey &b) {
+  int c = memcmp(a.hash, b.hash, sizeof(a.hash));
+  if (c != 0)
+    return c < 0;
+  if (a.scan != b.scan)
+    return a.scan < b.scan;
+  return a.pathOffset < b.pathOffset;
+}
+
+// Read-only map of a whole file; an empty file maps to nothing
+class MappedFile {
+public:
+  MappedFile() = default;
+  MappedFile(const MappedFile &) = delete;
+  MappedFile &operator=(const MappedFile &) = delete;
+  ~MappedFile() { unmap(); }
+
+  // `sequential` hints a front-to-back pass (merges) over random probes
+  bool open(const fs::path &path, string &error, bool sequential = false) {
+    unmap();
+    bool ok = false;
+#ifndef _WIN32
+    int fd = ::open(path.c_str(), O_RDONLY | O_CLOEXEC);
+    if (fd < 0) {
+      error = "cannot open " + path.string();
+      return false;
+    }
+    struct stat st;
+    if (fstat(fd, &st) == 0) {
+      length = static_cast<size_t>(st.st_size);
+      ok = true;
+      if (length > 0) {
+        void *p = mmap(nullptr, length, PROT_READ, MAP_SHARED, fd, 0);
+        ok = p != MAP_FAILED;
+        if (ok) {
+          base = static_cast<const unsigned char *>(p);
+          madvise(p, length, sequential ? MADV_SEQUENTIAL : MADV_RANDOM);
+        }
+      }
+    }
+    ::close(fd);
+#else
+    (void)sequential;
+    HANDLE file = CreateFileW(path.c_str(), GENERIC_READ,
+                              FILE_SHARE_READ | FILE_SHARE_DELETE, nullptr,
+                              OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, nullptr);
+    if (file == INVALID_HANDLE_VALUE) {
+      error = "cannot open " + path.string();
+      return false;
+    }
+    LARGE_INTEGER size;
+    if (GetFileSizeEx(file, &size)) {
+      length = static_cast<size_t>(size.QuadPart);
+      ok = true;
+      if (length > 0) {
+        HANDLE mapping =
+            CreateFileMappingW(file, nullptr, PAGE_READONLY, 0, 0, nullptr);
+        ok = mapping != nullptr;
+        if (ok) {
+          base = static_cast<const unsigned char *>(
+              MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0));
+          CloseHandle(mapping);
+          ok = base != nullptr;
+        }
+      }
+    }
+    CloseHandle(file);
+#endif
+    if (!ok) {
+      base = nullptr;
+      length = 0;
+      error = "cannot map " + path.string();
+    }
+    return ok;
+  }
+
+  const unsigned char *data() const { return base; }
+  size_t size() const { return length; }
+
+private:
+  void unmap() {
+    if (base) {
+#ifndef _WIN32
+      munmap(const_cast<unsigned char *>(base), length);
+#else
+      UnmapViewOfFile(base);
+#endif
+    }
+    base = nullptr;
+    length = 0;
+  }
+
+  const unsigned char *base = nullptr;
+  size_t length = 0;
+};
+
+// One run, mapped: NAME.keys (header + sorted keys) and NAME.paths
+class IndexRun {
+public:
+  bool open(const fs::path &dir, const string &name, string &error,
+            bool sequential = false) {
+    if (!keyFile.open(dir / (name + ".keys"), error, sequential) ||
+        !pathFile.open(dir / (name + ".paths"), error, sequential))
+      return false;
+    IndexRunHeader header;
+    bool valid = keyFile.size() >= sizeof(header);
+    if (valid) {
+      memcpy(&header, keyFile.data(), sizeof(header));
+      valid = memcmp(header.magic, INDEX_MAGIC, sizeof(INDEX_MAGIC)) == 0 &&
+              header.keySize == sizeof(IndexKey) &&
+              header.count == (keyFile.size() - sizeof(header)) /
+                                  sizeof(IndexKey) &&
+              keyFile.size() ==
+                  sizeof(header) + header.count * sizeof(IndexKey) &&
+              header.pathBytes == pathFile.size();
+    }
+    if (!valid) {
+      error = "corrupt index run " + (dir / name).string();
+      return false;
+    }
+    count = header.count;
+    return true;
+  }
+
+  size_t size() const { return count; }
+  const IndexKey *keys() const {
+    return reinterpret_cast<const IndexKey *>(keyFile.data() +
+                                              sizeof(IndexRunHeader));
+  }
+
+  string path(const IndexKey &key) const {
+    if (key.pathOffset >= pathFile.size())
+      return "";
+    const char *start =
+        reinterpret_cast<const char *>(pathFile.data()) + key.pathOffset;
+    const void *end = memchr(start, '\0', pathFile.size() - key.pathOffset);
+    return end ? string(start, static_cast<const char *>(end)) : string();
+  }
+
+  // Keys carrying `hash`, as a [first, last) range
+  pair<const IndexKey *, const IndexKey *>
+  find(const unsigned char hash[32]) const {
+    const IndexKey *first = keys(), *last = keys() + count;
+    first = lower_bound(first, last, hash,
+                        [](const IndexKey &k, const unsigned char *h) {
+                          return memcmp(k.hash, h, 32) < 0;
+                        });
+    last = upper_bound(first, last, hash,
+                       [](const unsigned char *h, const IndexKey &k) {
+                         return memcmp(h, k.hash, 32) < 0;
+                       });
+    return {first, last};
+  }
+
+private:
+  MappedFile keyFile;
+  MappedFile pathFile;
+  size_t count = 0;
+};
+
+// Streams one run to disk: paths as they come, keys already in order
+class IndexRunWriter {
+public:
+  IndexRunWriter() {
+    keyBuffer.resize(1 << 20);
+    pathBuffer.resize(1 << 20);
+  }
+
+  bool open(const fs::path &dir, const string &name, string &error) {
+    keysPath = dir / (name + ".keys");
+    pathsPath = dir / (name + ".paths");
+    keysOut.rdbuf()->pubsetbuf(keyBuffer.data(),
+                               static_cast<streamsize>(keyBuffer.size()));
+    pathsOut.rdbuf()->pubsetbuf(pathBuffer.data(),
+                                static_cast<streamsize>(pathBuffer.size()));
+    keysOut.open(keysPath, ios::binary | ios::trunc);
+    pathsOut.open(pathsPath, ios::binary | ios::trunc);
+    if (!keysOut || !pathsOut) {
+      error = "cannot create " + keysPath.string();
+      return false;
+    }
+    IndexRunHeader header{};
+    keysOut.write(reinterpret_cast<const char *>(&header), sizeof(header));
+    return true;
+  }
+
+  // Offset of the appended block, which must end in NUL
+  uint64_t addPaths(const char *data, size_t length) {
+    uint64_t offset = pathBytes;
+    pathsOut.write(data, static_cast<streamsize>(length));
+    pathBytes += length;
+    return offset;
+  }
+
+  uint64_t addPath(const string &path) {
+    return addPaths(path.c_str(), path.size() + 1);
+  }
+
+  void addKey(const IndexKey &key) {
+    keysOut.write(reinterpret_cast<const char *>(&key), sizeof(key));
+    count++;
+  }
+
+  bool finish(string &error) {
+    IndexRunHeader header{};
+    memcpy(header.magic, INDEX_MAGIC, sizeof(INDEX_MAGIC));
+    header.keySize = sizeof(IndexKey);
+    header.count = count;
+    header.pathBytes = pathBytes;
+    keysOut.seekp(0);
+    keysOut.write(reinterpret_cast<const char *>(&header), sizeof(header));
+    keysOut.close();
+    pathsOut.close();
+    if (!keysOut || !pathsOut) {
+      error = "cannot write " + keysPath.string();
+      return false;
+    }
+    return true;
+  }
+
+  uint64_t size() const { return count; }
+
+private:
+  vector<char> keyBuffer, pathBuffer;
+  fs::path keysPath, pathsPath;
+  ofstream keysOut, pathsOut;
+  uint64_t count = 0;
+  uint64_t pathBytes = 0;
+};
+
+// Pulls path/sha256 pairs out of a --hash report, whole (--json) or
+// streamed (--stream --json), without holding it in memory. Any object
+// carrying both string fields counts, however deeply it is nested.
+class ReportEntryReader {
+public:
+  explicit ReportEntryReader(istream &in) : in(*in.rdbuf()) {}
+
+  // False at the end of the report
+  bool next(string &path, string &sha256) {
+    int c;
+    while ((c = in.sbumpc()) != EOF) {
+      switch (c) {
+      case '{':
+        frames.push_back(Frame{true, {}, {}, 0});
+        expectKey = true;
+        break;
+      case '[':
+        frames.push_back(Frame{false, {}, {}, 0});
+        expectKey = false;
+        break;
+      case '}':
+      case ']': {
+        if (frames.empty())
+          break;
+        Frame done = std::move(frames.back());
+        frames.pop_back();
+        expectKey = false;
+        if (done.object && done.found == 3) {
+          path = std::move(done.path);
+          sha256 = std::move(done.sha256);
+          return true;
+        }
+        break;
+      }
+      case ',':
+        expectKey = !frames.empty() && frames.back().object;
+        break;
+      case '"': {
+        string text = readString();
+        if (frames.empty() || !frames.back().object)
+          break;
+        Frame &frame = frames.back();
+        if (expectKey) {
+          key = std::move(text);
+          expectKey = false;
+        } else if (key == "path") {
+          frame.path = std::move(text);
+          frame.found |= 1;
+        } else if (key == "sha256") {
+          frame.sha256 = std::move(text);
+          frame.found |= 2;
+        }
+        break;
+      }
+      default:
+        break;
+      }
+    }
+    return false;
+  }
+
+private:
+  struct Frame {
+    bool object;
+    string path, sha256;
+    int found; // Bit 0: path, bit 1: sha256
+  };
+
+  // After the opening quote; decodes escapes (\u to UTF-8)
+  string readString() {
+    string out;
+    int c;
+    while ((c = in.sbumpc()) != EOF && c != '"') {
+      if (c != '\\') {
+        out += static_cast<char>(c);
+        continue;
+      }
+      c = in.sbumpc();
+      switch (c) {
+      case 'n':
+        out += '\n';
+        break;
+      case 'r':
+        out += '\r';
+        break;
+      case 't':
+        out += '\t';
+        break;
+      case 'b':
+        out += '\b';
+        break;
+      case 'f':
+        out += '\f';
+        break;
+      case 'u': {
+        unsigned int code = 0;
+        for (int i = 0; i < 4; i++) {
+          int h = in.sbumpc();
+          code = code * 16 + (isdigit(h) ? h - '0' : (tolower(h) - 'a' + 10));
+        }
+        if (code < 0x80) {
+          out += static_cast<char>(code);
+        } else if (code < 0x800) {
+          out += static_cast<char>(0xC0 | (code >> 6));
+          out += static_cast<char>(0x80 | (code & 0x3F));
+        } else {
+          out += static_cast<char>(0xE0 | (code >> 12));
+          out += static_cast<char>(0x80 | ((code >> 6) & 0x3F));
+          out += static_cast<char>(0x80 | (code & 0x3F));
+        }
+        break;
+      }
+      case EOF:
+        return out;
+      default:
+        out += static_cast<char>(c);
+      }
+    }
+    return out;
+  }
+
+  streambuf &in;
+  vector<Frame> frames;
+  string key;
+  bool expectKey = false;
+};
+
+class ContentIndex {
+public:
+  struct Scan {
+    uint32_t id = 0;
+    int64_t added = 0; // Seconds since the Unix epoch
+    uint64_t entries = 0;
+    uintmax_t reportBytes = 0;
+    int64_t reportTime = 0; // The report's mtime when it was added
+    string report;
+  };
+
+  struct Run {
+    string name;
+    uint64_t entries = 0;
+  };
+
+  struct Hit {
+    uint32_t scan;
+    string path;
+  };
+
+  explicit ContentIndex(fs::path directory) : dir(std::move(directory)) {}
+  ~ContentIndex() {
+#ifndef _WIN32
+    if (lockFd >= 0)
+      ::close(lockFd);
+#endif
+  }
+
+  // Reads MANIFEST; a missing one is an empty index
+  bool load(string &error) {
+    scans.clear();
+    runs.clear();
+    mapped.clear();
+    ifstream in(dir / "MANIFEST");
+    if (!in)
+      return true;
+    string line;
+    while (getline(in, line)) {
+      if (line.empty() || line[0] == '#')
+        continue;
+      vector<string> fields = splitEscaped(line, '\t');
+      try {
+        if (fields[0] == "next" && fields.size() == 2) {
+          nextRun = static_cast<uint32_t>(stoul(fields[1]));
+        } else if (fields[0] == "scan" && fields.size() == 7) {
+          Scan scan;
+          scan.id = static_cast<uint32_t>(stoul(fields[1]));
+          scan.added = stoll(fields[2]);
+          scan.entries = stoull(fields[3]);
+          scan.reportBytes = stoull(fields[4]);
+          scan.reportTime = stoll(fields[5]);
+          scan.report = splitHistoryField(fields[6], '\0')[0];
+          scans.push_back(std::move(scan));
+        } else if (fields[0] == "run" && fields.size() == 3) {
+          runs.push_back(Run{fields[1], stoull(fields[2])});
+        } else {
+          throw invalid_argument(line);
+        }
+      } catch (...) {
+        error = "corrupt " + (dir / "MANIFEST").string() + ": " + line;
+        return false;
+      }
+    }
+    return true;
+  }
+
+  // Writers only: creates the directory, takes the writer lock, loads the
+  // manifest and removes run files an interrupted writer left behind
+  bool openForWriting(string &error) {
+    error_code ec;
+    fs::create_directories(dir, ec);
+    if (!fs::is_directory(dir, ec)) {
+      error = "cannot create index directory " + dir.string();
+      return false;
     }
+#ifndef _WIN32
+    lockFd = ::open((dir / "LOCK").c_str(), O_RDWR | O_CREAT | O_CLOEXEC,
+                    0644);
+    if (lockFd < 0 || flock(lockFd, LOCK_EX | LOCK_NB) != 0) {
+      error = "index " + dir.string() + " is being written by another process";
+      return false;
+    }
+#endif
+    if (!load(error))
+      return false;
+    set<string> live;
+    for (const Run &run : runs) {
+      live.insert(run.name + ".keys");
+      live.insert(run.name + ".paths");
+    }
+    for (const auto &entry : fs::directory_iterator(dir, ec)) {
+      string name = entry.path().filename().string();
+      bool runFile = name.rfind("run-", 0) == 0 &&
+                     (entry.path().extension() == ".keys" ||
+                      entry.path().extension() == ".paths");
+      if (runFile && !live.count(name))
+        fs::remove(entry.path(), ec);
+    }
+    return true;
   }
 
-  auto endTime = high_resolution_clock::now();
-  info.analysisTime =
-      static_cast<double>(
-          duration_cast<microseconds>(endTime - startTime).count()) /
-      1000.0;
-
-  return info;
-}
+  // The scan already ingested from this report, unchanged, if any
+  const Scan *findReport(const string &report, uintmax_t bytes,
+                         int64_t mtime) const {
+    for (const Scan &scan : scans) {
+      if (scan.report == report && scan.reportBytes == bytes &&
+          scan.reportTime == mtime)
+        return &scan;
+    }
+    return nullptr;
+  }
 
-// ============================================================================
-// Multi-threaded File Analysis
-// ============================================================================
-vector<FileInfo> analyzeFilesParallel(const vector<fs::path> &filePaths,
-                                      ProgressTracker &progress,
-                                      bool showProgress) {
-  vector<FileInfo> results(filePaths.size());
-  progress.setTotal(filePaths.size());
+  // Ingests one report as a new scan, merges and saves; `skipped` counts
+  // objects whose sha256 is not a digest
+  bool addReport(const string &report, uintmax_t reportBytes,
+                 int64_t reportTime, size_t memoryBudget, Scan &added,
+                 uint64_t &skipped, string &error) {
+    ifstream in(report, ios::binary);
+    if (!in) {
+      error = "cannot open " + report;
+      return false;
+    }
+    added = Scan{};
+    for (const Scan &scan : scans)
+      added.id = max(added.id, scan.id);
+    added.id++;
+    added.added = duration_cast<seconds>(
+                      system_clock::now().time_since_epoch())
+                      .count();
+    added.reportBytes = reportBytes;
+    added.reportTime = reportTime;
+    added.report = report;
 
-  // Determine thread count (use hardware threads, max 8)
-  unsigned int threadCount = min(thread::hardware_concurrency(), 8u);
-  if (threadCount == 0)
-    threadCount = 4;
+    vector<Run> written;
+    vector<IndexKey> pending;
+    string heap;
+    auto flush = [&]() {
+      if (pending.empty())
+        return true;
+      sort(pending.begin(), pending.end(), indexKeyLess);
+      Run run{newRunName(), pending.size()};
+      IndexRunWriter writer;
+      if (!writer.open(dir, run.name, error))
+        return false;
+      writer.addPaths(heap.data(), heap.size());
+      for (const IndexKey &key : pending)
+        writer.addKey(key);
+      if (!writer.finish(error))
+        return false;
+      written.push_back(run);
+      pending.clear();
+      heap.clear();
+      return true;
+    };
 
-  // Chunk files for parallel processing
-  vector<future<void>> futures;
-  size_t chunkSize = max<size_t>(1, filePaths.size() / threadCount);
+    ReportEntryReader reader(in);
+    string path, sha256;
+    bool ok = true;
+    while (ok && reader.next(path, sha256)) {
+      IndexKey key{};
+      if (!parseSha256Hex(sha256, key.hash)) {
+        skipped++;
+        continue;
+      }
+      key.scan = added.id;
+      key.pathOffset = heap.size();
+      heap += path;
+      heap += '\0';
+      pending.push_back(key);
+      added.entries++;
+      if (pending.capacity() * sizeof(IndexKey) + heap.capacity() >=
+          memoryBudget)
+        ok = flush();
+    }
+    ok = ok && flush();
+    if (ok && added.entries == 0) {
+      error = report + " has no path/sha256 pairs (scan with --json --hash)";
+      ok = false;
+    }
+    if (!ok) {
+      for (const Run &run : written)
+        removeRun(run.name);
+      return false;
+    }
+    scans.push_back(added);
+    runs.insert(runs.end(), written.begin(), written.end());
+    vector<string> replaced;
+    return merge(false, replaced, error) && save(error) &&
+           removeRuns(replaced);
+  }
 
-  for (size_t i = 0; i < filePaths.size(); i += chunkSize) {
-    size_t end = min(i + chunkSize, filePaths.size());
+  // Merges the newest runs until each is under a quarter of the one before
+  // it, or everything into one run with `all`
+  bool compact(bool all, string &error) {
+    vector<string> replaced;
+    return merge(all, replaced, error) && save(error) && removeRuns(replaced);
+  }
 
-    futures.push_back(async(launch::async, [&, i, end]() {
-      for (size_t j = i; j < end; j++) {
-        results[j] = analyzeFile(filePaths[j]);
-        progress.update(results[j].name);
+  // Every (scan, path) holding `hash`, newest scan first
+  bool lookup(const unsigned char hash[32], vector<Hit> &hits,
+              string &error) {
+    if (mapped.size() != runs.size()) {
+      mapped.clear();
+      for (const Run &run : runs) {
+        mapped.push_back(make_unique<IndexRun>());
+        if (!mapped.back()->open(dir, run.name, error)) {
+          mapped.clear();
+          return false;
+        }
       }
-    }));
+    }
+    hits.clear();
+    for (const auto &run : mapped) {
+      auto [first, last] = run->find(hash);
+      for (const IndexKey *k = first; k != last; ++k)
+        hits.push_back(Hit{k->scan, run->path(*k)});
+    }
+    sort(hits.begin(), hits.end(), [](const Hit &a, const Hit &b) {
+      return a.scan != b.scan ? a.scan > b.scan : a.path < b.path;
+    });
+    return true;
   }
 
-  // Wait for all threads with progress display
-  if (showProgress) {
-    while (true) {
-      auto [current, total, fileName] = progress.getProgress();
-      if (current >= total)
-        break;
+  const Scan *scan(uint32_t id) const {
+    for (const Scan &s : scans) {
+      if (s.id == id)
+        return &s;
+    }
+    return nullptr;
+  }
 
-      const int barWidth = 40;
-      float progressPct =
-          static_cast<float>(current) / static_cast<float>(total);
-      int pos = static_cast<int>(barWidth * progressPct);
+  const vector<Scan> &allScans() const { return scans; }
+  const vector<Run> &allRuns() const { return runs; }
+  const fs::path &directory() const { return dir; }
 
-      cout << "\r" << CYAN << "Progress: " << RESET << setw(3)
-           << static_cast<int>(progressPct * 100) << "% [";
-      for (int k = 0; k < barWidth; ++k) {
-        if (k < pos)
-          cout << GREEN << "█" << RESET;
-        else
-          cout << "░";
+  uintmax_t diskBytes() const {
+    uintmax_t total = 0;
+    error_code ec;
+    for (const Run &run : runs) {
+      for (const char *ext : {".keys", ".paths"}) {
+        uintmax_t size = fs::file_size(dir / (run.name + ext), ec);
+        if (!ec)
+          total += size;
       }
-      cout << "] " << current << "/" << total << " ";
+    }
+    return total;
+  }
 
-      string shortName = fileName.substr(0, 30);
-      if (fileName.length() > 30)
-        shortName += "...";
-      cout << shortName << "        ";
-      cout.flush();
+private:
+  string newRunName() {
+    char name[32];
+    snprintf(name, sizeof(name), "run-%06u", nextRun++);
+    return name;
+  }
 
-      this_thread::sleep_for(milliseconds(50));
-    }
+  void removeRun(const string &name) {
+    error_code ec;
+    fs::remove(dir / (name + ".keys"), ec);
+    fs::remove(dir / (name + ".paths"), ec);
   }
 
-  // Wait for all threads to complete
-  for (auto &f : futures) {
-    f.wait();
+  bool removeRuns(const vector<string> &names) {
+    for (const string &name : names)
+      removeRun(name);
+    return true;
   }
 
-  return results;
-}
+  bool merge(bool all, vector<string> &replaced, string &error) {
+    while (runs.size() > 1) {
+      // Grow the group backwards from the newest run while the run before
+      // it is not at least INDEX_MERGE_RATIO times the group's size
+      size_t first = runs.size() - 1;
+      uint64_t group = runs[first].entries;
+      while (first > 0 &&
+             (all || runs[first - 1].entries < INDEX_MERGE_RATIO * group)) {
+        first--;
+        group += runs[first].entries;
+      }
+      if (first == runs.size() - 1)
+        return true;
+      Run merged{newRunName(), 0};
+      if (!mergeRuns(first, merged, error)) {
+        removeRun(merged.name);
+        return false;
+      }
+      for (size_t i = first; i < runs.size(); i++)
+        replaced.push_back(runs[i].name);
+      runs.resize(first);
+      runs.push_back(merged);
+    }
+    return true;
+  }
 
-// ============================================================================
-// Progress Bar
-// ============================================================================
-void showProgressBar(size_t current, size_t total, const string &fileName) {
-  const int barWidth = 40;
-  float progress = static_cast<float>(current) / static_cast<float>(total);
-  int pos = static_cast<int>(barWidth * progress);
+  // k-way merge of runs[first..]. A hash found in many scans usually has the
+  // same few paths, so paths repeated within one hash are stored once.
+  bool mergeRuns(size_t first, Run &merged, string &error) {
+    vector<unique_ptr<IndexRun>> inputs;
+    for (size_t i = first; i < runs.size(); i++) {
+      inputs.push_back(make_unique<IndexRun>());
+      if (!inputs.back()->open(dir, runs[i].name, error, true))
+        return false;
+    }
+    IndexRunWriter writer;
+    if (!writer.open(dir, merged.name, error))
+      return false;
 
-  cout << "\r" << CYAN << "Progress: " << RESET << setw(3)
-       << static_cast<int>(progress * 100) << "% [";
-  for (int i = 0; i < barWidth; ++i) {
-    if (i < pos)
-      cout << GREEN << "█" << RESET;
-    else
-      cout << "░";
+    using Cursor = pair<const IndexKey *, size_t>; // {key, input}
+    auto later = [](const Cursor &a, const Cursor &b) {
+      return indexKeyLess(*b.first, *a.first);
+    };
+    priority_queue<Cursor, vector<Cursor>, decltype(later)> heads(later);
+    vector<const IndexKey *> ends;
+    for (size_t i = 0; i < inputs.size(); i++) {
+      ends.push_back(inputs[i]->keys() + inputs[i]->size());
+      if (inputs[i]->size() > 0)
+        heads.push({inputs[i]->keys(), i});
+    }
+
+    vector<pair<string, uint64_t>> recent; // Paths written for this hash
+    unsigned char currentHash[32] = {};
+    while (!heads.empty()) {
+      auto [key, input] = heads.top();
+      heads.pop();
+      if (memcmp(key->hash, currentHash, 32) != 0 || writer.size() == 0) {
+        memcpy(currentHash, key->hash, 32);
+        recent.clear();
+      }
+      IndexKey out = *key;
+      string path = inputs[input]->path(*key);
+      auto seen = find_if(recent.begin(), recent.end(),
+                          [&](const pair<string, uint64_t> &p) {
+                            return p.first == path;
+                          });
+      if (seen != recent.end()) {
+        out.pathOffset = seen->second;
+      } else {
+        out.pathOffset = writer.addPath(path);
+        if (recent.size() < 8)
+          recent.emplace_back(std::move(path), out.pathOffset);
+      }
+      writer.addKey(out);
+      if (++key != ends[input])
+        heads.push({key, input});
+    }
+    merged.entries = writer.size();
+    return writer.finish(error);
   }
-  cout << "] " << current << "/" << total << " " << fileName.substr(0, 30);
-  if (fileName.length() > 30)
-    cout << "...";
-  cout << "        ";
-  cout.flush();
-}
 
-// ============================================================================
-// JSON Output
-// ============================================================================
-string escapeJson(const string &s) {
-  string result;
-  for (char c : s) {
-    switch (c) {
-    case '"':
-      result += "\\\"";
-      break;
-    case '\\':
-      result += "\\\\";
-      break;
-    case '\n':
-      result += "\\n";
-      break;
-    case '\r':
-      result += "\\r";
-      break;
-    case '\t':
-      result += "\\t";
-      break;
-    default:
-      result += c;
+  bool save(string &error) {
+    fs::path tmp = dir / "MANIFEST.tmp";
+    ofstream out(tmp, ios::trunc);
+    out << "# fta index v1\n";
+    out << "next\t" << nextRun << "\n";
+    for (const Scan &scan : scans) {
+      out << "scan\t" << scan.id << "\t" << scan.added << "\t" << scan.entries
+          << "\t" << scan.reportBytes << "\t" << scan.reportTime << "\t"
+          << escapeHistoryField(scan.report) << "\n";
+    }
+    for (const Run &run : runs)
+      out << "run\t" << run.name << "\t" << run.entries << "\n";
+    out.close();
+    error_code ec;
+    if (!out)
+      ec = make_error_code(errc::io_error);
+    else
+      fs::rename(tmp, dir / "MANIFEST", ec);
+    if (ec) {
+      error = "cannot write " + (dir / "MANIFEST").string();
+      return false;
     }
+    return true;
   }
-  return result;
-}
 
-void outputJson(const vector<FileInfo> &files, double totalTime,
-                unsigned int threadCount) {
-  cout << "{\n";
-  cout << "  \"totalFiles\": " << files.size() << ",\n";
-  cout << "  \"totalTime\": " << fixed << setprecision(2) << totalTime << ",\n";
-  cout << "  \"threadsUsed\": " << threadCount << ",\n";
+  fs::path dir;
+  vector<Scan> scans;
+  vector<Run> runs; // Oldest (largest) first
+  uint32_t nextRun = 1;
+  vector<unique_ptr<IndexRun>> mapped; // Opened by lookup
+#ifndef _WIN32
+  int lockFd = -1;
+#endif
+};
 
-  // Calculate statistics
-  map<string, int> typeCounts;
-  map<string, uintmax_t> typeSizes;
-  int corruptCount = 0, mismatchCount = 0, encryptedCount = 0;
-  uintmax_t totalSize = 0;
+// `analyzer index add|lookup|compact|stats DIR ...`
+int runIndexCommand(int argc, char *argv[], int firstArg) {
+  auto usage = [&](ostream &out) {
+    out << "Usage: " << argv[0] << " index COMMAND DIR [options]\n\n";
+    out << "Commands:\n";
+    out << "  add DIR REPORT...      Ingest --json --hash reports (unchanged "
+           "ones are skipped)\n";
+    out << "  lookup DIR TARGET...   Scans and paths holding a SHA-256 or a "
+           "local file's content\n";
+    out << "  compact DIR            Merge every run into one\n";
+    out << "  stats DIR              Scans, runs and size on disk\n\n";
+    out << "Options:\n";
+    out << "      --memory MB    Memory per run while adding (default "
+        << (DEFAULT_INDEX_MEMORY >> 20) << ")\n";
+    out << "      --force        Add reports even if already ingested\n";
+    out << "  -j, --json         Output as JSON\n";
+  };
 
-  for (const auto &f : files) {
-    typeCounts[f.type]++;
-    typeSizes[f.type] += f.size;
-    totalSize += f.size;
-    if (f.isCorrupt)
-      corruptCount++;
-    if (f.extensionMismatch)
-      mismatchCount++;
-    if (f.entropy >= 7.5)
-      encryptedCount++;
+  string command;
+  vector<string> operands;
+  size_t memoryBudget = DEFAULT_INDEX_MEMORY;
+  bool force = false;
+  bool jsonOutput = false;
+  for (int i = firstArg; i < argc; i++) {
+    string arg = argv[i];
+    if (arg == "--memory" && i + 1 < argc) {
+      memoryBudget = max<size_t>(1, strtoull(argv[++i], nullptr, 10)) << 20;
+    } else if (arg == "--force") {
+      force = true;
+    } else if (arg == "--json" || arg == "-j") {
+      jsonOutput = true;
+    } else if (arg == "--help" || arg == "-h") {
+      usage(cout);
+      return 0;
+    } else if (command.empty()) {
+      command = arg;
+    } else {
+      operands.push_back(arg);
+    }
+  }
+  bool known = command == "add" || command == "lookup" ||
+               command == "compact" || command == "stats";
+  if (!known || operands.empty() ||
+      (operands.size() < 2 && (command == "add" || command == "lookup"))) {
+    usage(cerr);
+    return 1;
   }
 
-  cout << "  \"totalSize\": " << totalSize << ",\n";
-  cout << "  \"totalSizeFormatted\": \"" << formatSize(totalSize) << "\",\n";
-  cout << "  \"corruptFiles\": " << corruptCount << ",\n";
-  cout << "  \"mismatchedFiles\": " << mismatchCount << ",\n";
-  cout << "  \"encryptedFiles\": " << encryptedCount << ",\n";
+  ContentIndex index(operands[0]);
+  string error;
+  auto fail = [&]() {
+    cerr << RED << "Error: " << error << RESET << "\n";
+    return 1;
+  };
 
-  // Type statistics
-  cout << "  \"statistics\": [\n";
-  bool first = true;
-  for (const auto &[type, count] : typeCounts) {
-    if (!first)
-      cout << ",\n";
-    first = false;
-    cout << "    {\"type\": \"" << escapeJson(type)
-         << "\", \"count\": " << count << ", \"size\": " << typeSizes[type]
-         << ", \"sizeFormatted\": \"" << formatSize(typeSizes[type]) << "\"}";
+  if (command == "add" || command == "compact") {
+    if (!index.openForWriting(error))
+      return fail();
+    if (command == "compact") {
+      if (!index.compact(true, error))
+        return fail();
+      cout << "Compacted " << index.directory().string() << " to "
+           << index.allRuns().size() << " run(s)\n";
+      return 0;
+    }
+    int status = 0;
+    for (size_t i = 1; i < operands.size(); i++) {
+      error_code ec;
+      fs::path report = fs::absolute(operands[i], ec).lexically_normal();
+      uintmax_t bytes = fs::file_size(report, ec);
+      if (ec) {
+        cerr << RED << "Error: cannot read " << operands[i] << RESET << "\n";
+        status = 1;
+        continue;
+      }
+      int64_t mtime = 0;
+      FileInfo meta;
+      if (localIoBackend.stat(report.string(), meta) == IoKind::File)
+        mtime = meta.modifiedTime;
+      if (!force && index.findReport(report.string(), bytes, mtime)) {
+        cout << "Skipped " << report.string() << " (already indexed)\n";
+        continue;
+      }
+      ContentIndex::Scan scan;
+      uint64_t skipped = 0;
+      auto start = steady_clock::now();
+      if (!index.addReport(report.string(), bytes, mtime, memoryBudget, scan,
+                           skipped, error)) {
+        fail();
+        status = 1;
+        continue;
+      }
+      double secs = duration<double>(steady_clock::now() - start).count();
+      cout << "Added scan " << scan.id << ": " << scan.entries
+           << " entries from " << report.string() << " in " << fixed
+           << setprecision(2) << secs << "s";
+      if (skipped > 0)
+        cout << " (" << skipped << " without a valid sha256)";
+      cout << "; " << index.allRuns().size() << " run(s)\n";
+    }
+    return status;
   }
-  cout << "\n  ],\n";
 
-  // File details
-  cout << "  \"files\": [\n";
-  first = true;
-  for (const auto &f : files) {
-    if (!first)
-      cout << ",\n";
-    first = false;
-    cout << "    {\n";
-    cout << "      \"name\": \"" << escapeJson(f.name) << "\",\n";
-    cout << "      \"path\": \"" << escapeJson(f.path) << "\",\n";
-    cout << "      \"type\": \"" << escapeJson(f.type) << "\",\n";
-    cout << "      \"category\": \"" << escapeJson(f.category) << "\",\n";
-    cout << "      \"description\": \"" << escapeJson(f.description) << "\",\n";
-    cout << "      \"size\": " << f.size << ",\n";
-    cout << "      \"sizeFormatted\": \"" << formatSize(f.size) << "\",\n";
-    cout << "      \"entropy\": " << fixed << setprecision(4) << f.entropy
-         << ",\n";
-    cout << "      \"isCorrupt\": " << (f.isCorrupt ? "true" : "false")
-         << ",\n";
-    cout << "      \"extensionMismatch\": "
-         << (f.extensionMismatch ? "true" : "false") << ",\n";
-    cout << "      \"isEncrypted\": " << (f.entropy >= 7.5 ? "true" : "false")
-         << ",\n";
-    cout << "      \"actualExtension\": \"" << escapeJson(f.actualExtension)
-         << "\",\n";
-    cout << "      \"analysisTime\": " << fixed << setprecision(2)
-         << f.analysisTime << "\n";
-    cout << "    }";
+  error_code ec;
+  if (!fs::exists(index.directory() / "MANIFEST", ec)) {
+    error = "no content index at " + index.directory().string();
+    return fail();
   }
-  cout << "\n  ]\n";
-  cout << "}\n";
+  if (!index.load(error))
+    return fail();
+
+  if (command == "stats") {
+    uint64_t entries = 0;
+    for (const auto &run : index.allRuns())
+      entries += run.entries;
+    if (jsonOutput) {
+      cout << "{\"directory\": \"" << escapeJson(index.directory().string())
+           << "\", \"entries\": " << entries
+           << ", \"diskBytes\": " << index.diskBytes() << ", \"runs\": [";
+      for (size_t i = 0; i < index.allRuns().size(); i++) {
+        const auto &run = index.allRuns()[i];
+        cout << (i ? ", " : "") << "{\"name\": \"" << run.name
+             << "\", \"entries\": " << run.entries << "}";
+      }
+      cout << "], \"scans\": [";
+      for (size_t i = 0; i < index.allScans().size(); i++) {
+        const auto &scan = index.allScans()[i];
+        cout << (i ? ", " : "") << "{\"id\": " << scan.id
+             << ", \"added\": " << scan.added
+             << ", \"entries\": " << scan.entries << ", \"report\": \""
+             << escapeJson(scan.report) << "\"}";
+      }
+      cout << "]}\n";
+      return 0;
+    }
+    cout << BOLD << "Content index " << index.directory().string() << RESET
+         << "\n";
+    cout << "  " << entries << " entries in " << index.allRuns().size()
+         << " run(s), " << formatSize(index.diskBytes()) << " on disk\n";
+    for (const auto &run : index.allRuns())
+      cout << "    " << run.name << "  " << run.entries << "\n";
+    cout << "  " << index.allScans().size() << " scan(s)\n";
+    for (const auto &scan : index.allScans())
+      cout << "    " << setw(4) << scan.id << "  "
+           << formatTimestamp(scan.added) << "  " << setw(10)
+           << scan.entries << "  " << scan.report << "\n";
+    return 0;
+  }
+
+  // lookup: a writer may replace runs between reading MANIFEST and mapping
+  // them, so reload once if a run has vanished
+  int status = 0;
+  for (size_t i = 1; i < operands.size(); i++) {
+    const string &target = operands[i];
+    unsigned char hash[32];
+    string hex = target;
+    if (!parseSha256Hex(target, hash)) {
+      unique_ptr<IoFile> file = localIoBackend.open(target);
+      if (!file) {
+        cerr << RED << "Error: " << target
+             << " is neither a SHA-256 nor a readable file" << RESET << "\n";
+        status = 1;
+        continue;
+      }
+      hex = hashFileContent(nullptr, 0, *file);
+      parseSha256Hex(hex, hash);
+    }
+    hex = toLowercase(hex);
+    vector<ContentIndex::Hit> hits;
+    bool found = index.lookup(hash, hits, error);
+    if (!found && index.load(error))
+      found = index.lookup(hash, hits, error);
+    if (!found)
+      return fail();
+
+    set<uint32_t> scansHit;
+    for (const auto &hit : hits)
+      scansHit.insert(hit.scan);
+    if (jsonOutput) {
+      cout << "{\"target\": \"" << escapeJson(target) << "\", \"sha256\": \""
+           << hex << "\", \"scans\": " << scansHit.size() << ", \"hits\": [";
+      for (size_t h = 0; h < hits.size(); h++) {
+        const ContentIndex::Scan *scan = index.scan(hits[h].scan);
+        cout << (h ? ", " : "") << "{\"scan\": " << hits[h].scan
+             << ", \"added\": " << (scan ? scan->added : 0)
+             << ", \"report\": \"" << escapeJson(scan ? scan->report : "")
+             << "\", \"path\": \"" << escapeJson(hits[h].path) << "\"}";
+      }
+      cout << "]}\n";
+      continue;
+    }
+    cout << BOLD << hex << RESET;
+    if (target != hex)
+      cout << "  (" << target << ")";
+    cout << "\n  " << hits.size() << " location(s) in " << scansHit.size()
+         << " of " << index.allScans().size() << " scan(s)\n";
+    for (const auto &hit : hits) {
+      const ContentIndex::Scan *scan = index.scan(hit.scan);
+      cout << "    scan " << setw(4) << left << hit.scan << right << "  "
+           << (scan ? formatTimestamp(scan->added) : string(16, ' '))
+           << "  " << hit.path << "\n";
+    }
+  }
+  return status;
 }
 
 // ============================================================================
-// Terminal Output
+// Tree Comparison (`analyzer compare`)
 // ============================================================================
-void outputTerminal(const vector<FileInfo> &files, double totalTime,
-                    bool organize, const fs::path &outputDir,
-                    unsigned int threadCount) {
-  cout << "\n\n";
-  cout << CYAN
-       << "╔══════════════════════════════════════════════════════════════╗\n";
-  cout << "║" << BOLD
-       << "         FileTypeAnalyzer Pro - Analysis Complete            "
-       << RESET << CYAN << "║\n";
-  cout << "╚══════════════════════════════════════════════════════════════╝"
-       << RESET << "\n\n";
+// Walks two --merkle files side by side. Where a directory's fingerprints
+// match, both cursors jump past the subtree with a binary search over the
+// mapped file, so unchanged branches cost O(log n) page reads and only the
+// changed ones are read line by line.
+
+class MerkleFile {
+public:
+  struct Entry {
+    string path;
+    bool directory = false;
+    string hash;
+    uint64_t count = 0; // Files below a directory, or a file's size
+    string type;
+    size_t next = 0; // Offset of the following line
+  };
+
+  bool open(const string &path, string &error) {
+    if (!map.open(path, error))
+      return false;
+    const char *data = text();
+    const char *newline =
+        static_cast<const char *>(memchr(data, '\n', map.size()));
+    const string magic = "# fta merkle v1\t";
+    if (!newline || map.size() < magic.size() ||
+        memcmp(data, magic.data(), magic.size()) != 0) {
+      error = path + " is not a --merkle file";
+      return false;
+    }
+    root = splitHistoryField(string(data + magic.size(), newline), '\0')[0];
+    first = static_cast<size_t>(newline - data) + 1;
+    return true;
+  }
+
+  size_t begin() const { return first; }
+  size_t end() const { return map.size(); }
+
+  bool read(size_t pos, Entry &entry) {
+    entriesRead++;
+    const char *data = text();
+    const char *newline =
+        static_cast<const char *>(memchr(data + pos, '\n', end() - pos));
+    size_t stop = newline ? static_cast<size_t>(newline - data) : end();
+    vector<string> fields = splitEscaped(string(data + pos, stop - pos), '\t');
+    entry.next = stop + 1;
+    if (fields.size() != 5 || (fields[1] != "d" && fields[1] != "f"))
+      return false;
+    entry.path = splitHistoryField(fields[0], '\0')[0];
+    entry.directory = fields[1] == "d";
+    entry.hash = fields[2];
+    entry.count = strtoull(fields[3].c_str(), nullptr, 10);
+    entry.type =
+        entry.directory ? string() : splitHistoryField(fields[4], '\0')[0];
+    return true;
+  }
+
+  // Offset of the first line after `dir`'s subtree: gallop forward until a
+  // probe lands outside it, then bisect, so the cost follows the subtree's
+  // size rather than the file's
+  size_t skip(const Entry &dir) {
+    if (dir.path.empty())
+      return end();
+    size_t lo = dir.next, hi = end();
+    Entry probe;
+    bool galloping = true;
+    for (size_t step = 512; hi - lo > 512;) {
+      size_t start = lineAfter(galloping ? lo + step : lo + (hi - lo) / 2, hi);
+      if (start >= hi && galloping) {
+        galloping = false; // Overshot: bisect what is left
+        continue;
+      }
+      if (start >= hi || !read(start, probe))
+        break;
+      if (insideTreePath(probe.path, dir.path)) {
+        lo = start;
+        step *= 2;
+      } else {
+        hi = start;
+        galloping = false;
+      }
+    }
+    while (lo < hi && read(lo, probe) && insideTreePath(probe.path, dir.path))
+      lo = probe.next;
+    return min(lo, hi);
+  }
 
-  // Sort by size
-  vector<FileInfo> sorted = files;
-  sort(sorted.begin(), sorted.end(),
-       [](const FileInfo &a, const FileInfo &b) { return a.size > b.size; });
+  string root;
+  uint64_t entriesRead = 0;
 
-  // Detailed results
-  cout << YELLOW
-       << "┌─ Detailed Analysis Results ─────────────────────────────────────┐"
-       << RESET << "\n";
-  cout << BOLD
-       << " File Name                           │ Type           │ Size       "
-          "│ Entropy │ Status"
-       << RESET << "\n";
-  cout << "─────────────────────────────────────┼────────────────┼────────────┼"
-          "─────────┼──────────\n";
+private:
+  const char *text() const {
+    return reinterpret_cast<const char *>(map.data());
+  }
 
-  for (const auto &f : sorted) {
-    string name = f.name.length() > 35 ? f.name.substr(0, 32) + "..." : f.name;
-    string type = f.type.length() > 14 ? f.type.substr(0, 11) + "..." : f.type;
+  // Start of the first line beginning after `pos`, or `limit`
+  size_t lineAfter(size_t pos, size_t limit) const {
+    if (pos >= limit)
+      return limit;
+    const void *newline = memchr(text() + pos, '\n', limit - pos);
+    return newline ? static_cast<size_t>(static_cast<const char *>(newline) -
+                                         text()) +
+                         1
+                   : limit;
+  }
 
-    cout << " " << setw(36) << left << name << "│ " << setw(15) << left << type
-         << "│ " << setw(11) << left << formatSize(f.size) << "│ " << fixed
-         << setprecision(2) << setw(7) << f.entropy << " │ ";
+  MappedFile map;
+  size_t first = 0;
+};
 
-    if (f.isCorrupt) {
-      cout << RED << "⚠ CORRUPT" << RESET;
-    } else if (f.extensionMismatch) {
-      cout << YELLOW << "⚠ MISMATCH" << RESET;
-    } else if (f.entropy >= 7.5) {
-      cout << BLUE << "🔐 ENCRYPTED" << RESET;
+struct TreeChange {
+  char kind; // '+' only in B, '-' only in A, '~' content or type differs
+  string path;
+  bool directory;
+  uint64_t files; // Files in an added or removed directory
+};
+
+// `analyzer compare A.merkle B.merkle`: exit 0 if identical, 1 if not
+int runTreeCompare(int argc, char *argv[], int firstArg) {
+  vector<string> files;
+  bool jsonOutput = false;
+  for (int i = firstArg; i < argc; i++) {
+    string arg = argv[i];
+    if (arg == "--json" || arg == "-j") {
+      jsonOutput = true;
+    } else if (arg == "--help" || arg == "-h") {
+      cout << "Usage: " << argv[0] << " compare A.merkle B.merkle [--json]\n\n";
+      cout << "Lists files and directories added (+), removed (-) or "
+              "changed (~) from A to B,\n";
+      cout << "reading only subtrees whose fingerprints differ. Write the "
+              "files with --merkle.\n";
+      cout << "Exit status: 0 if the trees match, 1 if they differ, 2 on "
+              "error.\n";
+      return 0;
     } else {
-      cout << GREEN << "✓ OK" << RESET;
+      files.push_back(arg);
     }
-    cout << "\n";
   }
-  cout << YELLOW
-       << "└──────────────────────────────────────────────────────────────────┘"
-       << RESET << "\n\n";
+  if (files.size() != 2) {
+    cerr << "Usage: " << argv[0] << " compare A.merkle B.merkle [--json]\n";
+    return 2;
+  }
 
-  // Statistics
-  map<string, int> typeCounts;
-  map<string, uintmax_t> typeSizes;
-  int corruptCount = 0, mismatchCount = 0, encryptedCount = 0;
-  uintmax_t totalSize = 0;
+  MerkleFile a, b;
+  string error;
+  if (!a.open(files[0], error) || !b.open(files[1], error)) {
+    cerr << RED << "Error: " << error << RESET << "\n";
+    return 2;
+  }
 
-  for (const auto &f : files) {
-    typeCounts[f.type]++;
-    typeSizes[f.type] += f.size;
-    totalSize += f.size;
-    if (f.isCorrupt)
-      corruptCount++;
-    if (f.extensionMismatch)
-      mismatchCount++;
-    if (f.entropy >= 7.5)
-      encryptedCount++;
+  vector<TreeChange> changes;
+  uint64_t added = 0, removed = 0, modified = 0;
+  uint64_t sameSubtrees = 0, sameFiles = 0;
+  string rootA, rootB;
+  auto whole = [&](char kind, const MerkleFile::Entry &e) {
+    changes.push_back({kind, e.path, e.directory, e.directory ? e.count : 1});
+    (kind == '+' ? added : removed) += e.directory ? e.count : 1;
+  };
+
+  size_t pa = a.begin(), pb = b.begin();
+  MerkleFile::Entry ea, eb;
+  while (pa < a.end() || pb < b.end()) {
+    bool hasA = pa < a.end(), hasB = pb < b.end();
+    bool validA = !hasA || a.read(pa, ea);
+    bool validB = !hasB || b.read(pb, eb);
+    if (!validA || !validB) {
+      cerr << RED << "Error: malformed line in "
+           << (validA ? files[1] : files[0]) << RESET << "\n";
+      return 2;
+    }
+    if (hasA && ea.path.empty())
+      rootA = ea.hash;
+    if (hasB && eb.path.empty())
+      rootB = eb.hash;
+    int order = !hasA ? 1 : !hasB ? -1 : compareTreePaths(ea.path, eb.path);
+    if (order < 0) {
+      whole('-', ea);
+      pa = ea.directory ? a.skip(ea) : ea.next;
+    } else if (order > 0) {
+      whole('+', eb);
+      pb = eb.directory ? b.skip(eb) : eb.next;
+    } else if (ea.directory != eb.directory) {
+      whole('-', ea);
+      whole('+', eb);
+      pa = ea.directory ? a.skip(ea) : ea.next;
+      pb = eb.directory ? b.skip(eb) : eb.next;
+    } else if (ea.directory && ea.hash == eb.hash) {
+      sameSubtrees++;
+      sameFiles += ea.count;
+      pa = a.skip(ea);
+      pb = b.skip(eb);
+    } else if (ea.directory) {
+      pa = ea.next; // Descend into both
+      pb = eb.next;
+    } else {
+      if (ea.hash != eb.hash || ea.count != eb.count || ea.type != eb.type) {
+        changes.push_back({'~', ea.path, false, 1});
+        modified++;
+      } else {
+        sameFiles++;
+      }
+      pa = ea.next;
+      pb = eb.next;
+    }
   }
+  bool identical = changes.empty();
 
-  cout << MAGENTA
-       << "┌─ File Type Distribution ─────────────────────────────────────────┐"
-       << RESET << "\n";
-  for (const auto &[type, count] : typeCounts) {
-    int barLen = min(count * 2, 30);
-    cout << " " << setw(18) << left << type << " │ ";
-    cout << GREEN;
-    for (int i = 0; i < barLen; i++)
-      cout << "█";
-    cout << RESET << " " << count << " files (" << formatSize(typeSizes[type])
-         << ")\n";
+  if (jsonOutput) {
+    cout << "{\"identical\": " << (identical ? "true" : "false")
+         << ", \"a\": {\"file\": \"" << escapeJson(files[0])
+         << "\", \"root\": \"" << escapeJson(a.root) << "\", \"hash\": \""
+         << rootA << "\"}, \"b\": {\"file\": \"" << escapeJson(files[1])
+         << "\", \"root\": \"" << escapeJson(b.root) << "\", \"hash\": \""
+         << rootB << "\"}, \"addedFiles\": " << added
+         << ", \"removedFiles\": " << removed
+         << ", \"modifiedFiles\": " << modified
+         << ", \"identicalSubtrees\": " << sameSubtrees
+         << ", \"identicalFiles\": " << sameFiles
+         << ", \"entriesRead\": " << a.entriesRead + b.entriesRead
+         << ", \"changes\": [";
+    for (size_t i = 0; i < changes.size(); i++) {
+      const TreeChange &c = changes[i];
+      cout << (i ? ", " : "") << "{\"change\": \"" << c.kind
+           << "\", \"path\": \"" << escapeJson(c.path)
+           << "\", \"directory\": " << (c.directory ? "true" : "false")
+           << ", \"files\": " << c.files << "}";
+    }
+    cout << "]}\n";
+    return identical ? 0 : 1;
   }
-  cout << MAGENTA
-       << "└──────────────────────────────────────────────────────────────────┘"
-       << RESET << "\n\n";
 
-  // Summary
-  cout << BLUE
-       << "┌─ Analysis Summary ───────────────────────────────────────────────┐"
-       << RESET << "\n";
-  cout << " │ Total files analyzed: " << BOLD << files.size() << RESET << "\n";
-  cout << " │ Total size: " << BOLD << formatSize(totalSize) << RESET << "\n";
-  cout << " │ Unique file types: " << BOLD << typeCounts.size() << RESET
-       << "\n";
-  cout << " │ Threads used: " << BOLD << threadCount << RESET << "\n";
-  cout << " │ Analysis time: " << BOLD << fixed << setprecision(2) << totalTime
-       << "s" << RESET << "\n";
-  if (corruptCount > 0)
-    cout << " │ " << RED << "Corrupt files: " << corruptCount << RESET << "\n";
-  if (mismatchCount > 0)
-    cout << " │ " << YELLOW << "Extension mismatches: " << mismatchCount
-         << RESET << "\n";
-  if (encryptedCount > 0)
-    cout << " │ " << BLUE << "Encrypted/Compressed files: " << encryptedCount
-         << RESET << "\n";
-  if (organize)
-    cout << " │ Files organized to: " << CYAN << outputDir.string() << RESET
-         << "\n";
-  cout << BLUE
-       << "└──────────────────────────────────────────────────────────────────┘"
-       << RESET << "\n";
+  cout << BOLD << "Comparing " << a.root << " (" << files[0] << ") with "
+       << b.root << " (" << files[1] << ")" << RESET << "\n";
+  for (const TreeChange &c : changes) {
+    const string &color = c.kind == '+' ? GREEN : c.kind == '-' ? RED : YELLOW;
+    cout << "  " << color << c.kind << RESET << " "
+         << (c.path.empty() ? "." : c.path) << (c.directory ? "/" : "");
+    if (c.directory)
+      cout << " (" << c.files << " files)";
+    cout << "\n";
+  }
+  if (identical)
+    cout << GREEN << "Trees match" << RESET << " (root " << rootA.substr(0, 16)
+         << ")\n";
+  else
+    cout << added << " added, " << removed << " removed, " << modified
+         << " modified files\n";
+  cout << sameFiles << " unchanged files, " << sameSubtrees
+       << " identical subtrees skipped; read " << a.entriesRead + b.entriesRead
+       << " entries\n";
+  return identical ? 0 : 1;
 }
 
 // ============================================================================
 // Main Function
 // ============================================================================
+// Embedders (e.g. the Python bindings) define FTA_NO_MAIN and include this
+// file to reuse the engine without the CLI
+#ifndef FTA_NO_MAIN
+// True if argv[1] is the subcommand `name`. Subcommands win over a scan of
+// a directory with the same name, which takes `scan NAME`, `-- NAME` or
+// `./NAME`; say so when such a path exists.
+bool isSubcommand(int argc, char *argv[], const char *name) {
+  if (argc < 2 || strcmp(argv[1], name) != 0)
+    return false;
+  error_code ec;
+  if (fs::exists(name, ec)) {
+    cerr << "Note: running the '" << name << "' subcommand; to scan ./"
+         << name << " use: " << argv[0] << " scan " << name << "\n";
+  }
+  return true;
+}
+
 int main(int argc, char *argv[]) {
   enableVirtualTerminal();
 
+  // file(1) drop-in: "--file-compat ..." or a link named "file"
+  if (argc > 1 && string(argv[1]) == "--file-compat")
+    return runFileCompat(argc, argv, 2);
+  if (fs::path(argv[0]).filename() == "file")
+    return runFileCompat(argc, argv, 1);
+
+  // Trend queries over recorded scans
+  if (isSubcommand(argc, argv, "history"))
+    return runHistoryQuery(argc, argv, 2);
+
+  // Content-addressed lookups across ingested reports
+  if (isSubcommand(argc, argv, "index"))
+    return runIndexCommand(argc, argv, 2);
+
+  // Subtree-level diff of two --merkle files
+  if (isSubcommand(argc, argv, "compare"))
+    return runTreeCompare(argc, argv, 2);
+
   // Parse command line arguments
   bool jsonOutput = false;
   bool recursive = false;
   bool organize = false;
   bool parallel = true; // Default to parallel
+  bool estimate = false;
+  int treeDepth = -1;
+  bool owners = false;
+  bool ages = false;
+  bool chunkDedup = false;
   string inputPath;
   string customSigPath;
+  vector<string> magicPaths;
+  bool magicReport = false;
+  bool recordHistory = false;
+  string historyPath = defaultHistoryPath();
+  vector<string> pluginPaths;
+  uint64_t pluginReadBudget = DEFAULT_PLUGIN_READ_BUDGET;
+  uint64_t pluginCpuBudget = DEFAULT_PLUGIN_CPU_MICROS;
+  ScanOrder order = ScanOrder::Directory;
+  string orderName = "directory";
+  bool stream = false;
+  string modelPath;
+  string profileInPath, profileOutPath;
+  bool anomalies = false;
+  string baselineInPath, baselineOutPath;
+  bool showDashboard = false;
+  bool watchSignatures = false;
+  string manifestDir;
+  string merklePath;
+  bool pipeMode = false;
+  char pipeDelimiter = '\n';
+  double pipeP99Ms = 250.0;
+  unsigned int pipeWorkers = 0;
+  ManifestKey manifestKey = ManifestKey::Type;
+  S3Config s3Config = s3ConfigFromEnvironment();
+  string s3Error;
 
-  for (int i = 1; i < argc; i++) {
+  // "scan" is an explicit form of the default command, for directories
+  // named like a subcommand; after "--" every argument is a path
+  bool optionsDone = false;
+  for (int i = argc > 1 && string(argv[1]) == "scan" ? 2 : 1; i < argc; i++) {
     string arg = argv[i];
-    if (arg == "--json" || arg == "-j") {
+    if (optionsDone) {
+      if (inputPath.empty())
+        inputPath = arg;
+    } else if (arg == "--") {
+      optionsDone = true;
+    } else if (arg == "--json" || arg == "-j") {
       jsonOutput = true;
     } else if (arg == "--recursive" || arg == "-r") {
       recursive = true;
@@ -844,26 +9953,282 @@ int main(int argc, char *argv[]) {
       organize = true;
     } else if (arg == "--sequential" || arg == "-s") {
       parallel = false;
+    } else if (arg == "--estimate" || arg == "-e") {
+      estimate = true;
+    } else if (arg == "--tree" || arg == "-t") {
+      treeDepth = 2;
+    } else if (arg.rfind("--tree=", 0) == 0 || arg == "--tree-depth") {
+      // The depth is never taken from a bare following argument, which
+      // could be an input path such as 2024data/
+      string depth = arg == "--tree-depth" ? (i + 1 < argc ? argv[++i] : "")
+                                           : arg.substr(7);
+      char *end = nullptr;
+      long value = strtol(depth.c_str(), &end, 10);
+      if (depth.empty() || *end != '\0' || value < 0) {
+        cerr << "Invalid tree depth '" << depth << "'\n";
+        return 1;
+      }
+      treeDepth = static_cast<int>(min(value, 1024L));
+    } else if (arg == "--owners") {
+      owners = true;
+    } else if (arg == "--ages") {
+      ages = true;
+    } else if (arg == "--chunk-dedup") {
+      chunkDedup = true;
+    } else if (arg == "--hash") {
+      contentHashing = true;
+    } else if (arg == "--merkle") {
+      if (i + 1 < argc) {
+        merklePath = argv[++i];
+        contentHashing = true;
+      }
+    } else if (arg == "--compressibility" || arg == "-z") {
+      compressionSampleBudget = 256 * 1024;
+      if (i + 1 < argc && isdigit(static_cast<unsigned char>(argv[i + 1][0]))) {
+        compressionSampleBudget =
+            max<size_t>(1, strtoull(argv[++i], nullptr, 10)) * 1024;
+      }
     } else if (arg == "--signatures" || arg == "-S") {
       if (i + 1 < argc) {
         customSigPath = argv[++i];
       }
+    } else if (arg == "--magic" || arg == "-m") {
+      if (i + 1 < argc) {
+        magicPaths.push_back(argv[++i]);
+      }
+    } else if (arg == "--magic-report") {
+      magicReport = true;
+    } else if (arg == "--watch-signatures") {
+      watchSignatures = true;
+    } else if (arg == "--order" || arg.rfind("--order=", 0) == 0) {
+      if (arg == "--order")
+        orderName = i + 1 < argc ? argv[++i] : "";
+      else
+        orderName = arg.substr(8);
+      if (!parseScanOrder(orderName, order)) {
+        cerr << "Unknown --order '" << orderName
+             << "' (use mtime-desc, size-desc, size-asc or directory)\n";
+        return 1;
+      }
+    } else if (arg == "--stream") {
+      stream = true;
+    } else if (arg == "--dashboard") {
+      showDashboard = true;
+    } else if (arg == "--pipe" || arg == "--pipe-nul") {
+      pipeMode = true;
+      jsonOutput = true; // stdout carries only responses
+      if (arg == "--pipe-nul")
+        pipeDelimiter = '\0';
+    } else if (arg == "--pipe-p99-ms") {
+      if (i + 1 < argc) {
+        pipeP99Ms = max(0.0, strtod(argv[++i], nullptr));
+      }
+    } else if (arg == "--pipe-workers") {
+      if (i + 1 < argc) {
+        pipeWorkers = static_cast<unsigned int>(
+            min<unsigned long>(strtoul(argv[++i], nullptr, 10), 1024));
+      }
+    } else if (arg == "--emit-manifests") {
+      if (i + 1 < argc) {
+        manifestDir = argv[++i];
+      }
+    } else if (arg == "--manifest-by" || arg.rfind("--manifest-by=", 0) == 0) {
+      string by = arg == "--manifest-by" ? (i + 1 < argc ? argv[++i] : "")
+                                         : arg.substr(14);
+      if (by == "type") {
+        manifestKey = ManifestKey::Type;
+      } else if (by == "category") {
+        manifestKey = ManifestKey::Category;
+      } else {
+        cerr << "Unknown --manifest-by '" << by << "' (use type or category)\n";
+        return 1;
+      }
+    } else if (arg == "--plugin" || arg == "-P") {
+      if (i + 1 < argc) {
+        pluginPaths.push_back(argv[++i]);
+      }
+    } else if (arg == "--plugin-read-budget") {
+      if (i + 1 < argc) {
+        pluginReadBudget = strtoull(argv[++i], nullptr, 10);
+      }
+    } else if (arg == "--plugin-hang-ms") {
+      if (i + 1 < argc) {
+        pluginHangMicros =
+            static_cast<uint64_t>(max(1.0, atof(argv[++i])) * 1000.0);
+      }
+    } else if (arg == "--plugin-cpu-budget") {
+      if (i + 1 < argc) {
+        pluginCpuBudget =
+            static_cast<uint64_t>(max(0.0, atof(argv[++i])) * 1000.0);
+      }
+    } else if (arg == "--anomalies") {
+      anomalies = true;
+    } else if (arg == "--entropy-baseline") {
+      if (i + 1 < argc) {
+        baselineInPath = argv[++i];
+        anomalies = true;
+      }
+    } else if (arg == "--save-entropy-baseline") {
+      if (i + 1 < argc) {
+        baselineOutPath = argv[++i];
+        anomalies = true;
+      }
+    } else if (arg == "--signature-profile") {
+      if (i + 1 < argc) {
+        profileInPath = argv[++i];
+      }
+    } else if (arg == "--signature-profile-out") {
+      if (i + 1 < argc) {
+        profileOutPath = argv[++i];
+        signatureProfiling = true;
+      }
+    } else if (arg == "--model") {
+      if (i + 1 < argc) {
+        modelPath = argv[++i];
+      }
+    } else if (arg == "--model-threshold") {
+      if (i + 1 < argc) {
+        fallbackMinConfidence =
+            static_cast<float>(min(1.0, max(0.0, atof(argv[++i]))));
+      }
+    } else if (arg == "--s3-endpoint") {
+      if (i + 1 < argc && !parseS3Endpoint(argv[++i], s3Config, s3Error)) {
+        cerr << "Bad --s3-endpoint: " << s3Error << "\n";
+        return 1;
+      }
+    } else if (arg == "--s3-region") {
+      if (i + 1 < argc) {
+        s3Config.region = argv[++i];
+      }
+    } else if (arg == "--s3-head-bytes") {
+      if (i + 1 < argc) {
+        s3Config.headBytes = max<size_t>(1, strtoull(argv[++i], nullptr, 10));
+      }
+    } else if (arg == "--s3-pipeline") {
+      if (i + 1 < argc) {
+        s3Config.pipelineDepth =
+            max<size_t>(1, strtoull(argv[++i], nullptr, 10));
+      }
+    } else if (arg == "--record") {
+      recordHistory = true;
+    } else if (arg == "--history-file" || arg == "-H") {
+      if (i + 1 < argc) {
+        historyPath = argv[++i];
+      }
     } else if (arg == "--help" || arg == "-h") {
       cout << "FileTypeAnalyzer Pro v3.0 - Magic Number Based File "
               "Detection\n\n";
-      cout << "Usage: " << argv[0] << " [options] <directory_path>\n\n";
+      cout << "Usage: " << argv[0] << " [scan] [options] [--] "
+              "<directory_path>\n";
+      cout << "       " << argv[0] << " history [options]\n";
+      cout << "       " << argv[0] << " index COMMAND DIR [options]\n";
+      cout << "       " << argv[0] << " compare A.merkle B.merkle [--json]\n\n";
+      cout << "A first argument naming a subcommand runs it; scan a "
+              "directory with that name as\n"
+           << "\"" << argv[0] << " scan NAME\", \"" << argv[0]
+           << " -- NAME\" or \"" << argv[0] << " ./NAME\".\n\n";
       cout << "Options:\n";
       cout << "  -j, --json         Output results as JSON\n";
       cout << "  -r, --recursive    Scan subdirectories\n";
       cout << "  -o, --organize     Organize files into type-based folders\n";
       cout << "  -s, --sequential   Disable multi-threading\n";
       cout << "  -S, --signatures   Load custom signatures from JSON file\n";
-      cout << "  -h, --help         Show this help message\n\n";
+      cout << "  -m, --magic        Import magic(5) rules from a file or "
+              "directory (repeatable)\n";
+      cout << "      --magic-report List every unsupported magic(5) line\n";
+      cout << "      --watch-signatures  Reload -S/-m sources when they "
+              "change or on SIGHUP\n";
+      cout << "      --record       Append a scan summary to the history "
+              "file\n";
+      cout << "  -H, --history-file History file (default "
+           << defaultHistoryPath() << ")\n";
+      cout << "  -e, --estimate     Predict files, bytes, time and memory "
+              "without scanning\n";
+      cout << "  -t, --tree         Per-directory type/size rollup, 2 levels "
+              "deep\n";
+      cout << "      --tree=N       Same, N levels deep (also --tree-depth "
+              "N)\n";
+      cout << "      --owners       Per-user and per-group type breakdown\n";
+      cout << "      --ages         Modified/accessed age buckets by type\n";
+      cout << "      --chunk-dedup  Estimate block-level dedup savings "
+              "(reads whole files)\n";
+      cout << "      --hash         Add each file's SHA-256 to JSON output "
+              "(reads whole files)\n";
+      cout << "      --merkle FILE  Write per-directory Merkle fingerprints "
+              "(implies --hash; see compare)\n";
+      cout << "                     Directories are recorded only through "
+              "their files: empty ones\n";
+      cout << "                     are left out and show as removed once "
+              "emptied\n";
+      cout << "  -z, --compressibility [KB]  Sampled LZ compression ratio, "
+              "KB read per file (default 256)\n";
+      cout << "      --order=KEY    Scan mtime-desc, size-desc or size-asc "
+              "files first\n";
+      cout << "      --stream       Print each result as it completes "
+              "(NDJSON with --json)\n";
+      cout << "      --dashboard    Full-screen live view of every worker "
+              "(on stderr)\n";
+      cout << "      --pipe         Answer paths from stdin as JSON lines "
+              "(ID<TAB>PRIORITY<TAB>PATH also accepted)\n";
+      cout << "      --pipe-nul     Like --pipe with NUL-terminated records\n";
+      cout << "      --pipe-p99-ms MS  Queue-time target; requests predicted "
+              "over it get BUSY (default 250, 0 = off)\n";
+      cout << "      --pipe-workers N  Worker threads for --pipe (default: "
+              "CPU and memory limits)\n";
+      cout << "      --emit-manifests DIR  Write a NUL-delimited path list per "
+              "type as results complete\n";
+      cout << "      --manifest-by=KEY     Partition manifests by type "
+              "(default) or category\n";
+      cout << "  -P, --plugin       Load an analyzer plugin (repeatable)\n";
+      cout << "      --plugin-read-budget BYTES  Extra bytes a plugin may "
+              "read per file (default 1 MiB)\n";
+      cout << "      --plugin-cpu-budget MS      CPU time per plugin call "
+              "(default 50)\n";
+      cout << "      --plugin-hang-ms MS         Disable a plugin whose call "
+              "runs this long (default\n"
+              "                                  5000); the stuck call "
+              "itself cannot be interrupted\n";
+      cout << "      --anomalies    Flag files whose entropy or size is "
+              "unusual for their type\n";
+      cout << "      --entropy-baseline FILE       Seed --anomalies with "
+              "saved per-type statistics\n";
+      cout << "      --save-entropy-baseline FILE  Save this scan's "
+              "statistics (baseline included)\n";
+      cout << "      --signature-profile-out FILE  Count signature probes "
+              "and hits, write a profile\n";
+      cout << "      --signature-profile FILE      Try the profile's busiest "
+              "signatures first\n";
+      cout << "      --model FILE   Guess categories of unidentified files "
+              "(see tools/train_classifier.cpp)\n";
+      cout << "      --model-threshold P  Minimum confidence to report a "
+              "guess (default 0.5)\n";
+      cout << "      --s3-endpoint URL  Object store for s3://bucket/prefix "
+              "paths (default $FTA_S3_ENDPOINT)\n";
+      cout << "      --s3-region R      Signing region (default $AWS_REGION "
+              "or us-east-1)\n";
+      cout << "      --s3-head-bytes N  Bytes fetched per object (default "
+              "4096, or what signatures need)\n";
+      cout << "      --s3-pipeline N    Requests pipelined per connection "
+              "(default 16)\n";
+      cout << "  -h, --help         Show this help message\n";
+      cout << "      --file-compat  file(1)-compatible mode (must be first; "
+              "see --file-compat --help)\n\n";
       cout << "Examples:\n";
       cout << "  " << argv[0] << " ./downloads\n";
       cout << "  " << argv[0] << " --json ./documents\n";
       cout << "  " << argv[0] << " -r -o ./mixed_files\n";
       cout << "  " << argv[0] << " -S custom_sigs.json ./files\n";
+      cout << "  " << argv[0] << " --estimate -r /mnt/share\n";
+      cout << "  " << argv[0] << " -r --order=mtime-desc --stream --json /srv\n";
+      cout << "  " << argv[0]
+           << " -r --s3-endpoint http://127.0.0.1:9000 s3://logs/2024/\n";
+      cout << "  " << argv[0] << " -r --dashboard --json /data > scan.json\n";
+      cout << "  " << argv[0] << " --file-compat --mime-type -b *.bin\n";
+      cout << "  " << argv[0] << " history --root /mnt/share --last 50\n";
+      cout << "  " << argv[0] << " -r --merkle src.merkle /srv && " << argv[0]
+           << " compare src.merkle replica.merkle\n";
+      cout << "  " << argv[0] << " -r --json --hash /srv > scan.json && "
+           << argv[0] << " index add ~/fta-index scan.json\n";
       return 0;
     } else if (inputPath.empty()) {
       inputPath = arg;
@@ -873,6 +10238,7 @@ int main(int argc, char *argv[]) {
   // Load custom signatures if specified
   if (!customSigPath.empty()) {
     if (loadCustomSignatures(customSigPath)) {
+      signatureSources.customFiles.push_back(customSigPath);
       if (!jsonOutput) {
         cout << GREEN << "Loaded custom signatures from: " << customSigPath
              << RESET << "\n";
@@ -885,6 +10251,103 @@ int main(int argc, char *argv[]) {
     }
   }
 
+  // Import magic(5) rules if specified
+  MagicImportReport magicImport;
+  for (const auto &magicPath : magicPaths) {
+    if (importMagicFile(magicPath, magicImport)) {
+      signatureSources.magicPaths.push_back(magicPath);
+    } else if (!jsonOutput) {
+      cout << YELLOW << "Warning: Could not read magic file: " << magicPath
+           << RESET << "\n";
+    }
+  }
+  if (!magicPaths.empty() && !jsonOutput) {
+    cout << GREEN << "Imported " << magicImport.rules << " magic rules ("
+         << magicImport.continuations << " continuations)" << RESET;
+    if (magicImport.unsupportedRules + magicImport.unsupportedContinuations >
+        0) {
+      cout << YELLOW << ", skipped " << magicImport.unsupportedRules
+           << " rules and " << magicImport.unsupportedContinuations
+           << " continuations" << RESET;
+    }
+    cout << "\n";
+    vector<pair<size_t, string>> reasons;
+    for (const auto &[reason, count] : magicImport.reasons)
+      reasons.push_back({count, reason});
+    sort(reasons.rbegin(), reasons.rend());
+    for (size_t r = 0; r < reasons.size() && r < 8; r++) {
+      cout << "  " << setw(6) << right << reasons[r].first << left << "  "
+           << reasons[r].second << "\n";
+    }
+    if (magicReport) {
+      for (const auto &[where, reason] : magicImport.unsupportedLines)
+        cout << "  " << where << ": " << reason << "\n";
+    }
+  }
+  if (!profileInPath.empty() && !loadSignatureProfile(profileInPath) &&
+      !jsonOutput) {
+    cout << YELLOW << "Warning: Could not read signature profile: "
+         << profileInPath << RESET << "\n";
+  }
+  rebuildSignatureMatcher();
+  SignatureWatcher watcher;
+  if (watchSignatures) {
+    watcher.start(seconds(1), true);
+    signatureWatcher = &watcher;
+  }
+
+  // Load analyzer plugins
+  for (const auto &pluginPath : pluginPaths) {
+    string error;
+    if (loadPlugin(pluginPath, pluginReadBudget, pluginCpuBudget, error)) {
+      if (!jsonOutput) {
+        const LoadedPlugin &p = *loadedPlugins.back();
+        cout << GREEN << "Loaded plugin " << p.name << " " << p.version
+             << RESET << "\n";
+      }
+    } else if (!jsonOutput) {
+      cout << YELLOW << "Warning: Could not load plugin " << pluginPath
+           << ": " << error << RESET << "\n";
+    }
+  }
+
+  // Load the fallback classifier
+  if (!modelPath.empty()) {
+    string error;
+    if (fallbackModel.load(modelPath, error)) {
+      if (!jsonOutput) {
+        cout << GREEN << "Loaded model with " << fallbackModel.classes.size()
+             << " classes from: " << modelPath << RESET << "\n";
+      }
+    } else if (!jsonOutput) {
+      cout << YELLOW << "Warning: Could not load model " << modelPath << ": "
+           << error << RESET << "\n";
+    }
+  }
+
+  if (pipeMode) {
+    unsigned int workers = pipeWorkers > 0 ? pipeWorkers
+                           : parallel      ? defaultWorkerCount()
+                                           : 1;
+    unique_ptr<ManifestWriter> manifestWriter;
+    string error;
+    if (!manifestDir.empty()) {
+      manifestWriter = make_unique<ManifestWriter>(manifestDir, manifestKey);
+      if (!manifestWriter->open(error)) {
+        cerr << "pipe: " << error << "\n";
+        return 1;
+      }
+      manifests = manifestWriter.get();
+    }
+    PipeServer server(workers, pipeP99Ms, pipeDelimiter);
+    int rc = server.run(cin);
+    if (manifests && !manifests->close(error))
+      cerr << "pipe: " << error << "\n";
+    manifests = nullptr;
+    unloadPlugins();
+    return rc;
+  }
+
   if (inputPath.empty()) {
     if (!jsonOutput) {
       cout << RED << "Error: No directory specified.\n" << RESET;
@@ -899,61 +10362,105 @@ int main(int argc, char *argv[]) {
     return 1;
   }
 
+  // s3://bucket/prefix paths are listed and read through the object store
+  unique_ptr<S3IoBackend> s3Backend;
+  if (inputPath.rfind("s3://", 0) == 0) {
+    if (estimate || organize) {
+      cerr << "--estimate and --organize need a local path\n";
+      return 1;
+    }
+    s3Backend = make_unique<S3IoBackend>(s3Config);
+    ioBackend = objectStore = s3Backend.get();
+  }
+
   fs::path inputDir = inputPath;
-  if (!fs::exists(inputDir)) {
+  FileInfo rootInfo;
+  IoKind rootKind = ioBackend->stat(inputPath, rootInfo);
+  if (rootKind == IoKind::Missing) {
+    string reason = objectStore ? objectStore->lastError() : "";
     if (!jsonOutput) {
       cout << RED << "Error: Path does not exist: " << inputDir << RESET
            << "\n";
+      if (!reason.empty())
+        cout << RED << "  " << reason << RESET << "\n";
     } else {
       cout << "{\"error\": \"Path does not exist\"}\n";
     }
     return 1;
   }
 
-  // Collect files
-  vector<fs::path> filePaths;
+  // Collect files up front, unless an ordered scan enumerates them as it goes
+  bool ordered = order != ScanOrder::Directory || stream;
 
-  try {
-    if (fs::is_regular_file(inputDir)) {
-      filePaths.push_back(inputDir);
-    } else if (fs::is_directory(inputDir)) {
-      if (recursive) {
-        for (const auto &entry : fs::recursive_directory_iterator(inputDir)) {
-          if (fs::is_regular_file(entry)) {
-            filePaths.push_back(entry.path());
-          }
-        }
-      } else {
-        for (const auto &entry : fs::directory_iterator(inputDir)) {
-          if (fs::is_regular_file(entry)) {
-            filePaths.push_back(entry.path());
-          }
-        }
-      }
-    }
-  } catch (const fs::filesystem_error &e) {
-    if (!jsonOutput) {
-      cout << RED << "Error reading directory: " << e.what() << RESET << "\n";
-    } else {
-      cout << "{\"error\": \"" << escapeJson(e.what()) << "\"}\n";
+  // What the scan aggregates beyond per-type totals; the estimate sizes
+  // the same set
+  AggregateOptions aggregateOptions;
+  if (treeDepth >= 0 && rootKind == IoKind::Directory) {
+    aggregateOptions.directoryTree = true;
+    aggregateOptions.directoryTreeDepth = treeDepth;
+    aggregateOptions.rootDirectory = inputDir.string();
+  }
+  if (!merklePath.empty()) {
+    if (rootKind == IoKind::Directory) {
+      string root = inputDir.string();
+      while (root.size() > 1 && (root.back() == '/' || root.back() == '\\'))
+        root.pop_back();
+      aggregateOptions.merkleTree = true;
+      aggregateOptions.rootDirectory = root;
+    } else if (!jsonOutput) {
+      cout << YELLOW << "Warning: --merkle needs a directory; skipping it"
+           << RESET << "\n";
     }
-    return 1;
   }
+  aggregateOptions.ownerBreakdown = owners;
+  aggregateOptions.ageBreakdown = ages;
+  aggregateOptions.chunkDedup = chunkDedup;
+  aggregateOptions.entropyAnomalies = anomalies;
 
-  if (filePaths.empty()) {
+  // Dry run: sample the tree and predict the cost of a full scan
+  if (estimate) {
+    unsigned int estimateThreads = parallel ? defaultWorkerCount(chunkDedup) : 1;
+    if (chunkDedup)
+      fitChunkIndexToBudget(estimateThreads);
     if (!jsonOutput) {
-      cout << YELLOW << "No files found to analyze." << RESET << "\n";
-    } else {
-      cout << "{\"error\": \"No files found\", \"files\": []}\n";
+      cout << BLUE << "Estimating scan of: " << RESET << inputDir.string()
+           << (recursive ? " (recursive)" : "") << "\n\n";
     }
+    ScanEstimate est = estimateScan(inputDir, recursive, estimateThreads,
+                                    jsonOutput, ordered, 2.0, aggregateOptions);
+    outputEstimate(est, jsonOutput);
     return 0;
   }
+  vector<fs::path> filePaths;
+
+  if (!ordered) {
+    try {
+      walkFiles(*ioBackend, inputDir.string(), recursive,
+                [&](const string &path) { filePaths.push_back(path); });
+    } catch (const fs::filesystem_error &e) {
+      if (!jsonOutput) {
+        cout << RED << "Error reading directory: " << e.what() << RESET
+             << "\n";
+      } else {
+        cout << "{\"error\": \"" << escapeJson(e.what()) << "\"}\n";
+      }
+      return 1;
+    }
+
+    if (filePaths.empty()) {
+      if (!jsonOutput) {
+        cout << YELLOW << "No files found to analyze." << RESET << "\n";
+      } else {
+        cout << "{\"error\": \"No files found\", \"files\": []}\n";
+      }
+      return 0;
+    }
+  }
 
-  // Determine thread count
-  unsigned int threadCount =
-      parallel ? min(thread::hardware_concurrency(), 8u) : 1;
-  if (threadCount == 0)
-    threadCount = 4;
+  // Determine thread count from CPUs, container quota and memory limit
+  unsigned int threadCount = parallel ? defaultWorkerCount(chunkDedup) : 1;
+  if (chunkDedup)
+    fitChunkIndexToBudget(threadCount);
 
   // Header (terminal only)
   if (!jsonOutput) {
@@ -982,28 +10489,131 @@ int main(int argc, char *argv[]) {
     cout << BLUE << "Mode: " << RESET
          << (recursive ? "Recursive" : "Non-recursive") << "\n";
     cout << BLUE << "Threads: " << RESET << threadCount << "\n";
-    cout << BLUE << "Files found: " << RESET << filePaths.size() << "\n\n";
+    cout << BLUE << "Limits: " << RESET << describeLimits(resourceLimits())
+         << "\n";
+    if (ordered) {
+      cout << BLUE << "Order: " << RESET << orderName
+           << (stream ? " (streaming)" : "") << "\n\n";
+    } else {
+      cout << BLUE << "Files found: " << RESET << filePaths.size() << "\n\n";
+    }
   }
 
   // Analyze files
   auto startTime = high_resolution_clock::now();
   vector<FileInfo> results;
+  ScanAggregates aggregates;
+  aggregates.options = aggregateOptions;
+  if (!baselineInPath.empty() &&
+      !loadEntropyBaseline(baselineInPath, aggregates.entropyByType) &&
+      !jsonOutput) {
+    cout << YELLOW << "Warning: Could not read entropy baseline: "
+         << baselineInPath << RESET << "\n";
+  }
+  aggregates.options.referenceTime =
+      duration_cast<seconds>(system_clock::now().time_since_epoch()).count();
   fs::path outputBase = inputDir / "OrganizedFiles";
 
-  if (parallel && filePaths.size() > 10) {
+  // Per-type path lists, appended as results complete
+  unique_ptr<ManifestWriter> manifestWriter;
+  if (!manifestDir.empty()) {
+    manifestWriter = make_unique<ManifestWriter>(manifestDir, manifestKey);
+    string error;
+    if (!manifestWriter->open(error)) {
+      if (!jsonOutput)
+        cout << RED << "Error: " << error << RESET << "\n";
+      else
+        cout << "{\"error\": \"" << escapeJson(error) << "\"}\n";
+      return 1;
+    }
+    manifests = manifestWriter.get();
+  }
+
+  // The live dashboard replaces the progress bar while the scan runs
+  unique_ptr<ScanDashboard> liveDashboard;
+  if (showDashboard) {
+    if (ScanDashboard::isTerminal(2) &&
+        !(stream && ScanDashboard::isTerminal(1))) {
+      liveDashboard = make_unique<ScanDashboard>();
+      dashboard = liveDashboard.get();
+      dashboard->start(inputDir.string());
+    } else if (!jsonOutput) {
+      cout << YELLOW
+           << "Warning: --dashboard needs a terminal on stderr (and stdout "
+              "redirected with --stream); showing progress instead"
+           << RESET << "\n";
+    }
+  }
+  auto closeDashboard = [&]() {
+    if (dashboard) {
+      dashboard->stop();
+      dashboard = nullptr;
+    }
+  };
+  bool showProgress = !jsonOutput && !dashboard;
+
+  if (ordered) {
+    function<void(const FileInfo &)> onResult;
+    if (stream && jsonOutput) {
+      onResult = outputFileJsonLine;
+    } else if (stream) {
+      onResult = [](const FileInfo &f) {
+        cout << "  " << setw(14) << left << f.type << " " << setw(10)
+             << formatSize(f.size) << " " << f.path << "\n";
+      };
+    }
+    try {
+      results = analyzeFilesOrdered(inputDir, recursive, order, threadCount,
+                                    showProgress && !stream, aggregates,
+                                    onResult);
+    } catch (const fs::filesystem_error &e) {
+      closeDashboard();
+      if (!jsonOutput) {
+        cout << RED << "Error reading directory: " << e.what() << RESET
+             << "\n";
+      } else {
+        cout << "{\"error\": \"" << escapeJson(e.what()) << "\"}\n";
+      }
+      return 1;
+    }
+    closeDashboard();
+    if (results.empty()) {
+      if (!jsonOutput) {
+        cout << YELLOW << "No files found to analyze." << RESET << "\n";
+      } else if (!stream) {
+        cout << "{\"error\": \"No files found\", \"files\": []}\n";
+      }
+      return 0;
+    }
+  } else if (parallel && filePaths.size() > SEQUENTIAL_SCAN_MAX_FILES) {
     // Use multi-threaded analysis
     ProgressTracker progress;
-    results = analyzeFilesParallel(filePaths, progress, !jsonOutput);
+    results =
+        analyzeFilesParallel(filePaths, progress, showProgress, aggregates);
   } else {
     // Sequential analysis for small sets
+    DashboardSlot slot(0);
+    if (dashboard)
+      dashboard->totalFiles = filePaths.size();
     for (size_t i = 0; i < filePaths.size(); i++) {
-      FileInfo info = analyzeFile(filePaths[i]);
+      dashboardBeginFile(filePaths[i].string());
+      FileInfo info = analyzeFile(
+          filePaths[i], nullptr,
+          aggregates.options.chunkDedup ? &aggregates.chunks : nullptr);
+      aggregates.add(info);
       results.push_back(info);
-      if (!jsonOutput) {
+      dashboardFinishFile(info);
+      recordManifest(info);
+      if (showProgress) {
         showProgressBar(i + 1, filePaths.size(), info.name);
       }
     }
   }
+  closeDashboard();
+  string manifestError;
+  if (manifests && !manifests->close(manifestError) && !jsonOutput) {
+    cout << YELLOW << "Warning: " << manifestError << RESET << "\n";
+  }
 
   // Organize if requested
   if (organize) {
@@ -1027,14 +10637,49 @@ int main(int argc, char *argv[]) {
   double totalTime =
       duration_cast<duration<double>>(endTime - startTime).count();
 
-  // Output results
-  if (jsonOutput) {
-    outputJson(results, totalTime, threadCount);
+  if (recordHistory &&
+      !appendHistory(historyPath, summarizeScan(results, inputPath, totalTime,
+                                                threadCount)) &&
+      !jsonOutput) {
+    cout << YELLOW << "Warning: Could not record scan history to "
+         << historyPath << RESET << "\n";
+  }
+  if (!baselineOutPath.empty() &&
+      !saveEntropyBaseline(baselineOutPath, aggregates.entropyByType) &&
+      !jsonOutput) {
+    cout << YELLOW << "Warning: Could not write entropy baseline to "
+         << baselineOutPath << RESET << "\n";
+  }
+  if (!profileOutPath.empty() &&
+      !writeSignatureProfile(profileOutPath, collectSignatureProfile()) &&
+      !jsonOutput) {
+    cout << YELLOW << "Warning: Could not write signature profile to "
+         << profileOutPath << RESET << "\n";
+  }
+  if (aggregates.options.merkleTree) {
+    if (!writeMerkleTree(aggregates, merklePath) && !jsonOutput) {
+      cout << YELLOW << "Warning: Could not write Merkle fingerprints to "
+           << merklePath << RESET << "\n";
+    }
+  }
+
+  // Output results (a JSON stream has already written every file)
+  if (jsonOutput && stream) {
+    if (!aggregates.merkle.rootHash.empty())
+      cout << "{\"merkle\": " << merkleSummaryJson(aggregates.merkle)
+           << "}\n";
+    unloadPlugins();
+    return 0;
+  } else if (jsonOutput) {
+    outputJson(results, totalTime, threadCount, aggregates);
   } else {
-    outputTerminal(results, totalTime, organize, outputBase, threadCount);
+    outputTerminal(results, totalTime, organize, outputBase, threadCount,
+                   aggregates);
     cout << "\nPress Enter to exit...";
     cin.get();
   }
 
+  unloadPlugins();
   return 0;
 }
+#endif // FTA_NO_MAIN
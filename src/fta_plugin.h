@@ -0,0 +1,114 @@
+/*
+ * FileTypeAnalyzer Pro - Analyzer Plugin ABI
+ *
+ * A plugin is a shared object exporting one C function:
+ *
+ *     const fta_plugin *fta_plugin_entry(void);
+ *
+ * The returned descriptor names the type IDs the plugin refines (the `type`
+ * strings the engine reports, e.g. "ZIP/DOCX/XLSX") and the byte ranges it
+ * needs. After the built-in engine has classified a file with one of those
+ * types, the plugin's analyze() receives read-only views of the requested
+ * ranges. Views into the first 64 KB point straight at the buffer the engine
+ * already read; only ranges outside it cost extra I/O, which is charged
+ * against the plugin's read budget.
+ *
+ * The engine measures the thread CPU time of every analyze() call. A call
+ * that exceeds the plugin's CPU budget has its result discarded, and a
+ * plugin that overruns repeatedly is disabled for the rest of the scan.
+ * The budget is checked when the call returns; a call that is still running
+ * after --plugin-hang-ms (default 5 s) gets its plugin disabled by a
+ * watchdog, but cannot be interrupted, so its worker keeps waiting for it.
+ *
+ * analyze() is called concurrently from several worker threads and must not
+ * keep pointers to views or results after it returns. Strings in the
+ * descriptor must stay valid until the library is unloaded.
+ *
+ * Compatibility: only fields may be appended to these structs, and
+ * FTA_PLUGIN_ABI_VERSION is bumped whenever an existing field changes.
+ */
+#ifndef FTA_PLUGIN_H
+#define FTA_PLUGIN_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define FTA_PLUGIN_ABI_VERSION 1
+
+#ifdef _WIN32
+#define FTA_PLUGIN_EXPORT __declspec(dllexport)
+#else
+#define FTA_PLUGIN_EXPORT __attribute__((visibility("default")))
+#endif
+
+/* A byte range of the file. Negative offsets count back from the end of the
+ * file, so {-22, 22} is the last 22 bytes. */
+typedef struct fta_range {
+  int64_t offset;
+  uint32_t length;
+} fta_range;
+
+/* Read-only bytes for one requested range. `length` is shorter than asked
+ * for when the file is shorter or the read budget ran out. */
+typedef struct fta_view {
+  const unsigned char *data;
+  size_t length;
+  uint64_t offset; /* Absolute file offset of data[0] */
+} fta_view;
+
+typedef struct fta_file {
+  const char *path;
+  uint64_t size;
+  const char *type;     /* Engine's classification so far */
+  const char *category;
+  const fta_view *views; /* One per fta_plugin::ranges entry, same order */
+  size_t view_count;
+} fta_file;
+
+/* Filled in by analyze(); empty strings leave the engine's value unchanged */
+typedef struct fta_result {
+  char type[64];
+  char category[32];
+  char description[256];
+} fta_result;
+
+enum {
+  FTA_RESULT_NONE = 0,   /* Nothing to add */
+  FTA_RESULT_REFINED = 1 /* Apply the non-empty fields of fta_result */
+};
+
+typedef struct fta_plugin {
+  uint32_t abi_version; /* FTA_PLUGIN_ABI_VERSION */
+  const char *name;
+  const char *version;
+
+  /* NULL-terminated list of type IDs to refine; "*" matches every type */
+  const char *const *types;
+
+  const fta_range *ranges;
+  size_t range_count;
+
+  /* Budgets the plugin asks for; 0 takes the engine default. The engine may
+   * lower them with --plugin-read-budget / --plugin-cpu-budget. */
+  uint64_t max_read_bytes; /* Extra bytes read per file beyond the 64 KB */
+  uint64_t max_cpu_micros; /* Thread CPU time per analyze() call */
+
+  /* Optional; a non-zero return refuses to load the plugin */
+  int (*init)(void);
+  /* Returns FTA_RESULT_NONE or FTA_RESULT_REFINED */
+  int (*analyze)(const fta_file *file, fta_result *result);
+  /* Optional */
+  void (*shutdown)(void);
+} fta_plugin;
+
+typedef const fta_plugin *(*fta_plugin_entry_fn)(void);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* FTA_PLUGIN_H */
@@ -0,0 +1,307 @@
+// ============================================================================
+// FileTypeAnalyzer Pro - Signature learner
+//
+// Derives fixed-offset signatures from a labelled corpus laid out as
+// corpus/<type>/... and writes them in the --signatures JSON format.
+//
+// For every class (analysed in parallel) the first --window bytes of each
+// training file are tallied per offset. Offsets where one byte value covers
+// at least --support of the class are kept exactly; everything in between
+// becomes a "??" wildcard. The pattern is then grown offset by offset until
+// it matches no training file of any other class. A held-out split gives
+// per-class precision and recall for the emitted set, and classes that a
+// built-in signature already claims are reported, since custom signatures
+// are tried after the built-ins.
+//
+// Build: g++ -std=c++17 -O2 -pthread tools/learn_signatures.cpp
+//          -o learn_signatures
+// Run:   ./learn_signatures [options] <corpus_dir> <signatures_out.json>
+//   --window N       Leading bytes examined per file (default 64)
+//   --support F      Fraction of a class a byte must cover (default 0.95)
+//   --min-bytes N    Fewest exact bytes in a signature (default 3)
+//   --max-bytes N    Most exact bytes in a signature (default 16)
+//   --holdout F      Fraction held out for evaluation (default 0.25)
+//   --category C     Category written for every learned type (default Data)
+// ============================================================================
+#define FTA_NO_MAIN
+#include "../src/analyzer.cpp"
+
+struct Sample {
+  string path;
+  vector<unsigned char> head;
+};
+
+struct LearnOptions {
+  size_t window = 64;
+  double support = 0.95;
+  size_t minBytes = 3;
+  size_t maxBytes = 16;
+};
+
+struct LearnedSignature {
+  string type;
+  string hex;           // Empty when nothing discriminating was found
+  string note;          // Why a class was skipped, or what shadows it
+  double coverage = 0;  // Fraction of the class's training files matched
+};
+
+// Stable (offset, byte) pairs for one class, most widely shared first
+vector<pair<uint32_t, uint8_t>> stableBytes(const vector<Sample> &samples,
+                                            const LearnOptions &options) {
+  vector<array<uint32_t, 256>> counts(options.window);
+  vector<uint32_t> present(options.window);
+  for (const auto &s : samples) {
+    for (size_t i = 0; i < s.head.size(); i++) {
+      counts[i][s.head[i]]++;
+      present[i]++;
+    }
+  }
+  vector<tuple<uint32_t, uint32_t, uint8_t>> stable; // support, offset, byte
+  double need = options.support * samples.size();
+  for (size_t i = 0; i < options.window; i++) {
+    if (present[i] == 0)
+      continue;
+    auto top = max_element(counts[i].begin(), counts[i].end());
+    if (*top >= need) {
+      stable.push_back({*top, static_cast<uint32_t>(i),
+                        static_cast<uint8_t>(top - counts[i].begin())});
+    }
+  }
+  // Widest support first, earlier offsets breaking ties, so short files
+  // are still covered by the bytes they do have
+  sort(stable.begin(), stable.end(), [](const auto &a, const auto &b) {
+    if (get<0>(a) != get<0>(b))
+      return get<0>(a) > get<0>(b);
+    return get<1>(a) < get<1>(b);
+  });
+  vector<pair<uint32_t, uint8_t>> result;
+  for (const auto &[n, offset, byte] : stable)
+    result.push_back({offset, byte});
+  return result;
+}
+
+string patternHex(const vector<pair<uint32_t, uint8_t>> &bytes) {
+  uint32_t length = 0;
+  for (const auto &[offset, byte] : bytes)
+    length = max(length, offset + 1);
+  vector<string> cells(length, "??");
+  const char *digits = "0123456789ABCDEF";
+  for (const auto &[offset, byte] : bytes)
+    cells[offset] = string{digits[byte >> 4], digits[byte & 15]};
+  string hex;
+  for (const auto &c : cells)
+    hex += c;
+  return hex;
+}
+
+ByteTest compilePattern(const string &hex) {
+  SignatureRule rule;
+  compileHexSignature(MagicSignature{hex, "", "", "", {}}, rule);
+  return rule.test;
+}
+
+size_t countMatches(const ByteTest &test, const vector<Sample> &samples) {
+  size_t n = 0;
+  for (const auto &s : samples)
+    n += test.matches(s.head.data(), s.head.size());
+  return n;
+}
+
+LearnedSignature learnClass(const string &type,
+                            const map<string, vector<Sample>> &train,
+                            const LearnOptions &options) {
+  LearnedSignature learned;
+  learned.type = type;
+  const auto &own = train.at(type);
+  auto stable = stableBytes(own, options);
+  if (stable.size() < options.minBytes) {
+    learned.note = "only " + to_string(stable.size()) + " stable bytes";
+    return learned;
+  }
+
+  // Grow from the minimum until no other class collides
+  vector<pair<uint32_t, uint8_t>> chosen(stable.begin(),
+                                         stable.begin() + options.minBytes);
+  size_t next = options.minBytes;
+  size_t collisions = 0;
+  for (;;) {
+    ByteTest test = compilePattern(patternHex(chosen));
+    collisions = 0;
+    for (const auto &[other, samples] : train) {
+      if (other != type)
+        collisions += countMatches(test, samples);
+    }
+    if (collisions == 0 || next >= stable.size() ||
+        chosen.size() >= options.maxBytes)
+      break;
+    chosen.push_back(stable[next++]);
+  }
+  if (collisions > 0) {
+    learned.note = "collides with " + to_string(collisions) +
+                   " files of other classes";
+    return learned;
+  }
+  sort(chosen.begin(), chosen.end());
+  learned.hex = patternHex(chosen);
+  learned.coverage = static_cast<double>(countMatches(
+                         compilePattern(learned.hex), own)) /
+                     own.size();
+
+  // Custom signatures run after the built-ins, so report any that win
+  map<string, size_t> builtin;
+  SignatureReadGuard signatures;
+  for (const auto &s : own) {
+    if (const SignatureRule *rule =
+            signatures->matcher.match(s.head.data(), s.head.size()))
+      builtin[rule->type]++;
+  }
+  for (const auto &[name, n] : builtin) {
+    if (n * 2 >= own.size())
+      learned.note = "mostly matched by built-in " + name + " already";
+  }
+  return learned;
+}
+
+int main(int argc, char *argv[]) {
+  LearnOptions options;
+  double holdout = 0.25;
+  string category = "Data";
+  vector<string> positional;
+  for (int i = 1; i < argc; i++) {
+    string arg = argv[i];
+    if (arg == "--window" && i + 1 < argc)
+      options.window = max<size_t>(1, strtoull(argv[++i], nullptr, 10));
+    else if (arg == "--support" && i + 1 < argc)
+      options.support = min(1.0, max(0.5, atof(argv[++i])));
+    else if (arg == "--min-bytes" && i + 1 < argc)
+      options.minBytes = max<size_t>(1, strtoull(argv[++i], nullptr, 10));
+    else if (arg == "--max-bytes" && i + 1 < argc)
+      options.maxBytes = max<size_t>(1, strtoull(argv[++i], nullptr, 10));
+    else if (arg == "--holdout" && i + 1 < argc)
+      holdout = min(0.9, max(0.0, atof(argv[++i])));
+    else if (arg == "--category" && i + 1 < argc)
+      category = argv[++i];
+    else
+      positional.push_back(arg);
+  }
+  if (positional.size() != 2) {
+    cerr << "Usage: " << argv[0]
+         << " [--window N] [--support F] [--min-bytes N] [--max-bytes N]"
+            " [--holdout F] [--category C] <corpus_dir> <signatures_out>\n";
+    return 1;
+  }
+  options.maxBytes = max(options.maxBytes, options.minBytes);
+  fs::path root = positional[0];
+
+  // Read the leading bytes of every labelled file, split per class
+  map<string, vector<Sample>> train, test;
+  mt19937 rng(12345);
+  for (const auto &dir : fs::directory_iterator(root)) {
+    if (!dir.is_directory())
+      continue;
+    vector<Sample> samples;
+    for (const auto &entry : fs::recursive_directory_iterator(
+             dir.path(), fs::directory_options::skip_permission_denied)) {
+      error_code ec;
+      if (!entry.is_regular_file(ec))
+        continue;
+      Sample s{entry.path().string(), vector<unsigned char>(options.window)};
+      ifstream file(entry.path(), ios::binary);
+      file.read(reinterpret_cast<char *>(s.head.data()),
+                static_cast<streamsize>(s.head.size()));
+      s.head.resize(static_cast<size_t>(max<streamsize>(0, file.gcount())));
+      if (!s.head.empty())
+        samples.push_back(std::move(s));
+    }
+    if (samples.size() < 2)
+      continue;
+    shuffle(samples.begin(), samples.end(), rng);
+    size_t testCount = min(samples.size() - 1,
+                           static_cast<size_t>(samples.size() * holdout));
+    string type = dir.path().filename().string();
+    test[type].assign(samples.begin(), samples.begin() + testCount);
+    train[type].assign(samples.begin() + testCount, samples.end());
+  }
+  if (train.size() < 2) {
+    cerr << "Need at least two class directories with two files each\n";
+    return 1;
+  }
+
+  auto start = high_resolution_clock::now();
+  vector<future<LearnedSignature>> jobs;
+  for (const auto &[type, samples] : train)
+    jobs.push_back(async(launch::async, learnClass, type, cref(train),
+                         cref(options)));
+  vector<LearnedSignature> learned;
+  for (auto &job : jobs)
+    learned.push_back(job.get());
+  double seconds =
+      duration<double>(high_resolution_clock::now() - start).count();
+
+  // Evaluate the learned set on its own against the held-out files
+  vector<SignatureRule> rules;
+  for (const auto &sig : learned) {
+    SignatureRule rule;
+    if (!sig.hex.empty() &&
+        compileHexSignature(MagicSignature{sig.hex, sig.type, category, "",
+                                           {}},
+                            rule))
+      rules.push_back(std::move(rule));
+  }
+  SignatureMatcher matcher(rules);
+  map<string, size_t> truePositives, predicted, actual;
+  for (const auto &[type, samples] : test) {
+    for (const auto &s : samples) {
+      actual[type]++;
+      if (const SignatureRule *rule =
+              matcher.match(s.head.data(), s.head.size())) {
+        predicted[rule->type]++;
+        truePositives[type] += rule->type == type;
+      }
+    }
+  }
+
+  cout << "Learned from " << train.size() << " classes in " << fixed
+       << setprecision(3) << seconds << "s\n\n";
+  cout << left << setw(16) << "Type" << setw(36) << "Signature" << right
+       << setw(9) << "Coverage" << setw(11) << "Precision" << setw(8)
+       << "Recall" << "\n";
+  for (const auto &sig : learned) {
+    cout << left << setw(16) << sig.type << setw(36)
+         << (sig.hex.empty() ? "-" : sig.hex.substr(0, 34)) << right;
+    if (!sig.hex.empty()) {
+      size_t tp = truePositives[sig.type];
+      cout << setw(8) << setprecision(1) << 100.0 * sig.coverage << "%"
+           << setw(10)
+           << (predicted[sig.type] ? 100.0 * tp / predicted[sig.type] : 0.0)
+           << "%" << setw(7)
+           << (actual[sig.type] ? 100.0 * tp / actual[sig.type] : 0.0) << "%";
+    }
+    if (!sig.note.empty())
+      cout << "  (" << sig.note << ")";
+    cout << "\n";
+  }
+
+  // Field order matters: loadCustomSignatures reads hex, type, category,
+  // description in turn
+  ofstream out(positional[1]);
+  out << "[\n";
+  bool first = true;
+  for (const auto &sig : learned) {
+    if (sig.hex.empty())
+      continue;
+    out << (first ? "" : ",\n") << "  {\"hex\": \"" << sig.hex
+        << "\", \"type\": \"" << escapeJson(sig.type) << "\", \"category\": \""
+        << escapeJson(category) << "\", \"description\": \""
+        << escapeJson(sig.type) << " (learned from "
+        << train[sig.type].size() << " samples)\"}";
+    first = false;
+  }
+  out << "\n]\n";
+  if (!out) {
+    cerr << "Could not write " << positional[1] << "\n";
+    return 1;
+  }
+  cout << "\nSignatures written to " << positional[1] << "\n";
+  return 0;
+}
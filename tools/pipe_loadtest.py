@@ -0,0 +1,175 @@
+#!/usr/bin/env python3
+"""Open-loop load test for the analyzer's --pipe mode.
+
+Measures one coprocess's capacity, then offers Poisson arrivals at a
+multiple of it and reports client-observed latency (from the scheduled
+arrival, so a stalled writer cannot hide queueing). The same load is run
+with admission control and without it (--pipe-p99-ms 0). Admitted requests
+should keep a flat tail while the uncontrolled queue grows for as long as
+the overload lasts.
+
+    python3 tools/pipe_loadtest.py ./analyzer /usr/share/doc \\
+        --overload 2 --seconds 10 --p99-ms 50 --high-priority 0.1
+
+Arguments after "--" go to the analyzer (e.g. -- --compressibility).
+"""
+import argparse
+import json
+import os
+import random
+import subprocess
+import sys
+import threading
+import time
+
+
+def percentile(values, q):
+    if not values:
+        return float("nan")
+    values = sorted(values)
+    return values[min(len(values) - 1, int(q * (len(values) - 1) + 0.5))]
+
+
+def collect_files(root, limit):
+    files = []
+    for base, _, names in os.walk(root):
+        for name in names:
+            path = os.path.join(base, name)
+            if os.path.isfile(path) and "\t" not in path and "\n" not in path:
+                files.append(path)
+                if len(files) >= limit:
+                    return files
+    return files
+
+
+class Run:
+    """One analyzer process fed from a schedule of (time, priority, path)."""
+
+    def __init__(self, analyzer, args):
+        self.proc = subprocess.Popen(
+            [analyzer, "--pipe"] + args, stdin=subprocess.PIPE,
+            stdout=subprocess.PIPE, stderr=subprocess.PIPE, bufsize=1 << 16)
+        self.sent = {}      # id -> (scheduled time, priority)
+        self.answers = []   # (id, status, latency s, server queue ms)
+        self.reader = threading.Thread(target=self.read, daemon=True)
+        self.reader.start()
+
+    def read(self):
+        for line in self.proc.stdout:
+            now = time.perf_counter()
+            record = json.loads(line)
+            scheduled, _ = self.sent[record["id"]]
+            self.answers.append((record["id"], record["status"],
+                                 now - scheduled, record.get("queueMs")))
+
+    def feed(self, schedule):
+        start = time.perf_counter()
+        i = 0
+        while i < len(schedule):
+            now = time.perf_counter() - start
+            batch = []
+            while i < len(schedule) and schedule[i][0] <= now:
+                at, priority, path = schedule[i]
+                rid = "r%d" % i
+                self.sent[rid] = (start + at, priority)
+                batch.append("%s\t%d\t%s\n" % (rid, priority, path))
+                i += 1
+            if batch:
+                self.proc.stdin.write("".join(batch).encode())
+                self.proc.stdin.flush()
+            elif i < len(schedule):
+                time.sleep(min(0.001, schedule[i][0] - now))
+        self.proc.stdin.close()
+        self.reader.join()
+        summary = self.proc.stderr.read().decode().strip()
+        self.proc.wait()
+        return summary
+
+
+def poisson_schedule(files, rate, seconds, high_share, rng):
+    schedule, at = [], 0.0
+    while True:
+        at += rng.expovariate(rate)
+        if at >= seconds:
+            return schedule
+        priority = 1 if rng.random() < high_share else 0
+        schedule.append((at, priority, rng.choice(files)))
+
+
+def report(label, run, seconds):
+    ok = [a for a in run.answers if a[1] == "OK"]
+    busy = sum(1 for a in run.answers if a[1] == "BUSY")
+    ms = [a[2] * 1000 for a in ok]
+    high = [a[2] * 1000 for a in ok if run.sent[a[0]][1] > 0]
+    # Tail drift: p99 of requests scheduled in the first vs last third
+    start = min(t for t, _ in run.sent.values())
+    thirds = [[], []]
+    for rid, _, latency, _ in ok:
+        offset = run.sent[rid][0] - start
+        if offset < seconds / 3:
+            thirds[0].append(latency * 1000)
+        elif offset >= 2 * seconds / 3:
+            thirds[1].append(latency * 1000)
+    print("%-12s %7d %7d %6d %8.1f %8.1f %8.1f %9.1f %9.1f %9.1f %9.1f" % (
+        label, len(run.sent), len(ok), busy, percentile(ms, 0.5),
+        percentile(ms, 0.95), percentile(ms, 0.99), max(ms or [0]),
+        percentile(high, 0.99), percentile(thirds[0], 0.99),
+        percentile(thirds[1], 0.99)))
+
+
+def main():
+    argv = sys.argv[1:]
+    extra = []
+    if "--" in argv:
+        extra = argv[argv.index("--") + 1:]
+        argv = argv[:argv.index("--")]
+    parser = argparse.ArgumentParser(description=__doc__.split("\n")[0])
+    parser.add_argument("analyzer")
+    parser.add_argument("root", help="directory whose files are requested")
+    parser.add_argument("--workers", type=int, default=0,
+                        help="--pipe-workers (default: the analyzer's)")
+    parser.add_argument("--p99-ms", type=float, default=50.0)
+    parser.add_argument("--overload", type=float, default=2.0,
+                        help="offered load as a multiple of capacity")
+    parser.add_argument("--seconds", type=float, default=10.0)
+    parser.add_argument("--high-priority", type=float, default=0.1,
+                        help="share of requests sent with priority 1")
+    parser.add_argument("--seed", type=int, default=1)
+    args = parser.parse_args(argv)
+
+    files = collect_files(args.root, 50000)
+    if not files:
+        sys.exit("no files under " + args.root)
+    common = extra + (["--pipe-workers", str(args.workers)]
+                      if args.workers else [])
+    rng = random.Random(args.seed)
+
+    # Capacity: a backlog drained with admission off
+    backlog = [(0.0, 0, rng.choice(files)) for _ in range(5000)]
+    run = Run(args.analyzer, common + ["--pipe-p99-ms", "0"])
+    started = time.perf_counter()
+    run.feed(backlog)
+    capacity = len(backlog) / (time.perf_counter() - started)
+    rate = capacity * args.overload
+    print("capacity %.0f req/s; offering %.0f req/s for %.0f s (%.0f%% "
+          "priority 1), p99 target %.0f ms\n" % (
+              capacity, rate, args.seconds, args.high_priority * 100,
+              args.p99_ms))
+
+    schedule = poisson_schedule(files, rate, args.seconds,
+                                args.high_priority, rng)
+    print("%-12s %7s %7s %6s %8s %8s %8s %9s %9s %9s %9s" % (
+        "mode", "sent", "ok", "busy", "p50 ms", "p95 ms", "p99 ms",
+        "max ms", "prio1 p99", "p99 1st/3", "p99 3rd/3"))
+    summaries = []
+    for label, target in (("admission", args.p99_ms), ("unbounded", 0)):
+        run = Run(args.analyzer, common + ["--pipe-p99-ms", str(target)])
+        summaries.append((label, run.feed(schedule)))
+        report(label, run, args.seconds)
+    print()
+    for label, summary in summaries:
+        print("%-12s %s" % (label, summary))
+
+
+if __name__ == "__main__":
+    main()
@@ -0,0 +1,261 @@
+#!/usr/bin/env python3
+"""Minimal S3-compatible stand-in for testing s3:// scans locally.
+
+Serves ROOT/<bucket>/<key> path-style over HTTP/1.1 with keep-alive (and
+therefore pipelining): ListObjectsV2 with prefix, delimiter, max-keys and
+continuation-token; GET with a single byte Range; HEAD. With --credentials
+every request must carry a valid AWS Signature V4. --latency-ms delays each
+response to model a distant endpoint. Request counts and bytes served are
+printed when the server stops (Ctrl-C).
+
+    python3 tools/s3_standin.py --root ./buckets --port 9000 \\
+        --credentials AKIDEXAMPLE:secret --latency-ms 20
+    AWS_ACCESS_KEY_ID=AKIDEXAMPLE AWS_SECRET_ACCESS_KEY=secret \\
+        ./analyzer -r --s3-endpoint http://127.0.0.1:9000 s3://bucket/prefix
+"""
+import argparse
+import base64
+import collections
+import hashlib
+import hmac
+import os
+import re
+import signal
+import sys
+import threading
+import time
+from datetime import datetime, timezone
+from email.utils import formatdate
+from http.server import BaseHTTPRequestHandler, ThreadingHTTPServer
+from urllib.parse import parse_qsl, quote, unquote, urlsplit
+from xml.sax.saxutils import escape
+
+STATS = collections.Counter()
+STATS_LOCK = threading.Lock()
+
+
+def count(key, n=1):
+    with STATS_LOCK:
+        STATS[key] += n
+
+
+def list_keys(bucket_dir, prefix):
+    # Only the directory holding the prefix can contain matching keys
+    top = os.path.join(bucket_dir, *prefix.split("/")[:-1])
+    keys = []
+    for base, _, files in os.walk(top):
+        for name in files:
+            if not os.path.isfile(os.path.join(base, name)):
+                continue  # Dangling symlinks and the like
+            rel = os.path.relpath(os.path.join(base, name), bucket_dir)
+            keys.append(rel.replace(os.sep, "/"))
+    return sorted(keys)
+
+
+def signing_key(secret, date, region):
+    key = ("AWS4" + secret).encode()
+    for part in (date, region, "s3", "aws4_request"):
+        key = hmac.new(key, part.encode(), hashlib.sha256).digest()
+    return key
+
+
+class Handler(BaseHTTPRequestHandler):
+    protocol_version = "HTTP/1.1"
+    server_version = "s3-standin"
+
+    def log_message(self, fmt, *args):
+        if self.server.verbose:
+            super().log_message(fmt, *args)
+
+    def setup(self):
+        super().setup()
+        count("connections")
+
+    def send(self, status, body=b"", headers=None, head=False):
+        if self.server.latency:
+            time.sleep(self.server.latency)
+        self.send_response(status)
+        for name, value in (headers or {}).items():
+            self.send_header(name, value)
+        self.send_header("Content-Length", str(len(body)))
+        self.end_headers()
+        if not head:
+            self.wfile.write(body)
+
+    def error(self, status, code, head=False):
+        body = f"<Error><Code>{code}</Code></Error>".encode()
+        self.send(status, body, {"Content-Type": "application/xml"}, head)
+
+    def authorized(self, raw_path, query):
+        creds = self.server.credentials
+        if not creds:
+            return True
+        auth = self.headers.get("Authorization", "")
+        m = re.match(r"AWS4-HMAC-SHA256 Credential=([^/]+)/(\d{8})/([^/]+)/s3/"
+                     r"aws4_request, SignedHeaders=([^,]+), Signature=(\w+)",
+                     auth)
+        if not m or m.group(1) != creds[0]:
+            return False
+        _, date, region, signed, signature = m.groups()
+        canonical_query = "&".join(
+            f"{quote(k, safe='-_.~')}={quote(v, safe='-_.~')}"
+            for k, v in sorted(parse_qsl(query, keep_blank_values=True)))
+        names = signed.split(";")
+        canonical_headers = "".join(
+            f"{n}:{(self.headers.get(n) or '').strip()}\n" for n in names)
+        payload = self.headers.get("x-amz-content-sha256", "")
+        canonical = "\n".join([self.command, raw_path, canonical_query,
+                               canonical_headers, signed, payload])
+        amz_date = self.headers.get("x-amz-date", "")
+        to_sign = "\n".join([
+            "AWS4-HMAC-SHA256", amz_date,
+            f"{date}/{region}/s3/aws4_request",
+            hashlib.sha256(canonical.encode()).hexdigest()])
+        expected = hmac.new(signing_key(creds[1], date, region),
+                            to_sign.encode(), hashlib.sha256).hexdigest()
+        return hmac.compare_digest(expected, signature)
+
+    def route(self, head=False):
+        url = urlsplit(self.path)
+        if not self.authorized(url.path, url.query):
+            count("denied")
+            return self.error(403, "SignatureDoesNotMatch", head)
+        parts = unquote(url.path).lstrip("/").split("/", 1)
+        bucket = parts[0]
+        key = parts[1] if len(parts) > 1 else ""
+        bucket_dir = os.path.join(self.server.root, bucket)
+        if not bucket or ".." in parts or not os.path.isdir(bucket_dir):
+            return self.error(404, "NoSuchBucket", head)
+        if not key:
+            return self.list(bucket, bucket_dir, dict(parse_qsl(url.query)))
+        return self.object(os.path.join(bucket_dir, key), head)
+
+    def list(self, bucket, bucket_dir, params):
+        count("list")
+        prefix = params.get("prefix", "")
+        delimiter = params.get("delimiter", "")
+        max_keys = int(params.get("max-keys", "1000"))
+        after = params.get("continuation-token", "")
+        after = base64.urlsafe_b64decode(after).decode() if after else ""
+        contents, prefixes, truncated, last = [], [], False, ""
+        for key in list_keys(bucket_dir, prefix):
+            if not key.startswith(prefix) or key <= after:
+                continue
+            rest = key[len(prefix):]
+            if delimiter and delimiter in rest:
+                common = prefix + rest.split(delimiter, 1)[0] + delimiter
+                if common in prefixes:
+                    continue
+                entry = ("prefix", common)
+            else:
+                entry = ("key", key)
+            if len(contents) + len(prefixes) >= max_keys:
+                truncated = True
+                break
+            if entry[0] == "prefix":
+                prefixes.append(entry[1])
+                # Skip everything under the common prefix
+                last = entry[1] + "\uffff"
+            else:
+                contents.append(entry[1])
+                last = entry[1]
+        xml = ["<?xml version=\"1.0\" encoding=\"UTF-8\"?>",
+               "<ListBucketResult>", f"<Name>{escape(bucket)}</Name>",
+               f"<Prefix>{escape(prefix)}</Prefix>",
+               f"<KeyCount>{len(contents) + len(prefixes)}</KeyCount>",
+               f"<MaxKeys>{max_keys}</MaxKeys>",
+               f"<IsTruncated>{'true' if truncated else 'false'}</IsTruncated>"]
+        if truncated:
+            token = base64.urlsafe_b64encode(last.encode()).decode()
+            xml.append(f"<NextContinuationToken>{token}"
+                       "</NextContinuationToken>")
+        for key in contents:
+            st = os.stat(os.path.join(bucket_dir, key))
+            modified = datetime.fromtimestamp(st.st_mtime, timezone.utc)
+            xml.append(
+                f"<Contents><Key>{escape(key)}</Key><LastModified>"
+                f"{modified.strftime('%Y-%m-%dT%H:%M:%S.000Z')}</LastModified>"
+                f"<Size>{st.st_size}</Size></Contents>")
+        for common in prefixes:
+            xml.append(f"<CommonPrefixes><Prefix>{escape(common)}</Prefix>"
+                       "</CommonPrefixes>")
+        xml.append("</ListBucketResult>")
+        self.send(200, "".join(xml).encode(),
+                  {"Content-Type": "application/xml"})
+
+    def object(self, path, head):
+        if not os.path.isfile(path):
+            return self.error(404, "NoSuchKey", head)
+        size = os.path.getsize(path)
+        headers = {"Last-Modified": formatdate(os.path.getmtime(path),
+                                               usegmt=True),
+                   "Accept-Ranges": "bytes"}
+        if head:
+            count("head")
+            self.send_response(200)
+            for name, value in headers.items():
+                self.send_header(name, value)
+            self.send_header("Content-Length", str(size))
+            self.end_headers()
+            return
+        m = re.fullmatch(r"bytes=(\d+)-(\d*)", self.headers.get("Range", ""))
+        start, end, status = 0, size - 1, 200
+        if m:
+            start = int(m.group(1))
+            end = min(int(m.group(2)) if m.group(2) else size - 1, size - 1)
+            if start >= size:
+                return self.error(416, "InvalidRange")
+            status = 206
+            headers["Content-Range"] = f"bytes {start}-{end}/{size}"
+            count("ranged_get")
+        else:
+            count("full_get")
+        with open(path, "rb") as f:
+            f.seek(start)
+            body = f.read(end - start + 1)
+        count("bytes_served", len(body))
+        self.send(status, body, headers)
+
+    def do_GET(self):
+        self.route()
+
+    def do_HEAD(self):
+        self.route(head=True)
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__.split("\n")[0])
+    parser.add_argument("--root", required=True,
+                        help="directory whose subdirectories are buckets")
+    parser.add_argument("--host", default="127.0.0.1")
+    parser.add_argument("--port", type=int, default=9000)
+    parser.add_argument("--credentials", metavar="KEY:SECRET",
+                        help="require SigV4 requests signed with these")
+    parser.add_argument("--latency-ms", type=float, default=0.0,
+                        help="delay before every response")
+    parser.add_argument("--verbose", action="store_true")
+    args = parser.parse_args()
+
+    server = ThreadingHTTPServer((args.host, args.port), Handler)
+    server.daemon_threads = True
+    server.root = os.path.abspath(args.root)
+    server.credentials = (tuple(args.credentials.split(":", 1))
+                          if args.credentials else None)
+    server.latency = args.latency_ms / 1000.0
+    server.verbose = args.verbose
+    print(f"Serving {server.root} on http://{args.host}:{args.port}",
+          file=sys.stderr, flush=True)
+    # Stop cleanly on Ctrl-C or kill, even when started in the background
+    signal.signal(signal.SIGINT, signal.default_int_handler)
+    signal.signal(signal.SIGTERM, signal.default_int_handler)
+    try:
+        server.serve_forever()
+    except KeyboardInterrupt:
+        pass
+    with STATS_LOCK:
+        for name, value in sorted(STATS.items()):
+            print(f"{name:14} {value}", file=sys.stderr)
+
+
+if __name__ == "__main__":
+    main()
@@ -0,0 +1,207 @@
+// ============================================================================
+// FileTypeAnalyzer Pro - Fallback classifier trainer
+//
+// Trains the softmax model used by --model on a labelled local corpus and
+// reports hold-out accuracy. Labels come from either:
+//   - the first-level subdirectory of each file (corpus/<label>/...), or
+//   - --self-label: the engine's own category for every file a signature
+//     identified, so a model can be trained on any tree of known files.
+// Features are the ones the engine computes at scan time (extractFeatures),
+// taken from the first 64 KB of each file.
+//
+// Build: g++ -std=c++17 -O2 -pthread tools/train_classifier.cpp
+//          -o train_classifier
+// Run:   ./train_classifier [options] <corpus_dir> <model_out>
+//   --self-label       Label files by the engine's category
+//   --epochs N         Passes over the training set (default 20)
+//   --rate R           Initial learning rate (default 0.5)
+//   --l2 L             Weight decay (default 1e-5)
+//   --holdout F        Fraction held out for evaluation (default 0.2)
+//   --min-per-class N  Drop labels with fewer examples (default 20)
+// ============================================================================
+#define FTA_NO_MAIN
+#include "../src/analyzer.cpp"
+
+struct Example {
+  ModelFeatures features;
+  size_t label = 0;
+};
+
+// Features exactly as classifyContent computes them
+bool featuresFor(const fs::path &path, ModelFeatures &features) {
+  ifstream file(path, ios::binary);
+  vector<unsigned char> buffer(65536);
+  file.read(reinterpret_cast<char *>(buffer.data()),
+            static_cast<streamsize>(buffer.size()));
+  size_t length = static_cast<size_t>(max<streamsize>(0, file.gcount()));
+  if (length < 2)
+    return false;
+  ByteHistogram histogram;
+  byteHistogram(buffer.data(), length, histogram);
+  extractFeatures(buffer.data(), length, histogram,
+                  calculateEntropy(histogram, length), features);
+  return true;
+}
+
+int main(int argc, char *argv[]) {
+  bool selfLabel = false;
+  int epochs = 20;
+  double rate = 0.5, l2 = 1e-5, holdout = 0.2;
+  size_t minPerClass = 20;
+  vector<string> positional;
+  for (int i = 1; i < argc; i++) {
+    string arg = argv[i];
+    if (arg == "--self-label")
+      selfLabel = true;
+    else if (arg == "--epochs" && i + 1 < argc)
+      epochs = max(1, atoi(argv[++i]));
+    else if (arg == "--rate" && i + 1 < argc)
+      rate = atof(argv[++i]);
+    else if (arg == "--l2" && i + 1 < argc)
+      l2 = atof(argv[++i]);
+    else if (arg == "--holdout" && i + 1 < argc)
+      holdout = min(0.9, max(0.0, atof(argv[++i])));
+    else if (arg == "--min-per-class" && i + 1 < argc)
+      minPerClass = strtoull(argv[++i], nullptr, 10);
+    else
+      positional.push_back(arg);
+  }
+  if (positional.size() != 2) {
+    cerr << "Usage: " << argv[0]
+         << " [--self-label] [--epochs N] [--rate R] [--l2 L] [--holdout F]"
+            " [--min-per-class N] <corpus_dir> <model_out>\n";
+    return 1;
+  }
+  fs::path root = positional[0];
+  rebuildSignatureMatcher();
+
+  // Collect (label, features)
+  map<string, vector<ModelFeatures>> byLabel;
+  auto start = high_resolution_clock::now();
+  for (const auto &entry : fs::recursive_directory_iterator(
+           root, fs::directory_options::skip_permission_denied)) {
+    error_code ec;
+    if (!entry.is_regular_file(ec))
+      continue;
+    string label;
+    if (selfLabel) {
+      FileInfo info = analyzeFile(entry.path());
+      if (info.type == "Unknown" || info.type == "Empty" || info.isCorrupt)
+        continue;
+      label = info.category;
+    } else {
+      fs::path rel = entry.path().lexically_relative(root);
+      if (distance(rel.begin(), rel.end()) < 2)
+        continue;
+      label = rel.begin()->string();
+    }
+    ModelFeatures features;
+    if (label.find_first_of(" \t\n") == string::npos &&
+        featuresFor(entry.path(), features))
+      byLabel[label].push_back(features);
+  }
+  double extractSeconds =
+      duration<double>(high_resolution_clock::now() - start).count();
+
+  FallbackModel model;
+  vector<Example> examples;
+  for (auto &[label, rows] : byLabel) {
+    if (rows.size() < minPerClass) {
+      cerr << "Skipping " << label << " (" << rows.size() << " files)\n";
+      continue;
+    }
+    for (const auto &features : rows)
+      examples.push_back({features, model.classes.size()});
+    model.classes.push_back(label);
+  }
+  if (model.classes.size() < 2) {
+    cerr << "Need at least two labels with " << minPerClass
+         << " files each\n";
+    return 1;
+  }
+  cout << "Corpus: " << examples.size() << " files, " << model.classes.size()
+       << " classes (features in " << fixed << setprecision(2)
+       << extractSeconds << "s)\n";
+
+  // Stratification is not worth it at these sizes; a seeded shuffle keeps
+  // runs reproducible
+  mt19937 rng(12345);
+  shuffle(examples.begin(), examples.end(), rng);
+  size_t testCount = static_cast<size_t>(examples.size() * holdout);
+  vector<Example> test(examples.begin(), examples.begin() + testCount);
+  vector<Example> train(examples.begin() + testCount, examples.end());
+
+  // Softmax regression, plain SGD with a decaying rate and L2 decay
+  size_t classes = model.classes.size(), row = model.rowSize();
+  model.weights.assign(classes * row, 0.0f);
+  vector<float> probs;
+  start = high_resolution_clock::now();
+  for (int epoch = 0; epoch < epochs; epoch++) {
+    shuffle(train.begin(), train.end(), rng);
+    float eta = static_cast<float>(rate / (1.0 + epoch));
+    float decay = static_cast<float>(1.0 - eta * l2);
+    double loss = 0.0;
+    for (const auto &ex : train) {
+      model.predict(ex.features, probs);
+      loss -= log(max(probs[ex.label], 1e-12f));
+      for (size_t c = 0; c < classes; c++) {
+        float grad = probs[c] - (c == ex.label ? 1.0f : 0.0f);
+        float *w = model.weights.data() + c * row;
+        for (size_t f = 0; f < MODEL_FEATURES; f++)
+          w[f] = w[f] * decay - eta * grad * ex.features[f];
+        w[MODEL_FEATURES] -= eta * grad;
+      }
+    }
+    cout << "  epoch " << setw(2) << epoch + 1 << "  loss " << setprecision(4)
+         << loss / train.size() << "\n";
+  }
+  double trainSeconds =
+      duration<double>(high_resolution_clock::now() - start).count();
+
+  // Hold-out evaluation, with the same confidence cut-off --model uses
+  vector<size_t> correct(classes), total(classes);
+  size_t confident = 0, confidentCorrect = 0;
+  start = high_resolution_clock::now();
+  for (const auto &ex : test) {
+    size_t guess = model.predict(ex.features, probs);
+    total[ex.label]++;
+    correct[ex.label] += guess == ex.label;
+    if (probs[guess] >= fallbackMinConfidence) {
+      confident++;
+      confidentCorrect += guess == ex.label;
+    }
+  }
+  double predictMicros =
+      test.empty() ? 0.0
+                   : duration<double, micro>(high_resolution_clock::now() -
+                                             start)
+                             .count() /
+                         test.size();
+
+  size_t allCorrect = 0;
+  cout << "\nHold-out (" << test.size() << " files):\n";
+  for (size_t c = 0; c < classes; c++) {
+    allCorrect += correct[c];
+    cout << "  " << setw(14) << left << model.classes[c] << right << setw(6)
+         << correct[c] << " / " << setw(6) << total[c] << "  "
+         << setprecision(1)
+         << (total[c] ? 100.0 * correct[c] / total[c] : 0.0) << "%\n";
+  }
+  if (!test.empty()) {
+    cout << "  accuracy " << setprecision(1)
+         << 100.0 * allCorrect / test.size() << "%, " << confident
+         << " above " << setprecision(0) << fallbackMinConfidence * 100
+         << "% confidence at " << setprecision(1)
+         << (confident ? 100.0 * confidentCorrect / confident : 0.0)
+         << "% precision\n";
+  }
+  cout << "Training " << setprecision(2) << trainSeconds << "s, inference "
+       << setprecision(1) << predictMicros << " us/file\n";
+
+  if (!model.save(positional[1])) {
+    cerr << "Could not write " << positional[1] << "\n";
+    return 1;
+  }
+  cout << "Model written to " << positional[1] << "\n";
+  return 0;
+}